@@ -0,0 +1,167 @@
+#include <benchmark/benchmark.h>
+#include "ExpressionParser.h"
+#include "GameData.h"
+#include "GameRules.h"
+#include "GameState.h"
+#include "JsonParser.h"
+#include "RuleArena.h"
+#include "RuleCursor.h"
+#include "RuleProgram.h"
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////
+// GameRule Benchmarks
+/////////////////////////////////////////////////////////////////////////////
+namespace {
+
+GameState::PlayerIDList buildPlayerIDs(std::size_t playerCount) {
+  GameState::PlayerIDList playerIDs = {};
+  playerIDs.reserve(playerCount);
+  for (std::size_t i = 0; i < playerCount; ++i) {
+    playerIDs.push_back(1000 + i);
+  }
+  return playerIDs;
+}
+
+}
+
+
+static void BM_ForEachRule_players(benchmark::State& state) {
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_forEach_basic.json";
+  const GameState::PlayerIDList playerIDs = buildPlayerIDs(state.range(0));
+
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(GAME_SPEC_PATH);
+  GameRules::Rule* forEachRule = nullptr;
+  for (const auto& rule : gameData.topLevelRules) {
+    if (dynamic_cast<GameRules::ForEachRule*>(rule.get()) != nullptr) {
+      forEachRule = rule.get();
+    }
+  }
+  if (forEachRule == nullptr) {
+    state.SkipWithError("Game spec has no forEach rule");
+    return;
+  }
+
+  GameState::GameState gameState = GameState::GameState(gameData.variableLayout, playerIDs);
+  for (auto _ : state) {
+    // Keep the global counter from overflowing, this is O(1) next to the forEach
+    (void)gameState.setValue("debug_target", 0);
+    if (forEachRule->executeRule(gameState) == GameRules::RuleExecutionResult::FAILURE) {
+      state.SkipWithError("forEach rule failed to execute");
+      return;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * playerIDs.size());
+}
+BENCHMARK(BM_ForEachRule_players)->RangeMultiplier(10)->Range(2, 10000);
+
+
+// Runs every top level rule of a game spec, on a freshly constructed GameState each time
+static void BM_TopLevelRules(benchmark::State& state, const std::string& gameSpecPath) {
+  const GameState::PlayerIDList playerIDs = buildPlayerIDs(4);
+
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(gameSpecPath);
+  if (!gameData.isValid) {
+    state.SkipWithError("Game spec failed to parse");
+    return;
+  }
+
+  for (auto _ : state) {
+    GameState::GameState gameState = GameState::GameState(gameData.variableLayout, playerIDs);
+    for (const auto& rule : gameData.topLevelRules) {
+      if (rule->executeRule(gameState) == GameRules::RuleExecutionResult::FAILURE) {
+        state.SkipWithError("Rule failed to execute");
+        return;
+      }
+    }
+    benchmark::DoNotOptimize(gameState);
+  }
+}
+BENCHMARK_CAPTURE(BM_TopLevelRules, addGlblMsg_basic,
+                  std::string("../social-gaming/test/json/gameSpec_addGlblMsg_basic.json"));
+BENCHMARK_CAPTURE(BM_TopLevelRules, addGlblMsg_advanced,
+                  std::string("../social-gaming/test/json/gameSpec_addGlblMsg_advanced.json"));
+BENCHMARK_CAPTURE(BM_TopLevelRules, forEach_basic,
+                  std::string("../social-gaming/test/json/gameSpec_forEach_basic.json"));
+BENCHMARK_CAPTURE(BM_TopLevelRules, forEach_differentElemName,
+                  std::string("../social-gaming/test/json/gameSpec_forEach_differentElemName.json"));
+BENCHMARK_CAPTURE(BM_TopLevelRules, while_basic,
+                  std::string("../social-gaming/test/json/gameSpec_while_basic.json"));
+BENCHMARK_CAPTURE(BM_TopLevelRules, loop_advanced,
+                  std::string("../social-gaming/test/json/gameSpec_loop_advanced.json"));
+
+
+// Plays a game spec through to the end with a RuleCursor, either walking its rule tree or interpreting
+// its bytecode, on one GameState whose values keep accumulating
+static void BM_RuleCursor(benchmark::State& state, const std::string& gameSpecPath, bool isCompiled) {
+  const GameState::PlayerIDList playerIDs = buildPlayerIDs(state.range(0));
+
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(gameSpecPath);
+  if (!gameData.isValid || (isCompiled && !gameData.program.has_value())) {
+    state.SkipWithError("Game spec failed to parse or compile");
+    return;
+  }
+
+  GameState::GameState gameState = GameState::GameState(gameData.variableLayout, playerIDs);
+  for (auto _ : state) {
+    GameRules::RuleCursor cursor = isCompiled
+      ? GameRules::RuleCursor(*gameData.program, gameState)
+      : GameRules::RuleCursor(gameData.topLevelRules, gameState);
+    if (cursor.run() != GameRules::RuleExecutionResult::SUCCESS) {
+      state.SkipWithError("Rules failed to execute");
+      return;
+    }
+    benchmark::DoNotOptimize(cursor.takeOutput());
+  }
+  state.SetItemsProcessed(state.iterations() * playerIDs.size());
+}
+BENCHMARK_CAPTURE(BM_RuleCursor, forEach_basic_tree,
+                  std::string("../social-gaming/test/json/gameSpec_forEach_basic.json"), false)
+    ->RangeMultiplier(10)->Range(2, 10000);
+BENCHMARK_CAPTURE(BM_RuleCursor, forEach_basic_bytecode,
+                  std::string("../social-gaming/test/json/gameSpec_forEach_basic.json"), true)
+    ->RangeMultiplier(10)->Range(2, 10000);
+BENCHMARK_CAPTURE(BM_RuleCursor, forEach_differentElemName_tree,
+                  std::string("../social-gaming/test/json/gameSpec_forEach_differentElemName.json"), false)
+    ->RangeMultiplier(10)->Range(2, 10000);
+BENCHMARK_CAPTURE(BM_RuleCursor, forEach_differentElemName_bytecode,
+                  std::string("../social-gaming/test/json/gameSpec_forEach_differentElemName.json"), true)
+    ->RangeMultiplier(10)->Range(2, 10000);
+BENCHMARK_CAPTURE(BM_RuleCursor, addGlblMsg_advanced_tree,
+                  std::string("../social-gaming/test/json/gameSpec_addGlblMsg_advanced.json"), false)
+    ->Arg(4);
+BENCHMARK_CAPTURE(BM_RuleCursor, addGlblMsg_advanced_bytecode,
+                  std::string("../social-gaming/test/json/gameSpec_addGlblMsg_advanced.json"), true)
+    ->Arg(4);
+
+
+// Evaluates a loop condition as parsed from a game spec
+static void BM_Expression_evaluate(benchmark::State& state) {
+  const auto layout = std::make_shared<const GameState::VariableLayout>(
+    GameState::VariableMap{{"round", 2}, {"rounds", 3}}, GameState::VariableMap{});
+  const GameState::GameState gameState = GameState::GameState(layout, buildPlayerIDs(4));
+
+  GameRules::RuleArena arena;
+  JsonParser::ExpressionParser parser = JsonParser::ExpressionParser(
+    [&layout](const std::string& name) -> std::optional<GameState::VariablePath> {
+      const std::optional<GameState::VariableSlot> slot = layout->variables.find(name);
+      return slot ? std::optional(GameState::VariablePath{.slot = *slot}) : std::nullopt;
+    },
+    arena);
+  const std::optional<GameRules::Expression> condition = parser.parseExpression("round < rounds && players.size > 1");
+  if (!condition) {
+    state.SkipWithError("Condition failed to parse");
+    return;
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(condition->evaluate(gameState));
+  }
+}
+BENCHMARK(BM_Expression_evaluate);
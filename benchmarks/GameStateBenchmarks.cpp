@@ -0,0 +1,191 @@
+#include <benchmark/benchmark.h>
+#include "GameData.h"
+#include "GameState.h"
+#include "JsonParser.h"
+#include "Snapshot.h"
+#include <memory>
+#include <optional>
+#include <string>
+
+/////////////////////////////////////////////////////////////////////////////
+// GameState Benchmarks
+/////////////////////////////////////////////////////////////////////////////
+namespace {
+
+const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_gameStateVariables_basic.json";
+const GameState::PlayerIDList PLAYER_IDS = {123, 456, 789};
+
+GameState::GameState buildGameState() {
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(GAME_SPEC_PATH);
+  return GameState::GameState(gameData.variableLayout, PLAYER_IDS);
+}
+
+// The "players.$player.*" benchmarks access the player which a forEach over "player" is on
+GameState::GameState buildScopedGameState() {
+  GameState::GameState gameState = buildGameState();
+  (void)gameState.setActiveScopeVariable("player", PLAYER_IDS.back());
+  return gameState;
+}
+
+}
+
+
+static void BM_GameState_getValue_global(benchmark::State& state) {
+  const GameState::GameState gameState = buildGameState();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(gameState.getValue("debug_target"));
+  }
+}
+BENCHMARK(BM_GameState_getValue_global);
+
+static void BM_GameState_setValue_global(benchmark::State& state) {
+  GameState::GameState gameState = buildGameState();
+  GameState::Integer value = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(gameState.setValue("debug_target", ++value));
+  }
+}
+BENCHMARK(BM_GameState_setValue_global);
+
+static void BM_GameState_getValue_scopedPlayer(benchmark::State& state) {
+  const GameState::GameState gameState = buildScopedGameState();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(gameState.getValue("players.$player.input"));
+  }
+}
+BENCHMARK(BM_GameState_getValue_scopedPlayer);
+
+static void BM_GameState_setValue_scopedPlayer(benchmark::State& state) {
+  GameState::GameState gameState = buildScopedGameState();
+  GameState::Integer value = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(gameState.setValue("players.$player.input", ++value));
+  }
+}
+BENCHMARK(BM_GameState_setValue_scopedPlayer);
+
+
+// Same accesses through the paths that RuleParser compiles rules into
+static void BM_GameState_getValue_globalPath(benchmark::State& state) {
+  const GameState::GameState gameState = buildGameState();
+  const GameState::VariablePath path = {
+    .kind = GameState::VariablePath::Kind::GLOBAL,
+    .slot = *gameState.getLayout().variables.find("debug_target"),
+  };
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(gameState.getValue(path));
+  }
+}
+BENCHMARK(BM_GameState_getValue_globalPath);
+
+static void BM_GameState_setValue_scopedPlayerPath(benchmark::State& state) {
+  GameState::GameState gameState = buildScopedGameState();
+  const GameState::VariablePath path = {
+    .kind = GameState::VariablePath::Kind::PER_PLAYER,
+    .slot = *gameState.getLayout().perPlayerVariables.find("input"),
+    .scopeDepth = 0,
+  };
+  GameState::Integer value = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(gameState.setValue(path, ++value));
+  }
+}
+BENCHMARK(BM_GameState_setValue_scopedPlayerPath);
+
+// The same write while the session keeps a write-ahead log, which is only appended to in memory
+static void BM_GameState_setValue_scopedPlayerPath_logged(benchmark::State& state) {
+  GameState::GameState gameState = buildScopedGameState();
+  const GameState::VariablePath path = {
+    .kind = GameState::VariablePath::Kind::PER_PLAYER,
+    .slot = *gameState.getLayout().perPlayerVariables.find("input"),
+    .scopeDepth = 0,
+  };
+  GameState::SnapshotWriter log;
+  gameState.setLog(&log);
+  GameState::Integer value = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(gameState.setValue(path, ++value));
+    // As when the session takes its log entry after each move
+    if (log.getBytes().size() > 4096) {
+      benchmark::DoNotOptimize(log.takeBytes());
+    }
+  }
+  gameState.setLog(nullptr);
+}
+BENCHMARK(BM_GameState_setValue_scopedPlayerPath_logged);
+
+
+// Starting a session, for a game with a typical number of variables and the given number of players
+static void BM_GameState_construct(benchmark::State& state) {
+  GameState::VariableMap variableMap;
+  GameState::VariableMap perPlayerVariableMap;
+  for (int i = 0; i < 32; ++i) {
+    variableMap.insert({"variable" + std::to_string(i), i});
+    perPlayerVariableMap.insert({"playerVariable" + std::to_string(i), i});
+  }
+  const auto layout = std::make_shared<const GameState::VariableLayout>(variableMap, perPlayerVariableMap);
+
+  GameState::PlayerIDList playerIDs;
+  for (GameState::PlayerID playerID = 0; playerID < static_cast<GameState::PlayerID>(state.range(0)); ++playerID) {
+    playerIDs.push_back(playerID);
+  }
+
+  for (auto _ : state) {
+    GameState::GameState gameState = GameState::GameState(layout, playerIDs);
+    benchmark::DoNotOptimize(gameState);
+  }
+}
+BENCHMARK(BM_GameState_construct)->RangeMultiplier(10)->Range(2, 1000);
+
+
+// Snapshotting a session part way through the same game, with every value written
+static GameState::GameState buildPlayedGameState(std::size_t playerCount) {
+  GameState::VariableMap variableMap;
+  GameState::VariableMap perPlayerVariableMap;
+  for (int i = 0; i < 32; ++i) {
+    variableMap.insert({"variable" + std::to_string(i), i});
+    perPlayerVariableMap.insert({"playerVariable" + std::to_string(i), i});
+  }
+  const auto layout = std::make_shared<const GameState::VariableLayout>(variableMap, perPlayerVariableMap);
+
+  GameState::PlayerIDList playerIDs;
+  for (GameState::PlayerID playerID = 0; playerID < playerCount; ++playerID) {
+    playerIDs.push_back(playerID);
+  }
+  GameState::GameState gameState = GameState::GameState(layout, playerIDs);
+  for (GameState::VariableSlot slot = 0; slot < layout->variables.size(); ++slot) {
+    (void)gameState.setVariableValue(slot, static_cast<GameState::Integer>(slot) * 1000);
+    for (GameState::PlayerIndex player = 0; player < playerCount; ++player) {
+      (void)gameState.setPlayerVariableValue(player, slot, static_cast<GameState::Integer>(player));
+    }
+  }
+  return gameState;
+}
+
+static void BM_GameState_writeSnapshot(benchmark::State& state) {
+  const GameState::GameState gameState = buildPlayedGameState(state.range(0));
+  for (auto _ : state) {
+    GameState::SnapshotWriter writer;
+    gameState.writeSnapshot(writer);
+    benchmark::DoNotOptimize(writer.getBytes().data());
+  }
+}
+BENCHMARK(BM_GameState_writeSnapshot)->RangeMultiplier(10)->Range(2, 1000);
+
+static void BM_GameState_readSnapshot(benchmark::State& state) {
+  const GameState::GameState gameState = buildPlayedGameState(state.range(0));
+  GameState::SnapshotWriter writer;
+  gameState.writeSnapshot(writer);
+  const std::string snapshot = writer.takeBytes();
+  // Restored against a copy of the layout, as after a restart
+  const auto layout = std::make_shared<const GameState::VariableLayout>(gameState.getLayout());
+
+  for (auto _ : state) {
+    GameState::SnapshotReader reader(snapshot);
+    std::optional<GameState::GameState> restored = GameState::GameState::readSnapshot(reader, layout);
+    benchmark::DoNotOptimize(restored);
+  }
+  state.SetBytesProcessed(state.iterations() * snapshot.size());
+}
+BENCHMARK(BM_GameState_readSnapshot)->RangeMultiplier(10)->Range(2, 1000);
@@ -0,0 +1,23 @@
+#include <benchmark/benchmark.h>
+#include "GameData.h"
+#include "JsonParser.h"
+#include <string>
+
+/////////////////////////////////////////////////////////////////////////////
+// Parser Benchmarks
+/////////////////////////////////////////////////////////////////////////////
+static void BM_ParseGameSpec(benchmark::State& state, const std::string& gameSpecPath) {
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  for (auto _ : state) {
+    GameData::GameData gameData = parser.parseJsonFile_gameSpec(gameSpecPath);
+    benchmark::DoNotOptimize(gameData);
+  }
+}
+BENCHMARK_CAPTURE(BM_ParseGameSpec, addGlblMsg_basic,
+                  std::string("../social-gaming/test/json/gameSpec_addGlblMsg_basic.json"));
+BENCHMARK_CAPTURE(BM_ParseGameSpec, addGlblMsg_advanced,
+                  std::string("../social-gaming/test/json/gameSpec_addGlblMsg_advanced.json"));
+BENCHMARK_CAPTURE(BM_ParseGameSpec, forEach_basic,
+                  std::string("../social-gaming/test/json/gameSpec_forEach_basic.json"));
+BENCHMARK_CAPTURE(BM_ParseGameSpec, inputOutput_basic,
+                  std::string("../social-gaming/test/json/gameSpec_inputOutput_basic.json"));
@@ -0,0 +1,22 @@
+#include "logconfig.h"
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+/////////////////////////////////////////////////////////////////////////////
+// Main function override for benchmark suite
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0], &customPrefix);
+  FLAGS_log_dir = "../social-gaming/log/files";
+  // Rules log every message they send, keep that out of the measurements
+  FLAGS_minloglevel = google::GLOG_WARNING;
+
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+  ::benchmark::Shutdown();
+  return 0;
+}
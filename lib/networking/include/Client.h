@@ -10,9 +10,13 @@
 #ifndef NETWORKING_CLIENT_H
 #define NETWORKING_CLIENT_H
 
+#include <deque>
 #include <memory>
 #include <string>
 
+#include "CompressionOptions.h"
+#include "MessageType.h"
+
 
 namespace networking {
 
@@ -30,11 +34,23 @@ namespace networking {
  */
 class Client {
 public:
+  /**
+   *  A single message received from the Server, together with the kind of
+   *  websocket frame that carried it.
+   */
+  struct Frame {
+    MessageType type;
+    std::string data;
+  };
+
   /**
    *  Construct a Client and acquire a connection to a remote Server at the
-   *  given address and port.
+   *  given address and port. Messages are compressed when the compression
+   *  options enable it and the Server agrees to it.
    */
-  Client(std::string_view address, std::string_view port);
+  Client(std::string_view address,
+         std::string_view port,
+         CompressionOptions compression = {});
 
   /** Out of line default constructor for compilation firewall. */
   ~Client();
@@ -46,9 +62,9 @@ public:
   void update();
 
   /**
-   *  Send a message to the server.
+   *  Send a message to the server, as a text frame unless asked otherwise.
    */
-  void send(std::string message);
+  void send(std::string message, MessageType type = MessageType::TEXT);
 
   /**
    *  Receive messages from the Server. This returns all messages collected by
@@ -58,6 +74,12 @@ public:
    */
   [[nodiscard]] std::string receive();
 
+  /**
+   *  Receive messages from the Server as Client::receive() does, but keep
+   *  each message separate and say whether it arrived as text or binary.
+   */
+  [[nodiscard]] std::deque<Frame> receiveFrames();
+
   /**
    *  Returns true iff the client disconnected from the server after initially
    *  connecting.
@@ -0,0 +1,47 @@
+/////////////////////////////////////////////////////////////////////////////
+//                         Single Threaded Networking
+//
+// This file is distributed under the MIT License. See the LICENSE file
+// for details.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NETWORKING_COMPRESSIONOPTIONS_H
+#define NETWORKING_COMPRESSIONOPTIONS_H
+
+#include <cstddef>
+
+
+namespace networking {
+
+
+/**
+ *  Settings for the permessage-deflate websocket extension. When both ends of
+ *  a connection offer it, the messages between them are compressed.
+ */
+struct CompressionOptions {
+  /** Offer the extension. Without it, messages are never compressed. */
+  bool enabled = false;
+
+  /**
+   *  Base two logarithm of the deflate window, from 9 to 15. Larger windows
+   *  find more repetition but hold more memory per connection.
+   */
+  int windowBits = 15;
+
+  /** Deflate memory level, from 1 to 9, trading memory for speed. */
+  int memoryLevel = 4;
+
+  /**
+   *  Messages smaller than this many bytes are sent uncompressed, as they
+   *  would gain little for the CPU time compressing them costs.
+   */
+  std::size_t minimumSize = 256;
+};
+
+
+}
+
+
+#endif
@@ -0,0 +1,130 @@
+/////////////////////////////////////////////////////////////////////////////
+//                         Single Threaded Networking
+//
+// This file is distributed under the MIT License. See the LICENSE file
+// for details.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NETWORKING_LATENCYHISTOGRAM_H
+#define NETWORKING_LATENCYHISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+
+namespace networking {
+
+
+/**
+ *  @class LatencyHistogram
+ *
+ *  @brief A fixed size log-linear histogram of latencies.
+ *
+ *  Each power of two range of microseconds is split into SUB_BUCKETS linear
+ *  buckets, so every recorded value is kept to within 1/SUB_BUCKETS of its
+ *  magnitude no matter how large it is. Recording is constant time and never
+ *  allocates, and histograms from many connections or intervals can be merged.
+ */
+class LatencyHistogram {
+public:
+  void
+  record(std::chrono::nanoseconds latency) noexcept {
+    auto micros = static_cast<uint64_t>(
+      std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(latency).count()));
+    ++buckets[bucketFor(micros)];
+    ++count;
+    totalMicros += micros;
+    maxMicros = std::max(maxMicros, micros);
+  }
+
+  void
+  merge(const LatencyHistogram& other) noexcept {
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+      buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    totalMicros += other.totalMicros;
+    maxMicros = std::max(maxMicros, other.maxMicros);
+  }
+
+  /** The smallest recorded latency that `quantile` of all samples lie under. */
+  [[nodiscard]] std::chrono::microseconds
+  percentile(double quantile) const noexcept {
+    if (count == 0) {
+      return {};
+    }
+    auto rank = static_cast<uint64_t>(quantile * static_cast<double>(count - 1)) + 1;
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+      seen += buckets[i];
+      if (seen >= rank) {
+        return std::chrono::microseconds{std::min(upperBoundOf(i), maxMicros)};
+      }
+    }
+    return std::chrono::microseconds{maxMicros};
+  }
+
+  [[nodiscard]] uint64_t getCount() const noexcept { return count; }
+
+  [[nodiscard]] std::chrono::microseconds
+  getMax() const noexcept {
+    return std::chrono::microseconds{maxMicros};
+  }
+
+  [[nodiscard]] std::chrono::microseconds
+  getMean() const noexcept {
+    return std::chrono::microseconds{count == 0 ? 0 : totalMicros / count};
+  }
+
+private:
+  static constexpr unsigned SUB_BUCKET_BITS = 5;
+  static constexpr uint64_t SUB_BUCKETS = uint64_t{1} << SUB_BUCKET_BITS;
+  // Values below SUB_BUCKETS are exact, each power of two above gets its own row
+  static constexpr std::size_t ROWS = 64 - SUB_BUCKET_BITS + 1;
+
+  // Row 0 holds the exact values below SUB_BUCKETS. Row r above it covers
+  // [SUB_BUCKETS << (r - 1), SUB_BUCKETS << r) in SUB_BUCKETS steps of
+  // 1 << (r - 1).
+  static constexpr std::size_t
+  bucketFor(uint64_t micros) noexcept {
+    if (micros < SUB_BUCKETS) {
+      return micros;
+    }
+    unsigned magnitude = std::bit_width(micros) - SUB_BUCKET_BITS - 1;
+    uint64_t subBucket = (micros >> magnitude) - SUB_BUCKETS;
+    return (magnitude + 1) * SUB_BUCKETS + subBucket;
+  }
+
+  static constexpr uint64_t
+  lowerBoundOf(std::size_t bucket) noexcept {
+    if (bucket < SUB_BUCKETS) {
+      return bucket;
+    }
+    unsigned magnitude = bucket / SUB_BUCKETS - 1;
+    uint64_t subBucket = bucket % SUB_BUCKETS;
+    return (SUB_BUCKETS + subBucket) << magnitude;
+  }
+
+  static constexpr uint64_t
+  upperBoundOf(std::size_t bucket) noexcept {
+    return bucket + 1 == ROWS * SUB_BUCKETS
+      ? UINT64_MAX
+      : lowerBoundOf(bucket + 1) - 1;
+  }
+
+  std::array<uint64_t, ROWS * SUB_BUCKETS> buckets{};
+  uint64_t count = 0;
+  uint64_t totalMicros = 0;
+  uint64_t maxMicros = 0;
+};
+
+
+}
+
+
+#endif
@@ -0,0 +1,32 @@
+/////////////////////////////////////////////////////////////////////////////
+//                         Single Threaded Networking
+//
+// This file is distributed under the MIT License. See the LICENSE file
+// for details.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NETWORKING_MESSAGETYPE_H
+#define NETWORKING_MESSAGETYPE_H
+
+#include <cstdint>
+
+
+namespace networking {
+
+
+/**
+ *  Whether a message travels as a websocket text frame, which must hold valid
+ *  UTF-8, or as a binary frame, which may hold any bytes.
+ */
+enum class MessageType : uint8_t {
+  TEXT,
+  BINARY,
+};
+
+
+}
+
+
+#endif
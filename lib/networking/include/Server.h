@@ -10,12 +10,17 @@
 #ifndef NETWORKING_SERVER_H
 #define NETWORKING_SERVER_H
 
+#include <chrono>
 #include <deque>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
+#include "CompressionOptions.h"
+#include "MessageType.h"
 
 namespace networking {
 
@@ -43,12 +48,151 @@ struct ConnectionHash {
 
 
 /**
- *  A Message containing text that can be sent to or was recieved from a given
- *  Connection.
+ *  A Message containing text or binary data that can be sent to or was
+ *  recieved from a given Connection. The type says which kind of websocket
+ *  frame carries it. Messages received by the Server are stamped with the time
+ *  that they were read from the Connection.
  */
 struct Message {
   Connection connection;
   std::string text;
+  MessageType type = MessageType::TEXT;
+  std::chrono::steady_clock::time_point receivedAt = {};
+};
+
+
+/**
+ *  Immutable data that can be shared by the pending writes of many Client
+ *  connections at once, so that broadcasting it does not copy it per Client.
+ */
+using Payload = std::shared_ptr<const std::string>;
+
+
+/**
+ *  What a Server does with a message for a Client whose pending writes have
+ *  grown past ServerOptions::writeHighWatermark.
+ */
+enum class OverflowPolicy {
+  /** Discard new messages until the backlog falls below the low watermark. */
+  DROP,
+  /** Disconnect the Client. */
+  DISCONNECT,
+  /**
+   *  Keep messages and send the backlog in batches of frames that each reach
+   *  the socket in one write, as long as the backlog stays within
+   *  ServerOptions::writeCoalesceLimit. Past that the Client is disconnected.
+   */
+  COALESCE,
+};
+
+
+/**
+ *  Tunable behavior of a Server. The defaults give a Server whose I/O is all
+ *  performed on the thread that calls Server::update().
+ */
+struct ServerOptions {
+  /**
+   *  Number of background threads that drive socket I/O. When non-zero, reads
+   *  and writes for every Client proceed on this pool while the thread calling
+   *  Server::update() only exchanges Message instances with it.
+   */
+  std::size_t ioThreadCount = 0;
+
+  /**
+   *  Number of received messages that may wait for Server::receive(). When
+   *  the queue is full, reading from Clients pauses until it drains.
+   */
+  std::size_t incomingQueueCapacity = 4096;
+
+  /**
+   *  Bytes waiting to be written to a single Client beyond which the
+   *  overflowPolicy applies to that Client. The policy stays in effect until
+   *  the backlog drains to writeLowWatermark bytes.
+   */
+  std::size_t writeHighWatermark = 4 * 1024 * 1024;
+  std::size_t writeLowWatermark = 1024 * 1024;
+  OverflowPolicy overflowPolicy = OverflowPolicy::DISCONNECT;
+
+  /**
+   *  Bytes waiting to be written to a single Client beyond which even the
+   *  COALESCE policy disconnects it.
+   */
+  std::size_t writeCoalesceLimit = 16 * 1024 * 1024;
+
+  /**
+   *  Send the messages waiting for a Client in batches that each reach the
+   *  socket in one write, rather than writing to the socket per message. Each
+   *  message still travels in a websocket frame of its own.
+   */
+  bool coalesceWrites = false;
+
+  /**
+   *  Whether and how to compress the messages of Clients that support the
+   *  permessage-deflate extension.
+   */
+  CompressionOptions compression;
+};
+
+
+/**
+ *  Counters describing the load on a Server.
+ */
+struct ServerStatistics {
+  /** Messages queued for Server::receive(). */
+  uint64_t messagesReceived = 0;
+
+  /** Times a Client read was held back because the receive queue was full. */
+  uint64_t receiveQueueFull = 0;
+
+  /** Maximum number of messages waiting for Server::receive(). */
+  std::size_t receiveQueueCapacity = 0;
+
+  /**
+   *  Messages written to Clients, and the socket writes carrying them when
+   *  they are batched. Unbatched messages count as a batch each.
+   */
+  uint64_t messagesSent = 0;
+  uint64_t writeBatches = 0;
+
+  /** Messages discarded for Clients past their high watermark. */
+  uint64_t messagesDropped = 0;
+
+  /**
+   *  Clients disconnected for falling past their high watermark, or past the
+   *  coalesce limit under OverflowPolicy::COALESCE.
+   */
+  uint64_t slowClientDisconnects = 0;
+};
+
+
+/**
+ *  Counters describing the traffic of a single Client. Message bytes count the
+ *  messages themselves, and wire bytes what crossed the socket once they were
+ *  framed and compressed.
+ */
+struct ChannelStatistics {
+  uint64_t messageBytesSent = 0;
+  uint64_t wireBytesSent = 0;
+  uint64_t messageBytesReceived = 0;
+  uint64_t wireBytesReceived = 0;
+
+  /**
+   *  CPU time spent turning messages into websocket frames and back, which
+   *  includes compressing and decompressing them. Only measured while
+   *  compression is enabled.
+   */
+  std::chrono::nanoseconds codingTime{0};
+
+  /** Message bytes waiting to be written to the Client. */
+  uint64_t messageBytesPending = 0;
+
+  /** Message bytes sent per wire byte, above 1 when compression pays off. */
+  [[nodiscard]] double
+  getCompressionRatio() const noexcept {
+    return wireBytesSent == 0
+      ? 1.0
+      : static_cast<double>(messageBytesSent) / static_cast<double>(wireBytesSent);
+  }
 };
 
 
@@ -69,7 +213,8 @@ struct ServerImplDeleter {
  *  connected on a given port. The behavior is single threaded, so all transfer
  *  operations are grouped and performed on the next call to Server::update().
  *  Text can be sent to the Server using Client::send() and received from the
- *  Server using Client::receive().
+ *  Server using Client::receive(). ServerOptions can move the socket I/O onto
+ *  a pool of background threads without changing this API.
  *
  *  The Server is websocket based and supports sending a single file back in
  *  response to HTTP requests for `index.html`. This allows command line and
@@ -92,14 +237,18 @@ public:
    *
    *  The httpMessage is a string containing HTML content that will be sent
    *  in response to standard HTTP requests for any path ending in `index.html`.
+   *
+   *  The callbacks are always invoked from within Server::update(), even when
+   *  the options request a pool of I/O threads.
    */
   template <typename C, typename D>
   Server(unsigned short port,
          std::string httpMessage,
          C onConnect,
-         D onDisconnect)
+         D onDisconnect,
+         ServerOptions options = {})
     : connectionHandler{std::make_unique<ConnectionHandlerImpl<C,D>>(onConnect, onDisconnect)},
-      impl{buildImpl(*this, port, std::move(httpMessage))}
+      impl{buildImpl(*this, port, std::move(httpMessage), options)}
       { }
 
   /**
@@ -108,18 +257,70 @@ public:
    */
   void update();
 
+  /**
+   *  Perform all pending sends and receives, first blocking until at least one
+   *  network event is ready or until the timeout expires. This lets an update
+   *  loop stay idle while there is no traffic and still wake as soon as a
+   *  message arrives. This function can throw an exception if any of the I/O
+   *  operations encounters an error.
+   */
+  void update(std::chrono::milliseconds timeout);
+
+  /**
+   *  Make a call to Server::update() that is waiting for events return
+   *  without waiting for its timeout, or, if none is waiting, make the next
+   *  one return immediately. Unlike every other member, this may be called
+   *  from any thread, so that work finishing elsewhere can be picked up by the
+   *  update loop promptly.
+   */
+  void wake();
+
   /**
    *  Send a list of messages to their respective Clients.
    */
   void send(const std::deque<Message>& messages);
 
+  /**
+   *  Send the same payload to every connected Client. All Clients write from
+   *  the one shared payload, so the cost of the payload does not grow with the
+   *  number of Clients.
+   */
+  void broadcast(Payload payload, MessageType type = MessageType::TEXT);
+
+  /**
+   *  Send the same payload to each of the given Clients, sharing one payload
+   *  in the same way as Server::broadcast().
+   */
+  void multicast(const std::vector<Connection>& connections,
+                 Payload payload,
+                 MessageType type = MessageType::TEXT);
+
   /**
    *  Receive Message instances from Client instances. This returns all Message
    *  instances collected by previous calls to Server::update() and not yet
-   *  received.
+   *  received. Each Message is read directly into its own buffer, which
+   *  comes from a pool shared by every Client.
    */
   [[nodiscard]] std::deque<Message> receive();
 
+  /**
+   *  Return received messages that are no longer needed so that their
+   *  buffers can be reused for later reads instead of being allocated anew.
+   */
+  void recycle(std::deque<Message> messages);
+
+  /**
+   *  Return a snapshot of the counters describing the load on this Server.
+   */
+  [[nodiscard]] ServerStatistics getStatistics() const;
+
+  /**
+   *  Return a snapshot of the counters describing the traffic of the Client
+   *  specified by the given Connection, or nothing if it is not connected.
+   */
+  [[nodiscard]] std::optional<ChannelStatistics>
+  getChannelStatistics(Connection connection) const;
+
   /**
    *  Disconnect the Client specified by the given Connection.
    */
@@ -155,7 +356,10 @@ private:
   };
 
   static std::unique_ptr<ServerImpl,ServerImplDeleter>
-  buildImpl(Server& server, unsigned short port, std::string httpMessage);
+  buildImpl(Server& server,
+            unsigned short port,
+            std::string httpMessage,
+            ServerOptions options);
 
   std::unique_ptr<ConnectionHandler> connectionHandler;
   std::unique_ptr<ServerImpl,ServerImplDeleter> impl;
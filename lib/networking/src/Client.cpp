@@ -7,14 +7,17 @@
 
 
 #include "Client.h"
+#include "Deflate.h"
 
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 
 
 #include <deque>
-#include <sstream>
+#include <optional>
+#include <utility>
 using networking::Client;
+using networking::MessageType;
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -25,11 +28,16 @@ namespace networking {
 
 class Client::ClientImpl {
 public:
-  ClientImpl(std::string_view address, std::string_view port)
+  ClientImpl(std::string_view address,
+             std::string_view port,
+             const CompressionOptions& compression)
     : isClosed{false},
       hostAddress{address.data(), address.size()},
       ioService{},
       websocket{ioService} {
+    if (compression.enabled) {
+      websocket.set_option(makeDeflateOption(compression, false));
+    }
     boost::asio::ip::tcp::resolver resolver{ioService};
     connect(resolver.resolve(address, port));
   }
@@ -42,15 +50,24 @@ public:
 
   void readMessage();
 
+  void writeMessage();
+
   void reportError(std::string_view message);
 
   bool isClosed;
+  bool isOpen = false;
   std::string hostAddress;
   boost::asio::io_service ioService;
   boost::beast::websocket::stream<boost::asio::ip::tcp::socket> websocket;
-  boost::beast::multi_buffer readBuffer;
-  std::ostringstream incomingMessage;
-  std::deque<std::string> writeBuffer;
+
+  // Each message is read straight into the string it is received as
+  using ReadBufferView =
+    decltype(boost::asio::dynamic_buffer(std::declval<std::string&>()));
+  std::string readBuffer;
+  std::optional<ReadBufferView> readBufferView;
+  std::deque<Frame> incomingFrames;
+
+  std::deque<Frame> writeBuffer;
 };
 
 
@@ -85,7 +102,12 @@ Client::ClientImpl::handshake() {
   websocket.async_handshake(hostAddress, "/",
     [this] (auto errorCode) {
       if (!errorCode) {
+        isOpen = true;
         this->readMessage();
+        // Anything sent while connecting has been waiting for the handshake
+        if (!writeBuffer.empty()) {
+          this->writeMessage();
+        }
       } else {
         reportError("Unable to handshake.");
       }
@@ -95,13 +117,14 @@ Client::ClientImpl::handshake() {
 
 void
 Client::ClientImpl::readMessage() {
-  websocket.async_read(readBuffer,
+  readBufferView.emplace(boost::asio::dynamic_buffer(readBuffer));
+  websocket.async_read(*readBufferView,
     [this] (auto errorCode, std::size_t size) {
       if (!errorCode) {
         if (size > 0) {
-          auto message = boost::beast::buffers_to_string(readBuffer.data());
-          incomingMessage.write(message.c_str(), message.size());
-          readBuffer.consume(readBuffer.size());
+          const auto type =
+            websocket.got_binary() ? MessageType::BINARY : MessageType::TEXT;
+          incomingFrames.push_back({type, std::exchange(readBuffer, {})});
           this->readMessage();
         }
       } else {
@@ -112,6 +135,24 @@ Client::ClientImpl::readMessage() {
 }
 
 
+void
+Client::ClientImpl::writeMessage() {
+  websocket.binary(writeBuffer.front().type == MessageType::BINARY);
+  websocket.async_write(boost::asio::buffer(writeBuffer.front().data),
+    [this] (auto errorCode, std::size_t /*size*/) {
+      if (!errorCode) {
+        writeBuffer.pop_front();
+        if (!writeBuffer.empty()) {
+          this->writeMessage();
+        }
+      } else {
+        reportError("Unable to write.");
+        disconnect();
+      }
+    });
+}
+
+
 void
 Client::ClientImpl::reportError(std::string_view /*message*/) {
   // Swallow errors....
@@ -123,8 +164,10 @@ Client::ClientImpl::reportError(std::string_view /*message*/) {
 /////////////////////////////////////////////////////////////////////////////
 
 
-Client::Client(std::string_view address, std::string_view port)
-  : impl{std::make_unique<ClientImpl>(address, port)}
+Client::Client(std::string_view address,
+               std::string_view port,
+               CompressionOptions compression)
+  : impl{std::make_unique<ClientImpl>(address, port, compression)}
     { }
 
 
@@ -139,29 +182,32 @@ Client::update() {
 
 std::string
 Client::receive() {
-  auto result = impl->incomingMessage.str();
-  impl->incomingMessage.str(std::string{});
-  impl->incomingMessage.clear();
+  std::string result;
+  for (auto& frame : receiveFrames()) {
+    result += frame.data;
+  }
   return result;
 }
 
 
+std::deque<Client::Frame>
+Client::receiveFrames() {
+  return std::exchange(impl->incomingFrames, {});
+}
+
+
 void
-Client::send(std::string message) {
+Client::send(std::string message, MessageType type) {
   if (message.empty()) {
     return;
   }
 
-  impl->writeBuffer.emplace_back(std::move(message));
-  impl->websocket.async_write(boost::asio::buffer(impl->writeBuffer.back()),
-    [this] (auto errorCode, std::size_t /*size*/) {
-      if (!errorCode) {
-        impl->writeBuffer.pop_front();
-      } else {
-        impl->reportError("Unable to write.");
-        impl->disconnect();
-      }
-    });
+  // Websockets allow only one write at a time, so messages wait their turn.
+  // Until the handshake completes, they all wait for it.
+  impl->writeBuffer.push_back({type, std::move(message)});
+  if (impl->isOpen && impl->writeBuffer.size() == 1) {
+    impl->writeMessage();
+  }
 }
 
 
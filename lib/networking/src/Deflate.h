@@ -0,0 +1,54 @@
+/////////////////////////////////////////////////////////////////////////////
+//                         Single Threaded Networking
+//
+// This file is distributed under the MIT License. See the LICENSE file
+// for details.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NETWORKING_DEFLATE_H
+#define NETWORKING_DEFLATE_H
+
+#include "CompressionOptions.h"
+
+#include <boost/beast/websocket/option.hpp>
+
+
+namespace networking {
+
+
+/**
+ *  Set the size below which Beast sends messages uncompressed. Releases of
+ *  Beast older than this option compress every message instead.
+ */
+template <typename Deflate>
+void
+setSizeThreshold(Deflate& deflate, std::size_t minimumSize) {
+  if constexpr (requires { deflate.msg_size_threshold; }) {
+    deflate.msg_size_threshold = minimumSize;
+  }
+}
+
+
+/**
+ *  Translate CompressionOptions into the permessage-deflate option offered by
+ *  the server or the client end of a websocket.
+ */
+inline boost::beast::websocket::permessage_deflate
+makeDeflateOption(const CompressionOptions& options, bool isServer) {
+  boost::beast::websocket::permessage_deflate deflate;
+  deflate.server_enable = isServer && options.enabled;
+  deflate.client_enable = !isServer && options.enabled;
+  deflate.server_max_window_bits = options.windowBits;
+  deflate.client_max_window_bits = options.windowBits;
+  deflate.memLevel = options.memoryLevel;
+  setSizeThreshold(deflate, options.minimumSize);
+  return deflate;
+}
+
+
+}
+
+
+#endif
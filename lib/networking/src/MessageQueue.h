@@ -0,0 +1,154 @@
+/////////////////////////////////////////////////////////////////////////////
+//                         Single Threaded Networking
+//
+// This file is distributed under the MIT License. See the LICENSE file
+// for details.
+/////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef NETWORKING_MESSAGEQUEUE_H
+#define NETWORKING_MESSAGEQUEUE_H
+
+#include "Server.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+
+namespace networking {
+
+
+/**
+ *  @class MessageQueue
+ *
+ *  @brief A bounded, lock-free queue of Message instances with many producers
+ *  and a single consumer.
+ *
+ *  Every slot of the ring is allocated up front. Each slot carries a sequence
+ *  number that tells producers and the consumer whose turn it is to use it, so
+ *  producers only contend on a single compare-and-swap of the enqueue position
+ *  and the consumer never contends at all. A push into a full queue fails
+ *  rather than blocking so that the producer can apply its own backpressure.
+ */
+class MessageQueue {
+public:
+  /** Construct a queue holding at least `capacity` messages. */
+  explicit MessageQueue(std::size_t capacity)
+    : capacity{roundUpToPowerOfTwo(capacity)},
+      mask{this->capacity - 1},
+      slots{std::make_unique<Slot[]>(this->capacity)} {
+    for (std::size_t i = 0; i < this->capacity; ++i) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   *  Attempt to push a message. The message is only moved from when the push
+   *  succeeds. A retry of a push that was already rejected is not counted as
+   *  rejected again. Safe to call from any number of threads.
+   */
+  [[nodiscard]] bool
+  tryPush(Message& message, bool isRetry = false) {
+    auto position = enqueuePosition.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    while (true) {
+      slot = &slots[position & mask];
+      auto sequence = slot->sequence.load(std::memory_order_acquire);
+      auto difference =
+        static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+      if (difference == 0) {
+        if (enqueuePosition.compare_exchange_weak(position, position + 1,
+                                                  std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (difference < 0) {
+        if (!isRetry) {
+          rejectedPushes.fetch_add(1, std::memory_order_relaxed);
+        }
+        return false;
+      } else {
+        position = enqueuePosition.load(std::memory_order_relaxed);
+      }
+    }
+
+    slot->message = std::move(message);
+    slot->sequence.store(position + 1, std::memory_order_release);
+    acceptedPushes.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   *  Pop every message that is ready and hand each to `consume`. Only the
+   *  single consumer thread may call this.
+   */
+  template <typename Consumer>
+  std::size_t
+  drain(Consumer&& consume) {
+    std::size_t count = 0;
+    while (count < capacity) {
+      Slot& slot = slots[dequeuePosition & mask];
+      if (slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1) {
+        break;
+      }
+      consume(std::move(slot.message));
+      slot.sequence.store(dequeuePosition + capacity, std::memory_order_release);
+      ++dequeuePosition;
+      ++count;
+    }
+    return count;
+  }
+
+  /** Whether a message is ready to be drained. Only the consumer may ask. */
+  [[nodiscard]] bool
+  empty() const noexcept {
+    const Slot& slot = slots[dequeuePosition & mask];
+    return slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1;
+  }
+
+  [[nodiscard]] std::size_t getCapacity() const noexcept { return capacity; }
+
+  [[nodiscard]] uint64_t
+  getAcceptedPushes() const noexcept {
+    return acceptedPushes.load(std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] uint64_t
+  getRejectedPushes() const noexcept {
+    return rejectedPushes.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Slot {
+    std::atomic<std::size_t> sequence;
+    Message message;
+  };
+
+  static std::size_t
+  roundUpToPowerOfTwo(std::size_t value) {
+    std::size_t result = 2;
+    while (result < value) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  const std::size_t capacity;
+  const std::size_t mask;
+  std::unique_ptr<Slot[]> slots;
+
+  // Kept on separate cache lines so that producers and the consumer do not
+  // invalidate each other's positions.
+  alignas(64) std::atomic<std::size_t> enqueuePosition{0};
+  alignas(64) std::size_t dequeuePosition{0};
+
+  alignas(64) std::atomic<uint64_t> acceptedPushes{0};
+  std::atomic<uint64_t> rejectedPushes{0};
+};
+
+
+}
+
+
+#endif
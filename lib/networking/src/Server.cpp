@@ -7,15 +7,34 @@
 
 
 #include "Server.h"
+#include "Deflate.h"
+#include "MessageQueue.h"
 
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 
+#include <atomic>
+#include <condition_variable>
+#include <ctime>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
 using namespace std::string_literals;
 using networking::Message;
+using networking::MessageQueue;
+using networking::MessageType;
+using networking::OverflowPolicy;
+using networking::Payload;
 using networking::Server;
+using networking::ChannelStatistics;
 using networking::ServerImpl;
 using networking::ServerImplDeleter;
+using networking::ServerOptions;
+using networking::ServerStatistics;
 
 
 
@@ -30,36 +49,358 @@ namespace networking {
 class Channel;
 
 
+// Buffers that received messages are read into. Handing them back through
+// Server::recycle() lets reads reuse their memory rather than allocating
+// for every message. Any I/O thread may acquire one.
+class BufferPool {
+public:
+  [[nodiscard]] std::string
+  acquire() {
+    std::lock_guard lock{mutex};
+    if (buffers.empty()) {
+      return {};
+    }
+    auto buffer = std::move(buffers.back());
+    buffers.pop_back();
+    return buffer;
+  }
+
+  void
+  release(std::string buffer) {
+    // Buffers that held unusually large messages are not worth keeping around
+    if (buffer.capacity() == 0 || MAX_BUFFER_CAPACITY < buffer.capacity()) {
+      return;
+    }
+    buffer.clear();
+    std::lock_guard lock{mutex};
+    if (buffers.size() < MAX_BUFFER_COUNT) {
+      buffers.push_back(std::move(buffer));
+    }
+  }
+
+private:
+  static constexpr std::size_t MAX_BUFFER_COUNT = 1024;
+  static constexpr std::size_t MAX_BUFFER_CAPACITY = 64 * 1024;
+
+  std::mutex mutex;
+  std::vector<std::string> buffers;
+};
+
+
 class ServerImpl {
 public:
 
-  ServerImpl(Server& server, unsigned short port, std::string httpMessage)
+  ServerImpl(Server& server,
+             unsigned short port,
+             std::string httpMessage,
+             ServerOptions options)
    : server{server},
      endpoint{boost::asio::ip::tcp::v4(), port},
      ioContext{},
      acceptor{ioContext, endpoint},
-     httpMessage{std::move(httpMessage)} {
+     httpMessage{std::move(httpMessage)},
+     options{options},
+     incoming{options.incomingQueueCapacity} {
     listenForConnections();
+    startIOThreads(options.ioThreadCount);
   }
 
+  ~ServerImpl();
+
   void listenForConnections();
   void registerChannel(Channel& channel);
+  void reportDisconnect(Connection connection);
   void reportError(std::string_view message);
 
+  [[nodiscard]] bool tryPushIncoming(Message& message, bool isRetry);
+  void waitForEvents(std::chrono::milliseconds timeout);
+  void wake();
+  void dispatchChannelEvents();
+
+  [[nodiscard]] bool isThreaded() const noexcept { return !ioThreads.empty(); }
+
   using ChannelMap =
     std::unordered_map<Connection, std::shared_ptr<Channel>, ConnectionHash>;
 
+  // A connection or disconnection observed by an I/O handler. These are
+  // queued so that the Server's callbacks always run inside Server::update().
+  struct ChannelEvent {
+    Connection connection;
+    std::shared_ptr<Channel> channel; // Empty for disconnections
+  };
+
   Server& server;
   const boost::asio::ip::tcp::endpoint endpoint;
   boost::asio::io_context ioContext;
   boost::asio::ip::tcp::acceptor acceptor;
   boost::beast::http::string_body::value_type httpMessage;
+  const ServerOptions options;
 
+  // Only accessed from the thread calling Server::update()
   ChannelMap channels;
-  std::deque<Message> incoming;
+
+  // Handoff between the I/O handlers and the thread calling Server::update().
+  // Messages bypass the mutex; it only guards the rarer channel events and
+  // lets a waiting update() sleep on the condition variable.
+  MessageQueue incoming;
+  BufferPool readBuffers;
+  std::mutex handoffMutex;
+  std::condition_variable handoffReady;
+  std::atomic<bool> isWaitingForEvents{false};
+  bool isWakeRequested = false;
+  std::deque<ChannelEvent> channelEvents;
+
+  // Updated by the channels from whichever I/O thread runs them
+  std::atomic<uint64_t> messagesSent{0};
+  std::atomic<uint64_t> writeBatches{0};
+  std::atomic<uint64_t> messagesDropped{0};
+  std::atomic<uint64_t> slowClientDisconnects{0};
+
+private:
+  void startIOThreads(std::size_t threadCount);
+
+  using WorkGuard =
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type>;
+  std::optional<WorkGuard> workGuard;
+  std::vector<std::thread> ioThreads;
 };
 
 
+/////////////////////////////////////////////////////////////////////////////
+// Traffic metering
+/////////////////////////////////////////////////////////////////////////////
+
+
+// The traffic of one channel. The counters are written on the channel's
+// strand and read by Server::getChannelStatistics() from the update thread.
+struct ChannelTraffic {
+  explicit ChannelTraffic(bool isTimed)
+    : isTimed{isTimed}
+      { }
+
+  std::atomic<uint64_t> messageBytesSent{0};
+  std::atomic<uint64_t> wireBytesSent{0};
+  std::atomic<uint64_t> messageBytesReceived{0};
+  std::atomic<uint64_t> wireBytesReceived{0};
+  std::atomic<int64_t> codingNanoseconds{0};
+
+  // Changed only on the strand; getChannelStatistics also reads it from the
+  // caller's thread, so it is atomic
+  std::atomic<std::size_t> messageBytesPending{0};
+
+  // Beast frames and compresses a message between the socket operations that
+  // carry it, so the CPU time from one operation finishing to the next one
+  // starting is time spent coding. A timer only counts when it is stopped on
+  // the thread that started it, as each thread has its own CPU clock.
+  struct CodingTimer {
+    bool isRunning = false;
+    std::thread::id thread;
+    std::chrono::nanoseconds startedAt{0};
+  };
+
+  void startTiming(CodingTimer& timer);
+  void stopTiming(CodingTimer& timer);
+
+  const bool isTimed;
+  CodingTimer readTimer;
+  CodingTimer writeTimer;
+};
+
+
+static std::chrono::nanoseconds
+getThreadCPUTime() {
+  timespec time{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+  return std::chrono::seconds{time.tv_sec} + std::chrono::nanoseconds{time.tv_nsec};
+}
+
+
+void
+ChannelTraffic::startTiming(CodingTimer& timer) {
+  if (!isTimed) {
+    return;
+  }
+  timer = {true, std::this_thread::get_id(), getThreadCPUTime()};
+}
+
+
+void
+ChannelTraffic::stopTiming(CodingTimer& timer) {
+  if (!timer.isRunning) {
+    return;
+  }
+  timer.isRunning = false;
+  if (timer.thread == std::this_thread::get_id()) {
+    auto elapsed = getThreadCPUTime() - timer.startedAt;
+    codingNanoseconds.fetch_add(elapsed.count(), std::memory_order_relaxed);
+  }
+}
+
+
+// Installed as the rate policy of a channel's stream so that it sees every
+// socket operation. It never limits the rate.
+class TrafficMeter {
+public:
+  explicit TrafficMeter(ChannelTraffic& traffic)
+    : traffic{&traffic}
+      { }
+
+private:
+  friend class boost::beast::rate_policy_access;
+
+  static constexpr std::size_t UNLIMITED = std::numeric_limits<std::size_t>::max();
+
+  std::size_t
+  available_read_bytes() {
+    traffic->stopTiming(traffic->readTimer);
+    return UNLIMITED;
+  }
+
+  std::size_t
+  available_write_bytes() {
+    traffic->stopTiming(traffic->writeTimer);
+    return UNLIMITED;
+  }
+
+  void
+  transfer_read_bytes(std::size_t size) {
+    traffic->wireBytesReceived.fetch_add(size, std::memory_order_relaxed);
+    traffic->startTiming(traffic->readTimer);
+  }
+
+  void
+  transfer_write_bytes(std::size_t size) {
+    traffic->wireBytesSent.fetch_add(size, std::memory_order_relaxed);
+    traffic->startTiming(traffic->writeTimer);
+  }
+
+  void
+  on_timer() { }
+
+  ChannelTraffic* traffic;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Write batching
+/////////////////////////////////////////////////////////////////////////////
+
+
+// Sits between a channel's websocket and its socket so that a batch of
+// messages can be framed one after another and reach the socket in a single
+// write. While a batch is open, frames are copied into it and their writes
+// complete at once. Anything else the websocket writes meanwhile, such as a
+// pong, joins the batch in order.
+template <typename NextLayer>
+class BatchingStream {
+public:
+  using executor_type = typename NextLayer::executor_type;
+
+  template <typename... Args>
+  explicit BatchingStream(Args&&... args)
+    : nextLayer{std::forward<Args>(args)...}
+      { }
+
+  executor_type get_executor() noexcept { return nextLayer.get_executor(); }
+  NextLayer& next_layer() noexcept { return nextLayer; }
+  const NextLayer& next_layer() const noexcept { return nextLayer; }
+
+  void startBatch() { isBatching = true; }
+
+  // Writes everything framed since startBatch() and closes the batch
+  template <typename WriteHandler>
+  void
+  asyncFlush(WriteHandler&& handler) {
+    isBatching = false;
+    boost::asio::async_write(nextLayer, boost::asio::buffer(batch),
+      [this, handler = std::forward<WriteHandler>(handler)]
+      (boost::beast::error_code errorCode, std::size_t size) mutable {
+        // Keep the storage for the next batch unless one was unusually large
+        batch.clear();
+        if (MAX_KEPT_CAPACITY < batch.capacity()) {
+          batch.shrink_to_fit();
+        }
+        handler(errorCode, size);
+      });
+  }
+
+  template <typename MutableBufferSequence, typename ReadHandler>
+  void
+  async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
+    nextLayer.async_read_some(buffers, std::forward<ReadHandler>(handler));
+  }
+
+  template <typename ConstBufferSequence, typename WriteHandler>
+  void
+  async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+    if (!isBatching) {
+      nextLayer.async_write_some(buffers, std::forward<WriteHandler>(handler));
+      return;
+    }
+    const std::size_t size = boost::asio::buffer_size(buffers);
+    const std::size_t offset = batch.size();
+    batch.resize(offset + size);
+    boost::asio::buffer_copy(boost::asio::buffer(batch.data() + offset, size), buffers);
+    boost::asio::post(nextLayer.get_executor(),
+      boost::beast::bind_front_handler(std::forward<WriteHandler>(handler),
+                                       boost::beast::error_code{}, size));
+  }
+
+  // The synchronous close in Channel::disconnect() bypasses any open batch
+  template <typename MutableBufferSequence>
+  std::size_t
+  read_some(const MutableBufferSequence& buffers, boost::beast::error_code& errorCode) {
+    return nextLayer.read_some(buffers, errorCode);
+  }
+
+  template <typename MutableBufferSequence>
+  std::size_t
+  read_some(const MutableBufferSequence& buffers) {
+    return nextLayer.read_some(buffers);
+  }
+
+  template <typename ConstBufferSequence>
+  std::size_t
+  write_some(const ConstBufferSequence& buffers, boost::beast::error_code& errorCode) {
+    return nextLayer.write_some(buffers, errorCode);
+  }
+
+  template <typename ConstBufferSequence>
+  std::size_t
+  write_some(const ConstBufferSequence& buffers) {
+    return nextLayer.write_some(buffers);
+  }
+
+private:
+  static constexpr std::size_t MAX_KEPT_CAPACITY = 256 * 1024;
+
+  NextLayer nextLayer;
+  bool isBatching = false;
+  std::string batch;
+};
+
+
+// Closing the websocket tears down the socket beneath the batching layer
+template <typename NextLayer>
+void
+teardown(boost::beast::role_type role,
+         BatchingStream<NextLayer>& stream,
+         boost::beast::error_code& errorCode) {
+  using boost::beast::websocket::teardown;
+  teardown(role, stream.next_layer(), errorCode);
+}
+
+
+template <typename NextLayer, typename TeardownHandler>
+void
+async_teardown(boost::beast::role_type role,
+               BatchingStream<NextLayer>& stream,
+               TeardownHandler&& handler) {
+  using boost::beast::websocket::async_teardown;
+  async_teardown(role, stream.next_layer(), std::forward<TeardownHandler>(handler));
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 // Channels (connections private to the implementation)
 /////////////////////////////////////////////////////////////////////////////
@@ -71,30 +412,65 @@ public:
     : disconnected{false},
       connection{reinterpret_cast<uintptr_t>(this)},
       serverImpl{serverImpl},
-      streamBuf{},
-      websocket{std::move(socket)},
-      readBuffer{serverImpl.incoming}
+      readBuffer{serverImpl.readBuffers.acquire()},
+      traffic{serverImpl.options.compression.enabled},
+      websocket{TrafficMeter{traffic}, std::move(socket)},
+      retryTimer{websocket.get_executor()}
       { }
 
   void start(boost::beast::http::request<boost::beast::http::string_body>& request);
-  void send(std::string outgoing);
+  void send(Payload outgoing, MessageType type);
   void disconnect();
 
   [[nodiscard]] Connection getConnection() const noexcept { return connection; }
+  [[nodiscard]] ChannelStatistics getStatistics() const;
 
 private:
   void readMessage();
+  void deliver(Message message, bool isRetry = false);
+  void write(Payload outgoing, MessageType type);
+  [[nodiscard]] bool acceptWrite(const Payload& outgoing);
+  void startWrite();
+  void writeFrame(std::size_t index, std::size_t batchSize);
   void afterWrite(std::error_code errorCode, std::size_t size);
 
   bool disconnected;
   Connection connection;
   ServerImpl &serverImpl;
 
-  boost::beast::flat_buffer streamBuf;
-  boost::beast::websocket::stream<boost::asio::ip::tcp::socket> websocket;
+  // Each message is read straight into a pooled string that then becomes the
+  // text of the Message, so nothing is copied out of the frame. The dynamic
+  // buffer tracks how much of the string a read has filled.
+  using ReadBufferView =
+    decltype(boost::asio::dynamic_buffer(std::declval<std::string&>()));
+  std::string readBuffer;
+  std::optional<ReadBufferView> readBufferView;
+
+  // The socket is accepted on its own strand, so every handler of this
+  // channel is serialized even when the I/O runs on a pool of threads.
+  using MeteredStream = boost::beast::basic_stream<boost::asio::ip::tcp,
+                                                   boost::asio::any_io_executor,
+                                                   TrafficMeter>;
+  ChannelTraffic traffic;
+  boost::beast::websocket::stream<BatchingStream<MeteredStream>> websocket;
+
+  // Paces retries while the server's receive queue is full
+  boost::asio::steady_timer retryTimer;
+
+  struct Outgoing {
+    Payload payload;
+    MessageType type;
+  };
+  std::deque<Outgoing> writeBuffer;
+
+  // The in-flight batch covers the first `messagesInFlight` payloads, which
+  // together stay within MAX_BATCH_BYTES unless a single one is larger
+  static constexpr std::size_t MAX_BATCH_BYTES = 64 * 1024;
+  std::size_t messagesInFlight = 0;
 
-  std::deque<Message> &readBuffer;
-  std::deque<std::string> writeBuffer;
+  // Whether the high watermark has been crossed without the backlog, counted
+  // by traffic.messageBytesPending, having drained to the low watermark since
+  bool overflowed = false;
 };
 
 }
@@ -105,13 +481,17 @@ using networking::Channel;
 void
 Channel::start(boost::beast::http::request<boost::beast::http::string_body>& request) {
   auto self = shared_from_this();
+  const auto& compression = serverImpl.options.compression;
+  if (compression.enabled) {
+    websocket.set_option(makeDeflateOption(compression, true));
+  }
   websocket.async_accept(request,
     [this, self] (std::error_code errorCode) {
       if (!errorCode) {
         serverImpl.registerChannel(*this);
         self->readMessage();
       } else {
-        serverImpl.server.disconnect(connection);
+        serverImpl.reportDisconnect(connection);
       }
     });
 }
@@ -119,51 +499,156 @@ Channel::start(boost::beast::http::request<boost::beast::http::string_body>& req
 
 void
 Channel::disconnect() {
-  disconnected = true;
-  boost::beast::error_code ec;
-  websocket.close(boost::beast::websocket::close_reason{}, ec);
+  boost::asio::post(websocket.get_executor(),
+    [this, self = shared_from_this()] {
+      disconnected = true;
+      boost::beast::error_code ec;
+      websocket.close(boost::beast::websocket::close_reason{}, ec);
+    });
 }
 
 
 void
-Channel::send(std::string outgoing) {
-  if (outgoing.empty()) {
+Channel::send(Payload outgoing, MessageType type) {
+  if (outgoing->empty()) {
     return;
   }
-  writeBuffer.push_back(std::move(outgoing));
+  boost::asio::post(websocket.get_executor(),
+    [this, self = shared_from_this(), outgoing = std::move(outgoing), type] () mutable {
+      write(std::move(outgoing), type);
+    });
+}
 
-  if (1 < writeBuffer.size()) {
-    // Note, multiple writes will be chained within asio via `continueSending`,
+
+void
+Channel::write(Payload outgoing, MessageType type) {
+  if (disconnected || !acceptWrite(outgoing)) {
+    return;
+  }
+
+  traffic.messageBytesPending.fetch_add(outgoing->size(), std::memory_order_relaxed);
+  writeBuffer.push_back({std::move(outgoing), type});
+
+  if (0 < messagesInFlight) {
+    // Note, multiple writes will be chained within asio via `afterWrite`,
     // so that callback should be used instead of directly invoking async_write
     // again.
     return;
   }
+  startWrite();
+}
+
 
-  websocket.async_write(boost::asio::buffer(writeBuffer.front()),
-    [this, self = shared_from_this()] (auto errorCode, std::size_t size) {
-      afterWrite(errorCode, size);
+bool
+Channel::acceptWrite(const Payload& outgoing) {
+  const auto& options = serverImpl.options;
+  const std::size_t pendingBytes =
+    traffic.messageBytesPending.load(std::memory_order_relaxed) + outgoing->size();
+  if (!overflowed && pendingBytes <= options.writeHighWatermark) {
+    return true;
+  }
+  overflowed = true;
+
+  switch (options.overflowPolicy) {
+  case OverflowPolicy::DROP:
+    serverImpl.messagesDropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+
+  case OverflowPolicy::COALESCE:
+    if (pendingBytes <= options.writeCoalesceLimit) {
+      return true;
+    }
+    // A Client that cannot keep up even with batched writes is let go
+    [[fallthrough]];
+
+  case OverflowPolicy::DISCONNECT:
+    serverImpl.slowClientDisconnects.fetch_add(1, std::memory_order_relaxed);
+    disconnected = true;
+    serverImpl.reportDisconnect(connection);
+    return false;
+  }
+  return true;
+}
+
+
+void
+Channel::startWrite() {
+  bool shouldCoalesce = serverImpl.options.coalesceWrites
+    || (overflowed && serverImpl.options.overflowPolicy == OverflowPolicy::COALESCE);
+
+  // A coalesced write is a batch of what is waiting so far, up to a size
+  // limit. Each message still gets a frame of its own so that Clients can
+  // tell them apart, but the frames reach the socket in one write.
+  messagesInFlight = 1;
+  if (shouldCoalesce) {
+    std::size_t batchBytes = writeBuffer.front().payload->size();
+    while (messagesInFlight < writeBuffer.size()) {
+      batchBytes += writeBuffer[messagesInFlight].payload->size();
+      if (MAX_BATCH_BYTES < batchBytes) {
+        break;
+      }
+      ++messagesInFlight;
+    }
+  }
+
+  traffic.startTiming(traffic.writeTimer);
+  if (1 < messagesInFlight) {
+    websocket.next_layer().startBatch();
+  }
+  writeFrame(0, 0);
+}
+
+
+void
+Channel::writeFrame(std::size_t index, std::size_t batchSize) {
+  // Only one websocket write is ever in flight, so the frame type can be
+  // switched between frames.
+  const Outgoing& outgoing = writeBuffer[index];
+  websocket.binary(outgoing.type == MessageType::BINARY);
+  websocket.async_write(boost::asio::buffer(*outgoing.payload),
+    [this, self = shared_from_this(), index, batchSize] (auto errorCode, std::size_t size) {
+      if (errorCode || messagesInFlight == 1) {
+        afterWrite(errorCode, batchSize + size);
+      } else if (index + 1 < messagesInFlight) {
+        writeFrame(index + 1, batchSize + size);
+      } else {
+        websocket.next_layer().asyncFlush(
+          [this, self, batchSize = batchSize + size] (auto errorCode, std::size_t) {
+            afterWrite(errorCode, batchSize);
+          });
+      }
     });
 }
 
 
 void
 Channel::afterWrite(std::error_code errorCode, std::size_t size) {
+  traffic.stopTiming(traffic.writeTimer);
   if (errorCode) {
     if (!disconnected) {
-      serverImpl.server.disconnect(connection);
+      serverImpl.reportDisconnect(connection);
     }
     return;
   }
 
-  writeBuffer.pop_front();
+  serverImpl.messagesSent.fetch_add(messagesInFlight, std::memory_order_relaxed);
+  serverImpl.writeBatches.fetch_add(1, std::memory_order_relaxed);
+  traffic.messageBytesSent.fetch_add(size, std::memory_order_relaxed);
+  for (; 0 < messagesInFlight; --messagesInFlight) {
+    traffic.messageBytesPending.fetch_sub(writeBuffer.front().payload->size(),
+                                          std::memory_order_relaxed);
+    writeBuffer.pop_front();
+  }
+
+  const std::size_t pendingBytes = traffic.messageBytesPending.load(std::memory_order_relaxed);
+  if (overflowed && pendingBytes <= serverImpl.options.writeLowWatermark) {
+    overflowed = false;
+  }
 
   // Continue asynchronously processing any further messages that have been
   // sent.
   if (!writeBuffer.empty()) {
-    websocket.async_write(boost::asio::buffer(writeBuffer.front()),
-      [this, self = shared_from_this()] (auto errorCode, std::size_t size) {
-        afterWrite(errorCode, size);
-      });
+    startWrite();
   }
 }
 
@@ -171,15 +656,53 @@ Channel::afterWrite(std::error_code errorCode, std::size_t size) {
 void
 Channel::readMessage() {
   auto self = shared_from_this();
-  websocket.async_read(streamBuf,
+  readBufferView.emplace(boost::asio::dynamic_buffer(readBuffer));
+  websocket.async_read(*readBufferView,
     [this, self] (auto errorCode, std::size_t size) {
+      // Decompressing the last of the message happened since the last read
+      traffic.stopTiming(traffic.readTimer);
       if (!errorCode) {
-        auto message = boost::beast::buffers_to_string(streamBuf.data());
-        readBuffer.push_back({connection, std::move(message)});
-        streamBuf.consume(streamBuf.size());
-        this->readMessage();
+        traffic.messageBytesReceived.fetch_add(size, std::memory_order_relaxed);
+        const auto type =
+          websocket.got_binary() ? MessageType::BINARY : MessageType::TEXT;
+        auto text = std::exchange(readBuffer, serverImpl.readBuffers.acquire());
+        deliver({connection, std::move(text), type, std::chrono::steady_clock::now()});
       } else if (!disconnected) {
-        serverImpl.server.disconnect(connection);
+        serverImpl.reportDisconnect(connection);
+      }
+    });
+}
+
+
+ChannelStatistics
+Channel::getStatistics() const {
+  return {
+    traffic.messageBytesSent.load(std::memory_order_relaxed),
+    traffic.wireBytesSent.load(std::memory_order_relaxed),
+    traffic.messageBytesReceived.load(std::memory_order_relaxed),
+    traffic.wireBytesReceived.load(std::memory_order_relaxed),
+    std::chrono::nanoseconds{traffic.codingNanoseconds.load(std::memory_order_relaxed)},
+    traffic.messageBytesPending.load(std::memory_order_relaxed),
+  };
+}
+
+
+void
+Channel::deliver(Message message, bool isRetry) {
+  if (serverImpl.tryPushIncoming(message, isRetry)) {
+    readMessage();
+    return;
+  }
+
+  // The server is not keeping up. Hold on to the message and stop reading so
+  // that the backlog stays in the client's TCP window instead of our memory.
+  // The read counts as held back once, however many retries it takes.
+  retryTimer.expires_after(std::chrono::milliseconds{1});
+  retryTimer.async_wait(
+    [this, self = shared_from_this(), message = std::move(message)]
+    (std::error_code errorCode) mutable {
+      if (!errorCode && !disconnected) {
+        deliver(std::move(message), true);
       }
     });
 }
@@ -192,17 +715,15 @@ Channel::readMessage() {
 
 class HTTPSession : public std::enable_shared_from_this<HTTPSession> {
 public:
-  HTTPSession(ServerImpl& serverImpl)
+  HTTPSession(ServerImpl& serverImpl, boost::asio::ip::tcp::socket socket)
     : serverImpl{serverImpl},
-      socket{serverImpl.ioContext},
+      socket{std::move(socket)},
       streamBuf{}
       { }
 
   void start();
   void handleRequest();
 
-  boost::asio::ip::tcp::socket & getSocket() { return socket; }
-
 private:
   ServerImpl &serverImpl;
   boost::asio::ip::tcp::socket socket;
@@ -325,15 +846,37 @@ HTTPSession::handleRequest() {
 /////////////////////////////////////////////////////////////////////////////
 
 
+ServerImpl::~ServerImpl() {
+  workGuard.reset();
+  ioContext.stop();
+  for (auto& thread : ioThreads) {
+    thread.join();
+  }
+}
+
+
 void
-ServerImpl::listenForConnections() {
-  auto session =
-    std::make_shared<HTTPSession>(*this);
+ServerImpl::startIOThreads(std::size_t threadCount) {
+  if (threadCount == 0) {
+    return;
+  }
+
+  workGuard.emplace(ioContext.get_executor());
+  ioThreads.reserve(threadCount);
+  for (std::size_t i = 0; i < threadCount; ++i) {
+    ioThreads.emplace_back([this] { ioContext.run(); });
+  }
+}
+
 
-  acceptor.async_accept(session->getSocket(),
-    [this, session] (auto errorCode) {
+void
+ServerImpl::listenForConnections() {
+  // Each accepted socket gets its own strand so that the handlers of a single
+  // connection never run concurrently.
+  acceptor.async_accept(boost::asio::make_strand(ioContext),
+    [this] (auto errorCode, boost::asio::ip::tcp::socket socket) {
       if (!errorCode) {
-        session->start();
+        std::make_shared<HTTPSession>(*this, std::move(socket))->start();
       } else {
         reportError("Fatal error while accepting");
       }
@@ -344,9 +887,94 @@ ServerImpl::listenForConnections() {
 
 void
 ServerImpl::registerChannel(Channel& channel) {
-  auto connection = channel.getConnection();
-  channels[connection] = channel.shared_from_this();
-  server.connectionHandler->handleConnect(connection);
+  {
+    std::lock_guard lock{handoffMutex};
+    channelEvents.push_back({channel.getConnection(), channel.shared_from_this()});
+  }
+  handoffReady.notify_one();
+}
+
+
+void
+ServerImpl::reportDisconnect(Connection connection) {
+  {
+    std::lock_guard lock{handoffMutex};
+    channelEvents.push_back({connection, nullptr});
+  }
+  handoffReady.notify_one();
+}
+
+
+bool
+ServerImpl::tryPushIncoming(Message& message, bool isRetry) {
+  if (!incoming.tryPush(message, isRetry)) {
+    return false;
+  }
+
+  // Pairs with the fence in waitForEvents() so that either the waiting thread
+  // sees the new message or this thread sees that it must be woken.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (isWaitingForEvents.load(std::memory_order_relaxed)) {
+    { std::lock_guard lock{handoffMutex}; }
+    handoffReady.notify_one();
+  }
+  return true;
+}
+
+
+void
+ServerImpl::waitForEvents(std::chrono::milliseconds timeout) {
+  if (!isThreaded()) {
+    // Block until the first handler is ready, then drain everything else that
+    // became ready in the meantime without blocking again.
+    ioContext.run_one_for(timeout);
+    ioContext.poll();
+    return;
+  }
+
+  std::unique_lock lock{handoffMutex};
+  isWaitingForEvents.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  handoffReady.wait_for(lock, timeout, [this] {
+    return !incoming.empty() || !channelEvents.empty() || isWakeRequested;
+  });
+  isWaitingForEvents.store(false, std::memory_order_relaxed);
+  isWakeRequested = false;
+}
+
+
+void
+ServerImpl::wake() {
+  if (!isThreaded()) {
+    // Any completed handler ends the wait in run_one_for()
+    boost::asio::post(ioContext, [] {});
+    return;
+  }
+
+  {
+    std::lock_guard lock{handoffMutex};
+    isWakeRequested = true;
+  }
+  handoffReady.notify_one();
+}
+
+
+void
+ServerImpl::dispatchChannelEvents() {
+  std::deque<ChannelEvent> events;
+  {
+    std::lock_guard lock{handoffMutex};
+    std::swap(events, channelEvents);
+  }
+
+  for (auto& event : events) {
+    if (event.channel) {
+      channels[event.connection] = std::move(event.channel);
+      server.connectionHandler->handleConnect(event.connection);
+    } else {
+      server.disconnect(event.connection);
+    }
+  }
 }
 
 
@@ -370,15 +998,65 @@ ServerImplDeleter::operator()(ServerImpl* serverImpl) {
 
 void
 Server::update() {
-  impl->ioContext.poll();
+  if (!impl->isThreaded()) {
+    impl->ioContext.poll();
+  }
+  impl->dispatchChannelEvents();
+}
+
+
+void
+Server::update(std::chrono::milliseconds timeout) {
+  impl->waitForEvents(timeout);
+  impl->dispatchChannelEvents();
 }
 
 
 std::deque<Message>
 Server::receive() {
-  std::deque<Message> oldIncoming;
-  std::swap(oldIncoming, impl->incoming);
-  return oldIncoming;
+  std::deque<Message> received;
+  impl->incoming.drain([&received] (Message&& message) {
+    received.push_back(std::move(message));
+  });
+  return received;
+}
+
+
+void
+Server::recycle(std::deque<Message> messages) {
+  for (auto& message : messages) {
+    impl->readBuffers.release(std::move(message.text));
+  }
+}
+
+
+ServerStatistics
+Server::getStatistics() const {
+  return {
+    impl->incoming.getAcceptedPushes(),
+    impl->incoming.getRejectedPushes(),
+    impl->incoming.getCapacity(),
+    impl->messagesSent.load(std::memory_order_relaxed),
+    impl->writeBatches.load(std::memory_order_relaxed),
+    impl->messagesDropped.load(std::memory_order_relaxed),
+    impl->slowClientDisconnects.load(std::memory_order_relaxed),
+  };
+}
+
+
+std::optional<ChannelStatistics>
+Server::getChannelStatistics(Connection connection) const {
+  auto found = impl->channels.find(connection);
+  if (impl->channels.end() == found) {
+    return std::nullopt;
+  }
+  return found->second->getStatistics();
+}
+
+
+void
+Server::wake() {
+  impl->wake();
 }
 
 
@@ -387,7 +1065,29 @@ Server::send(const std::deque<Message>& messages) {
   for (auto& message : messages) {
     auto found = impl->channels.find(message.connection);
     if (impl->channels.end() != found) {
-      found->second->send(message.text);
+      found->second->send(std::make_shared<const std::string>(message.text),
+                          message.type);
+    }
+  }
+}
+
+
+void
+Server::broadcast(Payload payload, MessageType type) {
+  for (auto& [connection, channel] : impl->channels) {
+    channel->send(payload, type);
+  }
+}
+
+
+void
+Server::multicast(const std::vector<Connection>& connections,
+                  Payload payload,
+                  MessageType type) {
+  for (auto connection : connections) {
+    auto found = impl->channels.find(connection);
+    if (impl->channels.end() != found) {
+      found->second->send(payload, type);
     }
   }
 }
@@ -407,12 +1107,12 @@ Server::disconnect(Connection connection) {
 std::unique_ptr<ServerImpl,ServerImplDeleter>
 Server::buildImpl(Server& server,
                   unsigned short port,
-                  std::string httpMessage) {
+                  std::string httpMessage,
+                  ServerOptions options) {
   // NOTE: We are using a custom deleter here so that the impl class can be
   // hidden within the source file rather than exposed in the header. Using
   // a custom deleter means that we need to use a raw `new` rather than using
   // `std::make_unique`.
-  auto* impl = new ServerImpl(server, port, std::move(httpMessage));
+  auto* impl = new ServerImpl(server, port, std::move(httpMessage), options);
   return std::unique_ptr<ServerImpl,ServerImplDeleter>(impl);
 }
-
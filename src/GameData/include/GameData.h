@@ -3,8 +3,12 @@
 #include "nlohmann/json.hpp"
 
 #include "GameRules.h"
+#include "RuleArena.h"
 #include "GameState.h"
+#include "RuleProgram.h"
 
+#include <memory>
+#include <optional>
 #include <vector>
 
 using json = nlohmann::json;
@@ -18,20 +22,33 @@ namespace GameData {
 
 
 
-using TopLevelRules = std::vector<GameRules::RulePtr>;
+using TopLevelRules = GameRules::Rules;
 
 struct GameData {
     bool isValid = false;
     // TODO: configuration
-    // TODO: constants (Probably also an unordered_map)
+    GameState::VariableMap constantMap = {};
+
     GameState::VariableMap variableMap = {};
 
     GameState::VariableMap perPlayerVariableMap = {};
 
+    // Slot assignment for the constants and variables above, shared by every GameState of this game
+    std::shared_ptr<const GameState::VariableLayout> variableLayout = {};
+
+    // Holds the rules below and their strings, so it is declared first to be destroyed last
+    std::unique_ptr<GameRules::RuleArena> ruleArena = {};
+
     // TODO: per-audience
     TopLevelRules topLevelRules = {};
+
+    // The same rules lowered to bytecode, when every one of them could be
+    std::optional<GameRules::RuleProgram> program = std::nullopt;
 };
 
+// Parsed game data is never modified, so every session playing a game shares one parse of it
+using GameDataPtr = std::shared_ptr<const GameData>;
+
 
 
 }
@@ -0,0 +1,47 @@
+#include "Expression.h"
+
+#include "GameState.h"
+
+#include <utility>
+
+namespace GameRules {
+
+
+
+Expression::Expression(std::string_view source, std::pmr::vector<ExpressionNode> nodes)
+  : source(source)
+  , nodes(std::move(nodes)) {}
+
+[[nodiscard]] GameState::GetVariableResult Expression::evaluate(const GameState::GameState& gameState) const {
+  auto readValue = [&gameState](const GameState::VariablePath& path) {
+    return gameState.getValue(path);
+  };
+  return this->evaluate(readValue, gameState.getPlayerIDs().size());
+}
+
+[[nodiscard]] GameState::GetVariableResult
+Expression::compare(ExpressionOp op, const GameState::VariableValue& lhs, const GameState::VariableValue& rhs) {
+  int order = 0;
+  if (lhs.isInteger() && rhs.isInteger()) {
+    order = (lhs.getInteger() > rhs.getInteger()) - (lhs.getInteger() < rhs.getInteger());
+  } else if (lhs.isString() && rhs.isString()) {
+    order = lhs.getString().compare(rhs.getString());
+  } else {
+    return {};
+  }
+
+  bool result = false;
+  switch (op) {
+  case ExpressionOp::LESS:          result = order < 0; break;
+  case ExpressionOp::LESS_EQUAL:    result = order <= 0; break;
+  case ExpressionOp::GREATER:       result = order > 0; break;
+  case ExpressionOp::GREATER_EQUAL: result = order >= 0; break;
+  default:
+    return {};
+  }
+  return {.wasSuccessful = true, .value = result};
+}
+
+
+
+}
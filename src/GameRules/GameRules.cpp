@@ -1,45 +1,115 @@
 #include "GameRules.h"
 
 #include "GameState.h"
+#include "RuleCursor.h"
+#include "RuleProgram.h"
 
 #include <glog/logging.h>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace GameRules {
 
 
 
+/******************************************************************************
+ *                                    Rule                                    *
+ ******************************************************************************/
+void RuleDeleter::operator()(Rule* rule) const {
+  if (this->isArenaAllocated) {
+    rule->~Rule();
+  } else {
+    delete rule;
+  }
+}
+
+// Rules without children run to completion in a single step
+[[nodiscard]] RuleStep Rule::stepRule(RuleCursor& cursor, RuleFrame& frame) {
+  if (this->executeRuleImpl(cursor.getGameState()) == RuleExecutionResult::SUCCESS) {
+    return RuleStep::COMPLETE;
+  }
+  return RuleStep::FAIL;
+}
+
+[[nodiscard]] bool Rule::compileRule(RuleCompiler& compiler) const {
+  return false;
+}
+
+// Rules with children run to completion through a cursor of their own
+[[nodiscard]] static RuleExecutionResult
+executeWithCursor(Rule& rule, GameState::GameState& gameState) {
+  RuleCursor cursor = RuleCursor(rule, gameState);
+  const RuleExecutionResult result = cursor.run();
+  if (result == RuleExecutionResult::SUSPENDED) {
+    LOG(ERROR) << "Rules waiting for input must be executed with a RuleCursor";
+    cursor.abandon();
+    return RuleExecutionResult::FAILURE;
+  }
+  return result;
+}
+
+
+
 /******************************************************************************
  *                                  Add Rule                                  *
  ******************************************************************************/
 // TODO: For now we only support integers as the value - we should support variable names, and floats in the future
-AddRule::AddRule(const GameState::VariableKey targetVariableName, GameState::VariableValue value)
-  : addTarget(targetVariableName), value(value) {}
+AddRule::AddRule(const GameState::VariablePath targetVariable, GameState::Integer value)
+  : addTarget(targetVariable), value(value) {}
 
 [[nodiscard]] RuleExecutionResult AddRule::executeRuleImpl(GameState::GameState& gameState) {
   const GameState::GetVariableResult getVariableResult = gameState.getValue(this->addTarget);
   if (getVariableResult.wasSuccessful == false) {
-    LOG(ERROR) << "Failed to get variable: " << this->addTarget;
+    LOG(ERROR) << "Failed to get variable: " << this->addTarget.name;
+    return RuleExecutionResult::FAILURE;
+  }
+
+  if (!getVariableResult.value.isInteger()) {
+    LOG(ERROR) << "Cannot add to a variable which is not an integer: " << this->addTarget.name;
     return RuleExecutionResult::FAILURE;
   }
 
-  const GameState::VariableValue newTargetValue = getVariableResult.value + this->value;
+  const GameState::VariableValue newTargetValue = getVariableResult.value.getInteger() + this->value;
   
   if (gameState.setValue(this->addTarget, newTargetValue) == GameState::SetVariableResult::FAILURE) {
-    LOG(ERROR) << "Failed to set variable: " << this->addTarget;
+    LOG(ERROR) << "Failed to set variable: " << this->addTarget.name;
     return RuleExecutionResult::FAILURE;
   }
 
   return RuleExecutionResult::SUCCESS;
 }
 
+[[nodiscard]] bool AddRule::compileRule(RuleCompiler& compiler) const {
+  switch (this->addTarget.kind) {
+  case GameState::VariablePath::Kind::GLOBAL:
+    compiler.emit({
+      .op = OpCode::ADD_VARIABLE,
+      .slot = static_cast<uint32_t>(this->addTarget.slot),
+      .value = this->value,
+    });
+    return true;
+
+  case GameState::VariablePath::Kind::PER_PLAYER:
+    compiler.emit({
+      .op = OpCode::ADD_PLAYER_VARIABLE,
+      .scopeDepth = static_cast<uint16_t>(this->addTarget.scopeDepth),
+      .slot = static_cast<uint32_t>(this->addTarget.slot),
+      .value = this->value,
+    });
+    return true;
+
+  default:
+    return false;
+  }
+}
+
 
 
 /******************************************************************************
  *                             Global Message Rule                            *
  ******************************************************************************/
-GlobalMessageRule::GlobalMessageRule(const std::string messageValue)
+GlobalMessageRule::GlobalMessageRule(std::string_view messageValue)
   : messageValue(messageValue) { }
 
 // TODO-51: Parse {variable_name} into value
@@ -51,32 +121,74 @@ GlobalMessageRule::GlobalMessageRule(const std::string messageValue)
   return RuleExecutionResult::SUCCESS;
 }
 
+[[nodiscard]] RuleStep GlobalMessageRule::stepRule(RuleCursor& cursor, RuleFrame& frame) {
+  cursor.addOutput(this->messageValue);
+  return RuleStep::COMPLETE;
+}
+
+[[nodiscard]] bool GlobalMessageRule::compileRule(RuleCompiler& compiler) const {
+  compiler.emit({.op = OpCode::MESSAGE, .operand = compiler.addMessage(this->messageValue)});
+  return true;
+}
+
 
 
 /******************************************************************************
  *                                  Loop Rule                                 *
  ******************************************************************************/
-LoopRule::LoopRule(std::string stopCondition, Rules rulesToExecuteEachIteration)
-  : stopCondition(stopCondition)
+LoopRule::LoopRule(Expression condition, Rules rulesToExecuteEachIteration)
+  : condition(std::move(condition))
   , rulesToExecuteEachIteration(std::move(rulesToExecuteEachIteration)) {}
 
 [[nodiscard]] RuleExecutionResult LoopRule::executeRuleImpl(GameState::GameState& gameState) {
-  if (gameState.getValue("debug_target").wasSuccessful == false) {
-        return RuleExecutionResult::FAILURE;
-  }
-
-  // TODO-#50: Parse the conditional rather than hard-coding it
-  while (gameState.getValue("debug_target").value != 10) {
-    // Every iteration of this loopRule, execute each rule that is contained within this loopRule
-    for (const auto& rule : this->rulesToExecuteEachIteration) {
-      if (rule->executeRule(gameState) == RuleExecutionResult::FAILURE) {
-        LOG(ERROR) << "Rule within loop failed to execute";
-        return RuleExecutionResult::FAILURE;
-      }
+  return executeWithCursor(*this, gameState);
+}
+
+[[nodiscard]] RuleStep LoopRule::stepRule(RuleCursor& cursor, RuleFrame& frame) {
+  // Every iteration of this loopRule, execute each rule that is contained within this loopRule
+  if (frame.child == 0) {
+    const GameState::GetVariableResult conditionResult = this->condition.evaluate(cursor.getGameState());
+    if (conditionResult.wasSuccessful == false) {
+      LOG(ERROR) << "Failed to evaluate loop condition: " << this->condition.getSource();
+      return RuleStep::FAIL;
+    }
+
+    const std::optional<bool> shouldContinue = conditionResult.value.asCondition();
+    if (!shouldContinue.has_value()) {
+      LOG(ERROR) << "Loop condition is not a boolean: " << this->condition.getSource();
+      return RuleStep::FAIL;
+    }
+    if (!*shouldContinue) {
+      return RuleStep::COMPLETE;
+    }
+
+    if (this->rulesToExecuteEachIteration.empty()) {
+      LOG(ERROR) << "Loop has no rules to reach its stop condition with";
+      return RuleStep::FAIL;
     }
   }
 
-  return RuleExecutionResult::SUCCESS;
+  Rule& rule = *this->rulesToExecuteEachIteration[frame.child];
+  frame.child = (frame.child + 1) % this->rulesToExecuteEachIteration.size();
+  cursor.call(rule);
+  return RuleStep::CALL;
+}
+
+[[nodiscard]] bool LoopRule::compileRule(RuleCompiler& compiler) const {
+  if (this->rulesToExecuteEachIteration.empty()) {
+    return false;
+  }
+
+  const std::size_t loopStart = compiler.emit({
+    .op = OpCode::JUMP_UNLESS,
+    .slot = compiler.addCondition(this->condition),
+  });
+  if (!compiler.compileRules(this->rulesToExecuteEachIteration)) {
+    return false;
+  }
+  compiler.emit({.op = OpCode::JUMP, .operand = static_cast<uint32_t>(loopStart)});
+  compiler.setJumpTarget(loopStart, compiler.getNextAddress());
+  return true;
 }
 
 
@@ -84,52 +196,71 @@ LoopRule::LoopRule(std::string stopCondition, Rules rulesToExecuteEachIteration)
 /******************************************************************************
  *                               Input Text Rule                              *
  ******************************************************************************/
-InputTextRule::InputTextRule(const std::string targettedUser,
-                             const std::string inputPrompt,
-                             const std::string resultVariable)
+InputTextRule::InputTextRule(const GameState::VariablePath targettedUser,
+                             std::string_view inputPrompt,
+                             const GameState::VariablePath resultVariable,
+                             const std::optional<std::chrono::milliseconds> timeout)
   : targettedUser(targettedUser)
   , inputPrompt(inputPrompt)
-  , resultVariable(resultVariable) {}
+  , resultVariable(resultVariable)
+  , timeout(timeout) {}
 
-// TODO: Add handling for timeout variable
+// Input can only be waited for by a RuleCursor
 [[nodiscard]] RuleExecutionResult
 InputTextRule::executeRuleImpl(GameState::GameState& gameState) {
-  const GameState::GetVariableResult getTargetResult = gameState.getValue(this->targettedUser);
-  if (getTargetResult.wasSuccessful == false) {
-    LOG(ERROR) << "Failed to get target user: " << this->targettedUser;
-    return RuleExecutionResult::FAILURE;
+  return executeWithCursor(*this, gameState);
+}
+
+[[nodiscard]] RuleStep InputTextRule::stepRule(RuleCursor& cursor, RuleFrame& frame) {
+  GameState::GameState& gameState = cursor.getGameState();
+
+  // First step: ask the targetted user for input, and suspend the game until it arrives
+  if (!frame.isEntered) {
+    const GameState::GetPlayerResult getTargetResult = gameState.getPlayer(this->targettedUser);
+    if (getTargetResult.wasSuccessful == false) {
+      LOG(ERROR) << "Failed to get target user: " << this->targettedUser.name;
+      return RuleStep::FAIL;
+    }
+
+    // A user who runs out of time leaves the result as it was
+    const GameState::GetVariableResult getResultResult = gameState.getValue(this->resultVariable);
+    if (getResultResult.wasSuccessful == false) {
+      LOG(ERROR) << "Failed to get variable: " << this->resultVariable.name;
+      return RuleStep::FAIL;
+    }
+
+    cursor.requestInput({
+      .playerID = getTargetResult.playerID,
+      .prompt = std::string(this->inputPrompt),
+      .timeout = this->timeout,
+      .defaultValue = getResultResult.value,
+    });
+    frame.isEntered = true;
+    return RuleStep::SUSPEND;
   }
 
-  // TODO-#57:
-  // call function which gets input from user
-  // -> if user input not number, print error and failure
-  // -> try to ensure user enters a number
-      // maybe try passing in a lambda function upon creation of gameState
-      // this lambda function could maybe be able to (blocking) get input from user
-      // blocking is okay because we dont have any inparallel yet
+  const std::optional<GameState::VariableValue> resultValue = cursor.takeInput();
+  if (!resultValue.has_value()) {
+    return RuleStep::SUSPEND;
+  }
 
-  // TODO-#57: Get the value from user above
-  const GameState::VariableValue resultValue = 123456789;
-  if (gameState.setValue(this->resultVariable, resultValue) == GameState::SetVariableResult::FAILURE) {
-    LOG(ERROR) << "Failed to set variable: " << this->resultVariable;
-    return RuleExecutionResult::FAILURE;
+  if (gameState.setValue(this->resultVariable, *resultValue) == GameState::SetVariableResult::FAILURE) {
+    LOG(ERROR) << "Failed to set variable: " << this->resultVariable.name;
+    return RuleStep::FAIL;
   }
 
-  // TODO-#57: uncomment when we have a working implementation
-  // return RuleExecutionResult::SUCCESS;
+  return RuleStep::COMPLETE;
+}
 
-  /* TODO-#57: Initial thoughts
-      - Select specified user
-      - Somehow indicate to the outside that we should pause and wait for input from user
-          - Do we take input from in here?
-          - Rules are on the server, we must make the server fetch the user input from clients
-          - Can we return? It a little hard:
-              - that would end this function, do we return a callback then?
-              - That's not even easy, this rule is very likely not a topLevelRule
-              - Tricky....
-      - Save the input to a variable within the user?
-  */
-  return RuleExecutionResult::FAILURE;
+[[nodiscard]] bool InputTextRule::compileRule(RuleCompiler& compiler) const {
+  const uint32_t input = compiler.addInput({
+    .targetScopeDepth = this->targettedUser.scopeDepth,
+    .result = this->resultVariable,
+    .prompt = this->inputPrompt,
+    .timeout = this->timeout,
+  });
+  compiler.emit({.op = OpCode::INPUT_TEXT, .operand = input});
+  return true;
 }
 
 
@@ -137,8 +268,8 @@ InputTextRule::executeRuleImpl(GameState::GameState& gameState) {
 /******************************************************************************
  *                                For Each Rule                               *
  ******************************************************************************/
-ForEachRule::ForEachRule(const GameState::VariableKey& listName,
-                         const GameState::VariableKey& listElementName,
+ForEachRule::ForEachRule(std::string_view listName,
+                         std::string_view listElementName,
                          Rules rulesToExecuteEachElement)
   : listName(listName)
   , listElementName(listElementName)
@@ -146,34 +277,105 @@ ForEachRule::ForEachRule(const GameState::VariableKey& listName,
 
 [[nodiscard]] RuleExecutionResult
 ForEachRule::executeRuleImpl(GameState::GameState& gameState) {
+  return executeWithCursor(*this, gameState);
+}
+
+[[nodiscard]] RuleStep ForEachRule::stepRule(RuleCursor& cursor, RuleFrame& frame) {
+  GameState::GameState& gameState = cursor.getGameState();
+
+  if (!frame.isEntered) {
+    // TODO: Currently only iterating through lists of players is supported
+    if (this->listName != "players") {
+      LOG(ERROR) << "Only iterating through \"players\" list is supported";
+      return RuleStep::FAIL;
+    }
+
+    // Put forEach element variable in scope for any rules that execute after this
+    // Rules compiled inside this forEach refer to the element by this depth
+    frame.scopeDepth = gameState.pushScope(this->listElementName);
+    frame.hasScope = true;
+    frame.isEntered = true;
+  }
+
+  // Execute all the rules within this loop for each player
+  if (frame.child == this->rulesToExecuteEachElement.size()) {
+    frame.child = 0;
+    ++frame.element;
+  }
+
+  // TODO: Support more lists than just the player list
+  if (frame.element >= gameState.getPlayerIDs().size()) {
+    // Take forEach element variable out of scope, future rule executions can't see forEach element
+    gameState.popScope();
+    frame.hasScope = false;
+    return RuleStep::COMPLETE;
+  }
+
+  gameState.bindScope(frame.scopeDepth, frame.element);
+  cursor.call(*this->rulesToExecuteEachElement[frame.child++]);
+  return RuleStep::CALL;
+}
+
+[[nodiscard]] bool ForEachRule::compileRule(RuleCompiler& compiler) const {
   // TODO: Currently only iterating through lists of players is supported
   if (this->listName != "players") {
-    LOG(ERROR) << "Only iterating through \"players\" list is supported";
-    return RuleExecutionResult::FAILURE;
+    return false;
   }
 
-  // TODO: Support more lists than just the player list
-  for (const GameState::PlayerID& playerID : gameState.getPlayerIDs()) {
-    // Put forEach element variable in scope for any rules that execute after this
-    if (gameState.setActiveScopeVariable(this->listElementName, playerID) == GameState::SetVariableResult::FAILURE) {
-      return RuleExecutionResult::FAILURE;
-    }
+  const std::size_t scopeDepth = compiler.pushScope();
+  const std::size_t loopStart = compiler.emit({
+    .op = OpCode::FOR_EACH_PLAYER,
+    .scopeDepth = static_cast<uint16_t>(scopeDepth),
+  });
+  const std::size_t bodyStart = compiler.getNextAddress();
+  if (!compiler.compileRules(this->rulesToExecuteEachElement)) {
+    return false;
+  }
+  compiler.emit({
+    .op = OpCode::NEXT_PLAYER,
+    .scopeDepth = static_cast<uint16_t>(scopeDepth),
+    .operand = static_cast<uint32_t>(bodyStart),
+  });
+  compiler.setJumpTarget(loopStart, compiler.getNextAddress());
+  compiler.popScope();
+  return true;
+}
 
-    // Execute all the rules within this loop for each player
-    for (const auto& rule : this->rulesToExecuteEachElement) {
-      if (rule->executeRule(gameState) == RuleExecutionResult::FAILURE) {
-        LOG(ERROR) << "Rule within forEach failed to execute";
-        return RuleExecutionResult::FAILURE;
-      }
-    }
-    
-    // Take forEach element variable out of scope, future rule executions can't see forEach element
-    if (gameState.unsetActiveScopeVariable(this->listElementName) == GameState::SetVariableResult::FAILURE) {
-      return RuleExecutionResult::FAILURE;
-    }
+
+
+/******************************************************************************
+ *                              Parallel For Rule                             *
+ ******************************************************************************/
+ParallelForRule::ParallelForRule(std::string_view listName,
+                                 std::string_view listElementName,
+                                 Rules rulesToExecuteEachElement)
+  : listName(listName)
+  , listElementName(listElementName)
+  , rulesToExecuteEachElement(std::move(rulesToExecuteEachElement)) {}
+
+[[nodiscard]] RuleExecutionResult
+ParallelForRule::executeRuleImpl(GameState::GameState& gameState) {
+  return executeWithCursor(*this, gameState);
+}
+
+[[nodiscard]] RuleStep ParallelForRule::stepRule(RuleCursor& cursor, RuleFrame& frame) {
+  // Stepped again once every branch has completed
+  if (frame.isEntered) {
+    return RuleStep::COMPLETE;
   }
-  
-  return RuleExecutionResult::SUCCESS;
+
+  // TODO: Currently only iterating through lists of players is supported
+  if (this->listName != "players") {
+    LOG(ERROR) << "Only iterating through \"players\" list is supported";
+    return RuleStep::FAIL;
+  }
+
+  if (!cursor.branch(this->rulesToExecuteEachElement, this->listElementName)) {
+    LOG(ERROR) << "Parallel for rules cannot be nested";
+    return RuleStep::FAIL;
+  }
+  frame.isEntered = true;
+  return RuleStep::BRANCH;
 }
 
 
@@ -0,0 +1,34 @@
+#include "RuleArena.h"
+
+#include <algorithm>
+#include <string_view>
+
+namespace GameRules {
+
+
+
+// Enough for the rules of a typical spec, larger specs grow the arena geometrically
+static constexpr std::size_t INITIAL_ARENA_SIZE = 16 * 1024;
+
+RuleArena::RuleArena()
+  : resource(INITIAL_ARENA_SIZE)
+  , internedStrings(&this->resource) {}
+
+[[nodiscard]] std::string_view RuleArena::intern(std::string_view text) {
+  const auto interned_it = this->internedStrings.find(text);
+  if (interned_it != this->internedStrings.end()) {
+    return *interned_it;
+  }
+
+  char* copy = static_cast<char*>(this->resource.allocate(text.size(), alignof(char)));
+  std::copy(text.begin(), text.end(), copy);
+  return *this->internedStrings.emplace(copy, text.size()).first;
+}
+
+[[nodiscard]] Rules RuleArena::makeRules() {
+  return Rules(&this->resource);
+}
+
+
+
+}
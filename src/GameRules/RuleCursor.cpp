@@ -0,0 +1,603 @@
+#include "RuleCursor.h"
+
+#include "Expression.h"
+#include "GameRules.h"
+#include "GameState.h"
+#include "RuleProgram.h"
+
+#include <algorithm>
+#include <charconv>
+#include <glog/logging.h>
+#include <string>
+#include <utility>
+
+namespace GameRules {
+
+
+
+// Most rule trees are shallow, this avoids regrowing the stack while they execute
+static constexpr std::size_t INITIAL_FRAME_CAPACITY = 8;
+
+RuleCursor::RuleCursor(const Rules& topLevelRules, GameState::GameState& gameState)
+  : topLevelRules(topLevelRules), gameState(gameState) {
+  this->frames.reserve(INITIAL_FRAME_CAPACITY);
+}
+
+RuleCursor::RuleCursor(Rule& rule, GameState::GameState& gameState)
+  : gameState(gameState) {
+  this->frames.reserve(INITIAL_FRAME_CAPACITY);
+  this->frames.push_back({.rule = &rule});
+}
+
+RuleCursor::RuleCursor(const RuleProgram& program, GameState::GameState& gameState)
+  : gameState(gameState)
+  , program(&program)
+  , scopedPlayers(program.scopeDepthCount, 0) {}
+
+[[nodiscard]] RuleExecutionResult RuleCursor::run() {
+  if (this->hasFailed) {
+    return RuleExecutionResult::FAILURE;
+  }
+
+  if (this->program != nullptr) {
+    return this->runProgram();
+  }
+
+  while (true) {
+    // The rule which started the branches is only stepped again once they have all completed
+    RuleStep step = this->branches.empty() ? RuleStep::COMPLETE : this->runBranches();
+    if (step == RuleStep::COMPLETE) {
+      step = this->runFrames(this->frames, this->topLevelRules, this->nextTopLevelRule);
+    }
+
+    switch (step) {
+    case RuleStep::COMPLETE:
+      return RuleExecutionResult::SUCCESS;
+
+    case RuleStep::BRANCH:
+      break;
+
+    case RuleStep::SUSPEND:
+      return RuleExecutionResult::SUSPENDED;
+
+    case RuleStep::CALL:
+    case RuleStep::FAIL:
+      LOG(ERROR) << "Rule failed to execute";
+      this->abandon();
+      return RuleExecutionResult::FAILURE;
+    }
+  }
+}
+
+[[nodiscard]] bool RuleCursor::isFinished() const {
+  if (this->program != nullptr) {
+    return this->hasFailed || this->programCounter == this->program->instructions.size();
+  }
+  return this->hasFailed
+    || (this->frames.empty() && this->nextTopLevelRule == this->topLevelRules.size());
+}
+
+[[nodiscard]] std::vector<const InputRequest*> RuleCursor::getPendingInputs() const {
+  std::vector<const InputRequest*> requests;
+  if (this->pendingInput.has_value()) {
+    requests.push_back(&*this->pendingInput);
+  }
+  for (const RuleBranch& branch : this->branches) {
+    if (branch.pendingInput.has_value()) {
+      requests.push_back(&*branch.pendingInput);
+    }
+  }
+  return requests;
+}
+
+[[nodiscard]] bool RuleCursor::provideInput(GameState::PlayerID playerID, std::string_view text) {
+  auto isFromPlayer = [playerID](const std::optional<InputRequest>& request) {
+    return request.has_value() && request->playerID == playerID;
+  };
+  std::optional<InputRequest>* pendingInput = &this->pendingInput;
+  std::optional<GameState::VariableValue>* providedInput = &this->providedInput;
+  if (!isFromPlayer(*pendingInput)) {
+    auto branch = std::find_if(this->branches.begin(), this->branches.end(), [&isFromPlayer](const RuleBranch& branch) {
+      return isFromPlayer(branch.pendingInput);
+    });
+    if (branch == this->branches.end()) {
+      return false;
+    }
+    pendingInput = &branch->pendingInput;
+    providedInput = &branch->providedInput;
+  }
+
+  // The input takes the type of the variable it is stored in, so text is only a number
+  // when the variable holds one
+  if ((*pendingInput)->defaultValue.isString()) {
+    pendingInput->reset();
+    *providedInput = GameState::VariableValue(text);
+    return true;
+  }
+
+  GameState::Integer value = 0;
+  const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (error != std::errc() || end != text.data() + text.size()) {
+    return false;
+  }
+
+  pendingInput->reset();
+  *providedInput = value;
+  return true;
+}
+
+[[nodiscard]] bool RuleCursor::expireInput(std::size_t requestNumber) {
+  auto expire = [requestNumber](std::optional<InputRequest>& pendingInput,
+                                std::optional<GameState::VariableValue>& providedInput) {
+    if (!pendingInput.has_value() || pendingInput->requestNumber != requestNumber) {
+      return false;
+    }
+    providedInput = pendingInput->defaultValue;
+    pendingInput.reset();
+    return true;
+  };
+
+  if (expire(this->pendingInput, this->providedInput)) {
+    return true;
+  }
+  return std::any_of(this->branches.begin(), this->branches.end(), [&expire](RuleBranch& branch) {
+    return expire(branch.pendingInput, branch.providedInput);
+  });
+}
+
+[[nodiscard]] std::string RuleCursor::takeOutput() {
+  return std::exchange(this->output, {});
+}
+
+[[nodiscard]] GameState::GameState& RuleCursor::getGameState() {
+  return this->gameState;
+}
+
+void RuleCursor::call(Rule& rule) {
+  this->calledRule = &rule;
+}
+
+[[nodiscard]] bool RuleCursor::branch(const Rules& rules, std::string_view elementName) {
+  if (this->runningBranch != nullptr) {
+    return false;
+  }
+
+  this->branchRules = rules;
+  this->branchScopeDepth = this->gameState.getScopeDepth();
+  this->branches.clear();
+  this->branches.resize(this->gameState.getPlayerIDs().size());
+  for (GameState::PlayerIndex player = 0; player < this->branches.size(); ++player) {
+    this->branches[player].scopes.push_back({GameState::VariableKey(elementName), player});
+  }
+  return true;
+}
+
+void RuleCursor::requestInput(InputRequest request) {
+  std::optional<InputRequest>& pendingInput =
+    this->runningBranch != nullptr ? this->runningBranch->pendingInput : this->pendingInput;
+  std::optional<GameState::VariableValue>& providedInput =
+    this->runningBranch != nullptr ? this->runningBranch->providedInput : this->providedInput;
+
+  providedInput.reset();
+  request.requestNumber = ++this->inputRequestCount;
+  pendingInput = std::move(request);
+}
+
+[[nodiscard]] std::optional<GameState::VariableValue> RuleCursor::takeInput() {
+  std::optional<GameState::VariableValue>& providedInput =
+    this->runningBranch != nullptr ? this->runningBranch->providedInput : this->providedInput;
+  return std::exchange(providedInput, std::nullopt);
+}
+
+void RuleCursor::addOutput(std::string_view message) {
+  this->output.append(message);
+  this->output.push_back('\n');
+}
+
+void RuleCursor::abandon() {
+  // Branches keep their scopes to themselves while they are not running, so only need dropping
+  this->branches.clear();
+  for (auto frame = this->frames.rbegin(); frame != this->frames.rend(); ++frame) {
+    if (frame->hasScope) {
+      this->gameState.popScope();
+    }
+  }
+  this->frames.clear();
+  this->pendingInput.reset();
+  this->hasFailed = true;
+}
+
+
+
+/******************************************************************************
+ *                                 Snapshots                                  *
+ ******************************************************************************/
+static void numberRules(std::span<const RulePtr> rules, std::size_t& nextIndex) {
+  for (const RulePtr& rule : rules) {
+    rule->setTreeIndex(nextIndex++);
+    numberRules(rule->getChildren(), nextIndex);
+  }
+}
+
+void numberRules(const Rules& rules) {
+  std::size_t nextIndex = 0;
+  numberRules(std::span<const RulePtr>(rules), nextIndex);
+}
+
+// Lists every rule in the tree in the order numberRules numbers them
+static void collectRules(std::span<const RulePtr> rules, std::vector<Rule*>& ordered) {
+  for (const RulePtr& rule : rules) {
+    ordered.push_back(rule.get());
+    collectRules(rule->getChildren(), ordered);
+  }
+}
+
+static void writeFrames(GameState::SnapshotWriter& writer, const std::vector<RuleFrame>& frames) {
+  writer.writeUnsigned(frames.size());
+  for (const RuleFrame& frame : frames) {
+    // Rules that were never numbered, i.e. outside a parsed spec, are written as invalid
+    writer.writeUnsigned(frame.rule->getTreeIndex());
+    writer.writeUnsigned(frame.element);
+    writer.writeUnsigned(frame.child);
+    writer.writeUnsigned(frame.scopeDepth);
+    writer.writeBool(frame.hasScope);
+    writer.writeBool(frame.isEntered);
+  }
+}
+
+static void readFrames(GameState::SnapshotReader& reader,
+                       std::vector<RuleFrame>& frames,
+                       const std::vector<Rule*>& ordered) {
+  frames.resize(reader.readCount());
+  for (RuleFrame& frame : frames) {
+    const std::size_t rule = reader.readUnsigned();
+    frame.rule = rule < ordered.size() ? ordered[rule] : nullptr;
+    frame.element = reader.readUnsigned();
+    frame.child = reader.readUnsigned();
+    frame.scopeDepth = reader.readUnsigned();
+    frame.hasScope = reader.readBool();
+    frame.isEntered = reader.readBool();
+    if (frame.rule == nullptr || frame.child > frame.rule->getChildren().size()) {
+      reader.fail();
+    }
+  }
+}
+
+static void writeInput(GameState::SnapshotWriter& writer,
+                       const std::optional<InputRequest>& pendingInput,
+                       const std::optional<GameState::VariableValue>& providedInput) {
+  writer.writeBool(pendingInput.has_value());
+  if (pendingInput.has_value()) {
+    writer.writeUnsigned(pendingInput->playerID);
+    writer.writeString(pendingInput->prompt);
+    writer.writeBool(pendingInput->timeout.has_value());
+    if (pendingInput->timeout.has_value()) {
+      writer.writeSigned(pendingInput->timeout->count());
+    }
+    writer.writeValue(pendingInput->defaultValue);
+    writer.writeUnsigned(pendingInput->requestNumber);
+  }
+  writer.writeBool(providedInput.has_value());
+  if (providedInput.has_value()) {
+    writer.writeValue(*providedInput);
+  }
+}
+
+static void readInput(GameState::SnapshotReader& reader,
+                      std::optional<InputRequest>& pendingInput,
+                      std::optional<GameState::VariableValue>& providedInput) {
+  pendingInput.reset();
+  if (reader.readBool()) {
+    InputRequest& request = pendingInput.emplace();
+    request.playerID = reader.readUnsigned();
+    request.prompt = reader.readString();
+    if (reader.readBool()) {
+      request.timeout = std::chrono::milliseconds(reader.readSigned());
+    }
+    request.defaultValue = reader.readValue();
+    request.requestNumber = reader.readUnsigned();
+  }
+  providedInput.reset();
+  if (reader.readBool()) {
+    providedInput = reader.readValue();
+  }
+}
+
+void RuleCursor::writeSnapshot(GameState::SnapshotWriter& writer) const {
+  writer.writeBool(this->program != nullptr);
+  if (this->program != nullptr) {
+    writer.writeUnsigned(this->programCounter);
+    writer.writeUnsigned(this->scopedPlayers.size());
+    for (const GameState::PlayerIndex player : this->scopedPlayers) {
+      writer.writeUnsigned(player);
+    }
+    writer.writeBool(this->isAwaitingProgramInput);
+  } else {
+    writer.writeUnsigned(this->nextTopLevelRule);
+    writeFrames(writer, this->frames);
+    // Branches run the children of the rule which started them, the last of the frames
+    writer.writeUnsigned(this->branches.size());
+    if (!this->branches.empty()) {
+      writer.writeUnsigned(this->branchScopeDepth);
+    }
+    for (const RuleBranch& branch : this->branches) {
+      writeFrames(writer, branch.frames);
+      writer.writeUnsigned(branch.nextRule);
+      writer.writeUnsigned(branch.scopes.size());
+      for (const GameState::GameState::ScopeVariable& scope : branch.scopes) {
+        writer.writeString(scope.name);
+        writer.writeUnsigned(scope.playerIndex);
+      }
+      writeInput(writer, branch.pendingInput, branch.providedInput);
+    }
+  }
+
+  writeInput(writer, this->pendingInput, this->providedInput);
+  writer.writeUnsigned(this->inputRequestCount);
+  writer.writeString(this->output);
+  writer.writeBool(this->hasFailed);
+}
+
+[[nodiscard]] bool RuleCursor::readSnapshot(GameState::SnapshotReader& reader) {
+  if (reader.readBool() != (this->program != nullptr)) {
+    reader.fail();
+  } else if (this->program != nullptr) {
+    this->programCounter = reader.readUnsigned();
+    this->scopedPlayers.resize(reader.readCount());
+    for (GameState::PlayerIndex& player : this->scopedPlayers) {
+      player = reader.readUnsigned();
+    }
+    this->isAwaitingProgramInput = reader.readBool();
+    if (this->programCounter > this->program->instructions.size()
+        || this->scopedPlayers.size() != this->program->scopeDepthCount) {
+      reader.fail();
+    }
+  } else {
+    std::vector<Rule*> ordered;
+    collectRules(this->topLevelRules, ordered);
+
+    this->nextTopLevelRule = reader.readUnsigned();
+    readFrames(reader, this->frames, ordered);
+    this->branches.resize(reader.readCount());
+    if (!this->branches.empty()) {
+      this->branchScopeDepth = reader.readUnsigned();
+      if (this->frames.empty() || this->frames.back().rule == nullptr) {
+        reader.fail();
+      } else {
+        this->branchRules = this->frames.back().rule->getChildren();
+      }
+    }
+    for (RuleBranch& branch : this->branches) {
+      readFrames(reader, branch.frames, ordered);
+      branch.nextRule = reader.readUnsigned();
+      branch.scopes.resize(reader.readCount());
+      for (GameState::GameState::ScopeVariable& scope : branch.scopes) {
+        scope.name = reader.readString();
+        scope.playerIndex = reader.readUnsigned();
+      }
+      readInput(reader, branch.pendingInput, branch.providedInput);
+      if (branch.nextRule > this->branchRules.size()) {
+        reader.fail();
+      }
+    }
+    if (this->nextTopLevelRule > this->topLevelRules.size()) {
+      reader.fail();
+    }
+  }
+
+  readInput(reader, this->pendingInput, this->providedInput);
+  this->inputRequestCount = reader.readUnsigned();
+  this->output = reader.readString();
+  this->hasFailed = reader.readBool();
+
+  if (!reader.isValid()) {
+    LOG(ERROR) << "Rule cursor snapshot is corrupt or for different rules";
+    this->frames.clear();
+    this->branches.clear();
+    this->hasFailed = true;
+    return false;
+  }
+  return true;
+}
+
+
+
+/******************************************************************************
+ *                                Tree Walker                                 *
+ ******************************************************************************/
+// Steps the rules until they have all completed, one of them fails, waits for input or branches
+[[nodiscard]] RuleStep
+RuleCursor::runFrames(std::vector<RuleFrame>& frames, std::span<const RulePtr> rules, std::size_t& nextRule) {
+  while (true) {
+    if (frames.empty()) {
+      if (nextRule == rules.size()) {
+        return RuleStep::COMPLETE;
+      }
+      frames.push_back({.rule = rules[nextRule++].get()});
+    }
+
+    // Rules only record the child they call, so this frame stays valid until the push below
+    RuleFrame& frame = frames.back();
+    switch (const RuleStep step = frame.rule->stepRule(*this, frame)) {
+    case RuleStep::COMPLETE:
+      frames.pop_back();
+      break;
+
+    case RuleStep::CALL:
+      frames.push_back({.rule = std::exchange(this->calledRule, nullptr)});
+      break;
+
+    // The frame stays, to be stepped again when resumed
+    case RuleStep::SUSPEND:
+    case RuleStep::BRANCH:
+    case RuleStep::FAIL:
+      return step;
+    }
+  }
+}
+
+// Gives each branch a turn, until all have completed or the rest are waiting for input
+[[nodiscard]] RuleStep RuleCursor::runBranches() {
+  bool isWaiting = false;
+  for (RuleBranch& branch : this->branches) {
+    if (branch.frames.empty() && branch.nextRule == this->branchRules.size()) {
+      continue;
+    }
+
+    this->gameState.swapScopes(this->branchScopeDepth, branch.scopes);
+    this->runningBranch = &branch;
+    const RuleStep step = this->runFrames(branch.frames, this->branchRules, branch.nextRule);
+    this->runningBranch = nullptr;
+    this->gameState.swapScopes(this->branchScopeDepth, branch.scopes);
+
+    if (step == RuleStep::FAIL) {
+      return RuleStep::FAIL;
+    }
+    isWaiting = isWaiting || step == RuleStep::SUSPEND;
+  }
+
+  if (isWaiting) {
+    return RuleStep::SUSPEND;
+  }
+  this->branches.clear();
+  return RuleStep::COMPLETE;
+}
+
+
+
+/******************************************************************************
+ *                                Interpreter                                 *
+ ******************************************************************************/
+[[nodiscard]] RuleExecutionResult RuleCursor::runProgram() {
+  const std::vector<Instruction>& instructions = this->program->instructions;
+  const GameState::PlayerIDList& playerIDs = this->gameState.getPlayerIDs();
+  std::size_t pc = this->programCounter;
+
+  auto fail = [this, &pc](const char* reason) {
+    LOG(ERROR) << "Instruction " << pc << " failed to execute: " << reason;
+    this->programCounter = pc;
+    this->abandon();
+    return RuleExecutionResult::FAILURE;
+  };
+
+  while (pc < instructions.size()) {
+    const Instruction& instruction = instructions[pc];
+    switch (instruction.op) {
+    case OpCode::ADD_VARIABLE: {
+      const GameState::GetVariableResult current = this->gameState.getVariableValue(instruction.slot);
+      if (!current.wasSuccessful || !current.value.isInteger()
+          || this->gameState.setVariableValue(instruction.slot, current.value.getInteger() + instruction.value)
+             == GameState::SetVariableResult::FAILURE) {
+        return fail("no such integer variable");
+      }
+      ++pc;
+      break;
+    }
+
+    case OpCode::ADD_PLAYER_VARIABLE: {
+      const GameState::PlayerIndex playerIndex = this->scopedPlayers[instruction.scopeDepth];
+      const GameState::GetVariableResult current = this->gameState.getPlayerVariableValue(playerIndex, instruction.slot);
+      if (!current.wasSuccessful || !current.value.isInteger()
+          || this->gameState.setPlayerVariableValue(playerIndex, instruction.slot,
+                                                    current.value.getInteger() + instruction.value)
+             == GameState::SetVariableResult::FAILURE) {
+        return fail("no such integer player variable");
+      }
+      ++pc;
+      break;
+    }
+
+    case OpCode::MESSAGE:
+      this->addOutput(this->program->messages[instruction.operand]);
+      ++pc;
+      break;
+
+    case OpCode::FOR_EACH_PLAYER:
+      if (playerIDs.empty()) {
+        pc = instruction.operand;
+      } else {
+        this->scopedPlayers[instruction.scopeDepth] = 0;
+        ++pc;
+      }
+      break;
+
+    case OpCode::NEXT_PLAYER:
+      if (++this->scopedPlayers[instruction.scopeDepth] < playerIDs.size()) {
+        pc = instruction.operand;
+      } else {
+        ++pc;
+      }
+      break;
+
+    case OpCode::JUMP_UNLESS: {
+      auto readValue = [this](const GameState::VariablePath& path) { return this->getProgramValue(path); };
+      const GameState::GetVariableResult condition =
+        this->program->conditions[instruction.slot]->evaluate(readValue, playerIDs.size());
+      const std::optional<bool> holds = condition.wasSuccessful ? condition.value.asCondition() : std::nullopt;
+      if (!holds.has_value()) {
+        return fail("condition could not be evaluated");
+      }
+      pc = *holds ? pc + 1 : instruction.operand;
+      break;
+    }
+
+    case OpCode::JUMP:
+      pc = instruction.operand;
+      break;
+
+    case OpCode::INPUT_TEXT: {
+      const ProgramInput& input = this->program->inputs[instruction.operand];
+
+      // First time here: ask the targetted user for input, and suspend until it arrives
+      if (!this->isAwaitingProgramInput) {
+        const GameState::GetVariableResult current = this->getProgramValue(input.result);
+        if (!current.wasSuccessful) {
+          return fail("no such input result variable");
+        }
+        this->requestInput({
+          .playerID = playerIDs[this->scopedPlayers[input.targetScopeDepth]],
+          .prompt = std::string(input.prompt),
+          .timeout = input.timeout,
+          .defaultValue = current.value,
+        });
+        this->isAwaitingProgramInput = true;
+      }
+
+      const std::optional<GameState::VariableValue> value = this->takeInput();
+      if (!value.has_value()) {
+        this->programCounter = pc;
+        return RuleExecutionResult::SUSPENDED;
+      }
+      if (this->setProgramValue(input.result, std::move(*value)) == GameState::SetVariableResult::FAILURE) {
+        return fail("no such input result variable");
+      }
+      this->isAwaitingProgramInput = false;
+      ++pc;
+      break;
+    }
+    }
+  }
+
+  this->programCounter = pc;
+  return RuleExecutionResult::SUCCESS;
+}
+
+[[nodiscard]] GameState::GetVariableResult
+RuleCursor::getProgramValue(const GameState::VariablePath& path) const {
+  if (path.kind == GameState::VariablePath::Kind::PER_PLAYER) {
+    return this->gameState.getPlayerVariableValue(this->scopedPlayers[path.scopeDepth], path.slot);
+  }
+  return this->gameState.getValue(path);
+}
+
+[[nodiscard]] GameState::SetVariableResult
+RuleCursor::setProgramValue(const GameState::VariablePath& path, GameState::VariableValue value) {
+  if (path.kind == GameState::VariablePath::Kind::PER_PLAYER) {
+    return this->gameState.setPlayerVariableValue(this->scopedPlayers[path.scopeDepth], path.slot, std::move(value));
+  }
+  return this->gameState.setValue(path, std::move(value));
+}
+
+
+
+}
@@ -0,0 +1,91 @@
+#include "RuleProgram.h"
+
+#include "GameRules.h"
+#include "GameState.h"
+
+#include <algorithm>
+#include <glog/logging.h>
+#include <limits>
+#include <string_view>
+#include <utility>
+
+namespace GameRules {
+
+
+
+RuleCompiler::RuleCompiler(const GameState::VariableLayout& layout)
+  : layout(layout) {}
+
+[[nodiscard]] bool RuleCompiler::compileRules(const Rules& rules) {
+  return std::all_of(rules.begin(), rules.end(), [this](const RulePtr& rule) {
+    return rule->compileRule(*this);
+  });
+}
+
+[[nodiscard]] RuleProgram RuleCompiler::takeProgram() {
+  return std::exchange(this->program, {});
+}
+
+[[nodiscard]] const GameState::VariableLayout& RuleCompiler::getLayout() const {
+  return this->layout;
+}
+
+std::size_t RuleCompiler::emit(Instruction instruction) {
+  this->program.instructions.push_back(instruction);
+  return this->program.instructions.size() - 1;
+}
+
+[[nodiscard]] std::size_t RuleCompiler::getNextAddress() const {
+  return this->program.instructions.size();
+}
+
+void RuleCompiler::setJumpTarget(std::size_t address, std::size_t target) {
+  this->program.instructions[address].operand = static_cast<uint32_t>(target);
+}
+
+[[nodiscard]] uint32_t RuleCompiler::addMessage(std::string_view message) {
+  this->program.messages.push_back(message);
+  return static_cast<uint32_t>(this->program.messages.size() - 1);
+}
+
+[[nodiscard]] uint32_t RuleCompiler::addCondition(const Expression& condition) {
+  this->program.conditions.push_back(&condition);
+  return static_cast<uint32_t>(this->program.conditions.size() - 1);
+}
+
+[[nodiscard]] uint32_t RuleCompiler::addInput(ProgramInput input) {
+  this->program.inputs.push_back(std::move(input));
+  return static_cast<uint32_t>(this->program.inputs.size() - 1);
+}
+
+[[nodiscard]] std::size_t RuleCompiler::pushScope() {
+  const std::size_t depth = this->scopeDepth++;
+  this->program.scopeDepthCount = std::max(this->program.scopeDepthCount, this->scopeDepth);
+  return depth;
+}
+
+void RuleCompiler::popScope() {
+  --this->scopeDepth;
+}
+
+
+[[nodiscard]] std::optional<RuleProgram> compileRules(const Rules& rules, const GameState::VariableLayout& layout) {
+  RuleCompiler compiler = RuleCompiler(layout);
+  if (!compiler.compileRules(rules)) {
+    LOG(INFO) << "Rules could not be compiled, they will be executed as a tree";
+    return std::nullopt;
+  }
+
+  RuleProgram program = compiler.takeProgram();
+  // Operands are 32 bits to keep instructions small
+  if (program.instructions.size() > std::numeric_limits<uint32_t>::max()
+      || program.scopeDepthCount > std::numeric_limits<uint16_t>::max()) {
+    LOG(INFO) << "Rules are too large to compile, they will be executed as a tree";
+    return std::nullopt;
+  }
+  return program;
+}
+
+
+
+}
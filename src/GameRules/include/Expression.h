@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
+
+#include "GameState.h"
+
+namespace GameRules {
+
+
+
+enum class ExpressionOp : uint8_t {
+  CONSTANT,      // value
+  VARIABLE,      // The value at path
+  PLAYER_COUNT,  // players.size
+  NOT,           // !lhs
+  NEGATE,        // -lhs
+  SIZE,          // lhs.size, of a string, list or map
+  ADD,
+  SUBTRACT,
+  MULTIPLY,
+  DIVIDE,
+  MODULO,
+  EQUAL,
+  NOT_EQUAL,
+  LESS,
+  LESS_EQUAL,
+  GREATER,
+  GREATER_EQUAL,
+  AND,           // Only evaluates rhs when lhs is true
+  OR,            // Only evaluates rhs when lhs is false
+};
+
+struct ExpressionNode {
+  ExpressionOp op;
+  uint32_t lhs = 0;  // Operands, as indices of other nodes in the same expression
+  uint32_t rhs = 0;
+  GameState::VariableValue value = {};
+  GameState::VariablePath path = {};
+};
+
+
+/**
+ * A condition or value written in a game spec, i.e. "round < rounds && !winner.isChosen",
+ * parsed once when the spec is loaded (see JsonParser::ExpressionParser).
+ *
+ * Variables are resolved to slots ahead of time, so evaluating an expression is a walk
+ * over its nodes which neither parses nor allocates. Comparisons and logical operators
+ * give booleans, and integers count as true when non-zero. Applying an operator to
+ * values it is not defined on, i.e. adding a list, fails the evaluation.
+ */
+class Expression {
+public:
+  // Operands come before the nodes using them, so the last node is the root
+  Expression(std::string_view source, std::pmr::vector<ExpressionNode> nodes);
+
+  // The expression as written in the spec, for logging
+  [[nodiscard]] std::string_view getSource() const { return this->source; }
+
+  [[nodiscard]] GameState::GetVariableResult evaluate(const GameState::GameState& gameState) const;
+
+  // Evaluates against values read through readValue(const VariablePath&) -> GetVariableResult
+  template <typename ValueReader>
+  [[nodiscard]] GameState::GetVariableResult evaluate(const ValueReader& readValue, std::size_t playerCount) const {
+    return this->evaluateNode(this->nodes.size() - 1, readValue, playerCount);
+  }
+
+private:
+  std::string_view source;
+  std::pmr::vector<ExpressionNode> nodes;
+
+  template <typename ValueReader>
+  [[nodiscard]] GameState::GetVariableResult
+  evaluateNode(std::size_t index, const ValueReader& readValue, std::size_t playerCount) const {
+    using GameState::Integer;
+    using GameState::VariableValue;
+    const ExpressionNode& node = this->nodes[index];
+
+    switch (node.op) {
+    case ExpressionOp::CONSTANT:
+      return {.wasSuccessful = true, .value = node.value};
+    case ExpressionOp::VARIABLE:
+      return readValue(node.path);
+    case ExpressionOp::PLAYER_COUNT:
+      return {.wasSuccessful = true, .value = static_cast<Integer>(playerCount)};
+    default:
+      break;
+    }
+
+    const GameState::GetVariableResult lhs = this->evaluateNode(node.lhs, readValue, playerCount);
+    if (!lhs.wasSuccessful) {
+      return {};
+    }
+
+    switch (node.op) {
+    case ExpressionOp::NOT: {
+      const std::optional<bool> condition = lhs.value.asCondition();
+      if (!condition.has_value()) {
+        return {};
+      }
+      return {.wasSuccessful = true, .value = !*condition};
+    }
+    case ExpressionOp::NEGATE:
+      if (!lhs.value.isInteger() || lhs.value.getInteger() == std::numeric_limits<Integer>::min()) {
+        return {};
+      }
+      return {.wasSuccessful = true, .value = -lhs.value.getInteger()};
+    case ExpressionOp::SIZE: {
+      const std::optional<std::size_t> size = lhs.value.size();
+      if (!size.has_value() || *size > static_cast<std::size_t>(std::numeric_limits<Integer>::max())) {
+        return {};
+      }
+      return {.wasSuccessful = true, .value = static_cast<Integer>(*size)};
+    }
+    case ExpressionOp::AND:
+    case ExpressionOp::OR: {
+      const std::optional<bool> condition = lhs.value.asCondition();
+      if (!condition.has_value()) {
+        return {};
+      }
+      if (*condition == (node.op == ExpressionOp::OR)) {
+        return {.wasSuccessful = true, .value = *condition};
+      }
+      const GameState::GetVariableResult rhs = this->evaluateNode(node.rhs, readValue, playerCount);
+      const std::optional<bool> rhsCondition = rhs.wasSuccessful ? rhs.value.asCondition() : std::nullopt;
+      if (!rhsCondition.has_value()) {
+        return {};
+      }
+      return {.wasSuccessful = true, .value = *rhsCondition};
+    }
+    default:
+      break;
+    }
+
+    const GameState::GetVariableResult rhs = this->evaluateNode(node.rhs, readValue, playerCount);
+    if (!rhs.wasSuccessful) {
+      return {};
+    }
+
+    switch (node.op) {
+    case ExpressionOp::EQUAL:
+      return {.wasSuccessful = true, .value = lhs.value == rhs.value};
+    case ExpressionOp::NOT_EQUAL:
+      return {.wasSuccessful = true, .value = !(lhs.value == rhs.value)};
+    case ExpressionOp::LESS:
+    case ExpressionOp::LESS_EQUAL:
+    case ExpressionOp::GREATER:
+    case ExpressionOp::GREATER_EQUAL:
+      return compare(node.op, lhs.value, rhs.value);
+    default:
+      break;
+    }
+
+    // Arithmetic is only defined on integers, and fails rather than overflowing
+    if (!lhs.value.isInteger() || !rhs.value.isInteger()) {
+      return {};
+    }
+    const Integer lhsInteger = lhs.value.getInteger();
+    const Integer rhsInteger = rhs.value.getInteger();
+    Integer result = 0;
+    switch (node.op) {
+    case ExpressionOp::ADD:
+      if (__builtin_add_overflow(lhsInteger, rhsInteger, &result)) {
+        return {};
+      }
+      break;
+    case ExpressionOp::SUBTRACT:
+      if (__builtin_sub_overflow(lhsInteger, rhsInteger, &result)) {
+        return {};
+      }
+      break;
+    case ExpressionOp::MULTIPLY:
+      if (__builtin_mul_overflow(lhsInteger, rhsInteger, &result)) {
+        return {};
+      }
+      break;
+    case ExpressionOp::DIVIDE:
+    case ExpressionOp::MODULO:
+      if (rhsInteger == 0 || (lhsInteger == std::numeric_limits<Integer>::min() && rhsInteger == -1)) {
+        return {};
+      }
+      result = node.op == ExpressionOp::DIVIDE ? lhsInteger / rhsInteger : lhsInteger % rhsInteger;
+      break;
+    default:
+      return {};
+    }
+    return {.wasSuccessful = true, .value = result};
+  }
+
+  // Orders two integers, or two strings alphabetically
+  [[nodiscard]] static GameState::GetVariableResult
+  compare(ExpressionOp op, const GameState::VariableValue& lhs, const GameState::VariableValue& rhs);
+};
+
+
+
+} // namespace GameRules
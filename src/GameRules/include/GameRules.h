@@ -1,10 +1,17 @@
 #pragma once
 
+#include <chrono>
+#include <limits>
 #include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
+#include "Expression.h"
 #include "GameState.h"
 
 namespace GameRules {
@@ -12,22 +19,70 @@ namespace GameRules {
 
 
 class Rule;
-using RulePtr = std::unique_ptr<Rule>;
-using Rules = std::vector<RulePtr>;
+
+// Rules made by a RuleArena are only destroyed, their memory is released with the arena
+struct RuleDeleter {
+  RuleDeleter() = default;
+  explicit RuleDeleter(bool isArenaAllocated) : isArenaAllocated(isArenaAllocated) {}
+  // Allows rules made with std::make_unique to be held as a RulePtr
+  template <typename RuleType>
+  RuleDeleter(std::default_delete<RuleType>) {}
+
+  void operator()(Rule* rule) const;
+
+  bool isArenaAllocated = false;
+};
+
+using RulePtr = std::unique_ptr<Rule, RuleDeleter>;
+using Rules = std::pmr::vector<RulePtr>;
+
+class RuleCursor;
+struct RuleFrame;
+class RuleCompiler;
 
 enum class RuleExecutionResult {
   SUCCESS,
   FAILURE,
+  SUSPENDED,  // Waiting for input, see RuleCursor
+};
+
+// What a rule did when stepped by a RuleCursor
+enum class RuleStep {
+  COMPLETE,  // The rule is done
+  CALL,      // The rule called a child with RuleCursor::call(), step it again once the child completes
+  SUSPEND,   // The rule is waiting for input, step it again once input arrives
+  BRANCH,    // The rule started branches with RuleCursor::branch(), step it again once they all complete
+  FAIL,
 };
 
+// Rules keep views of the strings they are given, so those must outlive the rule (see RuleArena)
 class Rule {
 public:
   Rule() = default;
+  virtual ~Rule() = default;
 
+  // Runs the rule to completion. Rules which wait for input fail here, they need a RuleCursor.
   [[nodiscard]] RuleExecutionResult executeRule(GameState::GameState& gameState) {
     return executeRuleImpl(gameState);
   }
+
+  // Advances the rule by one step within a cursor. Rules are shared by every game playing
+  // the same spec, so any progress through the rule must be kept in its frame.
+  [[nodiscard]] virtual RuleStep stepRule(RuleCursor& cursor, RuleFrame& frame);
+
+  // Emits the rule's bytecode, returning false if the rule has no bytecode form
+  [[nodiscard]] virtual bool compileRule(RuleCompiler& compiler) const;
+
+  // The rules this rule calls, in the order they were written
+  [[nodiscard]] virtual std::span<const RulePtr> getChildren() const { return {}; }
+
+  // The rule's position in its tree, by which snapshots refer to it. Set by numberRules.
+  static constexpr std::size_t NOT_IN_TREE = std::numeric_limits<std::size_t>::max();
+  [[nodiscard]] std::size_t getTreeIndex() const { return treeIndex; }
+  void setTreeIndex(std::size_t index) { treeIndex = index; }
 private:
+  std::size_t treeIndex = NOT_IN_TREE;
+
   [[nodiscard]] virtual RuleExecutionResult executeRuleImpl(GameState::GameState& gameState) = 0;
 };
 
@@ -35,10 +90,12 @@ private:
 class AddRule : public Rule {
 public:
   // TODO: For now we only support integers as the value - we should support variable names, and floats in the future
-  AddRule(const GameState::VariableKey targetVariableName, GameState::VariableValue value);
+  AddRule(const GameState::VariablePath targetVariable, GameState::Integer value);
+
+  [[nodiscard]] bool compileRule(RuleCompiler& compiler) const override;
 private:
-  const GameState::VariableKey addTarget;  // Variable name of an integer to add to
-  const GameState::VariableValue value;  // Constant containing the value to add
+  const GameState::VariablePath addTarget;  // Variable of an integer to add to
+  const GameState::Integer value;  // Constant containing the value to add
 
   [[nodiscard]] RuleExecutionResult executeRuleImpl(GameState::GameState& gameState);
 };
@@ -46,9 +103,12 @@ private:
 
 class GlobalMessageRule : public Rule {
 public:
-  GlobalMessageRule(const std::string messageValue);
+  GlobalMessageRule(std::string_view messageValue);
+
+  [[nodiscard]] RuleStep stepRule(RuleCursor& cursor, RuleFrame& frame) override;
+  [[nodiscard]] bool compileRule(RuleCompiler& compiler) const override;
 private:
-  std::string messageValue; // Value of message to send  // TODO: const?
+  const std::string_view messageValue; // Value of message to send
 
   [[nodiscard]] RuleExecutionResult executeRuleImpl(GameState::GameState& gameState);
 };
@@ -56,9 +116,14 @@ private:
 
 class LoopRule : public Rule {
 public:
-  LoopRule(std::string stopCondition, Rules rulesToExecuteEachIteration);
+  // Repeats the rules for as long as the condition holds, checking it before each iteration
+  LoopRule(Expression condition, Rules rulesToExecuteEachIteration);
+
+  [[nodiscard]] RuleStep stepRule(RuleCursor& cursor, RuleFrame& frame) override;
+  [[nodiscard]] bool compileRule(RuleCompiler& compiler) const override;
+  [[nodiscard]] std::span<const RulePtr> getChildren() const override { return this->rulesToExecuteEachIteration; }
 private:
-  std::string stopCondition; // Condition that may fail
+  const Expression condition;
   Rules rulesToExecuteEachIteration;
 
   [[nodiscard]] RuleExecutionResult executeRuleImpl(GameState::GameState& gameState);
@@ -68,13 +133,19 @@ private:
 class InputTextRule : public Rule {
 public:
   // TODO: Add handling for audience members
-  InputTextRule(const std::string targettedUser,
-                const std::string inputPrompt,
-                const std::string resultVariable);
+  // Without a timeout the game waits on the targetted user for as long as it takes
+  InputTextRule(const GameState::VariablePath targettedUser,
+                std::string_view inputPrompt,
+                const GameState::VariablePath resultVariable,
+                const std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+
+  [[nodiscard]] RuleStep stepRule(RuleCursor& cursor, RuleFrame& frame) override;
+  [[nodiscard]] bool compileRule(RuleCompiler& compiler) const override;
 private:
-  const std::string targettedUser; // TODO-#57: Alias
-  const std::string inputPrompt; // TODO-#57: Alias
-  const std::string resultVariable; // TODO-#57: alias
+  const GameState::VariablePath targettedUser;
+  const std::string_view inputPrompt; // TODO-#57: Alias
+  const GameState::VariablePath resultVariable;
+  const std::optional<std::chrono::milliseconds> timeout;
 
   [[nodiscard]] RuleExecutionResult executeRuleImpl(GameState::GameState& gameState);
 };
@@ -83,12 +154,36 @@ private:
 class ForEachRule : public Rule {
 public:
   // TODO: Add handling for non-user lists
-  ForEachRule(const GameState::VariableKey& listName,
-              const GameState::VariableKey& listElementName,
+  ForEachRule(std::string_view listName,
+              std::string_view listElementName,
               Rules rulesToExecuteEachElement);
+
+  [[nodiscard]] RuleStep stepRule(RuleCursor& cursor, RuleFrame& frame) override;
+  [[nodiscard]] bool compileRule(RuleCompiler& compiler) const override;
+  [[nodiscard]] std::span<const RulePtr> getChildren() const override { return this->rulesToExecuteEachElement; }
+private:
+  const std::string_view listName;
+  const std::string_view listElementName;
+  Rules rulesToExecuteEachElement;
+
+  [[nodiscard]] RuleExecutionResult executeRuleImpl(GameState::GameState& gameState);
+};
+
+
+class ParallelForRule : public Rule {
+public:
+  // Runs the rules for every player at once, i.e. all players are prompted together,
+  // and completes once they have finished for all of them
+  // TODO: Add handling for non-user lists
+  ParallelForRule(std::string_view listName,
+                  std::string_view listElementName,
+                  Rules rulesToExecuteEachElement);
+
+  [[nodiscard]] RuleStep stepRule(RuleCursor& cursor, RuleFrame& frame) override;
+  [[nodiscard]] std::span<const RulePtr> getChildren() const override { return this->rulesToExecuteEachElement; }
 private:
-  const GameState::VariableKey listName;
-  const GameState::VariableKey listElementName;
+  const std::string_view listName;
+  const std::string_view listElementName;
   Rules rulesToExecuteEachElement;
 
   [[nodiscard]] RuleExecutionResult executeRuleImpl(GameState::GameState& gameState);
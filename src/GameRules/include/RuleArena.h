@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+
+#include "GameRules.h"
+
+namespace GameRules {
+
+
+
+/**
+ * Owns the rules of one game spec along with the strings they refer to.
+ *
+ * Everything is bump allocated from large blocks, so a spec's rules sit close
+ * together in memory, and are freed all at once with the arena rather than
+ * node by node. Rules made by the arena are only destroyed by their RulePtr,
+ * so the arena must outlive every rule and string it hands out.
+ */
+class RuleArena {
+public:
+  RuleArena();
+  RuleArena(const RuleArena&) = delete;
+  RuleArena& operator=(const RuleArena&) = delete;
+
+  // Returns a copy of the string which lives as long as the arena, equal strings share one copy
+  [[nodiscard]] std::string_view intern(std::string_view text);
+
+  template <typename RuleType, typename... Args>
+  [[nodiscard]] RulePtr makeRule(Args&&... args) {
+    void* memory = this->resource.allocate(sizeof(RuleType), alignof(RuleType));
+    return RulePtr(::new (memory) RuleType(std::forward<Args>(args)...), RuleDeleter(true));
+  }
+
+  // An empty list of rules whose storage comes from the arena
+  [[nodiscard]] Rules makeRules();
+
+  // For anything else which belongs with the rules, such as their expressions
+  [[nodiscard]] std::pmr::memory_resource* getResource() { return &this->resource; }
+
+private:
+  std::pmr::monotonic_buffer_resource resource;
+  std::pmr::unordered_set<std::string_view> internedStrings;
+};
+
+
+
+} // namespace GameRules
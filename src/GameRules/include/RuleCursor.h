@@ -0,0 +1,144 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "GameRules.h"
+#include "GameState.h"
+#include "RuleProgram.h"
+#include "Snapshot.h"
+
+namespace GameRules {
+
+
+
+// A player that a suspended game is waiting on
+struct InputRequest {
+  GameState::PlayerID playerID;
+  std::string prompt;
+  std::optional<std::chrono::milliseconds> timeout = std::nullopt;
+  GameState::VariableValue defaultValue;  // Taken as the input if the player runs out of time
+  std::size_t requestNumber = 0;              // Numbers the requests of one cursor, set by the cursor
+};
+
+// The progress of one rule within a RuleCursor
+struct RuleFrame {
+  Rule* rule;
+  std::size_t element = 0;      // Index of the list element being visited
+  std::size_t child = 0;        // Index of the next child rule to call
+  std::size_t scopeDepth = 0;   // Scope pushed by this rule, valid while hasScope is set
+  bool hasScope = false;
+  bool isEntered = false;
+};
+
+// One player's run through the rules of a parallelFor, interleaved with the runs of the others
+struct RuleBranch {
+  std::vector<RuleFrame> frames;
+  std::size_t nextRule = 0;
+  GameState::GameState::Scopes scopes;  // The branch's forEach elements, kept here while it is not running
+  std::optional<InputRequest> pendingInput;
+  std::optional<GameState::VariableValue> providedInput;
+};
+
+// Numbers every rule in the tree depth first for snapshots to refer to, which gives the
+// same numbers for every load of a spec. Rules are shared by every game playing the spec,
+// so this must happen before they are.
+void numberRules(const Rules& rules);
+
+// Executes rules with an explicit stack of frames instead of the C++ call stack,
+// so a game can be suspended part way through a rule tree while it waits for
+// input, and resumed later from any thread without blocking one in the meantime.
+// A cursor over a RuleProgram interprets its bytecode instead, and suspends the same way.
+// A parallelFor splits the cursor into a branch per player, which take turns running until
+// each completes or waits for input, so the game can wait on several players at once.
+class RuleCursor {
+public:
+  RuleCursor(const Rules& topLevelRules, GameState::GameState& gameState);
+  RuleCursor(Rule& rule, GameState::GameState& gameState);
+  RuleCursor(const RuleProgram& program, GameState::GameState& gameState);
+
+  // Runs until every rule has completed, a rule fails, or a rule waits for input
+  [[nodiscard]] RuleExecutionResult run();
+
+  [[nodiscard]] bool isFinished() const;
+
+  // The requests the game is waiting on, at most one per player
+  [[nodiscard]] std::vector<const InputRequest*> getPendingInputs() const;
+
+  // Hands input to the rule that requested it, run() again to continue the game.
+  // Returns false if the input is not from a player being waited on or is not a number.
+  [[nodiscard]] bool provideInput(GameState::PlayerID playerID, std::string_view text);
+
+  // Hands a pending request its default value, if it is still pending
+  [[nodiscard]] bool expireInput(std::size_t requestNumber);
+
+  // Returns and clears the messages rules have sent to the players
+  [[nodiscard]] std::string takeOutput();
+
+  // Gives up on the rules still executing, taking their variables back out of scope
+  void abandon();
+
+  // Snapshots record how far the rules have got, referring to rules by their position in
+  // the rule tree. One is restored into a new cursor over the same top-level rules or
+  // program, and a GameState restored from the snapshot taken alongside it.
+  void writeSnapshot(GameState::SnapshotWriter& writer) const;
+  [[nodiscard]] bool readSnapshot(GameState::SnapshotReader& reader);
+
+  /*****************************************************************************
+   *                       For use by rules being stepped                      *
+   *****************************************************************************/
+  [[nodiscard]] GameState::GameState& getGameState();
+
+  void call(Rule& rule);
+
+  // Starts a branch running the rules for each player, with the player in scope as elementName.
+  // Returns false if the calling rule is itself in a branch.
+  [[nodiscard]] bool branch(const Rules& rules, std::string_view elementName);
+
+  void requestInput(InputRequest request);
+
+  [[nodiscard]] std::optional<GameState::VariableValue> takeInput();
+
+  void addOutput(std::string_view message);
+
+private:
+  [[nodiscard]] RuleStep runFrames(std::vector<RuleFrame>& frames, std::span<const RulePtr> rules, std::size_t& nextRule);
+  [[nodiscard]] RuleStep runBranches();
+  [[nodiscard]] RuleExecutionResult runProgram();
+  [[nodiscard]] GameState::GetVariableResult getProgramValue(const GameState::VariablePath& path) const;
+  [[nodiscard]] GameState::SetVariableResult setProgramValue(const GameState::VariablePath& path,
+                                                             GameState::VariableValue value);
+
+  std::span<const RulePtr> topLevelRules;
+  std::size_t nextTopLevelRule = 0;
+  GameState::GameState& gameState;
+
+  std::vector<RuleFrame> frames;
+  Rule* calledRule = nullptr;
+
+  // Only used while a parallelFor is running
+  std::vector<RuleBranch> branches;
+  std::span<const RulePtr> branchRules;
+  std::size_t branchScopeDepth = 0;      // Scopes below this are shared by every branch
+  RuleBranch* runningBranch = nullptr;   // Whose input requests rules are making
+
+  // Only used when running a program
+  const RuleProgram* program = nullptr;
+  std::size_t programCounter = 0;
+  std::vector<GameState::PlayerIndex> scopedPlayers;  // The player bound to each forEach depth
+  bool isAwaitingProgramInput = false;
+
+  std::optional<InputRequest> pendingInput;
+  std::size_t inputRequestCount = 0;
+  std::optional<GameState::VariableValue> providedInput;
+  std::string output;
+  bool hasFailed = false;
+};
+
+
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "Expression.h"
+#include "GameRules.h"
+#include "GameState.h"
+
+namespace GameRules {
+
+
+
+// The bytecode operations a RuleProgram is made of, see RuleCursor::runProgram for what each does
+enum class OpCode : uint8_t {
+  ADD_VARIABLE,         // variables[slot] += value
+  ADD_PLAYER_VARIABLE,  // the scopeDepth element's variables[slot] += value
+  MESSAGE,              // Sends messages[operand]
+  FOR_EACH_PLAYER,      // Binds the first player to scopeDepth, or jumps to operand if there are none
+  NEXT_PLAYER,          // Binds the next player to scopeDepth and jumps to operand, unless it was the last
+  JUMP_UNLESS,          // Jumps to operand unless conditions[slot] holds
+  JUMP,                 // Jumps to operand
+  INPUT_TEXT,           // Waits for inputs[operand]
+};
+
+struct Instruction {
+  OpCode op;
+  uint16_t scopeDepth = 0;
+  uint32_t slot = 0;
+  uint32_t operand = 0;
+  GameState::Integer value = 0;
+};
+
+// Operands of an INPUT_TEXT instruction, which are too big to keep inline
+struct ProgramInput {
+  std::size_t targetScopeDepth;
+  GameState::VariablePath result;
+  std::string_view prompt;
+  std::optional<std::chrono::milliseconds> timeout;
+};
+
+// A rule tree lowered into one flat array of instructions, run by a RuleCursor.
+// Strings and conditions are the rules' own, so the program must not outlive its rules.
+struct RuleProgram {
+  std::vector<Instruction> instructions;
+  std::vector<std::string_view> messages;
+  std::vector<const Expression*> conditions;
+  std::vector<ProgramInput> inputs;
+  std::size_t scopeDepthCount = 0;  // How deeply forEach rules nest
+};
+
+// Lowers rules into a RuleProgram, each rule emitting its own instructions with Rule::compileRule
+class RuleCompiler {
+public:
+  explicit RuleCompiler(const GameState::VariableLayout& layout);
+
+  // Returns false if any of the rules cannot be compiled
+  [[nodiscard]] bool compileRules(const Rules& rules);
+  [[nodiscard]] RuleProgram takeProgram();
+
+  /*****************************************************************************
+   *                       For use by rules being compiled                     *
+   *****************************************************************************/
+  [[nodiscard]] const GameState::VariableLayout& getLayout() const;
+
+  // Returns the address of the emitted instruction
+  std::size_t emit(Instruction instruction);
+  [[nodiscard]] std::size_t getNextAddress() const;
+  void setJumpTarget(std::size_t address, std::size_t target);
+
+  [[nodiscard]] uint32_t addMessage(std::string_view message);
+  [[nodiscard]] uint32_t addCondition(const Expression& condition);
+  [[nodiscard]] uint32_t addInput(ProgramInput input);
+
+  // forEach rules put their element in scope at the returned depth while compiling their children
+  [[nodiscard]] std::size_t pushScope();
+  void popScope();
+
+private:
+  const GameState::VariableLayout& layout;
+  RuleProgram program;
+  std::size_t scopeDepth = 0;
+};
+
+// Returns nothing if the rules use anything the compiler does not support, they can still be executed as a tree
+[[nodiscard]] std::optional<RuleProgram> compileRules(const Rules& rules, const GameState::VariableLayout& layout);
+
+
+
+}
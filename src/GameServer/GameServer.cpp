@@ -8,73 +8,154 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <iterator>
 #include "Client.h"
 #include "GameData.h"
 #include "GameRules.h"
 #include "GameState.h"
 #include "JsonParser.h"
+#include "Protocol.h"
 #include "ServerConfig.h"
 
 
 void GameServer::setupConfig() {
-    ServerConfig config{"../social-gaming/data/serverconfig.json"};
-
     std::string gameName;
     std::cout << "Please specify the game you would like to play\n";
     std::cin >> gameName;
-    GameData::GameData gameData = config.parseGamefile(gameName);
-    // is valid will also check if game exists
-    if (!config.isValid()) {
+    if (!configure("../social-gaming/data/serverconfig.json", gameName)) {
         LOG(ERROR) << "Invalid server configuration";
         google::ShutdownGoogleLogging();
         std::exit(1);
     }
+}
+
+bool GameServer::configure(const std::string& configFilepath, const std::string& gameName) {
+    this->config = std::make_unique<ServerConfig>(configFilepath);
+    ServerConfig& config = *this->config;
+
+    if (!config.isValid()) {
+        return false;
+    }
+    // The game played by default must exist and have a valid spec
+    Lobby::GameDataPtr gameData = config.parseGamefile(gameName);
+    if (gameData == nullptr) {
+        return false;
+    }
 
     this->port = config.getPort();
     this->serverHtml = config.getServerHtml();
+    this->serverOptions = config.getServerOptions();
     this->inviteCode = config.generateInviteCode();
-    this->gameData = std::move(gameData);
+    this->gameWorkerCount = config.getGameWorkerCount();
+    this->snapshotDirectory = config.getSnapshotDirectory();
+    this->lobbies = Lobby::LobbyManager(this->inviteCode, gameName, std::move(gameData),
+        [this](const Lobby::InviteCode& closedInviteCode) {
+            if (shardPool != nullptr) {
+                shardPool->post({.kind = Lobby::LobbyTask::Kind::CLOSE, .inviteCode = closedInviteCode});
+            }
+        },
+        [this](const Lobby::InviteCode& lobbyInviteCode, GameState::PlayerID playerID) {
+            if (shardPool != nullptr) {
+                shardPool->post({.kind = Lobby::LobbyTask::Kind::LEAVE, .inviteCode = lobbyInviteCode, .playerID = playerID});
+            }
+        });
     LOG(INFO) << "Validated server configuration file... Launching server";
     LOG(INFO) << "Clients can connect with invite code " + inviteCode;
+    return true;
 }
 
-void GameServer::removeDisconnectedUser(const networking::Connection& c) {
-    for (auto user : users) {
-        if (user.getConnection() == c) {
-            auto beginErase = std::remove(std::begin(users), std::end(users), user);
-            users.erase(beginErase, std::end(users));
-            return;
+/**
+ * Starts the shards that play the lobbies' games, keeping the games in the snapshot
+ * directory when the config names one, and resumes the games kept there when the
+ * server last stopped. A resumed game's players take their places back by joining its
+ * lobby under the nickname they played with.
+ *
+ * @param onOutput called from whichever thread a game produced output on
+ */
+void GameServer::startGames(Lobby::ShardPool::OutputHandler onOutput) {
+    if (!this->snapshotDirectory.empty()) {
+        this->snapshotStore = std::make_unique<Lobby::SnapshotStore>(this->snapshotDirectory);
+    }
+    this->shardPool = std::make_unique<Lobby::ShardPool>(this->gameWorkerCount, std::move(onOutput), this->snapshotStore.get());
+    if (this->snapshotStore == nullptr) {
+        return;
+    }
+
+    // How long the players of a resumed game have to join back before it stops waiting on them
+    const std::chrono::minutes REJOIN_TIMEOUT{2};
+    for (auto& stored : Lobby::SnapshotStore::loadAll(this->snapshotDirectory)) {
+        Lobby::GameDataPtr gameData = config->parseGamefile(stored.gameName);
+        if (gameData == nullptr) {
+            LOG(WARNING) << "Cannot resume the game of lobby " << stored.inviteCode << ", no game named " << stored.gameName;
+            continue;
         }
+        // Players take their places back by joining with the nickname they played under
+        lobbies.restoreLobby(stored.inviteCode, stored.gameName, gameData, stored.playerNames,
+                             std::chrono::steady_clock::now() + REJOIN_TIMEOUT);
+        LOG(INFO) << "Resuming the game of lobby " << stored.inviteCode;
+        shardPool->post({
+            .kind = Lobby::LobbyTask::Kind::RESTORE,
+            .inviteCode = stored.inviteCode,
+            .gameData = std::move(gameData),
+            .gameName = std::move(stored.gameName),
+            .playerNames = std::move(stored.playerNames),
+            .text = std::move(stored.snapshot),
+            .log = std::move(stored.log),
+        });
     }
 }
 
+// Workers must be finished with the games, and the store with their snapshots, before either goes away
+void GameServer::stopGames() {
+    this->shardPool.reset();
+    this->snapshotStore.reset();
+}
+
+/**
+ * Hands the output of the lobbies' games to their lobbies, adding the text to their logs
+ * and returning the variables each game changed.
+ */
+LobbyDeltas GameServer::collectGameOutputs(LobbyLogs& lobbyLogs) {
+    LobbyDeltas lobbyDeltas;
+    for (auto& output : shardPool->takeOutputs()) {
+        lobbyLogs[output.inviteCode] += output.text;
+        if (Lobby::Lobby* lobby = lobbies.findLobby(output.inviteCode); lobby != nullptr) {
+            lobby->setAwaitingInputFrom(std::move(output.awaitingInputFrom));
+        }
+        if (!output.stateDelta.empty()) {
+            Lobby::StateDelta& delta = lobbyDeltas[output.inviteCode];
+            delta.insert(delta.end(), std::make_move_iterator(output.stateDelta.begin()),
+                         std::make_move_iterator(output.stateDelta.end()));
+        }
+    }
+    return lobbyDeltas;
+}
+
 void GameServer::onConnect(const networking::Connection& c) {
     LOG(INFO) << "New connection found: " << c.id;
-    clients.push_back(c);
-    User user = User(c);
-    users.push_back(user);
+    users.try_emplace(c.id, c);
+    // Everyone starts in the default lobby until they create or join another
+    lobbies.joinLobby(c, lobbies.getDefaultLobby().getInviteCode());
 }
 
 void GameServer::onDisconnect(const networking::Connection& c) {
     LOG(INFO) << "Connection lost: " << c.id;
-    auto eraseBegin = std::remove(std::begin(clients), std::end(clients), c);
-    clients.erase(eraseBegin, std::end(clients));
-    removeDisconnectedUser(c);
+    lobbies.leaveLobby(c);
+    users.erase(c.id);
 }
 
 /**
- * Changes the value of the user's nickname in the User object in the `users` vector.
- * Makes no changes if the user does not exist in the vector.
+ * Changes the value of the user's nickname in the User object in the `users` map.
+ * Makes no changes if the user does not exist in the map.
  *
  * @param id id of the users Connection object's
  * @param nickname A string of the new nickname
  */
 void GameServer::changeUserNickname(uintptr_t id, std::string& nickname) {
-    for (auto& user : users) {
-        if (user.userConnection.id == id) {
-            user.nickname = nickname;
-            return;
-        }
+    auto found = users.find(id);
+    if (found != users.end()) {
+        found->second.nickname = nickname;
+        return;
     }
     LOG(ERROR) << "Attempted to change the nickname of a user not presently connected.";
 }
@@ -88,21 +169,20 @@ void GameServer::changeUserNickname(uintptr_t id, std::string& nickname) {
  * @returns the nickname of the user or an empty string
  */
 std::string GameServer::getUserNickname(uintptr_t id) {
-    for (auto user : users) {
-        if (user.userConnection.id == id) {
-            return user.nickname;
-        }
+    auto found = users.find(id);
+    if (found != users.end()) {
+        return found->second.nickname;
     }
     LOG(ERROR) << "Attempted to get the nickname of a user not presently connected. Returning empty string.";
     return "";
 }
 
-std::deque<networking::Message> GameServer::buildOutgoing(const std::string& log) {
-    std::deque<networking::Message> outgoing;
-    for (auto client : clients) {
-        outgoing.push_back({client, log});
+Lobby::PlayerNames GameServer::getPlayerNames(const Lobby::Lobby& lobby) {
+    Lobby::PlayerNames playerNames;
+    for (const networking::Connection& member : lobby.getMembers()) {
+        playerNames.push_back({lobby.getPlayerID(member), getUserNickname(member.id)});
     }
-    return outgoing;
+    return playerNames;
 }
 
 std::string GameServer::getHTTPMessage(const char* htmlLocation) {
@@ -118,104 +198,236 @@ std::string GameServer::getHTTPMessage(const char* htmlLocation) {
 
 MessageResult GameServer::processMessages(networking::Server& server,
                                           const std::deque<networking::Message>& incoming) {
-    const char COMMAND_PREFIX = '/';
-    std::ostringstream result;
+    LobbyLogs lobbyLogs;
     bool quit = false;
 
     for (auto& message : incoming) {
+        // Whatever a message causes is only seen by the lobby its sender ends up in
+        std::ostringstream result;
         auto displayName = getUserNickname(message.connection.id);
+        if (message.type == networking::MessageType::BINARY) {
+            markBinaryClient(message.connection.id);
+        }
 
-        if (message.text == "quit") {
+        const std::optional<Lobby::Command> command = Lobby::decodeCommand(message);
+        if (!command.has_value()) {
+            result << displayName << "> command not found.\n";
+        } else if (command->kind == Lobby::MessageKind::QUIT) {
             server.disconnect(message.connection);
-        } else if (message.text == "shutdown") {
+        } else if (command->kind == Lobby::MessageKind::SHUTDOWN) {
             LOG(INFO) << "Shutting down";
             quit = true;
-        } else if (message.text.at(0) == COMMAND_PREFIX) {
-            // TODO-#58: Refactor to address string manipulation and reduce complexity
-            const auto command = message.text.substr(1, message.text.find(' ') - 1);
-
-            if (command == "nickname") {
-                auto nickname = message.text.substr(message.text.find(' ') + 1);
-                changeUserNickname(message.connection.id, nickname);
-
-                // Send conformation message that nickname has been chnaged
-                result << displayName << " has changed their name to: " << nickname << ".\n";
-            } 
-            else if (command == "execute") {
-                if (!gameData.isValid) {
-                    result << "\tCannot execute game - not yet loaded\n";
-                }
-                else {
-                    result << "Found cmd: execute (Execute game)\n";
-                    // TODO-#45: Move this logic into a module separate from the command handling section
-                    result << "\tExecuting loaded game\n";
-
-                    // TODO-#57: Move this little mechanism for converting users to IDs to somewhere else
-                    //           once input/output is implemented
-                    GameState::PlayerIDList playerIDs = {};
-                    std::transform(users.begin(),
-                                   users.end(),
-                                   std::back_inserter(playerIDs),
-                                   [](User& user) {
-                                       return user.getConnection().id;
-                                   });
-                    GameState::GameState gameState = GameState::GameState(gameData.variableMap,
-                                                                          playerIDs,
-                                                                          gameData.perPlayerVariableMap);
-
-                    // TODO-#51: Just to demonstrate that the rule is doing something, can remove later
-                    result << "\tdebug_target variable BEFORE executing rules: "
-                           << gameState.getValue("debug_target").value << "\n";
-
-                        for (const auto& rule : this->gameData.topLevelRules) {
-                            if (rule->executeRule(gameState) == GameRules::RuleExecutionResult::FAILURE) {
-                                LOG(ERROR) << "Top level rule failed to execute";
-                                break;
-                            }
-                        }
-                    
-                    // TODO-#51: Just to demonstrate that the rule is doing something, can remove later
-                    result << "\tdebug_target variable AFTER executing rules: "
-                           << gameState.getValue("debug_target").value << "\n";
-
-                    result << "\tGame finished executing.\n";
-                }
-            } 
+        } else if (command->kind == Lobby::MessageKind::NICKNAME) {
+            std::string nickname{command->argument};
+            changeUserNickname(message.connection.id, nickname);
+
+            // Send conformation message that nickname has been chnaged
+            result << displayName << " has changed their name to: " << nickname << ".\n";
+        } else if (command->kind == Lobby::MessageKind::CREATE) {
+            const std::string gameName{command->argument};
+            Lobby::GameDataPtr gameData = config->parseGamefile(gameName);
+            if (gameData == nullptr) {
+                result << displayName << "> no game named " << gameName << ".\n";
+            }
             else {
-                result << displayName << "> command not found.\n";
+                Lobby::Lobby& lobby = lobbies.createLobby(gameName, std::move(gameData));
+                lobbies.joinLobby(message.connection, lobby.getInviteCode());
+                result << displayName << " created a lobby playing " << gameName
+                       << ". Others can join with invite code " << lobby.getInviteCode() << "\n";
+            }
+        } else if (command->kind == Lobby::MessageKind::JOIN) {
+            Lobby::Lobby* lobby = lobbies.joinLobby(message.connection, Lobby::InviteCode{command->argument});
+            if (lobby == nullptr) {
+                result << displayName << "> no lobby has invite code " << command->argument << ".\n";
+            }
+            else if (lobby->reclaimPlayer(message.connection, displayName)) {
+                result << displayName << " has rejoined the game.\n";
+            }
+            else {
+                result << displayName << " has joined the lobby.\n";
+            }
+        } else if (command->kind == Lobby::MessageKind::EXECUTE) {
+            Lobby::Lobby* lobby = lobbies.findLobbyOf(message.connection);
+            if (lobby != nullptr) {
+                result << "Found cmd: execute (Execute game)\n";
+                // The game's own output reaches the lobby once its shard has played it
+                shardPool->post({
+                    .kind = Lobby::LobbyTask::Kind::EXECUTE,
+                    .inviteCode = lobby->getInviteCode(),
+                    .gameData = lobby->getGameData(),
+                    .gameName = lobby->getGameName(),
+                    .playerIDs = lobby->getPlayerIDs(),
+                    .playerNames = getPlayerNames(*lobby),
+                });
+            }
+        } else if (command->kind == Lobby::MessageKind::CHAT) {
+            // A game waiting on this player takes the message as its input, which may be a
+            // secret answer, so only the sender hears that it arrived
+            Lobby::Lobby* lobby = lobbies.findLobbyOf(message.connection);
+            const GameState::PlayerID playerID = lobby != nullptr ? lobby->getPlayerID(message.connection) : 0;
+            if (lobby != nullptr && lobby->isAwaitingInputFrom(playerID)) {
+                lobby->stopAwaitingInputFrom(playerID);
+                shardPool->post({
+                    .kind = Lobby::LobbyTask::Kind::INPUT,
+                    .inviteCode = lobby->getInviteCode(),
+                    .playerID = playerID,
+                    .text = std::string{command->argument},
+                });
+                server.send({networking::Message{message.connection, "Input received.\n"}});
+            }
+            else {
+                result << displayName << "> " << command->argument << "\n";
             }
         } else {
-            result << displayName << "> " << message.text << "\n";
+            result << displayName << "> command not found.\n";
+        }
+
+        Lobby::Lobby* lobby = lobbies.findLobbyOf(message.connection);
+        if (lobby != nullptr) {
+            lobbyLogs[lobby->getInviteCode()] += result.str();
         }
     }
-    return MessageResult{result.str(), quit};
+    return MessageResult{std::move(lobbyLogs), quit};
+}
+
+void GameServer::markBinaryClient(uintptr_t id) {
+    auto found = users.find(id);
+    if (found != users.end()) {
+        found->second.isBinaryClient = true;
+    }
+}
+
+/**
+ * Sends a game's changed variables to each member of its lobby, encoded the way that
+ * member talks to the server. Each encoding is shared by all members that use it.
+ */
+void GameServer::multicastStateDelta(networking::Server& server,
+                                     const std::vector<networking::Connection>& members,
+                                     const Lobby::StateDelta& delta) {
+    std::vector<networking::Connection> textMembers;
+    std::vector<networking::Connection> binaryMembers;
+    for (const auto& member : members) {
+        auto found = users.find(member.id);
+        bool isBinaryClient = found != users.end() && found->second.isBinaryClient;
+        (isBinaryClient ? binaryMembers : textMembers).push_back(member);
+    }
+
+    if (!textMembers.empty()) {
+        server.multicast(textMembers, std::make_shared<const std::string>(Lobby::encodeStateDelta(delta)));
+    }
+    if (!binaryMembers.empty()) {
+        server.multicast(binaryMembers, std::make_shared<const std::string>(Lobby::encodeStateUpdate(delta)),
+                         networking::MessageType::BINARY);
+    }
+}
+
+/**
+ * Logs how well compression worked for a connection that is going away, when the
+ * server compresses at all.
+ */
+void GameServer::logChannelStatistics(const networking::Server& server, const networking::Connection& c) {
+    if (!this->serverOptions.compression.enabled) {
+        return;
+    }
+    if (const auto statistics = server.getChannelStatistics(c); statistics.has_value()) {
+        LOG(INFO) << "Connection " << c.id << " sent " << statistics->messageBytesSent << " bytes of messages as "
+                  << statistics->wireBytesSent << " bytes, a compression ratio of " << statistics->getCompressionRatio()
+                  << ", using " << std::chrono::duration_cast<std::chrono::microseconds>(statistics->codingTime).count()
+                  << "us of CPU time";
+    }
+}
+
+void GameServer::recordBroadcastLatencies(const std::deque<networking::Message>& incoming) {
+    const auto broadcastAt = std::chrono::steady_clock::now();
+    for (const auto& message : incoming) {
+        broadcastLatencies.record(broadcastAt - message.receivedAt);
+    }
+}
+
+/**
+ * Logs the median and 99th percentile input-to-broadcast latency observed
+ * since the last time they were logged, then starts counting afresh.
+ */
+void GameServer::logBroadcastLatencies() {
+    broadcastLatenciesLoggedAt = std::chrono::steady_clock::now();
+    if (broadcastLatencies.getCount() == 0) {
+        return;
+    }
+
+    LOG(INFO) << "Input-to-broadcast latency over " << broadcastLatencies.getCount() << " messages: "
+              << "p50 " << broadcastLatencies.percentile(0.50).count() << "us, "
+              << "p99 " << broadcastLatencies.percentile(0.99).count() << "us, "
+              << "max " << broadcastLatencies.getMax().count() << "us";
+    broadcastLatencies = {};
 }
 
 void GameServer::run() {
     networking::Server server(
         this->port, this->serverHtml,
         [this](networking::Connection& c) { onConnect(c); },
-        [this](networking::Connection& c) { onDisconnect(c); });
+        [this, &server](networking::Connection& c) {
+            logChannelStatistics(server, c);
+            onDisconnect(c);
+        },
+        this->serverOptions);
+
+    // Finished games wake the loop so that their output goes out without waiting for traffic
+    startGames([&server] { server.wake(); });
+
+    // Upper bound on how long the loop sleeps while waiting for network events
+    const std::chrono::milliseconds EVENT_WAIT_TIMEOUT{1000};
+    // How often the latencies of the messages since are logged
+    const std::chrono::seconds LATENCY_LOG_INTERVAL{60};
+    broadcastLatenciesLoggedAt = std::chrono::steady_clock::now();
 
     while (true) {
+        // Without game workers, input deadlines expire on this thread, so it must not sleep through them
+        auto eventWaitTimeout = EVENT_WAIT_TIMEOUT;
+        if (const auto deadline = shardPool->getNextDeadline(); deadline.has_value()) {
+            const auto untilDeadline = std::chrono::ceil<std::chrono::milliseconds>(*deadline - std::chrono::steady_clock::now());
+            eventWaitTimeout = std::clamp(untilDeadline, std::chrono::milliseconds::zero(), EVENT_WAIT_TIMEOUT);
+        }
+
         bool errorWhileUpdating = false;
         try {
-            server.update();
+            server.update(eventWaitTimeout);
         } catch (std::exception& e) {
             LOG(ERROR) << "Exception from Server update: " << e.what();
             errorWhileUpdating = true;
         }
 
         auto incoming = server.receive();
-        auto [log, shouldQuit] = processMessages(server, incoming);
-        auto outgoing = buildOutgoing(log);
-        server.send(outgoing);
+        auto [lobbyLogs, shouldQuit] = processMessages(server, incoming);
+        shardPool->advanceTimers();
+        lobbies.expireAbsentPlayers(std::chrono::steady_clock::now());
+        LobbyDeltas lobbyDeltas = collectGameOutputs(lobbyLogs);
+        for (auto& [lobbyInviteCode, log] : lobbyLogs) {
+            Lobby::Lobby* lobby = lobbies.findLobby(lobbyInviteCode);
+            if (lobby != nullptr && !log.empty()) {
+                // Every member of the lobby shares the one copy of the log text
+                server.multicast(lobby->getMembers(), std::make_shared<const std::string>(std::move(log)));
+            }
+        }
+        // Clients are sent each game's changed variables once a tick, however many moves made them
+        for (const auto& [lobbyInviteCode, delta] : lobbyDeltas) {
+            if (Lobby::Lobby* lobby = lobbies.findLobby(lobbyInviteCode); lobby != nullptr) {
+                multicastStateDelta(server, lobby->getMembers(), delta);
+            }
+        }
+        recordBroadcastLatencies(incoming);
+        server.recycle(std::move(incoming));
+        if (std::chrono::steady_clock::now() - broadcastLatenciesLoggedAt >= LATENCY_LOG_INTERVAL) {
+            logBroadcastLatencies();
+        }
 
         if (shouldQuit || errorWhileUpdating) {
             break;
         }
-
-        sleep(1);
     }
+
+    // Workers must be finished with the server before it goes away
+    stopGames();
+
+    logBroadcastLatencies();
 }
 
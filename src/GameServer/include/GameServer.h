@@ -2,16 +2,29 @@
 
 #include <unistd.h>
 
+#include <chrono>
 #include <deque>
+#include <filesystem>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "LatencyHistogram.h"
+#include "Lobby.h"
+#include "ShardPool.h"
+#include "SnapshotStore.h"
 #include "Server.h"
 #include "ServerConfig.h"
 #include "User.h"
 
+// What happened in each lobby, keyed by the lobby's invite code
+using LobbyLogs = std::unordered_map<Lobby::InviteCode, std::string>;
+// What changed in each lobby's game, keyed the same way
+using LobbyDeltas = std::unordered_map<Lobby::InviteCode, Lobby::StateDelta>;
+
 struct MessageResult {
-    std::string result;
+    LobbyLogs results;
     bool shouldShutdown;
 };
 
@@ -28,25 +41,55 @@ class GameServer {
     void setupConfig();
     void run();
 
+    // The steps of run(), which can also drive the server without a network loop
+    [[nodiscard]] bool configure(const std::string& configFilepath, const std::string& gameName);
+    void startGames(Lobby::ShardPool::OutputHandler onOutput = {});
+    void stopGames();
+    void onConnect(const networking::Connection& c);
+    void onDisconnect(const networking::Connection& c);
+    MessageResult processMessages(networking::Server& server, const std::deque<networking::Message>& incoming);
+    LobbyDeltas collectGameOutputs(LobbyLogs& lobbyLogs);
+
   private:
     unsigned short port;
     std::string serverHtml;
     std::string inviteCode;
-    GameData::GameData gameData;
+    networking::ServerOptions serverOptions;
+    std::unique_ptr<ServerConfig> config;
+
+    // Every game session hosted by this server. Lobbies playing the same game share
+    // one parse of its spec, cached by the config.
+    Lobby::LobbyManager lobbies;
+
+    // Where the lobbies' games are played, only exists while the server is running
+    std::size_t gameWorkerCount = 0;
+    std::filesystem::path snapshotDirectory;  // Empty when games are not kept
+    std::unique_ptr<Lobby::SnapshotStore> snapshotStore;
+    std::unique_ptr<Lobby::ShardPool> shardPool;
 
-    void removeDisconnectedUser(const networking::Connection& c);
-    void onConnect(const networking::Connection& c);
-    void onDisconnect(const networking::Connection& c);
     void changeUserNickname(uintptr_t id, std::string& nickname);
   
 
     std::string getUserNickname(uintptr_t id);
+    Lobby::PlayerNames getPlayerNames(const Lobby::Lobby& lobby);
     std::string getHTTPMessage(const char* htmlLocation);
     std::string parseInviteCode(const std::string& inviteCode);
 
-    std::vector<networking::Connection> clients;
-    std::vector<User> users;
+    // Every connected user keyed by the id of their Connection. Being node
+    // based, references to a User stay valid until that user disconnects.
+    std::unordered_map<uintptr_t, User> users;
 
-    std::deque<networking::Message> buildOutgoing(const std::string& log);
-    MessageResult processMessages(networking::Server& server, const std::deque<networking::Message>& incoming);
+    void markBinaryClient(uintptr_t id);
+    void multicastStateDelta(networking::Server& server,
+                             const std::vector<networking::Connection>& members,
+                             const Lobby::StateDelta& delta);
+
+    // Time from a message being read off its connection until the resulting
+    // broadcast was handed back to the server, since the latencies were last logged
+    networking::LatencyHistogram broadcastLatencies;
+    std::chrono::steady_clock::time_point broadcastLatenciesLoggedAt;
+
+    void recordBroadcastLatencies(const std::deque<networking::Message>& incoming);
+    void logChannelStatistics(const networking::Server& server, const networking::Connection& c);
+    void logBroadcastLatencies();
 };
\ No newline at end of file
@@ -1,9 +1,13 @@
 #include "GameState.h"
 
+#include "Snapshot.h"
+
 #include <glog/logging.h>
 #include <unordered_map>
 #include <string>
 #include <algorithm>
+#include <iterator>
+#include <utility>
 
 
 
@@ -14,6 +18,18 @@ namespace GameState {
 /******************************************************************************
  *                   GameState Helper Functions Declarations                  *
  ******************************************************************************/
+// The changes a GameState appends to its log, each followed by its operands
+enum class LogRecord : uint8_t {
+  SET_VARIABLE,         // slot, value
+  SET_PLAYER_VARIABLE,  // playerIndex, slot, value
+  PUSH_SCOPE,           // name
+  BIND_SCOPE,           // scopeDepth, playerIndex
+  REMOVE_SCOPE,         // scopeDepth
+  REPLACE_SCOPES,       // baseDepth, count, then name and playerIndex of each scope above baseDepth
+};
+
+void writeLogRecord(SnapshotWriter& log, LogRecord record);
+
 NestedVariableKey parseRuntimeVariables(const GameState& gameState,
                                         NestedVariableKey rawNestedVariableName);
 std::pair<PlayerID, VariableKey>
@@ -21,27 +37,77 @@ extractPlayerVariableInfo(const GameState& gameState, NestedVariableKey nestedVa
 
 
 
+/******************************************************************************
+ *                         Symbol Table and Layout                            *
+ ******************************************************************************/
+VariableSlot SymbolTable::intern(const VariableKey& name) {
+  if (auto found = this->slots.find(name); found != this->slots.end()) {
+    return found->second;
+  }
+
+  const VariableSlot slot = this->names.size();
+  this->names.push_back(name);
+  this->slots.insert({name, slot});
+  return slot;
+}
+
+
+[[nodiscard]] std::optional<VariableSlot> SymbolTable::find(std::string_view name) const {
+  if (auto found = this->slots.find(name); found != this->slots.end()) {
+    return found->second;
+  }
+  return std::nullopt;
+}
+
+
+/**
+ * Assigns slots in name order, so that layouts built from equal maps always agree
+ */
+VariableLayout::VariableLayout(const VariableMap& variableMap,
+                               const VariableMap& perPlayerVariableMap,
+                               const VariableMap& constantMap) {
+  auto internSorted = [](const VariableMap& map, SymbolTable& symbols, std::vector<VariableValue>& defaults) {
+    std::vector<VariableKey> names;
+    names.reserve(map.size());
+    for (const auto& [name, _] : map) {
+      names.push_back(name);
+    }
+    std::sort(names.begin(), names.end());
+
+    defaults.reserve(names.size());
+    for (const auto& name : names) {
+      symbols.intern(name);
+      defaults.push_back(map.at(name));
+    }
+  };
+
+  internSorted(variableMap, this->variables, this->variableDefaults);
+  internSorted(perPlayerVariableMap, this->perPlayerVariables, this->perPlayerDefaults);
+  internSorted(constantMap, this->constants, this->constantValues);
+}
+
+
+
 /******************************************************************************
  *                          GameState Public Methods                          *
  ******************************************************************************/
 GameState::GameState(const VariableMap& variableMap,
                      const PlayerIDList& playerIDList,
                      const VariableMap& perPlayerVariableMap)
-  : variableMap(variableMap)
+  : GameState(std::make_shared<const VariableLayout>(variableMap, perPlayerVariableMap),
+              playerIDList) {}
+
+
+GameState::GameState(std::shared_ptr<const VariableLayout> layout,
+                     const PlayerIDList& playerIDList)
+  : layout(std::move(layout))
+  , playerIDs(playerIDList)
   , activeScopeVariables({}) {
-    // Initialize and construct perPlayer variables
-    // Data will end up looking like:
-    /*
-        {    playerIDs  :    perPlayerVariableMap
-          { "PLAYER_ID1": { "VAR1": 2, "VAR2": -1 } },
-          { "PLAYER_ID2": { "VAR1": 2, "VAR2": -1 } },
-          { "PLAYER_ID3": { "VAR1": 2, "VAR2": -1 } }
-        }
-    */
-    this->playerVariableMaps = {};
-    for (const PlayerID& playerID : playerIDList) {
-      this->playerVariableMaps.insert({std::to_string(playerID), perPlayerVariableMap});
-    }
+    // forEach rules nest only a few levels deep
+    this->activeScopeVariables.reserve(4);
+
+    // Values are left in the layout until they are first written, see setVariableValue
+    // and setPlayerVariableValue, so starting a game copies no variables
 }
 
 
@@ -87,53 +153,454 @@ GameState::setValue(NestedVariableKey rawNestedVariableName, VariableValue newVa
 }
 
 
-[[nodiscard]] PlayerIDList GameState::getPlayerIDs() const {
-  PlayerIDList playerIDs;
-  playerIDs.reserve(this->playerVariableMaps.size());
+[[nodiscard]] const PlayerIDList& GameState::getPlayerIDs() const {
+  return this->playerIDs;
+}
+
+
+[[nodiscard]] std::optional<PlayerIndex> GameState::findPlayerIndex(PlayerID playerID) const {
+  // Only lookups by name need the index, so it is built the first time one happens
+  if (this->playerIndices.empty()) {
+    this->playerIndices.reserve(this->playerIDs.size());
+    for (PlayerIndex index = 0; index < this->playerIDs.size(); ++index) {
+      this->playerIndices.insert({this->playerIDs[index], index});
+    }
+  }
+
+  if (auto found = this->playerIndices.find(playerID); found != this->playerIndices.end()) {
+    return found->second;
+  }
+  return std::nullopt;
+}
+
+
+////////////////////////////// Slot methods ///////////////////////////////
+[[nodiscard]] GetVariableResult GameState::getVariableValue(VariableSlot slot) const {
+  if (slot >= this->layout->variableDefaults.size()) {
+    LOG(ERROR) << "Variable slot " << slot << " is out of range";
+    return {};
+  }
+
+  return {
+    .wasSuccessful = true,
+    .value = this->variables.empty() ? this->layout->variableDefaults[slot] : this->variables[slot],
+  };
+}
+
+
+[[nodiscard]] SetVariableResult
+GameState::setVariableValue(VariableSlot slot, VariableValue newValue) {
+  if (slot >= this->layout->variableDefaults.size()) {
+    LOG(ERROR) << "Variable slot " << slot << " is out of range";
+    return SetVariableResult::FAILURE;
+  }
+
+  if (this->log != nullptr) {
+    writeLogRecord(*this->log, LogRecord::SET_VARIABLE);
+    this->log->writeUnsigned(slot);
+    this->log->writeValue(newValue);
+  }
+
+  if (this->isVariableChanged.empty()) {
+    this->isVariableChanged.resize(this->layout->variableDefaults.size());
+  }
+  if (!this->isVariableChanged[slot]) {
+    this->isVariableChanged[slot] = true;
+    this->changes.variables.push_back(slot);
+  }
+
+  // First write to any variable, take a copy of the defaults to write into
+  if (this->variables.empty()) {
+    this->variables = this->layout->variableDefaults;
+  }
+  this->variables[slot] = std::move(newValue);
+  return SetVariableResult::SUCCESS;
+}
+
+
+[[nodiscard]] GetVariableResult
+GameState::getPlayerVariableValue(PlayerIndex playerIndex, VariableSlot slot) const {
+  if (slot >= this->layout->perPlayerDefaults.size() || playerIndex >= this->playerIDs.size()) {
+    LOG(ERROR) << "Per-player variable slot " << slot << " or player index " << playerIndex << " is out of range";
+    return {};
+  }
+
+  const bool isWritten = slot < this->perPlayerVariables.size() && !this->perPlayerVariables[slot].empty();
+  return {
+    .wasSuccessful = true,
+    .value = isWritten ? this->perPlayerVariables[slot][playerIndex] : this->layout->perPlayerDefaults[slot],
+  };
+}
+
 
-  for (const auto& [playerID, _] : this->playerVariableMaps) {
-    playerIDs.push_back(std::stoul(playerID));
+[[nodiscard]] SetVariableResult
+GameState::setPlayerVariableValue(PlayerIndex playerIndex, VariableSlot slot, VariableValue newValue) {
+  if (slot >= this->layout->perPlayerDefaults.size() || playerIndex >= this->playerIDs.size()) {
+    LOG(ERROR) << "Per-player variable slot " << slot << " or player index " << playerIndex << " is out of range";
+    return SetVariableResult::FAILURE;
   }
 
-  return playerIDs;
+  if (this->log != nullptr) {
+    writeLogRecord(*this->log, LogRecord::SET_PLAYER_VARIABLE);
+    this->log->writeUnsigned(playerIndex);
+    this->log->writeUnsigned(slot);
+    this->log->writeValue(newValue);
+  }
+
+  if (this->isPlayerVariableChanged.empty()) {
+    this->isPlayerVariableChanged.resize(this->layout->perPlayerDefaults.size() * this->playerIDs.size());
+  }
+  if (const std::size_t flag = slot * this->playerIDs.size() + playerIndex; !this->isPlayerVariableChanged[flag]) {
+    this->isPlayerVariableChanged[flag] = true;
+    this->changes.playerVariables.push_back({playerIndex, slot});
+  }
+
+  // First write to this variable for any player, fill its column with the default to write into
+  if (this->perPlayerVariables.empty()) {
+    this->perPlayerVariables.resize(this->layout->perPlayerDefaults.size());
+  }
+  std::vector<VariableValue>& column = this->perPlayerVariables[slot];
+  if (column.empty()) {
+    column.assign(this->playerIDs.size(), this->layout->perPlayerDefaults[slot]);
+  }
+  column[playerIndex] = std::move(newValue);
+  return SetVariableResult::SUCCESS;
+}
+
+
+////////////////////////////// Path methods ///////////////////////////////
+[[nodiscard]] GetVariableResult GameState::getValue(const VariablePath& path) const {
+  switch (path.kind) {
+    case VariablePath::Kind::GLOBAL:
+      return getVariableValue(path.slot);
+    case VariablePath::Kind::CONSTANT:
+      if (path.slot >= this->layout->constantValues.size()) {
+        LOG(ERROR) << "Constant slot " << path.slot << " is out of range";
+        return {};
+      }
+      return {
+        .wasSuccessful = true,
+        .value = this->layout->constantValues[path.slot],
+      };
+    case VariablePath::Kind::PER_PLAYER: {
+      const std::optional<PlayerIndex> playerIndex = findScopedPlayer(path.scopeDepth);
+      if (!playerIndex) {
+        LOG(ERROR) << "No player in scope for " << path.name;
+        return {};
+      }
+      return getPlayerVariableValue(*playerIndex, path.slot);
+    }
+    default:
+      LOG(ERROR) << path.name << " does not refer to a variable";
+      return {};
+  }
+}
+
+
+[[nodiscard]] SetVariableResult GameState::setValue(const VariablePath& path, VariableValue newValue) {
+  switch (path.kind) {
+    case VariablePath::Kind::GLOBAL:
+      return setVariableValue(path.slot, std::move(newValue));
+    case VariablePath::Kind::CONSTANT:
+      LOG(ERROR) << path.name << " is a constant and cannot be changed";
+      return SetVariableResult::FAILURE;
+    case VariablePath::Kind::PER_PLAYER: {
+      const std::optional<PlayerIndex> playerIndex = findScopedPlayer(path.scopeDepth);
+      if (!playerIndex) {
+        LOG(ERROR) << "No player in scope for " << path.name;
+        return SetVariableResult::FAILURE;
+      }
+      return setPlayerVariableValue(*playerIndex, path.slot, std::move(newValue));
+    }
+    default:
+      LOG(ERROR) << path.name << " does not refer to a variable";
+      return SetVariableResult::FAILURE;
+  }
+}
+
+
+[[nodiscard]] GetPlayerResult GameState::getPlayer(const VariablePath& path) const {
+  if (path.kind != VariablePath::Kind::PLAYER) {
+    LOG(ERROR) << path.name << " does not refer to a player";
+    return {};
+  }
+
+  const std::optional<PlayerIndex> playerIndex = findScopedPlayer(path.scopeDepth);
+  if (!playerIndex) {
+    LOG(ERROR) << "No player in scope for " << path.name;
+    return {};
+  }
+
+  return {
+    .wasSuccessful = true,
+    .playerID = this->playerIDs[*playerIndex],
+  };
+}
+
+
+///////////////////////////// Change methods //////////////////////////////
+[[nodiscard]] GameState::Changes GameState::takeChanges() {
+  for (const VariableSlot slot : this->changes.variables) {
+    this->isVariableChanged[slot] = false;
+  }
+  for (const auto& [playerIndex, slot] : this->changes.playerVariables) {
+    this->isPlayerVariableChanged[slot * this->playerIDs.size() + playerIndex] = false;
+  }
+  return std::exchange(this->changes, {});
 }
 
 
 ////////////////////////////// Scope methods //////////////////////////////
+[[nodiscard]] std::size_t GameState::pushScope(std::string_view variableName) {
+  if (this->log != nullptr) {
+    writeLogRecord(*this->log, LogRecord::PUSH_SCOPE);
+    this->log->writeString(variableName);
+  }
+  this->activeScopeVariables.push_back({VariableKey(variableName), 0});
+  return this->activeScopeVariables.size() - 1;
+}
+
+
+void GameState::bindScope(std::size_t scopeDepth, PlayerIndex playerIndex) {
+  if (this->log != nullptr) {
+    writeLogRecord(*this->log, LogRecord::BIND_SCOPE);
+    this->log->writeUnsigned(scopeDepth);
+    this->log->writeUnsigned(playerIndex);
+  }
+  this->activeScopeVariables[scopeDepth].playerIndex = playerIndex;
+}
+
+
+void GameState::popScope() {
+  if (this->log != nullptr) {
+    writeLogRecord(*this->log, LogRecord::REMOVE_SCOPE);
+    this->log->writeUnsigned(this->activeScopeVariables.size() - 1);
+  }
+  this->activeScopeVariables.pop_back();
+}
+
+
+void GameState::swapScopes(std::size_t baseDepth, Scopes& scopes) {
+  const auto base = this->activeScopeVariables.begin() + baseDepth;
+  Scopes current = Scopes(std::make_move_iterator(base), std::make_move_iterator(this->activeScopeVariables.end()));
+  this->activeScopeVariables.erase(base, this->activeScopeVariables.end());
+  this->activeScopeVariables.insert(this->activeScopeVariables.end(),
+                                    std::make_move_iterator(scopes.begin()),
+                                    std::make_move_iterator(scopes.end()));
+  scopes = std::move(current);
+
+  if (this->log != nullptr) {
+    writeLogRecord(*this->log, LogRecord::REPLACE_SCOPES);
+    this->log->writeUnsigned(baseDepth);
+    this->log->writeUnsigned(this->activeScopeVariables.size() - baseDepth);
+    for (std::size_t depth = baseDepth; depth < this->activeScopeVariables.size(); ++depth) {
+      this->log->writeString(this->activeScopeVariables[depth].name);
+      this->log->writeUnsigned(this->activeScopeVariables[depth].playerIndex);
+    }
+  }
+}
+
+
+///////////////////////////// Snapshot methods //////////////////////////////
+void GameState::writeSnapshot(SnapshotWriter& writer) const {
+  writer.writeUnsigned(this->playerIDs.size());
+  for (const PlayerID playerID : this->playerIDs) {
+    writer.writeUnsigned(playerID);
+  }
+
+  // Unwritten variables and columns are left empty, and are read from the layout again once restored
+  writer.writeUnsigned(this->variables.size());
+  for (const VariableValue& value : this->variables) {
+    writer.writeValue(value);
+  }
+  writer.writeUnsigned(this->perPlayerVariables.size());
+  for (const std::vector<VariableValue>& column : this->perPlayerVariables) {
+    writer.writeUnsigned(column.size());
+    for (const VariableValue& value : column) {
+      writer.writeValue(value);
+    }
+  }
+
+  writer.writeUnsigned(this->activeScopeVariables.size());
+  for (const ScopeVariable& scope : this->activeScopeVariables) {
+    writer.writeString(scope.name);
+    writer.writeUnsigned(scope.playerIndex);
+  }
+}
+
+
+[[nodiscard]] std::optional<GameState>
+GameState::readSnapshot(SnapshotReader& reader, std::shared_ptr<const VariableLayout> layout) {
+  PlayerIDList playerIDs(reader.readCount());
+  for (PlayerID& playerID : playerIDs) {
+    playerID = reader.readUnsigned();
+  }
+  GameState gameState = GameState(std::move(layout), playerIDs);
+
+  // Anything not matching the layout was written for a different version of the game
+  gameState.variables.resize(reader.readCount());
+  if (!gameState.variables.empty() && gameState.variables.size() != gameState.layout->variableDefaults.size()) {
+    reader.fail();
+  }
+  for (VariableValue& value : gameState.variables) {
+    value = reader.readValue();
+  }
+
+  gameState.perPlayerVariables.resize(reader.readCount());
+  if (!gameState.perPlayerVariables.empty()
+      && gameState.perPlayerVariables.size() != gameState.layout->perPlayerDefaults.size()) {
+    reader.fail();
+  }
+  for (std::vector<VariableValue>& column : gameState.perPlayerVariables) {
+    column.resize(reader.readCount());
+    if (!column.empty() && column.size() != playerIDs.size()) {
+      reader.fail();
+    }
+    for (VariableValue& value : column) {
+      value = reader.readValue();
+    }
+  }
+
+  gameState.activeScopeVariables.resize(reader.readCount());
+  for (ScopeVariable& scope : gameState.activeScopeVariables) {
+    scope.name = reader.readString();
+    scope.playerIndex = reader.readUnsigned();
+    if (scope.playerIndex >= playerIDs.size()) {
+      reader.fail();
+    }
+  }
+
+  if (!reader.isValid()) {
+    LOG(ERROR) << "GameState snapshot is corrupt or for a different game";
+    return std::nullopt;
+  }
+  return gameState;
+}
+
+
+[[nodiscard]] bool GameState::replayLog(SnapshotReader& reader) {
+  // The changes being replayed are already in a log
+  SnapshotWriter* const log = std::exchange(this->log, nullptr);
+
+  bool isApplied = true;
+  while (isApplied && reader.isValid() && !reader.isAtEnd()) {
+    const uint64_t record = reader.readUnsigned();
+    if (record > static_cast<uint64_t>(LogRecord::REPLACE_SCOPES)) {
+      isApplied = false;
+      break;
+    }
+
+    switch (static_cast<LogRecord>(record)) {
+      case LogRecord::SET_VARIABLE: {
+        const VariableSlot slot = reader.readUnsigned();
+        VariableValue value = reader.readValue();
+        isApplied = reader.isValid() && setVariableValue(slot, std::move(value)) == SetVariableResult::SUCCESS;
+        break;
+      }
+      case LogRecord::SET_PLAYER_VARIABLE: {
+        const PlayerIndex playerIndex = reader.readUnsigned();
+        const VariableSlot slot = reader.readUnsigned();
+        VariableValue value = reader.readValue();
+        isApplied = reader.isValid()
+          && setPlayerVariableValue(playerIndex, slot, std::move(value)) == SetVariableResult::SUCCESS;
+        break;
+      }
+      case LogRecord::PUSH_SCOPE:
+        (void)pushScope(reader.readString());
+        break;
+      case LogRecord::BIND_SCOPE: {
+        const std::size_t scopeDepth = reader.readUnsigned();
+        const PlayerIndex playerIndex = reader.readUnsigned();
+        isApplied = scopeDepth < this->activeScopeVariables.size() && playerIndex < this->playerIDs.size();
+        if (isApplied) {
+          bindScope(scopeDepth, playerIndex);
+        }
+        break;
+      }
+      case LogRecord::REMOVE_SCOPE: {
+        const std::size_t scopeDepth = reader.readUnsigned();
+        isApplied = scopeDepth < this->activeScopeVariables.size();
+        if (isApplied) {
+          this->activeScopeVariables.erase(this->activeScopeVariables.begin() + scopeDepth);
+        }
+        break;
+      }
+      case LogRecord::REPLACE_SCOPES: {
+        const std::size_t baseDepth = reader.readUnsigned();
+        isApplied = baseDepth <= this->activeScopeVariables.size();
+        this->activeScopeVariables.resize(std::min(baseDepth, this->activeScopeVariables.size()));
+        for (std::size_t count = reader.readCount(); count > 0 && isApplied; --count) {
+          ScopeVariable scope = {VariableKey(reader.readString()), reader.readUnsigned()};
+          isApplied = scope.playerIndex < this->playerIDs.size();
+          this->activeScopeVariables.push_back(std::move(scope));
+        }
+        break;
+      }
+    }
+  }
+
+  this->log = log;
+  if (!isApplied || !reader.isValid()) {
+    LOG(ERROR) << "GameState log is corrupt or for a different game";
+    return false;
+  }
+  return true;
+}
+
+
 [[nodiscard]] SetVariableResult
 GameState::setActiveScopeVariable(VariableKey variableName, PlayerID value) {
-  if (this->activeScopeVariables.contains(variableName)) {
+  if (getActiveScopeVariableIndex(variableName)) {
     LOG(ERROR) << variableName << " already found in scope variable map - can't set";
     return SetVariableResult::FAILURE;
   }
 
-  this->activeScopeVariables.insert({variableName, value});
+  const std::optional<PlayerIndex> playerIndex = findPlayerIndex(value);
+  if (!playerIndex) {
+    LOG(ERROR) << value << " is not a player - can't set " << variableName;
+    return SetVariableResult::FAILURE;
+  }
+
+  if (this->log != nullptr) {
+    writeLogRecord(*this->log, LogRecord::PUSH_SCOPE);
+    this->log->writeString(variableName);
+    writeLogRecord(*this->log, LogRecord::BIND_SCOPE);
+    this->log->writeUnsigned(this->activeScopeVariables.size());
+    this->log->writeUnsigned(*playerIndex);
+  }
+  this->activeScopeVariables.push_back({variableName, *playerIndex});
   return SetVariableResult::SUCCESS;
 }
 
 
 [[nodiscard]] SetVariableResult
 GameState::unsetActiveScopeVariable(VariableKey variableName) {
-  if (!this->activeScopeVariables.contains(variableName)) {
+  const std::optional<std::size_t> scopeDepth = getActiveScopeVariableIndex(variableName);
+  if (!scopeDepth) {
     LOG(ERROR) << variableName << " not found in scope variable map - can't remove";
     return SetVariableResult::FAILURE;
   }
 
-  this->activeScopeVariables.erase(variableName);
+  if (this->log != nullptr) {
+    writeLogRecord(*this->log, LogRecord::REMOVE_SCOPE);
+    this->log->writeUnsigned(*scopeDepth);
+  }
+  this->activeScopeVariables.erase(this->activeScopeVariables.begin() + *scopeDepth);
   return SetVariableResult::SUCCESS;
 }
 
 
 [[nodiscard]] GetScopedVariableResult
 GameState::getActiveScopeVariable(VariableKey variableName) const {
-  if (!this->activeScopeVariables.contains(variableName)) {
+  const std::optional<std::size_t> scopeDepth = getActiveScopeVariableIndex(variableName);
+  if (!scopeDepth) {
     LOG(ERROR) << "Could not retrieve \"" << variableName << "\" from scope variable map";
     return {};
   }
   
   return {
     .wasSuccessful = true,
-    .value = this->activeScopeVariables.at(variableName),
+    .value = this->playerIDs[this->activeScopeVariables[*scopeDepth].playerIndex],
   };
 }
 
@@ -142,68 +609,87 @@ GameState::getActiveScopeVariable(VariableKey variableName) const {
 /******************************************************************************
  *                          GameState Private Methods                         *
  ******************************************************************************/
-[[nodiscard]] GetVariableResult GameState::getVariable(VariableKey variableName) const {
-  if (!this->variableMap.contains(variableName)) {
-    LOG(ERROR) << "Could not retrieve \"" << variableName << "\" from gameState variable map";
-    return {};
+[[nodiscard]] std::optional<PlayerIndex> GameState::findScopedPlayer(std::size_t scopeDepth) const {
+  if (scopeDepth >= this->activeScopeVariables.size()) {
+    return std::nullopt;
   }
-  
-  return {
-    .wasSuccessful = true,
-    .value = this->variableMap.at(variableName),
-  };
+  return this->activeScopeVariables[scopeDepth].playerIndex;
+}
+
+
+[[nodiscard]] std::optional<std::size_t>
+GameState::getActiveScopeVariableIndex(const VariableKey& variableName) const {
+  // Search innermost first so that nested elements shadow outer ones
+  for (std::size_t depth = this->activeScopeVariables.size(); depth > 0; --depth) {
+    if (this->activeScopeVariables[depth - 1].name == variableName) {
+      return depth - 1;
+    }
+  }
+  return std::nullopt;
+}
+
+
+[[nodiscard]] GetVariableResult GameState::getVariable(const VariableKey& variableName) const {
+  const std::optional<VariableSlot> slot = this->layout->variables.find(variableName);
+  if (slot) {
+    return getVariableValue(*slot);
+  }
+
+  const std::optional<VariableSlot> constantSlot = this->layout->constants.find(variableName);
+  if (constantSlot) {
+    return getValue(VariablePath{.kind = VariablePath::Kind::CONSTANT, .slot = *constantSlot, .name = variableName});
+  }
+
+  LOG(ERROR) << "Could not retrieve \"" << variableName << "\" from gameState variable map";
+  return {};
 }
 
 
 [[nodiscard]] SetVariableResult
-GameState::setVariable(VariableKey variableName, VariableValue newValue) {
-  if (!this->variableMap.contains(variableName)) {
+GameState::setVariable(const VariableKey& variableName, VariableValue newValue) {
+  const std::optional<VariableSlot> slot = this->layout->variables.find(variableName);
+  if (!slot) {
     LOG(ERROR) << variableName << " not found in gameState variable map";
     return SetVariableResult::FAILURE;
   }
 
-  this->variableMap.erase(variableName);
-  this->variableMap.insert({variableName, newValue});
-  return SetVariableResult::SUCCESS;
+  return setVariableValue(*slot, std::move(newValue));
 }
 
 
 [[nodiscard]] GetVariableResult
-GameState::getPlayerVariable(PlayerID playerID, VariableKey variableName) const {
-  if (!this->playerVariableMaps.contains(std::to_string(playerID))) {
+GameState::getPlayerVariable(PlayerID playerID, const VariableKey& variableName) const {
+  const std::optional<PlayerIndex> playerIndex = findPlayerIndex(playerID);
+  if (!playerIndex) {
     LOG(ERROR) << playerID << " not found in playerVariableMaps";
     return {};
   }
 
-  const VariableMap& playerVariables = this->playerVariableMaps.at(std::to_string(playerID));
-  if (!playerVariables.contains(variableName)) {
+  const std::optional<VariableSlot> slot = this->layout->perPlayerVariables.find(variableName);
+  if (!slot) {
     LOG(ERROR) << variableName << " not found in " << playerID << "'s variables";
     return {};
   }
 
-  return {
-    .wasSuccessful = true,
-    .value = playerVariables.at(variableName),
-  };
+  return getPlayerVariableValue(*playerIndex, *slot);
 }
 
 
 [[nodiscard]] SetVariableResult
-GameState::setPlayerVariable(PlayerID playerID, VariableKey variableName, VariableValue newValue) {
-  if (!this->playerVariableMaps.contains(std::to_string(playerID))) {
+GameState::setPlayerVariable(PlayerID playerID, const VariableKey& variableName, VariableValue newValue) {
+  const std::optional<PlayerIndex> playerIndex = findPlayerIndex(playerID);
+  if (!playerIndex) {
     LOG(ERROR) << playerID << " not found in playerVariableMaps";
     return SetVariableResult::FAILURE;
   }
 
-  VariableMap& playerVariables = this->playerVariableMaps.at(std::to_string(playerID));
-  if (!playerVariables.contains(variableName)) {
+  const std::optional<VariableSlot> slot = this->layout->perPlayerVariables.find(variableName);
+  if (!slot) {
     LOG(ERROR) << variableName << " not found in " << playerID << "'s variables";
     return SetVariableResult::FAILURE;
   }
 
-  playerVariables.erase(variableName);
-  playerVariables.insert({variableName, newValue});
-  return SetVariableResult::SUCCESS;
+  return setPlayerVariableValue(*playerIndex, *slot, std::move(newValue));
 }
 
 
@@ -319,5 +805,10 @@ extractPlayerVariableInfo(const GameState& gameState, NestedVariableKey nestedVa
 }
 
 
+void writeLogRecord(SnapshotWriter& log, LogRecord record) {
+  log.writeUnsigned(static_cast<uint64_t>(record));
+}
+
+
 
 } // namespace GameState
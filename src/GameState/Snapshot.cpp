@@ -0,0 +1,180 @@
+#include "Snapshot.h"
+
+#include <limits>
+#include <utility>
+#include <vector>
+
+
+
+namespace GameState {
+
+
+
+// Deeper values than this are taken to be corrupt rather than read recursively
+static constexpr std::size_t MAX_VALUE_DEPTH = 64;
+
+
+/******************************************************************************
+ *                                   Writer                                   *
+ ******************************************************************************/
+void SnapshotWriter::writeUnsigned(uint64_t value) {
+  while (value >= 0x80) {
+    this->bytes.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  this->bytes.push_back(static_cast<char>(value));
+}
+
+
+void SnapshotWriter::writeSigned(int64_t value) {
+  const uint64_t bits = static_cast<uint64_t>(value);
+  this->writeUnsigned((bits << 1) ^ (value < 0 ? ~uint64_t{0} : 0));
+}
+
+
+void SnapshotWriter::writeString(std::string_view value) {
+  this->writeUnsigned(value.size());
+  this->bytes.append(value);
+}
+
+
+void SnapshotWriter::writeValue(const Value& value) {
+  this->writeUnsigned(static_cast<uint8_t>(value.getKind()));
+  switch (value.getKind()) {
+    case Value::Kind::INTEGER:
+      this->writeSigned(value.getInteger());
+      break;
+    case Value::Kind::BOOLEAN:
+      this->writeBool(value.getBoolean());
+      break;
+    case Value::Kind::STRING:
+      this->writeString(value.getString());
+      break;
+    case Value::Kind::LIST:
+      this->writeUnsigned(value.getList().size());
+      for (const Value& element : value.getList()) {
+        this->writeValue(element);
+      }
+      break;
+    case Value::Kind::MAP:
+      this->writeUnsigned(value.getMap().size());
+      for (const Value::MapEntry& entry : value.getMap()) {
+        this->writeString(entry.key.getString());
+        this->writeValue(entry.value);
+      }
+      break;
+  }
+}
+
+
+
+/******************************************************************************
+ *                                   Reader                                   *
+ ******************************************************************************/
+[[nodiscard]] uint64_t SnapshotReader::readUnsigned() {
+  uint64_t value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    if (this->position == this->bytes.size()) {
+      break;
+    }
+    const auto byte = static_cast<uint8_t>(this->bytes[this->position++]);
+    value |= uint64_t{byte & 0x7Fu} << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+  this->fail();
+  return 0;
+}
+
+
+[[nodiscard]] int64_t SnapshotReader::readSigned() {
+  const uint64_t bits = this->readUnsigned();
+  return static_cast<int64_t>((bits >> 1) ^ (~(bits & 1) + 1));
+}
+
+
+[[nodiscard]] bool SnapshotReader::readBool() {
+  const uint64_t value = this->readUnsigned();
+  if (value > 1) {
+    this->fail();
+  }
+  return value == 1;
+}
+
+
+[[nodiscard]] std::string_view SnapshotReader::readString() {
+  const uint64_t size = this->readUnsigned();
+  if (size > this->bytes.size() - this->position) {
+    this->fail();
+    return {};
+  }
+  const std::string_view value = this->bytes.substr(this->position, size);
+  this->position += size;
+  return value;
+}
+
+
+[[nodiscard]] std::size_t SnapshotReader::readCount() {
+  const uint64_t count = this->readUnsigned();
+  if (count > this->bytes.size() - this->position) {
+    this->fail();
+    return 0;
+  }
+  return count;
+}
+
+
+[[nodiscard]] Value SnapshotReader::readValue() {
+  return this->readValue(0);
+}
+
+
+[[nodiscard]] Value SnapshotReader::readValue(std::size_t depth) {
+  if (depth == MAX_VALUE_DEPTH) {
+    this->fail();
+    return {};
+  }
+
+  const uint64_t kind = this->readUnsigned();
+  if (kind > static_cast<uint8_t>(Value::Kind::MAP)) {
+    this->fail();
+    return {};
+  }
+
+  switch (static_cast<Value::Kind>(kind)) {
+    case Value::Kind::INTEGER: {
+      const int64_t integer = this->readSigned();
+      if (integer < std::numeric_limits<Integer>::min() || integer > std::numeric_limits<Integer>::max()) {
+        this->fail();
+        return {};
+      }
+      return static_cast<Integer>(integer);
+    }
+    case Value::Kind::BOOLEAN:
+      return this->readBool();
+    case Value::Kind::STRING:
+      return this->readString();
+    case Value::Kind::LIST: {
+      std::vector<Value> elements(this->readCount());
+      for (Value& element : elements) {
+        element = this->readValue(depth + 1);
+      }
+      return Value::makeList(elements);
+    }
+    case Value::Kind::MAP: {
+      std::vector<std::pair<std::string, Value>> entries(this->readCount());
+      for (auto& [key, value] : entries) {
+        key = this->readString();
+        value = this->readValue(depth + 1);
+      }
+      return Value::makeMap(std::move(entries));
+    }
+  }
+  this->fail();
+  return {};
+}
+
+
+
+} // namespace GameState
@@ -0,0 +1,261 @@
+#include "Value.h"
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+
+namespace GameState {
+
+
+
+/******************************************************************************
+ *                                Shared Blocks                               *
+ ******************************************************************************/
+template <typename Element>
+[[nodiscard]] Value::SharedBlock* Value::allocateBlock(std::size_t size) {
+  static_assert(alignof(Element) <= alignof(SharedBlock) || sizeof(SharedBlock) % alignof(Element) == 0);
+  void* memory = ::operator new(sizeof(SharedBlock) + size * sizeof(Element));
+  return ::new (memory) SharedBlock{1, static_cast<uint32_t>(size)};
+}
+
+template <typename Element>
+[[nodiscard]] Element* Value::getElements(SharedBlock* block) {
+  return reinterpret_cast<Element*>(block + 1);
+}
+
+void Value::releaseBlock(SharedBlock* block) noexcept {
+  if (block->referenceCount.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+
+  if (this->kind == Kind::LIST) {
+    std::destroy_n(getElements<Value>(block), block->size);
+  } else if (this->kind == Kind::MAP) {
+    std::destroy_n(getElements<MapEntry>(block), block->size);
+  }
+  block->~SharedBlock();
+  ::operator delete(block);
+}
+
+
+
+/******************************************************************************
+ *                                Construction                                *
+ ******************************************************************************/
+Value::Value(std::string_view string)
+  : kind(Kind::STRING) {
+  if (string.size() <= SMALL_STRING_CAPACITY) {
+    std::copy(string.begin(), string.end(), this->storage);
+    this->smallStringSize = static_cast<uint8_t>(string.size());
+    return;
+  }
+
+  SharedBlock* block = allocateBlock<char>(string.size());
+  std::copy(string.begin(), string.end(), getElements<char>(block));
+  this->store(block);
+  this->smallStringSize = LARGE_STRING;
+}
+
+[[nodiscard]] Value Value::makeList(std::span<const Value> elements) {
+  Value list;
+  list.kind = Kind::LIST;
+  list.store<SharedBlock*>(nullptr);
+  if (elements.empty()) {
+    return list;
+  }
+
+  SharedBlock* block = allocateBlock<Value>(elements.size());
+  std::uninitialized_copy(elements.begin(), elements.end(), getElements<Value>(block));
+  list.store(block);
+  return list;
+}
+
+[[nodiscard]] Value Value::makeMap(std::vector<std::pair<std::string, Value>> entries) {
+  Value map;
+  map.kind = Kind::MAP;
+  map.store<SharedBlock*>(nullptr);
+  if (entries.empty()) {
+    return map;
+  }
+
+  // Sorted so that find() can binary search
+  std::sort(entries.begin(), entries.end(), [](const auto& lhs, const auto& rhs) {
+    return lhs.first < rhs.first;
+  });
+  SharedBlock* block = allocateBlock<MapEntry>(entries.size());
+  MapEntry* mapEntries = getElements<MapEntry>(block);
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    ::new (&mapEntries[i]) MapEntry{Value(entries[i].first), std::move(entries[i].second)};
+  }
+  map.store(block);
+  return map;
+}
+
+
+
+/******************************************************************************
+ *                                  Accessors                                 *
+ ******************************************************************************/
+[[nodiscard]] std::string_view Value::getString() const {
+  if (this->smallStringSize != LARGE_STRING) {
+    return {reinterpret_cast<const char*>(this->storage), this->smallStringSize};
+  }
+  SharedBlock* block = this->load<SharedBlock*>();
+  return {getElements<char>(block), block->size};
+}
+
+[[nodiscard]] std::span<const Value> Value::getList() const {
+  SharedBlock* block = this->load<SharedBlock*>();
+  if (block == nullptr) {
+    return {};
+  }
+  return {getElements<Value>(block), block->size};
+}
+
+[[nodiscard]] std::span<const Value::MapEntry> Value::getMap() const {
+  SharedBlock* block = this->load<SharedBlock*>();
+  if (block == nullptr) {
+    return {};
+  }
+  return {getElements<MapEntry>(block), block->size};
+}
+
+[[nodiscard]] const Value* Value::find(std::string_view key) const {
+  if (this->kind != Kind::MAP) {
+    return nullptr;
+  }
+
+  const std::span<const MapEntry> entries = this->getMap();
+  const auto entry_it = std::lower_bound(entries.begin(), entries.end(), key, [](const MapEntry& entry, std::string_view key) {
+    return entry.key.getString() < key;
+  });
+  if (entry_it == entries.end() || entry_it->key.getString() != key) {
+    return nullptr;
+  }
+  return &entry_it->value;
+}
+
+[[nodiscard]] std::optional<std::size_t> Value::size() const {
+  switch (this->kind) {
+    case Kind::STRING:
+      return this->getString().size();
+    case Kind::LIST:
+      return this->getList().size();
+    case Kind::MAP:
+      return this->getMap().size();
+    default:
+      return std::nullopt;
+  }
+}
+
+[[nodiscard]] std::optional<bool> Value::asCondition() const {
+  switch (this->kind) {
+    case Kind::BOOLEAN:
+      return this->getBoolean();
+    case Kind::INTEGER:
+      return this->getInteger() != 0;
+    default:
+      return std::nullopt;
+  }
+}
+
+
+
+/******************************************************************************
+ *                           Comparison and Printing                          *
+ ******************************************************************************/
+bool operator==(const Value& lhs, const Value& rhs) {
+  if (lhs.kind != rhs.kind) {
+    return false;
+  }
+
+  switch (lhs.kind) {
+    case Value::Kind::INTEGER:
+      return lhs.getInteger() == rhs.getInteger();
+    case Value::Kind::BOOLEAN:
+      return lhs.getBoolean() == rhs.getBoolean();
+    case Value::Kind::STRING:
+      return lhs.getString() == rhs.getString();
+    case Value::Kind::LIST:
+      return lhs.getBlock() == rhs.getBlock() || std::ranges::equal(lhs.getList(), rhs.getList());
+    case Value::Kind::MAP:
+      return lhs.getBlock() == rhs.getBlock()
+        || std::ranges::equal(lhs.getMap(), rhs.getMap(), [](const Value::MapEntry& lhs, const Value::MapEntry& rhs) {
+             return lhs.key == rhs.key && lhs.value == rhs.value;
+           });
+  }
+  return false;
+}
+
+static void printQuoted(std::ostream& out, std::string_view text) {
+  out << '"';
+  for (const char character : text) {
+    if (character == '"' || character == '\\') {
+      out << '\\' << character;
+    } else if (static_cast<unsigned char>(character) < 0x20) {
+      constexpr char HEX_DIGITS[] = "0123456789abcdef";
+      out << "\\u00" << HEX_DIGITS[character >> 4] << HEX_DIGITS[character & 0xF];
+    } else {
+      out << character;
+    }
+  }
+  out << '"';
+}
+
+static void printValue(std::ostream& out, const Value& value, bool isNested) {
+  switch (value.getKind()) {
+    case Value::Kind::INTEGER:
+      out << value.getInteger();
+      break;
+    case Value::Kind::BOOLEAN:
+      out << (value.getBoolean() ? "true" : "false");
+      break;
+    case Value::Kind::STRING:
+      if (isNested) {
+        printQuoted(out, value.getString());
+      } else {
+        out << value.getString();
+      }
+      break;
+    case Value::Kind::LIST: {
+      out << '[';
+      const char* separator = "";
+      for (const Value& element : value.getList()) {
+        out << std::exchange(separator, ", ");
+        printValue(out, element, true);
+      }
+      out << ']';
+      break;
+    }
+    case Value::Kind::MAP: {
+      out << '{';
+      const char* separator = "";
+      for (const Value::MapEntry& entry : value.getMap()) {
+        out << std::exchange(separator, ", ");
+        printValue(out, entry.key, true);
+        out << ": ";
+        printValue(out, entry.value, true);
+      }
+      out << '}';
+      break;
+    }
+  }
+}
+
+std::ostream& operator<<(std::ostream& out, const Value& value) {
+  printValue(out, value, false);
+  return out;
+}
+
+void printJson(std::ostream& out, const Value& value) {
+  printValue(out, value, true);
+}
+
+
+
+} // namespace GameState
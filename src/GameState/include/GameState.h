@@ -1,27 +1,33 @@
 #pragma once
 
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <memory>
 
+#include "Value.h"
 
 
 namespace GameState {
 
 
+class SnapshotReader;
+class SnapshotWriter;
+
 using NestedVariableKey = std::string; // <---  i.e. "players.$player.input"
 using VariableKey = std::string;       // <---  i.e. "debug_target"
-// TODO-#59?: In the future, variable values might want to be more than just ints
-using VariableValue = int;
+using VariableValue = Value;
 using VariableMap = std::unordered_map<VariableKey, VariableValue>;
 
 using PlayerID = uintptr_t;
 using PlayerIDList = std::vector<PlayerID>;
 using PlayerVariableMaps = std::unordered_map<VariableKey, VariableMap>;
 
-// TODO-#59?: Currently only holds playerIDs, we should generalize this to more types
-using ActiveScopeVariableMap = std::unordered_map<VariableKey, PlayerID>;
+// Dense integer handles for variables and players, see VariableLayout
+using VariableSlot = std::size_t;
+using PlayerIndex = std::size_t;
 
 struct GetVariableResult {
   bool wasSuccessful = false;
@@ -34,40 +40,179 @@ struct GetScopedVariableResult {
 
 enum class SetVariableResult { SUCCESS, FAILURE };
 
+struct GetPlayerResult {
+  bool wasSuccessful = false;
+  PlayerID playerID = 0;
+};
+
+
+/**
+ * Interns variable names into dense slots (0, 1, 2, ...) so that values can be
+ * stored in flat arrays and looked up without hashing strings
+ */
+class SymbolTable {
+  public:
+    VariableSlot intern(const VariableKey& name);
+    [[nodiscard]] std::optional<VariableSlot> find(std::string_view name) const;
+
+    [[nodiscard]] const VariableKey& getName(VariableSlot slot) const { return names[slot]; }
+    [[nodiscard]] std::size_t size() const { return names.size(); }
+  private:
+    struct NameHash {
+      using is_transparent = void;
+      std::size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+    };
+    std::unordered_map<VariableKey, VariableSlot, NameHash, std::equal_to<>> slots;
+    std::vector<VariableKey> names;
+};
+
+
+/**
+ * The names and default values of a game's variables, assigned to slots once
+ * when the game spec is loaded and shared by every GameState of that game
+ */
+struct VariableLayout {
+  VariableLayout(const VariableMap& variableMap,
+                 const VariableMap& perPlayerVariableMap,
+                 const VariableMap& constantMap = {});
+
+  SymbolTable variables;
+  std::vector<VariableValue> variableDefaults;
+
+  SymbolTable perPlayerVariables;
+  std::vector<VariableValue> perPlayerDefaults;
+
+  // Constants are never written, so every GameState reads them straight from here
+  SymbolTable constants;
+  std::vector<VariableValue> constantValues;
+};
+
+
+/**
+ * A variable reference resolved against a VariableLayout when the game spec is parsed, so that
+ * rules can reach their variables at runtime without parsing or allocating strings
+ * i.e. "debug_target"  -> {GLOBAL, slot of "debug_target"}
+ *      "player.input"  -> {PER_PLAYER, scopeDepth of "player", slot of "input"}
+ *      "player"        -> {PLAYER, scopeDepth of "player"}
+ *      "weapons"       -> {CONSTANT, slot of "weapons"}
+ */
+struct VariablePath {
+  enum class Kind { GLOBAL, PER_PLAYER, PLAYER, CONSTANT };
+
+  Kind kind = Kind::GLOBAL;
+  VariableSlot slot = 0;
+  std::size_t scopeDepth = 0;  // Which enclosing forEach element, outermost is 0
+  std::string_view name = "";  // The reference as written in the spec, only used for logging, not owned
+};
+
+
 class GameState {
   public:
+    // A forEach element in scope
+    struct ScopeVariable {
+      VariableKey name;
+      PlayerIndex playerIndex;
+    };
+    using Scopes = std::vector<ScopeVariable>;
+
     GameState() = delete;
     GameState(const VariableMap& variableMap,
               const PlayerIDList& playerIds,
               const VariableMap& playerVariableMaps);
+    GameState(std::shared_ptr<const VariableLayout> layout,
+              const PlayerIDList& playerIds);
 
     [[nodiscard]] GetVariableResult getValue(NestedVariableKey nestedVariableName) const;
     [[nodiscard]] SetVariableResult setValue(NestedVariableKey nestedVariableName, VariableValue newValue);
 
-    [[nodiscard]] PlayerIDList getPlayerIDs() const;
+    [[nodiscard]] const PlayerIDList& getPlayerIDs() const;
+
+    // Slot based access, for callers which resolved names through getLayout() ahead of time
+    [[nodiscard]] const VariableLayout& getLayout() const { return *layout; }
+    [[nodiscard]] std::optional<PlayerIndex> findPlayerIndex(PlayerID playerID) const;
+
+    [[nodiscard]] GetVariableResult getVariableValue(VariableSlot slot) const;
+    [[nodiscard]] SetVariableResult setVariableValue(VariableSlot slot, VariableValue newValue);
+    [[nodiscard]] GetVariableResult getPlayerVariableValue(PlayerIndex playerIndex, VariableSlot slot) const;
+    [[nodiscard]] SetVariableResult setPlayerVariableValue(PlayerIndex playerIndex,
+                                                           VariableSlot slot,
+                                                           VariableValue newValue);
+
+    // Path based access, for rules compiled against the layout
+    [[nodiscard]] GetVariableResult getValue(const VariablePath& path) const;
+    [[nodiscard]] SetVariableResult setValue(const VariablePath& path, VariableValue newValue);
+    [[nodiscard]] GetPlayerResult getPlayer(const VariablePath& path) const;
 
     // Scope methods
+    // A forEach pushes its element once, rebinds it for each player and pops it when done
+    [[nodiscard]] std::size_t pushScope(std::string_view variableName);
+    void bindScope(std::size_t scopeDepth, PlayerIndex playerIndex);
+    void popScope();
+    [[nodiscard]] std::size_t getScopeDepth() const { return this->activeScopeVariables.size(); }
+    // Exchanges the scopes above baseDepth with the given ones, so that each parallelFor
+    // branch can keep its own elements in scope while it runs
+    void swapScopes(std::size_t baseDepth, Scopes& scopes);
+
+    // Snapshots hold only what has been written over the layout's defaults, and are
+    // restored against the same layout, see Snapshot.h
+    void writeSnapshot(SnapshotWriter& writer) const;
+    [[nodiscard]] static std::optional<GameState> readSnapshot(SnapshotReader& reader,
+                                                               std::shared_ptr<const VariableLayout> layout);
+
+    // Once given a log, every change to the variables or scopes is also appended to it as a
+    // record, in memory only, so that replayLog can bring a GameState restored from an earlier
+    // snapshot up to date. The log is not owned, and is unset before it is destroyed.
+    void setLog(SnapshotWriter* log) { this->log = log; }
+    // Applies records until the reader is at its end, returns false if one is corrupt
+    [[nodiscard]] bool replayLog(SnapshotReader& reader);
+
+    // The variables written since the last takeChanges(), each listed once however often it
+    // was written, so that clients can be sent what changed rather than the whole state
+    struct Changes {
+      std::vector<VariableSlot> variables;
+      std::vector<std::pair<PlayerIndex, VariableSlot>> playerVariables;
+    };
+    [[nodiscard]] Changes takeChanges();
+
     [[nodiscard]] SetVariableResult setActiveScopeVariable(VariableKey variableName, PlayerID value);
     [[nodiscard]] SetVariableResult unsetActiveScopeVariable(VariableKey variableName);
     [[nodiscard]] GetScopedVariableResult getActiveScopeVariable(VariableKey variableName) const;
   private:
-    // TODO-#59: Variables can be held in a single data structure if we use something like a tree of sorts
-    VariableMap variableMap;
-    PlayerVariableMaps playerVariableMaps;
+    std::shared_ptr<const VariableLayout> layout;
+
+    // Values indexed by the slots of the layout's symbol tables. Copy-on-write: values
+    // are read from the layout's defaults until the first write copies them here.
+    std::vector<VariableValue> variables;
+
+    // Struct-of-arrays: perPlayerVariables[slot][playerIndex], where each column
+    // stays empty until one of its values is written
+    PlayerIDList playerIDs;
+    mutable std::unordered_map<PlayerID, PlayerIndex> playerIndices;  // Built by the first findPlayerIndex
+    std::vector<std::vector<VariableValue>> perPlayerVariables;
+
+    // Used for forEach iteration, innermost element last
+    Scopes activeScopeVariables;
+
+    SnapshotWriter* log = nullptr;
+
+    // See takeChanges(), the flags are indexed like variables and perPlayerVariables, row by row
+    Changes changes;
+    std::vector<bool> isVariableChanged;
+    std::vector<bool> isPlayerVariableChanged;
 
-    // Used for forEach iteration
-    ActiveScopeVariableMap activeScopeVariables;
+    [[nodiscard]] std::optional<PlayerIndex> findScopedPlayer(std::size_t scopeDepth) const;
+    [[nodiscard]] std::optional<std::size_t> getActiveScopeVariableIndex(const VariableKey& variableName) const;
 
     // TODO: Constant handling
     
     // Specialized variable accessers and modifiers
-    [[nodiscard]] GetVariableResult getVariable(VariableKey variableName) const;
-    [[nodiscard]] SetVariableResult setVariable(VariableKey variableName, VariableValue newValue);
+    [[nodiscard]] GetVariableResult getVariable(const VariableKey& variableName) const;
+    [[nodiscard]] SetVariableResult setVariable(const VariableKey& variableName, VariableValue newValue);
 
     [[nodiscard]] GetVariableResult getPlayerVariable(PlayerID playerID,
-                                                      VariableKey variableName) const;
+                                                      const VariableKey& variableName) const;
     [[nodiscard]] SetVariableResult setPlayerVariable(PlayerID playerID,
-                                                      VariableKey variableName,
+                                                      const VariableKey& variableName,
                                                       VariableValue newValue);
 };
 
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "Value.h"
+
+
+
+namespace GameState {
+
+
+/**
+ * Appends values to a compact binary snapshot, i.e. of a GameState, so that a game
+ * can be written out cheaply and restored after the server restarts.
+ *
+ * Integers are LEB128 varints, zigzag encoded when signed, so the small numbers
+ * games are mostly made of take a byte or two. Strings are length prefixed.
+ */
+class SnapshotWriter {
+  public:
+    void writeUnsigned(uint64_t value);
+    void writeSigned(int64_t value);
+    void writeBool(bool value) { this->bytes.push_back(value ? 1 : 0); }
+    void writeString(std::string_view value);
+    void writeValue(const Value& value);
+
+    [[nodiscard]] const std::string& getBytes() const { return this->bytes; }
+    [[nodiscard]] std::string takeBytes() { return std::move(this->bytes); }
+  private:
+    std::string bytes;
+};
+
+
+/**
+ * Reads back what a SnapshotWriter wrote, in the same order. A read past the end or
+ * of malformed data gives a default value and marks the reader as failed, so callers
+ * can read a whole record and check isValid() once at the end.
+ */
+class SnapshotReader {
+  public:
+    explicit SnapshotReader(std::string_view bytes) : bytes(bytes) {}
+
+    [[nodiscard]] uint64_t readUnsigned();
+    [[nodiscard]] int64_t readSigned();
+    [[nodiscard]] bool readBool();
+    [[nodiscard]] std::string_view readString();
+    [[nodiscard]] Value readValue();
+
+    // Reads a count of things each taking at least a byte, failing if there cannot be that many left
+    [[nodiscard]] std::size_t readCount();
+
+    void fail() { this->hasFailed = true; }
+    [[nodiscard]] bool isValid() const { return !this->hasFailed; }
+    [[nodiscard]] bool isAtEnd() const { return this->position == this->bytes.size(); }
+  private:
+    std::string_view bytes;
+    std::size_t position = 0;
+    bool hasFailed = false;
+
+    [[nodiscard]] Value readValue(std::size_t depth);
+};
+
+
+
+} // namespace GameState
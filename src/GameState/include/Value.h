@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+
+namespace GameState {
+
+
+using Integer = int;
+
+
+/**
+ * A value held by a game variable or constant: an integer, boolean, string, list or map.
+ *
+ * Values are 16 bytes. Integers, booleans and strings of up to 14 bytes are stored
+ * inline, so most variable accesses never touch the heap. Longer strings, lists and
+ * maps are immutable blocks shared between copies by reference counting. Each is one
+ * allocation holding its elements inline, and empty lists and maps hold none at all.
+ * A game's constants and default values are therefore shared by every session rather
+ * than copied, and "changing" a list means building a new one.
+ *
+ * Reference counts are atomic, as values shared through a game's data are copied by
+ * sessions on every shard.
+ */
+class Value {
+  public:
+    enum class Kind : uint8_t { INTEGER, BOOLEAN, STRING, LIST, MAP };
+    struct MapEntry;
+
+    Value() noexcept : Value(Integer{0}) {}
+    Value(Integer integer) noexcept : kind(Kind::INTEGER) { this->store(integer); }
+    // Only actual bools, so that pointers and the like do not silently become booleans
+    template <typename Boolean>
+      requires std::same_as<Boolean, bool>
+    Value(Boolean boolean) noexcept : kind(Kind::BOOLEAN) { this->store(boolean); }
+    Value(std::string_view string);
+    Value(const char* string) : Value(std::string_view(string)) {}
+    Value(const std::string& string) : Value(std::string_view(string)) {}
+
+    [[nodiscard]] static Value makeList(std::span<const Value> elements);
+    // Keys must be unique, entries are kept sorted by key
+    [[nodiscard]] static Value makeMap(std::vector<std::pair<std::string, Value>> entries);
+
+    Value(const Value& other) noexcept {
+      this->copyFrom(other);
+      this->retain();
+    }
+    Value(Value&& other) noexcept {
+      this->copyFrom(other);
+      other.clear();
+    }
+    Value& operator=(const Value& other) noexcept {
+      Value copy = other;
+      return *this = std::move(copy);
+    }
+    Value& operator=(Value&& other) noexcept {
+      if (this != &other) {
+        this->release();
+        this->copyFrom(other);
+        other.clear();
+      }
+      return *this;
+    }
+    ~Value() { this->release(); }
+
+    [[nodiscard]] Kind getKind() const { return this->kind; }
+    [[nodiscard]] bool isInteger() const { return this->kind == Kind::INTEGER; }
+    [[nodiscard]] bool isBoolean() const { return this->kind == Kind::BOOLEAN; }
+    [[nodiscard]] bool isString() const { return this->kind == Kind::STRING; }
+    [[nodiscard]] bool isList() const { return this->kind == Kind::LIST; }
+    [[nodiscard]] bool isMap() const { return this->kind == Kind::MAP; }
+
+    // Each of these may only be called on a value of its kind
+    [[nodiscard]] Integer getInteger() const { return this->load<Integer>(); }
+    [[nodiscard]] bool getBoolean() const { return this->load<bool>(); }
+    [[nodiscard]] std::string_view getString() const;
+    [[nodiscard]] std::span<const Value> getList() const;
+    [[nodiscard]] std::span<const MapEntry> getMap() const;
+
+    // The value under the key of a map, nullptr if there is none or this is not a map
+    [[nodiscard]] const Value* find(std::string_view key) const;
+    // Characters of a string, elements of a list or entries of a map, nullopt for anything else
+    [[nodiscard]] std::optional<std::size_t> size() const;
+    // Booleans, and integers which are true when non-zero, nullopt for anything else
+    [[nodiscard]] std::optional<bool> asCondition() const;
+
+    friend bool operator==(const Value& lhs, const Value& rhs);
+    // Strings are written as they are, without quotes unless within a list or map
+    friend std::ostream& operator<<(std::ostream& out, const Value& value);
+
+  private:
+    // Reference count and length, followed in the same allocation by the elements
+    struct SharedBlock {
+      std::atomic<uint32_t> referenceCount;
+      uint32_t size;
+    };
+
+    static constexpr std::size_t SMALL_STRING_CAPACITY = 14;
+    static constexpr uint8_t LARGE_STRING = 0xFF;
+
+    // Inline characters, or the bytes of an integer, boolean or SharedBlock pointer
+    alignas(8) unsigned char storage[SMALL_STRING_CAPACITY];
+    uint8_t smallStringSize = 0;  // LARGE_STRING for strings in a SharedBlock
+    Kind kind;
+
+    template <typename T>
+    void store(T value) { std::memcpy(this->storage, &value, sizeof(T)); }
+    template <typename T>
+    [[nodiscard]] T load() const {
+      T value;
+      std::memcpy(&value, this->storage, sizeof(T));
+      return value;
+    }
+
+    void copyFrom(const Value& other) {
+      std::memcpy(this->storage, other.storage, sizeof(this->storage));
+      this->smallStringSize = other.smallStringSize;
+      this->kind = other.kind;
+    }
+    // Leaves a moved from value as the integer 0, holding nothing to release
+    void clear() {
+      this->kind = Kind::INTEGER;
+      this->store(Integer{0});
+    }
+
+    [[nodiscard]] SharedBlock* getBlock() const {
+      const bool hasBlock = this->kind == Kind::LIST || this->kind == Kind::MAP
+        || (this->kind == Kind::STRING && this->smallStringSize == LARGE_STRING);
+      return hasBlock ? this->load<SharedBlock*>() : nullptr;
+    }
+    void retain() const {
+      if (SharedBlock* block = this->getBlock()) {
+        block->referenceCount.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    void release() noexcept {
+      if (SharedBlock* block = this->getBlock()) {
+        this->releaseBlock(block);
+      }
+    }
+    void releaseBlock(SharedBlock* block) noexcept;
+
+    template <typename Element>
+    [[nodiscard]] static SharedBlock* allocateBlock(std::size_t size);
+    template <typename Element>
+    [[nodiscard]] static Element* getElements(SharedBlock* block);
+};
+static_assert(sizeof(Value) == 16);
+
+
+struct Value::MapEntry {
+  Value key;  // Always a string
+  Value value;
+};
+
+
+// Writes the value as JSON, quoting every string, i.e. for clients to parse
+void printJson(std::ostream& out, const Value& value);
+
+
+
+} // namespace GameState
@@ -0,0 +1,231 @@
+#include "ExpressionParser.h"
+
+#include <glog/logging.h>
+
+#include "Expression.h"
+#include "GameState.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace JsonParser {
+
+using GameRules::ExpressionNode;
+using GameRules::ExpressionOp;
+
+
+struct BinaryOperator {
+  std::string_view token;
+  ExpressionOp op;
+};
+
+// One row per level of precedence, loosest first. Tokens come before any shorter token they start with.
+static const std::vector<std::vector<BinaryOperator>> BINARY_OPERATORS = {
+  {{"||", ExpressionOp::OR}},
+  {{"&&", ExpressionOp::AND}},
+  {{"==", ExpressionOp::EQUAL}, {"!=", ExpressionOp::NOT_EQUAL}},
+  {{"<=", ExpressionOp::LESS_EQUAL}, {">=", ExpressionOp::GREATER_EQUAL},
+   {"<", ExpressionOp::LESS}, {">", ExpressionOp::GREATER}},
+  {{"+", ExpressionOp::ADD}, {"-", ExpressionOp::SUBTRACT}},
+  {{"*", ExpressionOp::MULTIPLY}, {"/", ExpressionOp::DIVIDE}, {"%", ExpressionOp::MODULO}},
+};
+
+
+
+/******************************************************************************
+ *                          Public Expression Parser                          *
+ ******************************************************************************/
+ExpressionParser::ExpressionParser(VariableResolver resolveVariable, GameRules::RuleArena& arena)
+  : resolveVariable(std::move(resolveVariable))
+  , arena(arena) {}
+
+std::optional<GameRules::Expression>
+ExpressionParser::parseExpression(std::string_view text, bool isNegated)
+{
+  this->text = this->arena.intern(text);
+  this->position = 0;
+  this->nodes = std::pmr::vector<ExpressionNode>(this->arena.getResource());
+
+  const std::optional<uint32_t> root = parseBinary(0);
+  if (!root) {
+    return std::nullopt;
+  }
+
+  skipWhitespace();
+  if (this->position != this->text.size()) {
+    logError("unexpected text");
+    return std::nullopt;
+  }
+
+  if (isNegated) {
+    addNode({.op = ExpressionOp::NOT, .lhs = *root});
+  }
+  return GameRules::Expression(this->text, std::move(this->nodes));
+}
+
+
+
+/******************************************************************************
+ *                              Recursive Descent                             *
+ ******************************************************************************/
+std::optional<uint32_t>
+ExpressionParser::parseBinary(std::size_t precedence)
+{
+  if (precedence == BINARY_OPERATORS.size()) {
+    return parseUnary();
+  }
+
+  std::optional<uint32_t> lhs = parseBinary(precedence + 1);
+  while (lhs) {
+    const std::vector<BinaryOperator>& operators = BINARY_OPERATORS[precedence];
+    const auto operator_it = std::find_if(operators.begin(), operators.end(), [this](const BinaryOperator& binaryOperator) {
+      return consume(binaryOperator.token);
+    });
+    if (operator_it == operators.end()) {
+      break;
+    }
+
+    const std::optional<uint32_t> rhs = parseBinary(precedence + 1);
+    if (!rhs) {
+      return std::nullopt;
+    }
+    lhs = addNode({.op = operator_it->op, .lhs = *lhs, .rhs = *rhs});
+  }
+  return lhs;
+}
+
+std::optional<uint32_t>
+ExpressionParser::parseUnary()
+{
+  skipWhitespace();
+  // "!=" is never unary, leave it for the caller to report
+  if (this->text.substr(this->position, 2) != "!=" && consume("!")) {
+    const std::optional<uint32_t> operand = parseUnary();
+    return operand ? std::optional(addNode({.op = ExpressionOp::NOT, .lhs = *operand})) : std::nullopt;
+  }
+  if (consume("-")) {
+    const std::optional<uint32_t> operand = parseUnary();
+    return operand ? std::optional(addNode({.op = ExpressionOp::NEGATE, .lhs = *operand})) : std::nullopt;
+  }
+  return parsePrimary();
+}
+
+std::optional<uint32_t>
+ExpressionParser::parsePrimary()
+{
+  skipWhitespace();
+  if (this->position == this->text.size()) {
+    logError("expected a value");
+    return std::nullopt;
+  }
+
+  if (consume("(")) {
+    const std::optional<uint32_t> inner = parseBinary(0);
+    if (inner && !consume(")")) {
+      logError("expected \")\"");
+      return std::nullopt;
+    }
+    return inner;
+  }
+
+  const char next = this->text[this->position];
+  if (std::isdigit(static_cast<unsigned char>(next))) {
+    GameState::Integer value = 0;
+    const char* start = this->text.data() + this->position;
+    const auto [end, error] = std::from_chars(start, this->text.data() + this->text.size(), value);
+    if (error != std::errc()) {
+      logError("number is out of range");
+      return std::nullopt;
+    }
+    this->position += end - start;
+    return addNode({.op = ExpressionOp::CONSTANT, .value = value});
+  }
+
+  if (std::isalpha(static_cast<unsigned char>(next)) || next == '_') {
+    return parseReference();
+  }
+
+  logError("expected a value");
+  return std::nullopt;
+}
+
+/**
+ * Parses a name such as "debug_target", "player.input" or "players.size"
+ */
+std::optional<uint32_t>
+ExpressionParser::parseReference()
+{
+  const std::size_t start = this->position;
+  while (this->position < this->text.size()) {
+    const char next = this->text[this->position];
+    if (!std::isalnum(static_cast<unsigned char>(next)) && next != '_' && next != '.') {
+      break;
+    }
+    ++this->position;
+  }
+  const std::string_view name = this->text.substr(start, this->position - start);
+
+  if (name == "true" || name == "false") {
+    return addNode({.op = ExpressionOp::CONSTANT, .value = name == "true"});
+  }
+  if (name == "players.size") {
+    return addNode({.op = ExpressionOp::PLAYER_COUNT});
+  }
+
+  // "weapons.size" is the size of weapons, unless there is a variable with that name
+  constexpr std::string_view SIZE_SUFFIX = ".size";
+  std::optional<GameState::VariablePath> path = this->resolveVariable(std::string(name));
+  bool isSize = false;
+  if (!path && name.ends_with(SIZE_SUFFIX)) {
+    path = this->resolveVariable(std::string(name.substr(0, name.size() - SIZE_SUFFIX.size())));
+    isSize = true;
+  }
+  if (!path || path->kind == GameState::VariablePath::Kind::PLAYER) {
+    this->position = start;
+    logError("\"" + std::string(name) + "\" is not a variable");
+    return std::nullopt;
+  }
+
+  const uint32_t variable = addNode({.op = ExpressionOp::VARIABLE, .path = *path});
+  return isSize ? addNode({.op = ExpressionOp::SIZE, .lhs = variable}) : variable;
+}
+
+
+
+/******************************************************************************
+ *                                   Helpers                                  *
+ ******************************************************************************/
+uint32_t ExpressionParser::addNode(ExpressionNode node) {
+  this->nodes.push_back(std::move(node));
+  return static_cast<uint32_t>(this->nodes.size() - 1);
+}
+
+void ExpressionParser::skipWhitespace() {
+  while (this->position < this->text.size() && std::isspace(static_cast<unsigned char>(this->text[this->position]))) {
+    ++this->position;
+  }
+}
+
+// Moves past the token if it comes next
+bool ExpressionParser::consume(std::string_view token) {
+  skipWhitespace();
+  if (this->text.substr(this->position, token.size()) != token) {
+    return false;
+  }
+  this->position += token.size();
+  return true;
+}
+
+void ExpressionParser::logError(std::string_view reason) const {
+  LOG(ERROR) << "Invalid expression \"" << this->text << "\" at position " << this->position << ": " << reason;
+}
+
+
+
+} // namespace JsonParser
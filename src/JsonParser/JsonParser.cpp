@@ -7,6 +7,8 @@
 #include "GameData.h"
 #include "GameRules.h"
 #include "GameState.h"
+#include "RuleCursor.h"
+#include "RuleProgram.h"
 
 #include <fstream>
 #include <glog/logging.h>
@@ -77,26 +79,42 @@ JsonParser::parseJsonFile_gameSpec(const std::string& jsonFilepath) const
     return {};
   }
   
-  const json variableJson = parseResult["variables"];
   const VariableParser variableParser = VariableParser();
+  const json constantJson = parseResult["constants"];
+  const GameState::VariableMap constantMap = variableParser.parseVariables(constantJson);
+
+  const json variableJson = parseResult["variables"];
   const GameState::VariableMap variableMap = variableParser.parseVariables(variableJson);
   
   const json perPlayerJson = parseResult["per-player"];
   const GameState::VariableMap perPlayerVariableMap = variableParser.parseVariables(perPlayerJson);
 
+  // Rules refer to variables by slot, so the layout has to exist before they are parsed
+  auto variableLayout = std::make_shared<const GameState::VariableLayout>(variableMap, perPlayerVariableMap, constantMap);
+
   const json rulesJson = parseResult["rules"];
-  RuleParser ruleParser = RuleParser();
+  // Rules and their strings are allocated together, and freed together when the game data is
+  auto ruleArena = std::make_unique<GameRules::RuleArena>();
+  RuleParser ruleParser = RuleParser(variableLayout, *ruleArena);
   GameData::TopLevelRules topLevelRules = ruleParser.parseRules(rulesJson);
 
   if (variableMap.size() == 0 || topLevelRules.size() == 0) {
     return {};
   }
 
+  // Numbered once here so that snapshotting a game never has to search the tree
+  GameRules::numberRules(topLevelRules);
+  std::optional<GameRules::RuleProgram> program = GameRules::compileRules(topLevelRules, *variableLayout);
+
   return {
     .isValid = true,
+    .constantMap = constantMap,
     .variableMap = variableMap,
     .perPlayerVariableMap = perPlayerVariableMap,
+    .variableLayout = std::move(variableLayout),
+    .ruleArena = std::move(ruleArena),
     .topLevelRules = std::move(topLevelRules),
+    .program = std::move(program),
   };
 }
 
@@ -213,7 +231,23 @@ JsonParser::validateJsonContent_serverConfig(const json& jsonObject) const
     std::pair{"serverhtml", json::value_t::string}
   };
 
-  return validateJsonContent_rootLevelElements(jsonObject, SC_ROOT_ELEMS);
+  // Tuning options which fall back to defaults when left out
+  jsonRootElemProperties SC_OPTIONAL_ROOT_ELEMS = {
+    std::pair{"iothreads", json::value_t::number_unsigned},
+    std::pair{"writehighwatermark", json::value_t::number_unsigned},
+    std::pair{"writelowwatermark", json::value_t::number_unsigned},
+    std::pair{"writecoalescelimit", json::value_t::number_unsigned},
+    std::pair{"overflowpolicy", json::value_t::string},
+    std::pair{"coalescewrites", json::value_t::boolean},
+    std::pair{"gameworkers", json::value_t::number_unsigned},
+    std::pair{"snapshotdir", json::value_t::string},
+    std::pair{"compression", json::value_t::boolean},
+    std::pair{"compressionwindowbits", json::value_t::number_unsigned},
+    std::pair{"compressionmemlevel", json::value_t::number_unsigned},
+    std::pair{"compressionminsize", json::value_t::number_unsigned}
+  };
+
+  return validateJsonContent_rootLevelElements(jsonObject, SC_ROOT_ELEMS, SC_OPTIONAL_ROOT_ELEMS);
 }
 
 
@@ -223,14 +257,23 @@ JsonParser::validateJsonContent_serverConfig(const json& jsonObject) const
  * 
  * @param jsonObject The JSON object to be validated
  * @param rootElemProperties The desired root-level elements and their types
+ * @param optionalRootElemProperties Root-level elements which may be left out,
+ *                                   and their types when present
  * @return True for valid format, false otherwise
  */
 bool
 JsonParser::validateJsonContent_rootLevelElements(const json& jsonObject,
-                                                  const jsonRootElemProperties& rootElemProperties) const
+                                                  const jsonRootElemProperties& rootElemProperties,
+                                                  const jsonRootElemProperties& optionalRootElemProperties) const
 {
+  auto presentOptionalElems = std::count_if(optionalRootElemProperties.begin(),
+                                            optionalRootElemProperties.end(),
+                                            [&jsonObject](auto rootLevelKey) {
+                                              return jsonObject.contains(rootLevelKey.first);
+                                            });
+
   // Validate # of elements
-  if (jsonObject.size() != rootElemProperties.size()) {
+  if (jsonObject.size() != rootElemProperties.size() + presentOptionalElems) {
     return false;
   }
 
@@ -243,12 +286,18 @@ JsonParser::validateJsonContent_rootLevelElements(const json& jsonObject,
   }
 
   // Validate element value types
-  if (std::any_of(rootElemProperties.begin(), rootElemProperties.end(),
-                  [jsonObject](auto rootLevelKey) {
-                    json::value_t actual_type =
-                        jsonObject[rootLevelKey.first].type();
-                    json::value_t expected_type = rootLevelKey.second;
-                    return actual_type != expected_type;
+  auto hasWrongType = [&jsonObject](auto rootLevelKey) {
+    json::value_t actual_type =
+        jsonObject[rootLevelKey.first].type();
+    json::value_t expected_type = rootLevelKey.second;
+    return actual_type != expected_type;
+  };
+  if (std::any_of(rootElemProperties.begin(), rootElemProperties.end(), hasWrongType)) {
+    return false;
+  }
+  if (std::any_of(optionalRootElemProperties.begin(), optionalRootElemProperties.end(),
+                  [&jsonObject, &hasWrongType](auto rootLevelKey) {
+                    return jsonObject.contains(rootLevelKey.first) && hasWrongType(rootLevelKey);
                   })) {
     return false;
   }
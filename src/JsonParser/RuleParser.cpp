@@ -2,11 +2,17 @@
 
 #include <glog/logging.h>
 
+#include "ExpressionParser.h"
 #include "GameRules.h"
 #include "GameData.h"
+#include "RuleArena.h"
 
+#include <chrono>
+#include <cmath>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <algorithm>
 #include <unordered_map>
@@ -20,38 +26,94 @@ namespace JsonParser {
 /******************************************************************************
  *                         Scoped Variable Management                         *
  ******************************************************************************/
-// Convert variableName to one with context if possible
-// TODO-#58: Refactor to address string manipulation and reduce complexity
-VariableName
-RuleParser::processScopedVariables(VariableName variableName) const {
-  // Looping is necessary because variableName could be
-  // "XYZ.player.input" (where "player" is scoped variable)
-  // In which case, we only want to replace this part:
-  // "XYZ.player.input" -> "XYZ.players.$player.input"
-  //      ^^^^^^^               ^^^^^^^^^^^^^^^^  
-  //      |     |
-  //     Start  End
-  VariableName newVariableName = "";
-
-  auto variableComponentStart_it = variableName.begin();
-  auto variableComponentEnd_it = variableName.begin();
-  while (variableComponentEnd_it != variableName.end()) {
-    variableComponentEnd_it = std::find(variableComponentStart_it,
-                                        variableName.end(),
-                                        '.');
-    VariableName variableComponent = std::string(variableComponentStart_it, variableComponentEnd_it);
-    if (this->activeScopedVariableAliases.count(variableComponent) == 1) {
-      newVariableName.append(this->activeScopedVariableAliases.at(variableComponent));
-    } else {
-      newVariableName.append(variableComponent);
+// Only variables can be changed by rules, players and constants cannot
+static bool isWritable(const GameState::VariablePath& path) {
+  return path.kind == GameState::VariablePath::Kind::GLOBAL
+    || path.kind == GameState::VariablePath::Kind::PER_PLAYER;
+}
+
+namespace {
+
+// Keeps an element in scope while the child rules of a forEach are parsed, and
+// takes it out again however the parse ends
+class ScopedVariable {
+  public:
+    ScopedVariable(std::vector<VariableName>& activeScopedVariables, VariableName variableName)
+      : activeScopedVariables(activeScopedVariables) {
+      this->activeScopedVariables.push_back(std::move(variableName));
     }
-    if (variableComponentEnd_it != variableName.end()) {
-      newVariableName.append(".");
+    ~ScopedVariable() {
+      this->activeScopedVariables.pop_back();
     }
-    variableComponentStart_it = variableComponentEnd_it + 1;
+
+    ScopedVariable(const ScopedVariable&) = delete;
+    ScopedVariable& operator=(const ScopedVariable&) = delete;
+
+  private:
+    std::vector<VariableName>& activeScopedVariables;
+};
+
+}
+
+/**
+ * Resolves a variable reference within a rule to the slot it will be stored in at runtime
+ * i.e. (inside a forEach over "player")
+ *      "debug_target" -> global variable slot
+ *      "player.input" -> per-player variable slot of whichever player the forEach is on
+ *      "player"       -> the player the forEach is on
+ *      "weapons"      -> constant slot
+ * @return nullopt when the reference does not name a known variable
+ */
+std::optional<GameState::VariablePath>
+RuleParser::resolveVariablePath(const VariableName& variableName) const {
+  // Split "player.input" into "player" and "input"
+  const std::size_t separator = variableName.find('.');
+  const std::string_view head = std::string_view(variableName).substr(0, separator);
+
+  // Search innermost first so that nested elements shadow outer ones
+  const auto scopedVariable_it = std::find(this->activeScopedVariables.rbegin(),
+                                           this->activeScopedVariables.rend(),
+                                           head);
+  if (scopedVariable_it == this->activeScopedVariables.rend()) {
+    if (const std::optional<GameState::VariableSlot> slot = this->variableLayout->variables.find(variableName)) {
+      return GameState::VariablePath{
+        .kind = GameState::VariablePath::Kind::GLOBAL,
+        .slot = *slot,
+        .name = this->arena.intern(variableName),
+      };
+    }
+    if (const std::optional<GameState::VariableSlot> slot = this->variableLayout->constants.find(variableName)) {
+      return GameState::VariablePath{
+        .kind = GameState::VariablePath::Kind::CONSTANT,
+        .slot = *slot,
+        .name = this->arena.intern(variableName),
+      };
+    }
+    LOG(ERROR) << "Unknown variable \"" << variableName << "\"";
+    return std::nullopt;
+  }
+
+  const std::size_t scopeDepth = std::distance(scopedVariable_it, this->activeScopedVariables.rend()) - 1;
+  if (separator == VariableName::npos) {
+    return GameState::VariablePath{
+      .kind = GameState::VariablePath::Kind::PLAYER,
+      .scopeDepth = scopeDepth,
+      .name = this->arena.intern(variableName),
+    };
   }
 
-  return newVariableName;
+  const std::string_view perPlayerVariableName = std::string_view(variableName).substr(separator + 1);
+  const std::optional<GameState::VariableSlot> slot = this->variableLayout->perPlayerVariables.find(perPlayerVariableName);
+  if (!slot) {
+    LOG(ERROR) << "Unknown per-player variable \"" << variableName << "\"";
+    return std::nullopt;
+  }
+  return GameState::VariablePath{
+    .kind = GameState::VariablePath::Kind::PER_PLAYER,
+    .slot = *slot,
+    .scopeDepth = scopeDepth,
+    .name = this->arena.intern(variableName),
+  };
 }
 
 
@@ -59,10 +121,14 @@ RuleParser::processScopedVariables(VariableName variableName) const {
 /******************************************************************************
  *                             Public Rule Parser                             *
  ******************************************************************************/
+RuleParser::RuleParser(std::shared_ptr<const GameState::VariableLayout> variableLayout, GameRules::RuleArena& arena)
+  : variableLayout(std::move(variableLayout))
+  , arena(arena) {}
+
 RuleList
 RuleParser::parseRules(json ruleListJson)
 {
-  RuleList orderedRuleList = {};
+  RuleList orderedRuleList = this->arena.makeRules();
 
   if (ruleListJson.type() != json::value_t::array) {
       LOG(ERROR) << "Game rules are not an array at its highest level";
@@ -81,10 +147,11 @@ RuleParser::parseRules(json ruleListJson)
     } else if (ruleJson["rule"] == "global-message") {
       ruleObject = parseGlobalMessageRule(ruleJson);
     } else if (ruleJson["rule"] == "loop") {
-      // TODO-#50: The tricky part of implementing loop is handling the conditional (when to stop)
-      // ruleObject = parseLoopRule(ruleJson);
+      ruleObject = parseLoopRule(ruleJson);
     } else if (ruleJson["rule"] == "foreach") {
       ruleObject = parseForEachRule(ruleJson);
+    } else if (ruleJson["rule"] == "parallelfor") {
+      ruleObject = parseForEachRule(ruleJson, true);
     } else if (ruleJson["rule"] == "input-text") {
       ruleObject = parseInputTextRule(ruleJson);
     } else {
@@ -121,16 +188,21 @@ RuleParser::parseAddRule(json addRuleJson) const
     return nullptr;
   }
 
-  std::unique_ptr<GameRules::AddRule> addRule = nullptr;
+  GameRules::RulePtr addRule = nullptr;
   try {
-    addRule = std::make_unique<GameRules::AddRule>(processScopedVariables(addRuleJson["to"]),
-                                                   addRuleJson["value"]);
+    const std::optional<GameState::VariablePath> addTarget = resolveVariablePath(addRuleJson["to"]);
+    if (!addTarget || !isWritable(*addTarget)) {
+      LOG(ERROR) << "Add rule property \"to\" is not a variable";
+      return nullptr;
+    }
+
+    addRule = this->arena.makeRule<GameRules::AddRule>(*addTarget, addRuleJson["value"]);
   } catch (const std::exception& e) {
     LOG(ERROR) << "Add rule properties \"to\" or \"value\" was of invalid type";
     return nullptr;
   }
 
-  return std::move(addRule);
+  return addRule;
 }
 
 GameRules::RulePtr
@@ -148,7 +220,8 @@ RuleParser::parseGlobalMessageRule(json globalMessageRuleJson) const
 
   try {
     // TODO-#51: we need to somehow access variables from here?
-    return std::make_unique<GameRules::GlobalMessageRule>(globalMessageRuleJson["value"]);
+    return this->arena.makeRule<GameRules::GlobalMessageRule>(
+      this->arena.intern(globalMessageRuleJson["value"].get_ref<const std::string&>()));
   } catch (const std::exception& e) {
     LOG(ERROR) << "Global message rule property \"value\" was not string";
     return nullptr;
@@ -156,7 +229,50 @@ RuleParser::parseGlobalMessageRule(json globalMessageRuleJson) const
 }
 
 GameRules::RulePtr
-RuleParser::parseForEachRule(json forEachRuleJson)
+RuleParser::parseLoopRule(json loopRuleJson)
+{
+  const bool hasWhile = loopRuleJson.contains("while");
+  if (!loopRuleJson.contains("rules") || hasWhile == loopRuleJson.contains("until")) {
+    LOG(ERROR) << "Loop rule needs rules and exactly one of \"while\" or \"until\"";
+    return nullptr;
+  }
+
+  if (loopRuleJson.size() > 3) {
+    LOG(ERROR) << "Loop rule has too many properties";
+    return nullptr;
+  }
+
+  // The condition is either an expression, or true/false
+  const json& conditionJson = loopRuleJson[hasWhile ? "while" : "until"];
+  if (!conditionJson.is_string() && !conditionJson.is_boolean()) {
+    LOG(ERROR) << "Loop rule condition is not an expression";
+    return nullptr;
+  }
+  const std::string conditionText = conditionJson.is_string()
+    ? conditionJson.get<std::string>()
+    : conditionJson.dump();
+
+  ExpressionParser expressionParser = ExpressionParser(
+    [this](const std::string& variableName) { return this->resolveVariablePath(variableName); },
+    this->arena);
+  std::optional<GameRules::Expression> condition = expressionParser.parseExpression(conditionText, !hasWhile);
+  if (!condition) {
+    LOG(ERROR) << "Loop rule condition failed to parse";
+    return nullptr;
+  }
+
+  RuleList rulesToExecuteEachIteration = parseRules(loopRuleJson["rules"]);
+  if (rulesToExecuteEachIteration.empty()) {
+    LOG(ERROR) << "Loop rule has no rules to execute";
+    return nullptr;
+  }
+
+  return this->arena.makeRule<GameRules::LoopRule>(std::move(*condition), std::move(rulesToExecuteEachIteration));
+}
+
+// A parallelFor has the same properties as a forEach, and runs its rules for every element at once
+GameRules::RulePtr
+RuleParser::parseForEachRule(json forEachRuleJson, bool isParallel)
 {
   if (!forEachRuleJson.contains("list") || !forEachRuleJson.contains("element")
                                     || !forEachRuleJson.contains("rules")) {
@@ -169,39 +285,38 @@ RuleParser::parseForEachRule(json forEachRuleJson)
     return nullptr;
   }
 
-  std::unique_ptr<GameRules::ForEachRule> forEachRule = nullptr;
+  GameRules::RulePtr forEachRule = nullptr;
   try {
     if (std::string(forEachRuleJson["list"]) != "players") {
       LOG(ERROR) << "List found that is not named players - currently only \"players\" list is supported";
       return nullptr;
     }
 
-    // Convert any references of `element` into "`list`.$`element`" within the child rules
-    // The ($) will let us identify which elements need to be dynamically evaluated during runtime
-    VariableName listElemVariableName{forEachRuleJson["element"]};
-    VariableName contextedElemVariableName{forEachRuleJson["list"]};
-    contextedElemVariableName.append(".$");
-    contextedElemVariableName.append(forEachRuleJson["element"]);
-
-    // Parsing forEach, any references to "element" should be converted to "list.$element"
-    this->activeScopedVariableAliases.insert({listElemVariableName, contextedElemVariableName});
+    // Parsing forEach, any references to "element" within the child rules refer to this scope
+    const ScopedVariable element(this->activeScopedVariables, forEachRuleJson["element"]);
 
-    forEachRule = std::make_unique<GameRules::ForEachRule>(forEachRuleJson["list"],
-                                                           forEachRuleJson["element"],
-                                                           parseRules(forEachRuleJson["rules"]));
+    const std::string_view listName = this->arena.intern(forEachRuleJson["list"].get_ref<const std::string&>());
+    const std::string_view elementName = this->arena.intern(forEachRuleJson["element"].get_ref<const std::string&>());
+    RuleList rulesToExecuteEachElement = parseRules(forEachRuleJson["rules"]);
+    if (rulesToExecuteEachElement.empty()) {
+      LOG(ERROR) << "For-each rule has no rules to execute";
+      return nullptr;
+    }
 
-    // Done parsing forEach, no longer need to convert "element" -> "list.$element"
-    this->activeScopedVariableAliases.erase(listElemVariableName);
+    if (isParallel) {
+      forEachRule = this->arena.makeRule<GameRules::ParallelForRule>(listName, elementName, std::move(rulesToExecuteEachElement));
+    } else {
+      forEachRule = this->arena.makeRule<GameRules::ForEachRule>(listName, elementName, std::move(rulesToExecuteEachElement));
+    }
   } catch (const std::exception& e) {
     LOG(ERROR) << "For-each rule properties were of invalid type";
     return nullptr;
   }
 
-  return std::move(forEachRule);
+  return forEachRule;
 }
 
 // TODO: We should probably have some way of identifying and asserting that "to" is a player
-// TODO: Add hanlding for timeout variable
 GameRules::RulePtr
 RuleParser::parseInputTextRule(json inputTextRuleJson) const
 {
@@ -211,22 +326,47 @@ RuleParser::parseInputTextRule(json inputTextRuleJson) const
     return nullptr;
   }
 
-  if (inputTextRuleJson.size() > 4) {
+  const bool hasTimeout = inputTextRuleJson.contains("timeout");
+  if (inputTextRuleJson.size() > (hasTimeout ? 5 : 4)) {
     LOG(ERROR) << "Input-text rule has too many properties";
     return nullptr;
   }
 
-  std::unique_ptr<GameRules::InputTextRule> inputTextRule = nullptr;
+  // The timeout is in seconds
+  std::optional<std::chrono::milliseconds> timeout = std::nullopt;
+  if (hasTimeout) {
+    const json& timeoutJson = inputTextRuleJson["timeout"];
+    if (!timeoutJson.is_number() || timeoutJson.get<double>() < 0) {
+      LOG(ERROR) << "Input-text rule property \"timeout\" is not a number of seconds";
+      return nullptr;
+    }
+    timeout = std::chrono::milliseconds{std::llround(timeoutJson.get<double>() * 1000)};
+  }
+
+  GameRules::RulePtr inputTextRule = nullptr;
   try {
-    inputTextRule = std::make_unique<GameRules::InputTextRule>(processScopedVariables(inputTextRuleJson["to"]),
-                                                               inputTextRuleJson["prompt"],
-                                                               processScopedVariables(inputTextRuleJson["result"]));
+    const std::optional<GameState::VariablePath> targettedUser = resolveVariablePath(inputTextRuleJson["to"]);
+    const std::optional<GameState::VariablePath> resultVariable = resolveVariablePath(inputTextRuleJson["result"]);
+    if (!targettedUser || targettedUser->kind != GameState::VariablePath::Kind::PLAYER) {
+      LOG(ERROR) << "Input-text rule property \"to\" is not a player";
+      return nullptr;
+    }
+    if (!resultVariable || !isWritable(*resultVariable)) {
+      LOG(ERROR) << "Input-text rule property \"result\" is not a variable";
+      return nullptr;
+    }
+
+    inputTextRule = this->arena.makeRule<GameRules::InputTextRule>(
+      *targettedUser,
+      this->arena.intern(inputTextRuleJson["prompt"].get_ref<const std::string&>()),
+      *resultVariable,
+      timeout);
   } catch (const std::exception& e) {
     LOG(ERROR) << "Input-text rule properties were of invalid type";
     return nullptr;
   }
 
-  return std::move(inputTextRule);
+  return inputTextRule;
 }
 
 
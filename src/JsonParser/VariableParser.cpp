@@ -4,8 +4,11 @@
 
 #include "GameState.h"
 
+#include <limits>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 using json = nlohmann::json;
 
@@ -25,12 +28,12 @@ VariableParser::parseVariables(json variableJson) const
 
   GameState::VariableMap gameVariableMap = {};
   for (const auto& variable : variableJson.items()) {
-    try {
-      gameVariableMap.insert({variable.key(), variable.value()});
-    } catch (const std::exception& e) {
-      LOG(ERROR) << "Key or value were not of expected type";
+    std::optional<GameState::VariableValue> value = parseValue(variable.value());
+    if (!value.has_value()) {
+      LOG(ERROR) << "Value of " << variable.key() << " is not of a supported type";
       return {};
     }
+    gameVariableMap.insert({variable.key(), std::move(*value)});
   }
   
   return gameVariableMap;
@@ -38,4 +41,69 @@ VariableParser::parseVariables(json variableJson) const
 
 
 
+/******************************************************************************
+ *                                   Helpers                                  *
+ ******************************************************************************/
+/**
+ * Builds the value of a variable directly from its JSON, i.e. 3, true, "rock",
+ * ["rock", "paper"] or {"name": "rock", "beats": "scissors"}
+ */
+std::optional<GameState::VariableValue>
+VariableParser::parseValue(const json& valueJson) const
+{
+  switch (valueJson.type()) {
+  case json::value_t::number_integer:
+  case json::value_t::number_unsigned: {
+    // Both are read as signed 64 bits, so large unsigned numbers come out negative
+    const int64_t integer = valueJson.get<int64_t>();
+    if (valueJson.is_number_unsigned() && integer < 0) {
+      return std::nullopt;
+    }
+    if (integer < std::numeric_limits<GameState::Integer>::min()
+        || integer > std::numeric_limits<GameState::Integer>::max()) {
+      return std::nullopt;
+    }
+    return GameState::VariableValue(static_cast<GameState::Integer>(integer));
+  }
+
+  case json::value_t::boolean:
+    return GameState::VariableValue(valueJson.get<bool>());
+
+  case json::value_t::string:
+    return GameState::VariableValue(valueJson.get_ref<const std::string&>());
+
+  case json::value_t::array: {
+    std::vector<GameState::VariableValue> elements;
+    elements.reserve(valueJson.size());
+    for (const json& elementJson : valueJson) {
+      std::optional<GameState::VariableValue> element = parseValue(elementJson);
+      if (!element.has_value()) {
+        return std::nullopt;
+      }
+      elements.push_back(std::move(*element));
+    }
+    return GameState::VariableValue::makeList(elements);
+  }
+
+  case json::value_t::object: {
+    std::vector<std::pair<std::string, GameState::VariableValue>> entries;
+    entries.reserve(valueJson.size());
+    for (const auto& entry : valueJson.items()) {
+      std::optional<GameState::VariableValue> value = parseValue(entry.value());
+      if (!value.has_value()) {
+        return std::nullopt;
+      }
+      entries.emplace_back(entry.key(), std::move(*value));
+    }
+    return GameState::VariableValue::makeMap(std::move(entries));
+  }
+
+  // TODO: Floats
+  default:
+    return std::nullopt;
+  }
+}
+
+
+
 } // namespace JsonParser
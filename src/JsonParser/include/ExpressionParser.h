@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Expression.h"
+#include "GameState.h"
+#include "RuleArena.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace JsonParser {
+
+
+
+/**
+ * Parses expressions such as "round < rounds && !player.isDone" into an Expression.
+ *
+ * Precedence, loosest first:  ||   &&   == !=   < <= > >=   + -   * / %   ! -(unary)
+ * Operands are integers, true, false, parenthesized expressions, players.size, variable
+ * and constant references which are resolved to slots by the given resolver, and the
+ * sizes of those, i.e. "weapons.size".
+ */
+class ExpressionParser {
+public:
+  using VariableResolver = std::function<std::optional<GameState::VariablePath>(const std::string&)>;
+
+  ExpressionParser(VariableResolver resolveVariable, GameRules::RuleArena& arena);
+
+  // Returns nullopt (and logs why) when the text is not a valid expression. A negated
+  // expression holds when the text does not, i.e. for the "until" of a loop.
+  std::optional<GameRules::Expression> parseExpression(std::string_view text, bool isNegated = false);
+private:
+  VariableResolver resolveVariable;
+  GameRules::RuleArena& arena;
+
+  // State of the expression currently being parsed
+  std::string_view text;
+  std::size_t position = 0;
+  std::pmr::vector<GameRules::ExpressionNode> nodes;
+
+  // Each returns the index of the node it parsed, or nullopt on error
+  std::optional<uint32_t> parseBinary(std::size_t precedence);
+  std::optional<uint32_t> parseUnary();
+  std::optional<uint32_t> parsePrimary();
+  std::optional<uint32_t> parseReference();
+
+  uint32_t addNode(GameRules::ExpressionNode node);
+  void skipWhitespace();
+  bool consume(std::string_view token);
+  void logError(std::string_view reason) const;
+};
+
+
+
+} // namespace JsonParser
@@ -31,7 +31,8 @@ private:
     bool validateJsonContent_gameSpec(const json& jsonObject) const;
     bool validateJsonContent_serverConfig(const json& jsonObject) const;
     bool validateJsonContent_rootLevelElements(const json& jsonObject,
-                                               const jsonRootElemProperties& rootElemProperties) const;
+                                               const jsonRootElemProperties& rootElemProperties,
+                                               const jsonRootElemProperties& optionalRootElemProperties = {}) const;
 
     // Wraps Nlohmann's parse() to catch exceptions
     json safeParse(const std::string& jsonSource, const bool isFile) const;
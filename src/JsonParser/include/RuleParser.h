@@ -3,34 +3,42 @@
 
 #include "GameRules.h"
 #include "GameData.h"
+#include "RuleArena.h"
 
 #include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
 
 using json = nlohmann::json;
 
 namespace JsonParser {
 
-using RuleList = std::vector<GameRules::RulePtr>;
+using RuleList = GameRules::Rules;
 using VariableName = std::string;
-using VariableAliasMap = std::unordered_map<VariableName, VariableName>;
 
 
 class RuleParser {
 public:
-  RuleParser() = default;
+  // Variable references within rules are resolved against this layout, and
+  // the rules along with their strings are placed in the arena
+  RuleParser(std::shared_ptr<const GameState::VariableLayout> variableLayout, GameRules::RuleArena& arena);
 
   RuleList parseRules(json ruleListJson);
 private:
-  // Scoped variable management for rules such as forEach
-  VariableAliasMap activeScopedVariableAliases = {};
-  VariableName processScopedVariables(VariableName variableName) const;
+  std::shared_ptr<const GameState::VariableLayout> variableLayout;
+  GameRules::RuleArena& arena;
+
+  // Scoped variable management for rules such as forEach, innermost element last
+  std::vector<VariableName> activeScopedVariables = {};
+  std::optional<GameState::VariablePath> resolveVariablePath(const VariableName& variableName) const;
 
   // Rule Parsers
   GameRules::RulePtr parseAddRule(json addRuleJson) const;
   GameRules::RulePtr parseGlobalMessageRule(json globalMessageRuleJson) const;
-  GameRules::RulePtr parseForEachRule(json forEachRuleJson);
+  GameRules::RulePtr parseLoopRule(json loopRuleJson);
+  GameRules::RulePtr parseForEachRule(json forEachRuleJson, bool isParallel = false);
   GameRules::RulePtr parseInputTextRule(json inputTextRuleJson) const;
 };
 
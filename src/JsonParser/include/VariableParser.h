@@ -3,6 +3,7 @@
 
 #include "GameState.h"
 
+#include <optional>
 #include <string>
 #include <unordered_map>
 
@@ -18,7 +19,8 @@ public:
 
   GameState::VariableMap parseVariables(json variableJson) const;
 private:
-  // Any helper functions should be defined here
+  // Returns nullopt for values a variable cannot hold, i.e. floats or numbers out of range
+  std::optional<GameState::VariableValue> parseValue(const json& valueJson) const;
 };
 
 
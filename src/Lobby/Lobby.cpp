@@ -0,0 +1,559 @@
+#include "Lobby.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <charconv>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+#include "GameRules.h"
+#include "Snapshot.h"
+
+
+
+namespace Lobby {
+
+
+
+/******************************************************************************
+ *                                State Deltas                                *
+ ******************************************************************************/
+[[nodiscard]] std::string encodeStateDelta(const StateDelta& delta) {
+  std::ostringstream message;
+  message << "#state {";
+  std::unordered_set<std::string_view> sent;
+  const char* separator = "";
+  for (auto change = delta.rbegin(); change != delta.rend(); ++change) {
+    if (!sent.insert(change->name).second) {
+      continue;
+    }
+    message << std::exchange(separator, ", ");
+    GameState::printJson(message, GameState::VariableValue(change->name));
+    message << ": ";
+    GameState::printJson(message, change->value);
+  }
+  message << "}\n";
+  return message.str();
+}
+
+
+
+/******************************************************************************
+ *                                   Lobby                                    *
+ ******************************************************************************/
+Lobby::Lobby(InviteCode inviteCode, std::string gameName, GameDataPtr gameData)
+  : inviteCode(std::move(inviteCode))
+  , gameName(std::move(gameName))
+  , gameData(std::move(gameData)) {}
+
+
+void Lobby::addMember(networking::Connection connection) {
+  if (this->memberIndices.try_emplace(connection.id, this->members.size()).second) {
+    this->members.push_back(connection);
+  }
+}
+
+
+void Lobby::removeMember(networking::Connection connection) {
+  auto found = this->memberIndices.find(connection.id);
+  if (found == this->memberIndices.end()) {
+    return;
+  }
+
+  const std::size_t index = found->second;
+  this->memberIndices.erase(found);
+  this->reclaimedPlayers.erase(connection.id);
+  if (index + 1 != this->members.size()) {
+    this->members[index] = this->members.back();
+    this->memberIndices[this->members[index].id] = index;
+  }
+  this->members.pop_back();
+}
+
+
+[[nodiscard]] bool Lobby::isAwaitingInputFrom(GameState::PlayerID playerID) const {
+  return std::find(this->awaitingInputFrom.begin(), this->awaitingInputFrom.end(), playerID)
+    != this->awaitingInputFrom.end();
+}
+
+
+void Lobby::stopAwaitingInputFrom(GameState::PlayerID playerID) {
+  auto eraseBegin = std::remove(this->awaitingInputFrom.begin(), this->awaitingInputFrom.end(), playerID);
+  this->awaitingInputFrom.erase(eraseBegin, this->awaitingInputFrom.end());
+}
+
+
+[[nodiscard]] GameState::PlayerIDList Lobby::getPlayerIDs() const {
+  GameState::PlayerIDList playerIDs = {};
+  playerIDs.reserve(this->members.size());
+  for (const networking::Connection& member : this->members) {
+    playerIDs.push_back(this->getPlayerID(member));
+  }
+  return playerIDs;
+}
+
+
+[[nodiscard]] GameState::PlayerID Lobby::getPlayerID(networking::Connection connection) const {
+  auto found = this->reclaimedPlayers.find(connection.id);
+  return found != this->reclaimedPlayers.end() ? found->second : connection.id;
+}
+
+
+[[nodiscard]] bool Lobby::reclaimPlayer(networking::Connection connection, std::string_view nickname) {
+  if (!this->memberIndices.contains(connection.id) || this->reclaimedPlayers.contains(connection.id)) {
+    return false;
+  }
+  auto absent = std::find_if(this->absentPlayers.begin(), this->absentPlayers.end(), [nickname](const PlayerName& player) {
+    return player.nickname == nickname;
+  });
+  if (absent == this->absentPlayers.end()) {
+    return false;
+  }
+  this->reclaimedPlayers.insert({connection.id, absent->playerID});
+  this->absentPlayers.erase(absent);
+  return true;
+}
+
+
+
+/******************************************************************************
+ *                                Game Session                                *
+ ******************************************************************************/
+GameSession::GameSession(GameDataPtr gameData)
+  : gameData(std::move(gameData)) {}
+
+
+void GameSession::executeGame(const GameState::PlayerIDList& playerIDs, std::ostream& log) {
+  if (this->gameData == nullptr || !this->gameData->isValid) {
+    log << "\tCannot execute game - not yet loaded\n";
+    return;
+  }
+
+  if (this->isRunning()) {
+    log << "\tCannot execute game - already in progress\n";
+    return;
+  }
+
+  log << "\tExecuting loaded game\n";
+  this->gameState.emplace(this->gameData->variableLayout, playerIDs);
+  this->stateLog = GameState::SnapshotWriter();
+  this->gameState->setLog(&this->stateLog);
+  this->startCursor();
+
+  // TODO-#51: Just to demonstrate that the rule is doing something, can remove later
+  log << "\tdebug_target variable BEFORE executing rules: "
+      << this->gameState->getValue("debug_target").value << "\n";
+
+  this->runGame(log);
+}
+
+
+void GameSession::provideInput(GameState::PlayerID playerID, const std::string& text, std::ostream& log) {
+  if (!this->isRunning()) {
+    return;
+  }
+
+  if (!this->cursor->provideInput(playerID, text)) {
+    log << "\t\"" << text << "\" is not a valid input, please enter a number\n";
+  }
+
+  this->runGame(log);
+}
+
+
+void GameSession::expireInput(std::size_t requestNumber, std::ostream& log) {
+  const std::vector<const GameRules::InputRequest*> requests = this->getPendingInputs();
+  auto request = std::find_if(requests.begin(), requests.end(), [requestNumber](const GameRules::InputRequest* request) {
+    return request->requestNumber == requestNumber;
+  });
+  if (request == requests.end()) {
+    return;
+  }
+
+  const GameState::PlayerID playerID = (*request)->playerID;
+  if (!this->cursor->expireInput(requestNumber)) {
+    return;
+  }
+
+  log << "\tPlayer " << playerID << " ran out of time\n";
+  this->runGame(log);
+}
+
+
+void GameSession::expireInputFrom(GameState::PlayerID playerID, std::ostream& log) {
+  // Expiring a request changes the pending requests, so their numbers are gathered first
+  std::vector<std::size_t> requestNumbers;
+  for (const GameRules::InputRequest* request : this->getPendingInputs()) {
+    if (request->playerID == playerID) {
+      requestNumbers.push_back(request->requestNumber);
+    }
+  }
+
+  bool hasExpired = false;
+  for (const std::size_t requestNumber : requestNumbers) {
+    hasExpired = this->cursor->expireInput(requestNumber) || hasExpired;
+  }
+  if (!hasExpired) {
+    return;
+  }
+
+  log << "\tPlayer " << playerID << " left, so their input is not waited on\n";
+  this->runGame(log);
+}
+
+
+[[nodiscard]] GameState::PlayerIDList GameSession::getAwaitingInputFrom() const {
+  GameState::PlayerIDList playerIDs = {};
+  for (const GameRules::InputRequest* request : this->getPendingInputs()) {
+    playerIDs.push_back(request->playerID);
+  }
+  return playerIDs;
+}
+
+
+[[nodiscard]] StateDelta GameSession::takeStateDelta() {
+  if (!this->gameState.has_value()) {
+    return {};
+  }
+
+  const GameState::GameState::Changes changes = this->gameState->takeChanges();
+  const GameState::VariableLayout& layout = this->gameState->getLayout();
+  const GameState::PlayerIDList& playerIDs = this->gameState->getPlayerIDs();
+  StateDelta delta;
+  delta.reserve(changes.variables.size() + changes.playerVariables.size());
+  for (const GameState::VariableSlot slot : changes.variables) {
+    delta.push_back({layout.variables.getName(slot), this->gameState->getVariableValue(slot).value});
+  }
+  for (const auto& [playerIndex, slot] : changes.playerVariables) {
+    delta.push_back({
+      "players." + std::to_string(playerIDs[playerIndex]) + "." + layout.perPlayerVariables.getName(slot),
+      this->gameState->getPlayerVariableValue(playerIndex, slot).value,
+    });
+  }
+  return delta;
+}
+
+
+[[nodiscard]] std::vector<const GameRules::InputRequest*> GameSession::getPendingInputs() const {
+  if (!this->isRunning()) {
+    return {};
+  }
+  return this->cursor->getPendingInputs();
+}
+
+
+// Bumped whenever the layout of a snapshot changes, so older ones are refused rather than misread
+static constexpr uint64_t SESSION_SNAPSHOT_VERSION = 1;
+
+
+[[nodiscard]] std::string GameSession::writeSnapshot() {
+  this->stateLog = GameState::SnapshotWriter();
+
+  GameState::SnapshotWriter writer;
+  writer.writeUnsigned(SESSION_SNAPSHOT_VERSION);
+  writer.writeBool(this->isRunning());
+  if (this->isRunning()) {
+    writer.writeUnsigned(this->newestPromptedRequest);
+    this->gameState->writeSnapshot(writer);
+    this->cursor->writeSnapshot(writer);
+  }
+  return writer.takeBytes();
+}
+
+
+[[nodiscard]] bool GameSession::restoreSnapshot(std::string_view snapshot, std::string_view log) {
+  this->cursor.reset();
+  this->newestPromptedRequest = 0;
+  if (this->gameData == nullptr || !this->gameData->isValid) {
+    return false;
+  }
+
+  GameState::SnapshotReader reader(snapshot);
+  if (reader.readUnsigned() != SESSION_SNAPSHOT_VERSION) {
+    LOG(ERROR) << "Game snapshot has an unknown version";
+    return false;
+  }
+  if (!reader.readBool()) {
+    return reader.isValid() && reader.isAtEnd();
+  }
+
+  const std::size_t newestPromptedRequest = reader.readUnsigned();
+  std::optional<GameState::GameState> gameState =
+    GameState::GameState::readSnapshot(reader, this->gameData->variableLayout);
+  if (!gameState.has_value()) {
+    return false;
+  }
+
+  this->gameState.emplace(std::move(*gameState));
+  this->startCursor();
+  if (!this->cursor->readSnapshot(reader) || !reader.isAtEnd()) {
+    this->cursor.reset();
+    return false;
+  }
+  this->newestPromptedRequest = newestPromptedRequest;
+
+  if (!this->replayLog(log)) {
+    this->cursor.reset();
+    this->newestPromptedRequest = 0;
+    return false;
+  }
+  this->stateLog = GameState::SnapshotWriter();
+  this->gameState->setLog(&this->stateLog);
+  return true;
+}
+
+
+[[nodiscard]] std::string GameSession::takeLogEntry() {
+  GameState::SnapshotWriter cursorWriter;
+  if (this->isRunning()) {
+    this->cursor->writeSnapshot(cursorWriter);
+  }
+
+  GameState::SnapshotWriter entry;
+  entry.writeUnsigned(this->newestPromptedRequest);
+  entry.writeBool(this->isRunning());
+  entry.writeString(this->stateLog.getBytes());
+  entry.writeString(cursorWriter.getBytes());
+  this->stateLog = GameState::SnapshotWriter();
+
+  // Length prefixed, so that an entry cut short is recognised as such
+  GameState::SnapshotWriter framed;
+  framed.writeString(entry.getBytes());
+  return framed.takeBytes();
+}
+
+
+// The variables are brought up to date entry by entry, the cursor only needs the last one's position
+[[nodiscard]] bool GameSession::replayLog(std::string_view log) {
+  GameState::SnapshotReader logReader(log);
+  std::optional<std::string_view> cursorSnapshot;
+  while (!logReader.isAtEnd()) {
+    const std::string_view entry = logReader.readString();
+    if (!logReader.isValid()) {
+      LOG(WARNING) << "Dropping the last game log entry, which was not completely written";
+      break;
+    }
+
+    GameState::SnapshotReader entryReader(entry);
+    const std::size_t newestPromptedRequest = entryReader.readUnsigned();
+    const bool isRunning = entryReader.readBool();
+    GameState::SnapshotReader stateReader(entryReader.readString());
+    cursorSnapshot = entryReader.readString();
+    if (!entryReader.isValid() || !entryReader.isAtEnd() || !this->gameState->replayLog(stateReader)) {
+      LOG(ERROR) << "Game log entry is corrupt or for a different game";
+      return false;
+    }
+
+    this->newestPromptedRequest = newestPromptedRequest;
+    if (!isRunning) {
+      this->cursor.reset();
+      this->newestPromptedRequest = 0;
+      return true;
+    }
+  }
+
+  if (cursorSnapshot.has_value()) {
+    this->startCursor();
+    GameState::SnapshotReader cursorReader(*cursorSnapshot);
+    return this->cursor->readSnapshot(cursorReader) && cursorReader.isAtEnd();
+  }
+  return true;
+}
+
+
+void GameSession::startCursor() {
+  if (this->gameData->program.has_value()) {
+    this->cursor.emplace(*this->gameData->program, *this->gameState);
+  } else {
+    this->cursor.emplace(this->gameData->topLevelRules, *this->gameState);
+  }
+}
+
+
+void GameSession::runGame(std::ostream& log) {
+  const GameRules::RuleExecutionResult result = this->cursor->run();
+  log << this->cursor->takeOutput();
+
+  if (result == GameRules::RuleExecutionResult::SUSPENDED) {
+    // Requests are numbered in order, so players still answering in a parallelFor are only prompted once
+    std::size_t newestRequest = this->newestPromptedRequest;
+    for (const GameRules::InputRequest* request : this->cursor->getPendingInputs()) {
+      if (request->requestNumber > this->newestPromptedRequest) {
+        log << "\tWaiting for input from player " << request->playerID << ": " << request->prompt << "\n";
+        newestRequest = std::max(newestRequest, request->requestNumber);
+      }
+    }
+    this->newestPromptedRequest = newestRequest;
+    return;
+  }
+
+  if (result == GameRules::RuleExecutionResult::FAILURE) {
+    LOG(ERROR) << "Top level rule failed to execute";
+  }
+
+  // TODO-#51: Just to demonstrate that the rule is doing something, can remove later
+  log << "\tdebug_target variable AFTER executing rules: "
+      << this->gameState->getValue("debug_target").value << "\n";
+
+  log << "\tGame finished executing.\n";
+  this->cursor.reset();
+  this->newestPromptedRequest = 0;
+}
+
+
+
+/******************************************************************************
+ *                               Lobby Manager                                *
+ ******************************************************************************/
+LobbyManager::LobbyManager(InviteCode baseInviteCode,
+                           std::string defaultGameName,
+                           GameDataPtr defaultGameData,
+                           LobbyClosedHandler onLobbyClosed,
+                           AwaitedMemberLeftHandler onAwaitedMemberLeft)
+  : baseInviteCode(baseInviteCode)
+  , onLobbyClosed(std::move(onLobbyClosed))
+  , onAwaitedMemberLeft(std::move(onAwaitedMemberLeft)) {
+  this->lobbies.try_emplace(baseInviteCode, baseInviteCode, std::move(defaultGameName), std::move(defaultGameData));
+}
+
+
+Lobby& LobbyManager::createLobby(std::string gameName, GameDataPtr gameData) {
+  InviteCode inviteCode = this->baseInviteCode + "-" + std::to_string(++this->lobbiesCreated);
+  auto [lobby, _] = this->lobbies.try_emplace(inviteCode, inviteCode, std::move(gameName), std::move(gameData));
+  LOG(INFO) << "Created lobby " << inviteCode << " playing " << lobby->second.getGameName();
+  return lobby->second;
+}
+
+
+Lobby& LobbyManager::restoreLobby(const InviteCode& inviteCode,
+                                  std::string gameName,
+                                  GameDataPtr gameData,
+                                  PlayerNames players,
+                                  std::chrono::steady_clock::time_point rejoinDeadline) {
+  // Lobbies created from now on must not take the restored lobby's invite code
+  const std::string createdPrefix = this->baseInviteCode + "-";
+  if (inviteCode.starts_with(createdPrefix)) {
+    const std::string_view number = std::string_view(inviteCode).substr(createdPrefix.size());
+    std::size_t created = 0;
+    if (std::from_chars(number.data(), number.data() + number.size(), created).ec == std::errc{}) {
+      this->lobbiesCreated = std::max(this->lobbiesCreated, created);
+    }
+  }
+
+  auto [lobby, _] = this->lobbies.try_emplace(inviteCode, inviteCode, std::move(gameName), std::move(gameData));
+  lobby->second.setAbsentPlayers(std::move(players));
+  this->rejoinDeadlines.insert_or_assign(inviteCode, rejoinDeadline);
+  return lobby->second;
+}
+
+
+void LobbyManager::expireAbsentPlayers(std::chrono::steady_clock::time_point now) {
+  std::vector<InviteCode> expired;
+  for (const auto& [inviteCode, rejoinDeadline] : this->rejoinDeadlines) {
+    if (rejoinDeadline <= now) {
+      expired.push_back(inviteCode);
+    }
+  }
+
+  for (const InviteCode& inviteCode : expired) {
+    this->rejoinDeadlines.erase(inviteCode);
+    Lobby* lobby = findLobby(inviteCode);
+    if (lobby == nullptr) {
+      continue;
+    }
+    if (lobby->isEmpty()) {
+      LOG(INFO) << "Closing restored lobby " << inviteCode << ", nobody joined back";
+      closeLobby(inviteCode);
+      continue;
+    }
+
+    // Treated as having left, so the game is not held up by them
+    for (const PlayerName& player : lobby->getAbsentPlayers()) {
+      if (lobby->isAwaitingInputFrom(player.playerID)) {
+        lobby->stopAwaitingInputFrom(player.playerID);
+        if (this->onAwaitedMemberLeft) {
+          this->onAwaitedMemberLeft(inviteCode, player.playerID);
+        }
+      }
+    }
+    lobby->setAbsentPlayers({});
+  }
+}
+
+
+[[nodiscard]] Lobby* LobbyManager::findLobby(const InviteCode& inviteCode) {
+  auto found = this->lobbies.find(inviteCode);
+  return found != this->lobbies.end() ? &found->second : nullptr;
+}
+
+
+[[nodiscard]] Lobby* LobbyManager::findLobbyOf(networking::Connection connection) {
+  auto found = this->memberLobbies.find(connection.id);
+  return found != this->memberLobbies.end() ? found->second : nullptr;
+}
+
+
+[[nodiscard]] Lobby& LobbyManager::getDefaultLobby() {
+  return this->lobbies.at(this->baseInviteCode);
+}
+
+
+Lobby* LobbyManager::joinLobby(networking::Connection connection, const InviteCode& inviteCode) {
+  Lobby* lobby = findLobby(inviteCode);
+  if (lobby == nullptr) {
+    return nullptr;
+  }
+
+  if (findLobbyOf(connection) == lobby) {
+    return lobby;
+  }
+
+  leaveLobby(connection);
+  lobby->addMember(connection);
+  this->memberLobbies.insert({connection.id, lobby});
+  return lobby;
+}
+
+
+void LobbyManager::leaveLobby(networking::Connection connection) {
+  auto found = this->memberLobbies.find(connection.id);
+  if (found == this->memberLobbies.end()) {
+    return;
+  }
+
+  Lobby* lobby = found->second;
+  const GameState::PlayerID playerID = lobby->getPlayerID(connection);
+  this->memberLobbies.erase(found);
+  lobby->removeMember(connection);
+
+  if (lobby->isEmpty() && lobby->getInviteCode() != this->baseInviteCode) {
+    const InviteCode inviteCode = lobby->getInviteCode();
+    LOG(INFO) << "Closing empty lobby " << inviteCode;
+    closeLobby(inviteCode);
+    return;
+  }
+
+  // The game would otherwise wait on them until their input times out, if it ever does
+  if (lobby->isAwaitingInputFrom(playerID)) {
+    lobby->stopAwaitingInputFrom(playerID);
+    if (this->onAwaitedMemberLeft) {
+      this->onAwaitedMemberLeft(lobby->getInviteCode(), playerID);
+    }
+  }
+}
+
+
+void LobbyManager::closeLobby(const InviteCode& inviteCode) {
+  this->lobbies.erase(inviteCode);
+  this->rejoinDeadlines.erase(inviteCode);
+  if (this->onLobbyClosed) {
+    this->onLobbyClosed(inviteCode);
+  }
+}
+
+
+
+} // namespace Lobby
@@ -0,0 +1,117 @@
+#include "Protocol.h"
+
+#include <array>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "Snapshot.h"
+
+
+
+namespace Lobby {
+
+
+static constexpr char COMMAND_PREFIX = '/';
+
+static constexpr std::array<std::pair<std::string_view, MessageKind>, 4> TEXT_COMMANDS = {{
+  {"nickname", MessageKind::NICKNAME},
+  {"create", MessageKind::CREATE},
+  {"join", MessageKind::JOIN},
+  {"execute", MessageKind::EXECUTE},
+}};
+
+
+// Text is chat, except for "quit", "shutdown" and "/<command> <argument>"
+static std::optional<Command> decodeTextCommand(std::string_view text) {
+  if (text == "quit") {
+    return Command{MessageKind::QUIT, {}};
+  }
+  if (text == "shutdown") {
+    return Command{MessageKind::SHUTDOWN, {}};
+  }
+  if (text.empty() || text.front() != COMMAND_PREFIX) {
+    return Command{MessageKind::CHAT, text};
+  }
+
+  text.remove_prefix(1);
+  const std::size_t space = text.find(' ');
+  const std::string_view name = text.substr(0, space);
+  const std::string_view argument = space == std::string_view::npos ? std::string_view{} : text.substr(space + 1);
+  for (const auto& [commandName, kind] : TEXT_COMMANDS) {
+    if (name == commandName) {
+      return Command{kind, argument};
+    }
+  }
+  return std::nullopt;
+}
+
+
+static std::optional<Command> decodeBinaryCommand(std::string_view bytes) {
+  GameState::SnapshotReader reader(bytes);
+  const uint64_t kind = reader.readUnsigned();
+  const std::string_view argument = reader.readString();
+  if (!reader.isValid() || !reader.isAtEnd() || static_cast<uint64_t>(MessageKind::SHUTDOWN) < kind) {
+    return std::nullopt;
+  }
+  return Command{static_cast<MessageKind>(kind), argument};
+}
+
+
+[[nodiscard]] std::optional<Command> decodeCommand(const networking::Message& message) {
+  if (message.type == networking::MessageType::BINARY) {
+    return decodeBinaryCommand(message.text);
+  }
+  return decodeTextCommand(message.text);
+}
+
+
+[[nodiscard]] std::string encodeCommand(const Command& command) {
+  GameState::SnapshotWriter writer;
+  writer.writeUnsigned(static_cast<uint64_t>(command.kind));
+  writer.writeString(command.argument);
+  return writer.takeBytes();
+}
+
+
+[[nodiscard]] std::string encodeStateUpdate(const StateDelta& delta) {
+  // As with encodeStateDelta(), only the last value of each variable is sent
+  std::unordered_set<std::string_view> sent;
+  std::vector<const VariableChange*> changes;
+  for (auto change = delta.rbegin(); change != delta.rend(); ++change) {
+    if (sent.insert(change->name).second) {
+      changes.push_back(&*change);
+    }
+  }
+
+  GameState::SnapshotWriter writer;
+  writer.writeUnsigned(static_cast<uint64_t>(MessageKind::STATE_UPDATE));
+  writer.writeUnsigned(changes.size());
+  for (const VariableChange* change : changes) {
+    writer.writeString(change->name);
+    writer.writeValue(change->value);
+  }
+  return writer.takeBytes();
+}
+
+
+[[nodiscard]] std::optional<StateDelta> decodeStateUpdate(std::string_view bytes) {
+  GameState::SnapshotReader reader(bytes);
+  if (reader.readUnsigned() != static_cast<uint64_t>(MessageKind::STATE_UPDATE)) {
+    return std::nullopt;
+  }
+
+  StateDelta delta(reader.readCount());
+  for (VariableChange& change : delta) {
+    change.name = reader.readString();
+    change.value = reader.readValue();
+  }
+  if (!reader.isValid() || !reader.isAtEnd()) {
+    return std::nullopt;
+  }
+  return delta;
+}
+
+
+
+} // namespace Lobby
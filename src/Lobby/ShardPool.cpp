@@ -0,0 +1,300 @@
+#include "ShardPool.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <sstream>
+
+
+
+namespace Lobby {
+
+
+// Log entries are a fraction of the size of a snapshot, so a game's log is allowed to grow
+// for a good while before it is cheaper to take a new snapshot than to replay it on restore
+static constexpr std::size_t LOG_ENTRIES_PER_SNAPSHOT = 64;
+
+
+
+ShardPool::ShardPool(std::size_t workerCount, OutputHandler onOutput, SnapshotStore* snapshots)
+  : hasWorkers(workerCount > 0)
+  , onOutput(std::move(onOutput))
+  , snapshots(snapshots) {
+  const std::size_t shardCount = std::max<std::size_t>(1, workerCount);
+  this->shards.reserve(shardCount);
+  for (std::size_t i = 0; i < shardCount; ++i) {
+    this->shards.push_back(std::make_unique<Shard>());
+  }
+
+  if (this->hasWorkers) {
+    for (auto& shard : this->shards) {
+      shard->worker = std::thread([this, &shard = *shard] { runWorker(shard); });
+    }
+  }
+}
+
+
+ShardPool::~ShardPool() {
+  for (auto& shard : this->shards) {
+    {
+      std::lock_guard lock{shard->mutex};
+      shard->isStopping = true;
+    }
+    shard->tasksReady.notify_one();
+  }
+  for (auto& shard : this->shards) {
+    if (shard->worker.joinable()) {
+      shard->worker.join();
+    }
+  }
+}
+
+
+[[nodiscard]] std::size_t ShardPool::getShardIndex(const InviteCode& inviteCode) const {
+  return std::hash<InviteCode>{}(inviteCode) % this->shards.size();
+}
+
+
+void ShardPool::post(LobbyTask task) {
+  Shard& shard = *this->shards[getShardIndex(task.inviteCode)];
+  if (!this->hasWorkers) {
+    runTask(shard, task);
+    return;
+  }
+
+  {
+    std::lock_guard lock{shard.mutex};
+    shard.tasks.push_back(std::move(task));
+  }
+  shard.tasksReady.notify_one();
+}
+
+
+[[nodiscard]] std::vector<LobbyOutput> ShardPool::takeOutputs() {
+  std::vector<LobbyOutput> taken;
+  std::lock_guard lock{this->outputMutex};
+  std::swap(taken, this->outputs);
+  return taken;
+}
+
+
+void ShardPool::advanceTimers(Clock::time_point now) {
+  if (!this->hasWorkers) {
+    expireTimers(*this->shards.front(), now);
+  }
+}
+
+
+[[nodiscard]] std::optional<ShardPool::Clock::time_point> ShardPool::getNextDeadline() const {
+  if (this->hasWorkers) {
+    return std::nullopt;
+  }
+  return this->shards.front()->timers.getNextDeadline();
+}
+
+
+void ShardPool::runWorker(Shard& shard) {
+  std::deque<LobbyTask> tasks;
+  while (true) {
+    {
+      // Sleeps until there is work to do, or the next input deadline is due
+      std::unique_lock lock{shard.mutex};
+      auto hasWork = [&shard] { return shard.isStopping || !shard.tasks.empty(); };
+      if (const auto deadline = shard.timers.getNextDeadline(); deadline.has_value()) {
+        shard.tasksReady.wait_until(lock, *deadline, hasWork);
+      } else {
+        shard.tasksReady.wait(lock, hasWork);
+      }
+      if (shard.isStopping) {
+        return;
+      }
+      std::swap(tasks, shard.tasks);
+    }
+
+    // Tasks for one lobby always run in the order they were posted
+    for (LobbyTask& task : tasks) {
+      runTask(shard, task);
+    }
+    tasks.clear();
+
+    expireTimers(shard, Clock::now());
+  }
+}
+
+
+void ShardPool::runTask(Shard& shard, LobbyTask& task) {
+  switch (task.kind) {
+    case LobbyTask::Kind::EXECUTE: {
+      auto [session, _] = shard.sessions.try_emplace(task.inviteCode, task.gameData);
+      shard.storedSessions.insert_or_assign(task.inviteCode, StoredSession{
+        .gameName = task.gameName,
+        .playerNames = std::move(task.playerNames),
+      });
+      std::ostringstream log;
+      session->second.executeGame(task.playerIDs, log);
+      updateInputTimers(shard, task.inviteCode, session->second);
+      storeSession(shard, task.inviteCode, session->second);
+      this->addOutput({task.inviteCode, log.str(), session->second.getAwaitingInputFrom(), session->second.takeStateDelta()});
+      break;
+    }
+    case LobbyTask::Kind::INPUT: {
+      auto session = shard.sessions.find(task.inviteCode);
+      if (session == shard.sessions.end()) {
+        break;
+      }
+      std::ostringstream log;
+      session->second.provideInput(task.playerID, task.text, log);
+      updateInputTimers(shard, task.inviteCode, session->second);
+      storeSession(shard, task.inviteCode, session->second);
+      this->addOutput({task.inviteCode, log.str(), session->second.getAwaitingInputFrom(), session->second.takeStateDelta()});
+      break;
+    }
+    case LobbyTask::Kind::LEAVE: {
+      auto session = shard.sessions.find(task.inviteCode);
+      if (session == shard.sessions.end()) {
+        break;
+      }
+      std::ostringstream log;
+      session->second.expireInputFrom(task.playerID, log);
+      updateInputTimers(shard, task.inviteCode, session->second);
+      storeSession(shard, task.inviteCode, session->second);
+      this->addOutput({task.inviteCode, log.str(), session->second.getAwaitingInputFrom(), session->second.takeStateDelta()});
+      break;
+    }
+    case LobbyTask::Kind::CLOSE:
+      cancelInputTimers(shard, task.inviteCode);
+      shard.sessions.erase(task.inviteCode);
+      shard.storedSessions.erase(task.inviteCode);
+      if (this->snapshots != nullptr) {
+        this->snapshots->remove(task.inviteCode);
+      }
+      break;
+    case LobbyTask::Kind::RESTORE: {
+      cancelInputTimers(shard, task.inviteCode);
+      shard.sessions.erase(task.inviteCode);
+      auto [session, _] = shard.sessions.try_emplace(task.inviteCode, task.gameData);
+      shard.storedSessions.insert_or_assign(task.inviteCode, StoredSession{
+        .gameName = task.gameName,
+        .playerNames = std::move(task.playerNames),
+      });
+      if (!session->second.restoreSnapshot(task.text, task.log)) {
+        LOG(ERROR) << "Cannot restore the game of lobby " << task.inviteCode << " from its snapshot";
+      }
+      updateInputTimers(shard, task.inviteCode, session->second);
+      storeSession(shard, task.inviteCode, session->second);
+      this->addOutput({task.inviteCode, "", session->second.getAwaitingInputFrom(), session->second.takeStateDelta()});
+      break;
+    }
+  }
+}
+
+
+void ShardPool::expireTimers(Shard& shard, Clock::time_point now) {
+  for (InputTimeout& timeout : shard.timers.advance(now)) {
+    // The timer has fired, so only the others need cancelling if the game moves on
+    if (auto inputTimers = shard.inputTimers.find(timeout.inviteCode); inputTimers != shard.inputTimers.end()) {
+      std::erase_if(inputTimers->second, [&timeout](const InputTimer& inputTimer) {
+        return inputTimer.requestNumber == timeout.requestNumber;
+      });
+    }
+    auto session = shard.sessions.find(timeout.inviteCode);
+    if (session == shard.sessions.end()) {
+      continue;
+    }
+
+    std::ostringstream log;
+    session->second.expireInput(timeout.requestNumber, log);
+    updateInputTimers(shard, timeout.inviteCode, session->second);
+    storeSession(shard, timeout.inviteCode, session->second);
+    this->addOutput({timeout.inviteCode, log.str(), session->second.getAwaitingInputFrom(), session->second.takeStateDelta()});
+  }
+}
+
+
+// Keeps a timer for each input request the session is waiting on
+void ShardPool::updateInputTimers(Shard& shard, const InviteCode& inviteCode, const GameSession& session) {
+  const std::vector<const GameRules::InputRequest*> requests = session.getPendingInputs();
+  if (requests.empty()) {
+    cancelInputTimers(shard, inviteCode);
+    return;
+  }
+
+  std::vector<InputTimer>& inputTimers = shard.inputTimers[inviteCode];
+  auto isPending = [&requests](std::size_t requestNumber) {
+    return std::any_of(requests.begin(), requests.end(), [requestNumber](const GameRules::InputRequest* request) {
+      return request->requestNumber == requestNumber;
+    });
+  };
+  std::erase_if(inputTimers, [&shard, &isPending](const InputTimer& inputTimer) {
+    if (isPending(inputTimer.requestNumber)) {
+      return false;
+    }
+    shard.timers.cancel(inputTimer.timer);
+    return true;
+  });
+
+  for (const GameRules::InputRequest* request : requests) {
+    const bool hasTimer = std::any_of(inputTimers.begin(), inputTimers.end(), [request](const InputTimer& inputTimer) {
+      return inputTimer.requestNumber == request->requestNumber;
+    });
+    if (hasTimer || !request->timeout.has_value()) {
+      continue;
+    }
+    const TimerId timer = shard.timers.schedule(Clock::now() + *request->timeout,
+                                                {inviteCode, request->requestNumber});
+    inputTimers.push_back({timer, request->requestNumber});
+  }
+
+  if (inputTimers.empty()) {
+    shard.inputTimers.erase(inviteCode);
+  }
+}
+
+
+void ShardPool::cancelInputTimers(Shard& shard, const InviteCode& inviteCode) {
+  auto inputTimers = shard.inputTimers.find(inviteCode);
+  if (inputTimers == shard.inputTimers.end()) {
+    return;
+  }
+  for (const InputTimer& inputTimer : inputTimers->second) {
+    shard.timers.cancel(inputTimer.timer);
+  }
+  shard.inputTimers.erase(inputTimers);
+}
+
+
+// Snapshots and log entries are taken on the shard's thread, the store writes them out on its own
+void ShardPool::storeSession(Shard& shard, const InviteCode& inviteCode, GameSession& session) {
+  if (this->snapshots == nullptr) {
+    return;
+  }
+  if (!session.isRunning()) {
+    this->snapshots->remove(inviteCode);
+    return;
+  }
+
+  StoredSession& storedSession = shard.storedSessions[inviteCode];
+  if (!storedSession.hasSnapshot || storedSession.logEntryCount >= LOG_ENTRIES_PER_SNAPSHOT) {
+    this->snapshots->save(inviteCode, storedSession.gameName, storedSession.playerNames, session.writeSnapshot());
+    storedSession.hasSnapshot = true;
+    storedSession.logEntryCount = 0;
+  } else {
+    this->snapshots->appendLog(inviteCode, session.takeLogEntry());
+    ++storedSession.logEntryCount;
+  }
+}
+
+
+void ShardPool::addOutput(LobbyOutput output) {
+  {
+    std::lock_guard lock{this->outputMutex};
+    this->outputs.push_back(std::move(output));
+  }
+  if (this->onOutput) {
+    this->onOutput();
+  }
+}
+
+
+
+} // namespace Lobby
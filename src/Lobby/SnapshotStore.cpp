@@ -0,0 +1,313 @@
+#include "SnapshotStore.h"
+
+#include <glog/logging.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+#include "Snapshot.h"
+
+
+
+namespace Lobby {
+
+
+static const std::string SNAPSHOT_EXTENSION = ".snapshot";
+static const std::string LOG_EXTENSION = ".log";
+
+
+static std::filesystem::path getPath(const std::filesystem::path& directory,
+                                     const InviteCode& inviteCode,
+                                     const std::string& extension) {
+  return directory / (inviteCode + extension);
+}
+
+
+static std::optional<std::string> readFile(const std::filesystem::path& path) {
+  std::ifstream file{path, std::ios::binary};
+  if (!file) {
+    return std::nullopt;
+  }
+  std::string bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+  if (file.bad()) {
+    return std::nullopt;
+  }
+  return bytes;
+}
+
+
+// Writes bytes to the file and waits for them to reach the disk
+static bool writeFile(const std::filesystem::path& path, std::string_view bytes, int flags) {
+  const int file = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | flags, 0644);
+  if (file < 0) {
+    LOG(ERROR) << "Cannot open " << path << ": " << std::strerror(errno);
+    return false;
+  }
+
+  bool isWritten = true;
+  while (!bytes.empty() && isWritten) {
+    const ssize_t written = ::write(file, bytes.data(), bytes.size());
+    if (written < 0 && errno != EINTR) {
+      LOG(ERROR) << "Cannot write " << path << ": " << std::strerror(errno);
+      isWritten = false;
+    } else if (written > 0) {
+      bytes.remove_prefix(written);
+    }
+  }
+  if (isWritten && ::fdatasync(file) != 0) {
+    LOG(ERROR) << "Cannot sync " << path << ": " << std::strerror(errno);
+    isWritten = false;
+  }
+  ::close(file);
+  return isWritten;
+}
+
+
+// Makes files created in, renamed into or removed from the directory survive a crash
+static bool syncDirectory(const std::filesystem::path& directory) {
+  const int file = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (file < 0 || ::fsync(file) != 0) {
+    LOG(ERROR) << "Cannot sync " << directory << ": " << std::strerror(errno);
+    if (file >= 0) {
+      ::close(file);
+    }
+    return false;
+  }
+  ::close(file);
+  return true;
+}
+
+
+// A snapshot file holds its generation, the game's name, its players' nicknames and the
+// session's snapshot
+static bool readSnapshotFile(std::string_view bytes, uint64_t& generation, SnapshotStore::StoredSnapshot& snapshot) {
+  GameState::SnapshotReader reader(bytes);
+  generation = reader.readUnsigned();
+  snapshot.gameName = reader.readString();
+  snapshot.playerNames.resize(reader.readCount());
+  for (PlayerName& player : snapshot.playerNames) {
+    player.playerID = reader.readUnsigned();
+    player.nickname = reader.readString();
+  }
+  snapshot.snapshot = reader.readString();
+  return reader.isValid() && reader.isAtEnd();
+}
+
+
+// A log file holds entries each stamped with the generation of the snapshot they follow.
+// Returns the entries of the given generation, up to any torn one at the end.
+static std::string readLogFile(std::string_view bytes, uint64_t generation) {
+  GameState::SnapshotReader reader(bytes);
+  std::string entries;
+  while (!reader.isAtEnd()) {
+    const uint64_t entryGeneration = reader.readUnsigned();
+    const std::string_view entry = reader.readString();
+    if (!reader.isValid()) {
+      break;
+    }
+    if (entryGeneration == generation) {
+      entries.append(entry);
+    }
+  }
+  return entries;
+}
+
+
+
+SnapshotStore::SnapshotStore(std::filesystem::path directory)
+  : directory(std::move(directory)) {
+  std::error_code error;
+  std::filesystem::create_directories(this->directory, error);
+  if (error) {
+    LOG(ERROR) << "Cannot create snapshot directory " << this->directory << ": " << error.message();
+  }
+
+  // Carries on from the newest generation already on disk
+  for (const auto& entry : std::filesystem::directory_iterator(this->directory, error)) {
+    if (entry.path().extension() != SNAPSHOT_EXTENSION) {
+      continue;
+    }
+    if (const std::optional<std::string> bytes = readFile(entry.path()); bytes.has_value()) {
+      GameState::SnapshotReader reader(*bytes);
+      const uint64_t generation = reader.readUnsigned();
+      if (reader.isValid()) {
+        this->nextGeneration = std::max(this->nextGeneration, generation + 1);
+      }
+    }
+  }
+  this->writer = std::thread([this] { runWriter(); });
+}
+
+
+SnapshotStore::~SnapshotStore() {
+  {
+    std::lock_guard lock{this->mutex};
+    this->isStopping = true;
+  }
+  this->writesReady.notify_one();
+  this->writer.join();
+}
+
+
+void SnapshotStore::save(const InviteCode& inviteCode, std::string gameName, PlayerNames playerNames, std::string snapshot) {
+  {
+    std::lock_guard lock{this->mutex};
+    const uint64_t generation = this->nextGeneration++;
+    this->generations.insert_or_assign(inviteCode, generation);
+    PendingWrite& pendingWrite = this->pending[inviteCode];
+    pendingWrite.snapshot = StoredSnapshot{inviteCode, std::move(gameName), std::move(playerNames), std::move(snapshot), ""};
+    pendingWrite.generation = generation;
+    pendingWrite.log.clear();
+  }
+  this->writesReady.notify_one();
+}
+
+
+void SnapshotStore::appendLog(const InviteCode& inviteCode, std::string_view entry) {
+  {
+    std::lock_guard lock{this->mutex};
+    // Without a snapshot in this store yet, the entry belongs to none and is never replayed
+    auto generation = this->generations.find(inviteCode);
+    GameState::SnapshotWriter writer;
+    writer.writeUnsigned(generation != this->generations.end() ? generation->second : 0);
+    writer.writeString(entry);
+    this->pending[inviteCode].log.append(writer.getBytes());
+  }
+  this->writesReady.notify_one();
+}
+
+
+void SnapshotStore::remove(const InviteCode& inviteCode) {
+  {
+    std::lock_guard lock{this->mutex};
+    this->generations.erase(inviteCode);
+    this->pending.insert_or_assign(inviteCode, PendingWrite{.isRemoved = true});
+  }
+  this->writesReady.notify_one();
+}
+
+
+void SnapshotStore::flush() {
+  std::unique_lock lock{this->mutex};
+  this->writesDone.wait(lock, [this] { return this->pending.empty() && !this->isWriting; });
+}
+
+
+[[nodiscard]] std::optional<SnapshotStore::StoredSnapshot>
+SnapshotStore::load(const std::filesystem::path& directory, const InviteCode& inviteCode) {
+  const std::filesystem::path path = getPath(directory, inviteCode, SNAPSHOT_EXTENSION);
+  const std::optional<std::string> bytes = readFile(path);
+  if (!bytes.has_value()) {
+    return std::nullopt;
+  }
+
+  uint64_t generation = 0;
+  StoredSnapshot snapshot = {inviteCode, "", {}, "", ""};
+  if (!readSnapshotFile(*bytes, generation, snapshot)) {
+    LOG(WARNING) << "Skipping unreadable snapshot " << path;
+    return std::nullopt;
+  }
+  // A missing log means no moves were made since the snapshot
+  snapshot.log = readLogFile(readFile(getPath(directory, inviteCode, LOG_EXTENSION)).value_or(""), generation);
+  return snapshot;
+}
+
+
+[[nodiscard]] std::vector<SnapshotStore::StoredSnapshot> SnapshotStore::loadAll(const std::filesystem::path& directory) {
+  std::vector<StoredSnapshot> snapshots;
+  std::error_code error;
+  for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+    if (!entry.is_regular_file() || entry.path().extension() != SNAPSHOT_EXTENSION) {
+      continue;
+    }
+    if (std::optional<StoredSnapshot> snapshot = load(directory, entry.path().stem().string()); snapshot.has_value()) {
+      snapshots.push_back(std::move(*snapshot));
+    }
+  }
+  if (error) {
+    LOG(ERROR) << "Cannot read snapshot directory " << directory << ": " << error.message();
+  }
+  return snapshots;
+}
+
+
+void SnapshotStore::runWriter() {
+  std::unordered_map<InviteCode, PendingWrite> writes;
+  while (true) {
+    {
+      std::unique_lock lock{this->mutex};
+      this->isWriting = false;
+      this->writesDone.notify_all();
+      this->writesReady.wait(lock, [this] { return this->isStopping || !this->pending.empty(); });
+      if (this->pending.empty()) {
+        return;
+      }
+      std::swap(writes, this->pending);
+      this->isWriting = true;
+    }
+
+    for (const auto& [inviteCode, pendingWrite] : writes) {
+      write(inviteCode, pendingWrite);
+    }
+    writes.clear();
+  }
+}
+
+
+// The snapshot goes first, so that the log is only ever emptied once the moves in it are covered.
+// Emptying it is only to keep it short, as its entries are of an older generation by then.
+void SnapshotStore::write(const InviteCode& inviteCode, const PendingWrite& pendingWrite) const {
+  const std::filesystem::path snapshotPath = getPath(this->directory, inviteCode, SNAPSHOT_EXTENSION);
+  const std::filesystem::path logPath = getPath(this->directory, inviteCode, LOG_EXTENSION);
+  std::error_code error;
+
+  if (pendingWrite.isRemoved) {
+    std::filesystem::remove(snapshotPath, error);
+    std::filesystem::remove(logPath, error);
+    if (error) {
+      LOG(ERROR) << "Cannot remove the snapshot of " << inviteCode << ": " << error.message();
+    }
+    (void)syncDirectory(this->directory);
+  }
+
+  if (pendingWrite.snapshot.has_value()) {
+    GameState::SnapshotWriter writer;
+    writer.writeUnsigned(pendingWrite.generation);
+    writer.writeString(pendingWrite.snapshot->gameName);
+    writer.writeUnsigned(pendingWrite.snapshot->playerNames.size());
+    for (const PlayerName& player : pendingWrite.snapshot->playerNames) {
+      writer.writeUnsigned(player.playerID);
+      writer.writeString(player.nickname);
+    }
+    writer.writeString(pendingWrite.snapshot->snapshot);
+
+    std::filesystem::path temporaryPath = snapshotPath;
+    temporaryPath += ".tmp";
+    if (!writeFile(temporaryPath, writer.getBytes(), O_TRUNC)) {
+      return;
+    }
+    std::filesystem::rename(temporaryPath, snapshotPath, error);
+    if (error) {
+      LOG(ERROR) << "Cannot replace snapshot " << snapshotPath << ": " << error.message();
+      return;
+    }
+    if (!syncDirectory(this->directory) || !writeFile(logPath, pendingWrite.log, O_TRUNC)) {
+      return;
+    }
+    // The log may be new, and entries appended to it later depend on it existing
+    (void)syncDirectory(this->directory);
+  } else if (!pendingWrite.log.empty()) {
+    (void)writeFile(logPath, pendingWrite.log, O_APPEND);
+  }
+}
+
+
+
+} // namespace Lobby
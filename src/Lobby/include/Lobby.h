@@ -0,0 +1,223 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "GameData.h"
+#include "GameState.h"
+#include "RuleCursor.h"
+#include "Snapshot.h"
+#include "Server.h"
+
+
+
+namespace Lobby {
+
+
+using InviteCode = std::string;  // <---  i.e. "0004" or "0004-12"
+using GameDataPtr = GameData::GameDataPtr;
+
+
+// A variable of a game which changed, under the name clients know it by, i.e. "players.123.input"
+struct VariableChange {
+  GameState::NestedVariableKey name;
+  GameState::VariableValue value;
+};
+using StateDelta = std::vector<VariableChange>;
+
+// The nickname of a player of a game, by which they take their place back after a restart
+struct PlayerName {
+  GameState::PlayerID playerID;
+  std::string nickname;
+};
+using PlayerNames = std::vector<PlayerName>;
+
+// Encodes what changed in a game as one message for its clients, i.e.
+//   #state {"debug_target": 3, "players.123.input": "Rock"}
+// Where a variable changed more than once, the delta's last value for it is the one sent
+[[nodiscard]] std::string encodeStateDelta(const StateDelta& delta);
+
+
+/**
+ * One lobby: the connections in it and the game they play. Lobbies playing the
+ * same game share its parsed GameData. The game itself is played by a GameSession
+ * on whichever shard the lobby is pinned to, see ShardPool.
+ */
+class Lobby {
+  public:
+    Lobby(InviteCode inviteCode, std::string gameName, GameDataPtr gameData);
+
+    [[nodiscard]] const InviteCode& getInviteCode() const { return this->inviteCode; }
+    [[nodiscard]] const std::string& getGameName() const { return this->gameName; }
+    [[nodiscard]] const GameDataPtr& getGameData() const { return this->gameData; }
+    [[nodiscard]] const std::vector<networking::Connection>& getMembers() const { return this->members; }
+    [[nodiscard]] bool isEmpty() const { return this->members.empty(); }
+
+    [[nodiscard]] GameState::PlayerIDList getPlayerIDs() const;
+    // The player a member plays as, which is their connection's id unless they took back the
+    // place of a player of a restored game
+    [[nodiscard]] GameState::PlayerID getPlayerID(networking::Connection connection) const;
+
+    void addMember(networking::Connection connection);
+    void removeMember(networking::Connection connection);
+
+    // The players of a restored game who have not joined back yet
+    [[nodiscard]] const PlayerNames& getAbsentPlayers() const { return this->absentPlayers; }
+    void setAbsentPlayers(PlayerNames players) { this->absentPlayers = std::move(players); }
+    // Makes the member the absent player with their nickname, returning false if there is none
+    [[nodiscard]] bool reclaimPlayer(networking::Connection connection, std::string_view nickname);
+
+    // The players whose next message is input for the lobby's game, as last reported by its shard
+    [[nodiscard]] const GameState::PlayerIDList& getAwaitingInputFrom() const { return this->awaitingInputFrom; }
+    [[nodiscard]] bool isAwaitingInputFrom(GameState::PlayerID playerID) const;
+    void setAwaitingInputFrom(GameState::PlayerIDList playerIDs) { this->awaitingInputFrom = std::move(playerIDs); }
+    void stopAwaitingInputFrom(GameState::PlayerID playerID);
+  private:
+    InviteCode inviteCode;
+    std::string gameName;
+    GameDataPtr gameData;
+    GameState::PlayerIDList awaitingInputFrom;
+    PlayerNames absentPlayers;
+    std::unordered_map<uintptr_t, GameState::PlayerID> reclaimedPlayers;  // By connection id
+
+    // Unordered, a leaving member's place is taken by the last one so that removal is constant time
+    std::vector<networking::Connection> members;
+    std::unordered_map<uintptr_t, std::size_t> memberIndices;  // Where each connection is in members
+};
+
+
+/**
+ * The state of the game played in one lobby. A session is owned by the shard its
+ * lobby is pinned to, and is only ever touched by that shard's thread.
+ *
+ * A game runs until it finishes or its rules wait for input, from several players
+ * at once within a parallelFor. A waiting game holds no thread, it is resumed by
+ * provideInput() whenever one of those players' messages arrives.
+ */
+class GameSession {
+  public:
+    explicit GameSession(GameDataPtr gameData);
+
+    GameSession(const GameSession&) = delete;
+    GameSession& operator=(const GameSession&) = delete;
+
+    // Starts the game with the given players, describing its progress to log
+    void executeGame(const GameState::PlayerIDList& playerIDs, std::ostream& log);
+
+    // Resumes a game waiting on input from playerID, among others
+    void provideInput(GameState::PlayerID playerID, const std::string& text, std::ostream& log);
+
+    // Resumes a game whose input request ran out of time, with the request's default value
+    void expireInput(std::size_t requestNumber, std::ostream& log);
+
+    // Resumes a game waiting on a player who left, with the default values of their requests
+    void expireInputFrom(GameState::PlayerID playerID, std::ostream& log);
+
+    [[nodiscard]] bool isRunning() const { return this->cursor.has_value(); }
+    [[nodiscard]] GameState::PlayerIDList getAwaitingInputFrom() const;
+    [[nodiscard]] std::vector<const GameRules::InputRequest*> getPendingInputs() const;
+    // The variables which changed since the last call, with their values now
+    [[nodiscard]] StateDelta takeStateDelta();
+
+    // Only exists once a game has been started
+    [[nodiscard]] const GameState::GameState* getGameState() const { return this->gameState ? &*this->gameState : nullptr; }
+
+    // Snapshots carry a running game over a server restart, into a new session for the same game.
+    // A restored game waits on the same requests, whose timeouts start again.
+    // Each snapshot starts a new log, see takeLogEntry().
+    [[nodiscard]] std::string writeSnapshot();
+
+    // Returns the changes made to the game since the last snapshot or log entry, for appending
+    // to a write-ahead log. Entries are cheap to take after every move, as only the variables
+    // and scopes changed and the position of the rules are written.
+    [[nodiscard]] std::string takeLogEntry();
+
+    // Restores a snapshot, then replays the log entries taken since it. An entry left incomplete
+    // by a crash part way through writing the log is dropped, along with the move it recorded.
+    // Returns false, leaving the game stopped, if either is corrupt or of a different game.
+    [[nodiscard]] bool restoreSnapshot(std::string_view snapshot, std::string_view log = {});
+  private:
+    void runGame(std::ostream& log);
+    void startCursor();
+    [[nodiscard]] bool replayLog(std::string_view log);
+
+    GameDataPtr gameData;
+
+    // Changes to gameState since the last snapshot or log entry
+    GameState::SnapshotWriter stateLog;
+
+    // Only exists once a game has been started
+    std::optional<GameState::GameState> gameState;
+
+    // Only exists while a game is running, refers to gameState
+    std::optional<GameRules::RuleCursor> cursor;
+    std::size_t newestPromptedRequest = 0;
+};
+
+
+/**
+ * Hosts every lobby of a GameServer and tracks which lobby each connection is in.
+ * A connection is in exactly one lobby at a time. The default lobby always exists,
+ * any other lobby is closed once its last member leaves.
+ */
+class LobbyManager {
+  public:
+    using LobbyClosedHandler = std::function<void(const InviteCode&)>;
+    // Called when a member leaves a lobby, which stays open, whose game is waiting on their input
+    using AwaitedMemberLeftHandler = std::function<void(const InviteCode&, GameState::PlayerID)>;
+
+    LobbyManager() = default;
+    // The default lobby is addressed by baseInviteCode, the rest by "<baseInviteCode>-<n>"
+    LobbyManager(InviteCode baseInviteCode,
+                 std::string defaultGameName,
+                 GameDataPtr defaultGameData,
+                 LobbyClosedHandler onLobbyClosed = {},
+                 AwaitedMemberLeftHandler onAwaitedMemberLeft = {});
+
+    Lobby& createLobby(std::string gameName, GameDataPtr gameData);
+    // Brings back a lobby, under its old invite code, whose game was kept over a restart.
+    // Its players have until rejoinDeadline to join back, see expireAbsentPlayers().
+    Lobby& restoreLobby(const InviteCode& inviteCode,
+                        std::string gameName,
+                        GameDataPtr gameData,
+                        PlayerNames players,
+                        std::chrono::steady_clock::time_point rejoinDeadline);
+
+    // Once a restored lobby's rejoin deadline passes, its game stops waiting on the players
+    // who did not join back, and the lobby closes if none did
+    void expireAbsentPlayers(std::chrono::steady_clock::time_point now);
+
+    [[nodiscard]] Lobby* findLobby(const InviteCode& inviteCode);
+    [[nodiscard]] Lobby* findLobbyOf(networking::Connection connection);
+    [[nodiscard]] Lobby& getDefaultLobby();
+    [[nodiscard]] std::size_t getLobbyCount() const { return this->lobbies.size(); }
+
+    // Moves the connection out of whichever lobby it is in and into the specified one
+    // Returns nullptr, leaving the connection where it was, when no such lobby exists
+    Lobby* joinLobby(networking::Connection connection, const InviteCode& inviteCode);
+    void leaveLobby(networking::Connection connection);
+  private:
+    InviteCode baseInviteCode;
+    std::size_t lobbiesCreated = 0;
+    LobbyClosedHandler onLobbyClosed;
+    AwaitedMemberLeftHandler onAwaitedMemberLeft;
+
+    // Node based so that references to a Lobby stay valid until it closes
+    std::unordered_map<InviteCode, Lobby> lobbies;
+    std::unordered_map<uintptr_t, Lobby*> memberLobbies;
+    std::unordered_map<InviteCode, std::chrono::steady_clock::time_point> rejoinDeadlines;
+
+    void closeLobby(const InviteCode& inviteCode);
+};
+
+
+
+} // namespace Lobby
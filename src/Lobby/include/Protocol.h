@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "Lobby.h"
+#include "Server.h"
+
+
+
+namespace Lobby {
+
+
+/**
+ * What a message between a client and the server asks for or carries. Clients can type
+ * commands as text, i.e. "/join 0004", or send them as binary messages encoded by
+ * encodeCommand(), which start with this as a byte followed by a length prefixed
+ * argument. A client that sends binary is sent its state updates in binary too.
+ */
+enum class MessageKind : uint8_t {
+  CHAT,          // Text for the lobby, and input for a game waiting on its sender
+  NICKNAME,
+  CREATE,        // Argument is the name of the game to play
+  JOIN,          // Argument is an invite code
+  EXECUTE,
+  QUIT,
+  SHUTDOWN,
+  STATE_UPDATE,  // Only sent by the server, see encodeStateUpdate()
+};
+
+
+struct Command {
+  MessageKind kind;
+  std::string_view argument;  // Points into the message the command was decoded from
+};
+
+// Gives nothing for an unknown command or a malformed binary message
+[[nodiscard]] std::optional<Command> decodeCommand(const networking::Message& message);
+[[nodiscard]] std::string encodeCommand(const Command& command);
+
+// The binary form of encodeStateDelta(): the STATE_UPDATE byte, the number of variables,
+// then each variable's name and value as written by GameState::SnapshotWriter
+[[nodiscard]] std::string encodeStateUpdate(const StateDelta& delta);
+
+// Every state update travels in a websocket frame of its own, so a frame holding anything
+// more or less than one update gives nothing
+[[nodiscard]] std::optional<StateDelta> decodeStateUpdate(std::string_view bytes);
+
+
+
+} // namespace Lobby
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Lobby.h"
+#include "SnapshotStore.h"
+#include "TimerWheel.h"
+
+
+
+namespace Lobby {
+
+
+/**
+ * Work for the game of one lobby, carried out on the shard that lobby is pinned to
+ */
+struct LobbyTask {
+  enum class Kind {
+    EXECUTE,  // Start the lobby's game with playerIDs, whose nicknames are playerNames
+    INPUT,    // playerID sent text while the lobby's game was waiting on them
+    CLOSE,    // The lobby closed, discard its game
+    RESTORE,  // Resume the lobby's game, of playerNames, from the snapshot in text and the log after it
+    LEAVE,    // playerID left the lobby, so its game stops waiting on them
+  };
+
+  Kind kind;
+  InviteCode inviteCode;
+  GameDataPtr gameData = nullptr;
+  std::string gameName = "";               // Which game gameData is, recorded with its snapshots
+  GameState::PlayerIDList playerIDs = {};  // The lobby's members when the task was posted
+  PlayerNames playerNames = {};            // Recorded with the game's snapshots
+  GameState::PlayerID playerID = 0;
+  std::string text = "";
+  std::string log = "";
+};
+
+/**
+ * Text a shard produced for the members of a lobby
+ */
+struct LobbyOutput {
+  InviteCode inviteCode;
+  std::string text;
+  GameState::PlayerIDList awaitingInputFrom = {};  // Whose input the game now waits on
+  StateDelta stateDelta = {};                       // The game's variables which changed
+};
+
+
+/**
+ * Runs the games of many lobbies on a fixed set of worker threads. Every lobby is
+ * pinned to one shard by its invite code, and each shard has its own thread, task
+ * queue and GameSessions, so a lobby's GameState is only ever touched by one
+ * thread and a slow game only holds up the lobbies sharing its shard.
+ *
+ * Output is collected for the thread that posts tasks to pick up with
+ * takeOutputs(). onOutput is called, from the worker, whenever there is some.
+ *
+ * Each shard keeps a TimerWheel of the input deadlines of its games, one for each
+ * player a game waits on. A game whose player runs out of time is resumed with the
+ * input's default value.
+ *
+ * With no workers there is a single shard, and tasks run on the posting thread
+ * inside post(). Deadlines then expire when that thread calls advanceTimers().
+ *
+ * Given a SnapshotStore, a shard appends a log entry for each running game after every
+ * change to it, and replaces the log with a new snapshot once it has grown long enough.
+ * Both are removed once the game finishes or its lobby closes.
+ */
+class ShardPool {
+  public:
+    using OutputHandler = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+
+    ShardPool(std::size_t workerCount, OutputHandler onOutput = {}, SnapshotStore* snapshots = nullptr);
+    ~ShardPool();
+
+    ShardPool(const ShardPool&) = delete;
+    ShardPool& operator=(const ShardPool&) = delete;
+
+    void post(LobbyTask task);
+    [[nodiscard]] std::vector<LobbyOutput> takeOutputs();
+
+    // Only needed without workers, each worker keeps the timers of its own shard
+    void advanceTimers(Clock::time_point now = Clock::now());
+    [[nodiscard]] std::optional<Clock::time_point> getNextDeadline() const;
+
+    [[nodiscard]] std::size_t getShardCount() const { return this->shards.size(); }
+    [[nodiscard]] std::size_t getShardIndex(const InviteCode& inviteCode) const;
+  private:
+    struct InputTimeout {
+      InviteCode inviteCode;
+      std::size_t requestNumber = 0;
+    };
+
+    struct InputTimer {
+      TimerId timer;
+      std::size_t requestNumber;
+    };
+
+    // How a session is kept in the SnapshotStore
+    struct StoredSession {
+      std::string gameName;
+      PlayerNames playerNames;
+      std::size_t logEntryCount = 0;
+      bool hasSnapshot = false;
+    };
+
+    struct Shard {
+      std::mutex mutex;
+      std::condition_variable tasksReady;
+      std::deque<LobbyTask> tasks;
+      bool isStopping = false;
+
+      // Only touched by the shard's own thread
+      std::unordered_map<InviteCode, GameSession> sessions;
+      std::unordered_map<InviteCode, StoredSession> storedSessions;
+      TimerWheel<InputTimeout> timers;
+      std::unordered_map<InviteCode, std::vector<InputTimer>> inputTimers;
+
+      std::thread worker;
+    };
+
+    void runWorker(Shard& shard);
+    void runTask(Shard& shard, LobbyTask& task);
+    void expireTimers(Shard& shard, Clock::time_point now);
+    void updateInputTimers(Shard& shard, const InviteCode& inviteCode, const GameSession& session);
+    void cancelInputTimers(Shard& shard, const InviteCode& inviteCode);
+    void storeSession(Shard& shard, const InviteCode& inviteCode, GameSession& session);
+    void addOutput(LobbyOutput output);
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    const bool hasWorkers;
+    OutputHandler onOutput;
+    SnapshotStore* snapshots;
+
+    std::mutex outputMutex;
+    std::vector<LobbyOutput> outputs;
+};
+
+
+
+} // namespace Lobby
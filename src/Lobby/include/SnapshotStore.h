@@ -0,0 +1,95 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Lobby.h"
+
+
+
+namespace Lobby {
+
+
+/**
+ * Keeps each running game on disk, as its latest snapshot and a write-ahead log of the
+ * moves made since, so that games survive the server restarting. Shards hand these over
+ * with save() and appendLog() and carry on; a thread of the store's own writes them out.
+ *
+ * Writes are group committed: everything handed over while the previous batch was being
+ * written goes out in the next batch, with one fsync per file touched, so a busy server
+ * pays for an fsync every batch rather than every move. A lobby saved several times
+ * within a batch has only its newest snapshot written.
+ *
+ * Each lobby has the files "<inviteCode>.snapshot", replaced whole by writing a temporary
+ * file and renaming it over, and "<inviteCode>.log", emptied whenever the snapshot is.
+ * Every snapshot is stamped with a generation, and every log entry with the generation of
+ * the snapshot it follows, so that entries left over from an older snapshot, as when the
+ * server stops between replacing a snapshot and emptying its log, are never replayed.
+ */
+class SnapshotStore {
+  public:
+    struct StoredSnapshot {
+      InviteCode inviteCode;
+      std::string gameName;
+      PlayerNames playerNames;
+      std::string snapshot;  // As written by GameSession::writeSnapshot()
+      std::string log;       // The GameSession::takeLogEntry() entries since, oldest first
+    };
+
+    explicit SnapshotStore(std::filesystem::path directory);
+    // Writes out whatever is still pending
+    ~SnapshotStore();
+
+    SnapshotStore(const SnapshotStore&) = delete;
+    SnapshotStore& operator=(const SnapshotStore&) = delete;
+
+    // Replaces the lobby's snapshot, and empties its log
+    void save(const InviteCode& inviteCode, std::string gameName, PlayerNames playerNames, std::string snapshot);
+    void appendLog(const InviteCode& inviteCode, std::string_view entry);
+    void remove(const InviteCode& inviteCode);
+
+    // Blocks until every save, append and remove made so far is on disk
+    void flush();
+
+    // Reads back what is stored in a directory, skipping any snapshots that are unreadable
+    [[nodiscard]] static std::optional<StoredSnapshot> load(const std::filesystem::path& directory,
+                                                            const InviteCode& inviteCode);
+    [[nodiscard]] static std::vector<StoredSnapshot> loadAll(const std::filesystem::path& directory);
+  private:
+    struct PendingWrite {
+      bool isRemoved = false;
+      std::optional<StoredSnapshot> snapshot;  // Without its log, which is appended from log
+      uint64_t generation = 0;                 // Of the snapshot
+      std::string log;                         // Entries stamped with their generation
+    };
+
+    void runWriter();
+    void write(const InviteCode& inviteCode, const PendingWrite& pendingWrite) const;
+
+    std::filesystem::path directory;
+
+    std::mutex mutex;
+    // Generations only ever grow, including across restarts, so an entry can never be
+    // mistaken for one following a later snapshot. Lobbies map to their latest snapshot's.
+    uint64_t nextGeneration = 1;
+    std::unordered_map<InviteCode, uint64_t> generations;
+    std::condition_variable writesReady;
+    std::condition_variable writesDone;
+    std::unordered_map<InviteCode, PendingWrite> pending;
+    bool isWriting = false;
+    bool isStopping = false;
+
+    std::thread writer;
+};
+
+
+
+} // namespace Lobby
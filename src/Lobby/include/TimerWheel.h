@@ -0,0 +1,272 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+
+
+namespace Lobby {
+
+
+/**
+ * Identifies a scheduled timer. Stays safe to cancel after the timer has fired
+ * or been cancelled, even once its storage has been reused by another timer.
+ */
+struct TimerId {
+  uint32_t index = std::numeric_limits<uint32_t>::max();
+  uint32_t generation = 0;
+};
+
+
+/**
+ * A hierarchical timer wheel, for tracking very many deadlines of which most are
+ * cancelled before they expire (e.g. players answering before their input times out).
+ *
+ * Time is split into ticks of a fixed length. The first level has a slot for each
+ * of the next 256 ticks, and each level above covers 256 times the span of the one
+ * below it. Timers are kept in intrusive lists threaded through one slab, so
+ * scheduling and cancelling are O(1) and never allocate once the slab has grown
+ * to the number of pending timers. A timer far in the future is moved down a
+ * level each time the wheel below it wraps around, at most LEVELS - 1 times.
+ *
+ * Timers never fire early, and fire at most one tick late. Advancing skips over
+ * ticks where nothing happens, so it costs the same however long ago it was last
+ * called.
+ */
+template <typename Payload>
+class TimerWheel {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TimerWheel(Clock::duration tickLength = std::chrono::milliseconds{10},
+                        Clock::time_point start = Clock::now())
+      : tickLength(tickLength)
+      , start(start) {
+      this->heads.fill(NIL);
+    }
+
+    TimerId schedule(Clock::time_point deadline, Payload payload) {
+      uint64_t expiryTick = this->toTick(deadline, true);
+      if (expiryTick <= this->currentTick) {
+        expiryTick = this->currentTick + 1;
+      }
+
+      const uint32_t index = this->allocate();
+      Node& node = this->nodes[index];
+      node.payload = std::move(payload);
+      node.expiryTick = expiryTick;
+      node.isScheduled = true;
+      this->link(index);
+      ++this->scheduledCount;
+      return {index, node.generation};
+    }
+
+    // Returns false if the timer already fired or was cancelled
+    bool cancel(TimerId timer) {
+      if (timer.index >= this->nodes.size()) {
+        return false;
+      }
+      Node& node = this->nodes[timer.index];
+      if (!node.isScheduled || node.generation != timer.generation) {
+        return false;
+      }
+
+      this->unlink(timer.index);
+      this->release(timer.index);
+      --this->scheduledCount;
+      return true;
+    }
+
+    // Moves time forward to now, returning the payloads of every timer that expired in order of expiry
+    [[nodiscard]] std::vector<Payload> advance(Clock::time_point now) {
+      std::vector<Payload> expired;
+      const uint64_t targetTick = this->toTick(now, false);
+
+      // Ticks where nothing expires or cascades are skipped over
+      while (this->scheduledCount > 0) {
+        const uint64_t tick = this->nextEventTick();
+        if (tick > targetTick) {
+          break;
+        }
+        this->currentTick = tick;
+
+        // Timers from a level above whose slot just came around are redistributed below
+        for (std::size_t level = 1; level < LEVELS; ++level) {
+          if ((tick & lowBitsMask(level)) != 0) {
+            break;
+          }
+          this->cascade(level, slotOf(tick, level));
+        }
+
+        uint32_t index = std::exchange(this->heads[bucketOf(0, slotOf(tick, 0))], NIL);
+        while (index != NIL) {
+          Node& node = this->nodes[index];
+          const uint32_t next = node.next;
+          expired.push_back(std::move(node.payload));
+          this->release(index);
+          --this->scheduledCount;
+          index = next;
+        }
+      }
+
+      this->currentTick = std::max(this->currentTick, targetTick);
+      return expired;
+    }
+
+    // The time advance() next has anything to do, at or before the earliest pending deadline
+    [[nodiscard]] std::optional<Clock::time_point> getNextDeadline() const {
+      if (this->scheduledCount == 0) {
+        return std::nullopt;
+      }
+      return this->toTime(this->nextEventTick());
+    }
+
+    [[nodiscard]] std::size_t size() const { return this->scheduledCount; }
+    [[nodiscard]] bool empty() const { return this->scheduledCount == 0; }
+
+  private:
+    static constexpr uint32_t NIL = std::numeric_limits<uint32_t>::max();
+    static constexpr std::size_t SLOT_BITS = 8;
+    static constexpr std::size_t SLOTS = std::size_t{1} << SLOT_BITS;
+    static constexpr std::size_t LEVELS = 4;
+
+    struct Node {
+      Payload payload = {};
+      uint64_t expiryTick = 0;
+      uint32_t prev = NIL;
+      uint32_t next = NIL;     // Also links free nodes together
+      uint32_t bucket = 0;     // Index into heads of the list this node is in
+      uint32_t generation = 0;
+      bool isScheduled = false;
+    };
+
+    static constexpr uint64_t lowBitsMask(std::size_t level) {
+      return (uint64_t{1} << (SLOT_BITS * level)) - 1;
+    }
+
+    static constexpr std::size_t slotOf(uint64_t tick, std::size_t level) {
+      return (tick >> (SLOT_BITS * level)) & (SLOTS - 1);
+    }
+
+    static constexpr std::size_t bucketOf(std::size_t level, std::size_t slot) {
+      return level * SLOTS + slot;
+    }
+
+    [[nodiscard]] uint64_t toTick(Clock::time_point time, bool roundUp) const {
+      if (time <= this->start) {
+        return 0;
+      }
+      const auto elapsed = time - this->start;
+      const uint64_t ticks = elapsed / this->tickLength;
+      return (roundUp && elapsed % this->tickLength != Clock::duration::zero()) ? ticks + 1 : ticks;
+    }
+
+    // The first tick after the current one where a timer expires or a non-empty slot cascades
+    [[nodiscard]] uint64_t nextEventTick() const {
+      uint64_t earliest = std::numeric_limits<uint64_t>::max();
+      for (uint64_t tick = this->currentTick + 1; tick < this->currentTick + SLOTS; ++tick) {
+        if (this->heads[bucketOf(0, slotOf(tick, 0))] != NIL) {
+          earliest = tick;
+          break;
+        }
+      }
+
+      for (std::size_t level = 1; level < LEVELS; ++level) {
+        const uint64_t span = uint64_t{1} << (SLOT_BITS * level);
+        uint64_t boundary = ((this->currentTick >> (SLOT_BITS * level)) + 1) << (SLOT_BITS * level);
+        for (std::size_t i = 0; i < SLOTS && boundary < earliest; ++i, boundary += span) {
+          if (this->heads[bucketOf(level, slotOf(boundary, level))] != NIL) {
+            earliest = boundary;
+            break;
+          }
+        }
+      }
+      return earliest;
+    }
+
+    [[nodiscard]] Clock::time_point toTime(uint64_t tick) const {
+      return this->start + this->tickLength * tick;
+    }
+
+    uint32_t allocate() {
+      if (this->freeHead == NIL) {
+        this->nodes.emplace_back();
+        return static_cast<uint32_t>(this->nodes.size() - 1);
+      }
+      const uint32_t index = this->freeHead;
+      this->freeHead = this->nodes[index].next;
+      return index;
+    }
+
+    void release(uint32_t index) {
+      Node& node = this->nodes[index];
+      node.payload = {};
+      node.isScheduled = false;
+      ++node.generation;
+      node.prev = NIL;
+      node.next = this->freeHead;
+      this->freeHead = index;
+    }
+
+    // Places the node on the lowest level whose span reaches its expiry
+    void link(uint32_t index) {
+      Node& node = this->nodes[index];
+      const uint64_t delta = node.expiryTick - this->currentTick;
+
+      std::size_t level = 0;
+      while (level < LEVELS - 1 && delta >= (uint64_t{1} << (SLOT_BITS * (level + 1)))) {
+        ++level;
+      }
+      // Anything beyond the top level waits in its furthest slot, and is placed again when that comes around
+      const uint64_t placedTick = level == LEVELS - 1
+        ? std::min(node.expiryTick, this->currentTick + lowBitsMask(LEVELS))
+        : node.expiryTick;
+
+      node.bucket = static_cast<uint32_t>(bucketOf(level, slotOf(placedTick, level)));
+      node.prev = NIL;
+      node.next = this->heads[node.bucket];
+      if (node.next != NIL) {
+        this->nodes[node.next].prev = index;
+      }
+      this->heads[node.bucket] = index;
+    }
+
+    void unlink(uint32_t index) {
+      Node& node = this->nodes[index];
+      if (node.prev != NIL) {
+        this->nodes[node.prev].next = node.next;
+      } else {
+        this->heads[node.bucket] = node.next;
+      }
+      if (node.next != NIL) {
+        this->nodes[node.next].prev = node.prev;
+      }
+    }
+
+    void cascade(std::size_t level, std::size_t slot) {
+      uint32_t index = std::exchange(this->heads[bucketOf(level, slot)], NIL);
+      while (index != NIL) {
+        const uint32_t next = this->nodes[index].next;
+        this->link(index);
+        index = next;
+      }
+    }
+
+    Clock::duration tickLength;
+    Clock::time_point start;
+    uint64_t currentTick = 0;
+
+    std::vector<Node> nodes;
+    uint32_t freeHead = NIL;
+    std::size_t scheduledCount = 0;
+    std::array<uint32_t, LEVELS * SLOTS> heads;
+};
+
+
+
+} // namespace Lobby
@@ -1,5 +1,6 @@
 #include "ServerConfig.h"
 #include "JsonParser.h"
+#include <filesystem>
 #include <fstream>
 #include <glog/logging.h>
 
@@ -48,6 +49,80 @@ void ServerConfig::configure(const json& config)
     this->port = config["port"];
     this->htmlFilepath = config["serverhtml"];
     this->valid = true;
+
+    // Threads to run lobbies' games on, with none they run on the server's own thread
+    this->gameWorkerCount = config.value("gameworkers", this->gameWorkerCount);
+
+    // Where running games are kept so that they survive a restart, none are kept without it
+    this->snapshotDirectory = config.value("snapshotdir", this->snapshotDirectory);
+    if (config.contains("snapshotdir"))
+    {
+        std::error_code error;
+        std::filesystem::create_directories(this->snapshotDirectory, error);
+        if (this->snapshotDirectory.empty() || error || !std::filesystem::is_directory(this->snapshotDirectory))
+        {
+            LOG(ERROR) << "snapshotdir must name a directory the server can create";
+            this->valid = false;
+            return;
+        }
+    }
+
+    // Optional networking tuning, defaults come from networking::ServerOptions
+    auto& options = this->serverOptions;
+    options.ioThreadCount = config.value("iothreads", options.ioThreadCount);
+    options.writeHighWatermark = config.value("writehighwatermark", options.writeHighWatermark);
+    options.writeLowWatermark = config.value("writelowwatermark", options.writeLowWatermark);
+    options.writeCoalesceLimit = config.value("writecoalescelimit", options.writeCoalesceLimit);
+    options.coalesceWrites = config.value("coalescewrites", options.coalesceWrites);
+
+    // Optional permessage-deflate compression for clients that support it
+    auto& compression = options.compression;
+    compression.enabled = config.value("compression", compression.enabled);
+    compression.windowBits = config.value("compressionwindowbits", compression.windowBits);
+    compression.memoryLevel = config.value("compressionmemlevel", compression.memoryLevel);
+    compression.minimumSize = config.value("compressionminsize", compression.minimumSize);
+
+    const std::unordered_map<std::string, networking::OverflowPolicy> overflowPolicies
+    {
+        { "drop", networking::OverflowPolicy::DROP },
+        { "disconnect", networking::OverflowPolicy::DISCONNECT },
+        { "coalesce", networking::OverflowPolicy::COALESCE }
+    };
+    if (config.contains("overflowpolicy"))
+    {
+        auto found = overflowPolicies.find(config["overflowpolicy"]);
+        if (found == overflowPolicies.end())
+        {
+            LOG(ERROR) << "Unknown overflowpolicy: expected drop, disconnect or coalesce";
+            this->valid = false;
+            return;
+        }
+        options.overflowPolicy = found->second;
+    }
+
+    if (options.writeHighWatermark < options.writeLowWatermark)
+    {
+        LOG(ERROR) << "writehighwatermark must not be below writelowwatermark";
+        this->valid = false;
+    }
+
+    if (options.writeCoalesceLimit < options.writeHighWatermark)
+    {
+        LOG(ERROR) << "writecoalescelimit must not be below writehighwatermark";
+        this->valid = false;
+    }
+
+    if (compression.windowBits < 9 || 15 < compression.windowBits)
+    {
+        LOG(ERROR) << "compressionwindowbits must be from 9 to 15";
+        this->valid = false;
+    }
+
+    if (compression.memoryLevel < 1 || 9 < compression.memoryLevel)
+    {
+        LOG(ERROR) << "compressionmemlevel must be from 1 to 9";
+        this->valid = false;
+    }
 }
 
 std::string ServerConfig::generateInviteCode()
@@ -67,21 +142,51 @@ std::string ServerConfig::getServerHtml()
     return this->htmlFilepath;
 }
 
+networking::ServerOptions ServerConfig::getServerOptions()
+{
+    return this->serverOptions;
+}
+
+std::size_t ServerConfig::getGameWorkerCount()
+{
+    return this->gameWorkerCount;
+}
+
+std::string ServerConfig::getSnapshotDirectory()
+{
+    return this->snapshotDirectory;
+}
+
 bool ServerConfig::isValid()
 {
     return this->valid;
 }
 
-GameData::GameData ServerConfig::parseGamefile(const std::string& gameName)
+// Parses a game's spec the first time it is asked for, later calls share that parse
+// Returns nullptr when the game does not exist or its spec is invalid
+// Called while the server runs, so an unknown or invalid game only fails that request
+GameData::GameDataPtr ServerConfig::parseGamefile(const std::string& gameName)
 {
-    GameData::GameData gameData;
     if (this->gameFilepaths.count(gameName) == 0)
     {
         LOG(ERROR) << "Game does not exist";
-        this->valid = false;
-        return gameData;
+        return nullptr;
+    }
+
+    // Invalid specs are cached as nullptr, so each is only parsed and reported once
+    auto cached = this->specCache.find(gameName);
+    if (cached != this->specCache.end())
+    {
+        return cached->second;
     }
+
     JsonParser::JsonParser parser = JsonParser::JsonParser();
-    gameData = parser.parseJsonFile_gameSpec(this->gameFilepaths.at(gameName));
-    return gameData;
-}
\ No newline at end of file
+    GameData::GameData gameData = parser.parseJsonFile_gameSpec(this->gameFilepaths.at(gameName));
+    GameData::GameDataPtr gameDataPtr = nullptr;
+    if (gameData.isValid)
+    {
+        gameDataPtr = std::make_shared<const GameData::GameData>(std::move(gameData));
+    }
+    this->specCache.emplace(gameName, gameDataPtr);
+    return gameDataPtr;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "JsonParser.h"
+#include "Server.h"
 
 class ServerConfig 
 {
@@ -10,8 +11,11 @@ public:
     void setHtmlFilepath(const std::string& htmlFilepath);
     unsigned short getPort();
     std::string getServerHtml();
+    networking::ServerOptions getServerOptions();
+    std::size_t getGameWorkerCount();
+    std::string getSnapshotDirectory();
     std::string generateInviteCode(); //keep invite code different from port number
-    GameData::GameData parseGamefile(const std::string& gameName);
+    GameData::GameDataPtr parseGamefile(const std::string& gameName);
     bool isValid();
     
 private:
@@ -20,10 +24,16 @@ private:
     const std::unordered_map<std::string,std::string> gameFilepaths
     {
         //add game file paths and matching string here
-        { "Test", "../social-gaming/test/json/gameSpec_forEach_basic.json"}
+        { "Test", "../social-gaming/test/json/gameSpec_forEach_basic.json"},
+        { "InputOutput", "../social-gaming/test/json/gameSpec_inputOutput_basic.json"}
     };
+    //parsed game specs, each parsed the first time it is asked for, nullptr when invalid
+    std::unordered_map<std::string, GameData::GameDataPtr> specCache;
     std::string configFilepath;
     std::string htmlFilepath;
     unsigned short port;
+    networking::ServerOptions serverOptions;
+    std::size_t gameWorkerCount = 0;
+    std::string snapshotDirectory;
     bool valid = false;
 };
\ No newline at end of file
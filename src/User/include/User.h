@@ -8,6 +8,8 @@ class User
 public:
     std::string nickname;
     networking::Connection userConnection;  
+    // Set once the user sends a binary message, after which state updates reach them in binary
+    bool isBinaryClient = false;
 
     User();
     User(networking::Connection c);
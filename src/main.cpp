@@ -22,8 +22,9 @@ void printWelcome() {
 
 std::string parseInviteCode(const std::string& inviteCode) {
     std::string parsedInviteCode;
-    // inviteCode is just reverse of port number
-    std::for_each(inviteCode.rbegin(), inviteCode.rend(), [&parsedInviteCode](char c) { parsedInviteCode += c; });
+    // inviteCode is the reverse of the port number, followed by "-<n>" for any lobby but the default
+    const std::string reversedPort = inviteCode.substr(0, inviteCode.find('-'));
+    std::for_each(reversedPort.rbegin(), reversedPort.rend(), [&parsedInviteCode](char c) { parsedInviteCode += c; });
     return parsedInviteCode;
 }
 
@@ -33,6 +34,10 @@ void executeJoinLobby() {
     std::cin >> inviteCode;
 
     networking::Client client{"localhost", parseInviteCode(inviteCode)};  // would it ever not be localhost?
+    if (inviteCode.find('-') != std::string::npos) {
+        // Every connection starts in the server's default lobby
+        client.send("/join " + inviteCode);
+    }
 
     bool isExitCommandReceieved = false;
     auto onTextEntry = [&isExitCommandReceieved, &client](std::string text) {
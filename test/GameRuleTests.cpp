@@ -1,10 +1,18 @@
 #include "gtest/gtest.h"
 #include <glog/logging.h>
+#include "ExpressionParser.h"
 #include "GameData.h"
 #include "GameRules.h"
 #include "GameState.h"
 #include "JsonParser.h"
+#include "RuleArena.h"
+#include "RuleCursor.h"
+#include "RuleProgram.h"
+#include "Snapshot.h"
+#include <chrono>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 using namespace testing;
@@ -89,6 +97,39 @@ TEST(GameRuleTests, invalidAddGlobalMsgRules) {
   EXPECT_EQ(EXPECTED_PARSE_VALIDITY, gameData.isValid);
 }
 
+TEST(GameRuleTests, addUnknownVariable) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_add_unknownVariable.json";
+  const bool EXPECTED_PARSE_VALIDITY = false;
+         
+  // Act (Game Load)
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(GAME_SPEC_PATH);
+
+  // Assert (Game Load)
+  EXPECT_EQ(EXPECTED_PARSE_VALIDITY, gameData.isValid);
+}
+
+TEST(GameRuleTests, forEachUnknownVariable) {
+  // Arrange
+  const std::vector<std::string> GAME_SPEC_PATHS = {
+    "../social-gaming/test/json/gameSpec_forEach_unknownVariable.json",
+    "../social-gaming/test/json/gameSpec_parallelFor_unknownVariable.json",
+  };
+  const bool EXPECTED_PARSE_VALIDITY = false;
+
+  for (const std::string& gameSpecPath : GAME_SPEC_PATHS) {
+    SCOPED_TRACE(gameSpecPath);
+
+    // Act (Game Load)
+    const JsonParser::JsonParser parser = JsonParser::JsonParser();
+    const GameData::GameData gameData = parser.parseJsonFile_gameSpec(gameSpecPath);
+
+    // Assert (Game Load)
+    EXPECT_EQ(EXPECTED_PARSE_VALIDITY, gameData.isValid);
+  }
+}
+
 // TODO-#61: Add more tests for various ways you could create an invalid json file using add+glblmsg
 
 TEST(GameRuleTests, basicForEach) {
@@ -180,3 +221,378 @@ TEST(GameRuleTests, basicForEach_differentElemName) {
     EXPECT_EQ(EXPECTED_NEW_PERPLAYER_VALUE, getResult.value);
   }
 }
+
+TEST(GameRuleTests, inputText_suspendsAndResumes) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_inputOutput_basic.json";
+  const GameState::PlayerIDList playerIDs = {123, 456, 789};
+  const std::vector<std::string> playerInputs = {"7", "-8", "9"};
+  const bool EXPECTED_PARSE_VALIDITY = true;
+  const bool EXPECTED_GET_VALIDITY = true;
+  const std::vector<GameState::VariableValue> EXPECTED_NEW_PERPLAYER_VALUES = {7, -8, 9};
+
+  // Act (Game Load)
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(GAME_SPEC_PATH);
+  GameState::GameState gameState = GameState::GameState(gameData.variableLayout, playerIDs);
+  GameRules::RuleCursor cursor = GameRules::RuleCursor(gameData.topLevelRules, gameState);
+
+  // Assert (Game Load)
+  ASSERT_EQ(EXPECTED_PARSE_VALIDITY, gameData.isValid);
+
+  // Act + Assert (Game Execute): the game waits on each player in turn
+  for (std::size_t i = 0; i < playerIDs.size(); ++i) {
+    ASSERT_EQ(cursor.run(), GameRules::RuleExecutionResult::SUSPENDED);
+    ASSERT_EQ(1u, cursor.getPendingInputs().size());
+    EXPECT_EQ(playerIDs[i], cursor.getPendingInputs().front()->playerID);
+    EXPECT_EQ("Please enter a number.", cursor.getPendingInputs().front()->prompt);
+
+    // Waiting does not move the game along
+    EXPECT_EQ(cursor.run(), GameRules::RuleExecutionResult::SUSPENDED);
+    EXPECT_FALSE(cursor.provideInput(playerIDs[(i + 1) % playerIDs.size()], playerInputs[i]));
+    EXPECT_FALSE(cursor.provideInput(playerIDs[i], "not a number"));
+    EXPECT_TRUE(cursor.provideInput(playerIDs[i], playerInputs[i]));
+  }
+  ASSERT_EQ(cursor.run(), GameRules::RuleExecutionResult::SUCCESS);
+  EXPECT_TRUE(cursor.isFinished());
+  EXPECT_NE(std::string::npos, cursor.takeOutput().find("Finished producing output"));
+
+  // Assert (Game Execute)
+  for (std::size_t i = 0; i < playerIDs.size(); ++i) {
+    GameState::GetVariableResult getResult = gameState.getValue("players." + std::to_string(playerIDs[i]) + ".input");
+    EXPECT_EQ(EXPECTED_GET_VALIDITY, getResult.wasSuccessful);
+    EXPECT_EQ(EXPECTED_NEW_PERPLAYER_VALUES[i], getResult.value);
+  }
+}
+
+TEST(GameRuleTests, inputText_storesTextForStringVariables) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_inputText_string.json";
+  const GameState::PlayerIDList playerIDs = {123, 456};
+  const std::vector<std::string> playerInputs = {"Rock", "7"};
+  const std::vector<GameState::VariableValue> EXPECTED_NEW_PERPLAYER_VALUES = {"Rock", "7"};
+
+  // Act (Game Load)
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(GAME_SPEC_PATH);
+  GameState::GameState gameState = GameState::GameState(gameData.variableLayout, playerIDs);
+  GameRules::RuleCursor cursor = GameRules::RuleCursor(gameData.topLevelRules, gameState);
+
+  // Assert (Game Load)
+  ASSERT_TRUE(gameData.isValid);
+
+  // Act (Game Execute)
+  for (std::size_t i = 0; i < playerIDs.size(); ++i) {
+    ASSERT_EQ(cursor.run(), GameRules::RuleExecutionResult::SUSPENDED);
+    EXPECT_TRUE(cursor.provideInput(playerIDs[i], playerInputs[i]));
+  }
+  ASSERT_EQ(cursor.run(), GameRules::RuleExecutionResult::SUCCESS);
+
+  // Assert (Game Execute)
+  for (std::size_t i = 0; i < playerIDs.size(); ++i) {
+    GameState::GetVariableResult getResult = gameState.getValue("players." + std::to_string(playerIDs[i]) + ".weapon");
+    EXPECT_TRUE(getResult.wasSuccessful);
+    EXPECT_EQ(EXPECTED_NEW_PERPLAYER_VALUES[i], getResult.value);
+  }
+}
+
+TEST(GameRuleTests, inputText_failsWithoutCursor) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_inputOutput_basic.json";
+  const GameState::PlayerIDList playerIDs = {123, 456};
+
+  // Act
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(GAME_SPEC_PATH);
+  GameState::GameState gameState = GameState::GameState(gameData.variableLayout, playerIDs);
+
+  // Assert: the forEach holding the input rule cannot wait for input when run to completion
+  ASSERT_EQ(gameData.topLevelRules.size(), 5u);
+  EXPECT_EQ(gameData.topLevelRules[0]->executeRule(gameState), GameRules::RuleExecutionResult::SUCCESS);
+  EXPECT_EQ(gameData.topLevelRules[1]->executeRule(gameState), GameRules::RuleExecutionResult::FAILURE);
+
+  // The forEach element is taken back out of scope
+  EXPECT_FALSE(gameState.getActiveScopeVariable("player").wasSuccessful);
+}
+
+TEST(GameRuleTests, compiledProgram_matchesTreeWalk) {
+  // Arrange
+  const std::vector<std::string> GAME_SPEC_PATHS = {
+    "../social-gaming/test/json/gameSpec_addGlblMsg_basic.json",
+    "../social-gaming/test/json/gameSpec_addGlblMsg_advanced.json",
+    "../social-gaming/test/json/gameSpec_forEach_basic.json",
+    "../social-gaming/test/json/gameSpec_forEach_differentElemName.json",
+    "../social-gaming/test/json/gameSpec_while_basic.json",
+    "../social-gaming/test/json/gameSpec_loop_advanced.json",
+  };
+  const GameState::PlayerIDList playerIDs = {123, 456, 789};
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+
+  for (const std::string& gameSpecPath : GAME_SPEC_PATHS) {
+    SCOPED_TRACE(gameSpecPath);
+    const GameData::GameData gameData = parser.parseJsonFile_gameSpec(gameSpecPath);
+    ASSERT_TRUE(gameData.isValid);
+    ASSERT_TRUE(gameData.program.has_value());
+
+    // Act
+    GameState::GameState treeState = GameState::GameState(gameData.variableLayout, playerIDs);
+    GameRules::RuleCursor treeCursor = GameRules::RuleCursor(gameData.topLevelRules, treeState);
+    const GameRules::RuleExecutionResult treeResult = treeCursor.run();
+
+    GameState::GameState programState = GameState::GameState(gameData.variableLayout, playerIDs);
+    GameRules::RuleCursor programCursor = GameRules::RuleCursor(*gameData.program, programState);
+    const GameRules::RuleExecutionResult programResult = programCursor.run();
+
+    // Assert
+    EXPECT_EQ(GameRules::RuleExecutionResult::SUCCESS, treeResult);
+    EXPECT_EQ(treeResult, programResult);
+    EXPECT_EQ(treeCursor.takeOutput(), programCursor.takeOutput());
+    const GameState::VariableLayout& layout = *gameData.variableLayout;
+    for (GameState::VariableSlot slot = 0; slot < layout.variables.size(); ++slot) {
+      EXPECT_EQ(treeState.getVariableValue(slot).value, programState.getVariableValue(slot).value);
+    }
+    for (GameState::VariableSlot slot = 0; slot < layout.perPlayerVariables.size(); ++slot) {
+      for (GameState::PlayerIndex player = 0; player < playerIDs.size(); ++player) {
+        EXPECT_EQ(treeState.getPlayerVariableValue(player, slot).value,
+                  programState.getPlayerVariableValue(player, slot).value);
+      }
+    }
+  }
+}
+
+TEST(GameRuleTests, parallelFor_promptsEveryPlayerAtOnce) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_parallelFor_basic.json";
+  const GameState::PlayerIDList playerIDs = {123, 456, 789};
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(GAME_SPEC_PATH);
+  ASSERT_TRUE(gameData.isValid);
+  GameState::GameState gameState = GameState::GameState(gameData.variableLayout, playerIDs);
+  GameRules::RuleCursor cursor = GameRules::RuleCursor(gameData.topLevelRules, gameState);
+
+  // Act + Assert: every player is waited on together, and answers in any order
+  ASSERT_EQ(GameRules::RuleExecutionResult::SUSPENDED, cursor.run());
+  std::vector<const GameRules::InputRequest*> requests = cursor.getPendingInputs();
+  ASSERT_EQ(playerIDs.size(), requests.size());
+  for (std::size_t i = 0; i < playerIDs.size(); ++i) {
+    EXPECT_EQ(playerIDs[i], requests[i]->playerID);
+  }
+  const std::size_t firstPlayerRequest = requests.front()->requestNumber;
+
+  EXPECT_TRUE(cursor.provideInput(789, "9"));
+  EXPECT_FALSE(cursor.provideInput(789, "10"));
+  ASSERT_EQ(GameRules::RuleExecutionResult::SUSPENDED, cursor.run());
+  EXPECT_EQ(2u, cursor.getPendingInputs().size());
+  EXPECT_EQ(1, gameState.getValue("debug_target").value);
+
+  EXPECT_TRUE(cursor.provideInput(456, "-8"));
+  EXPECT_TRUE(cursor.expireInput(firstPlayerRequest));
+  EXPECT_FALSE(cursor.expireInput(firstPlayerRequest));
+  ASSERT_EQ(GameRules::RuleExecutionResult::SUCCESS, cursor.run());
+  EXPECT_TRUE(cursor.isFinished());
+  EXPECT_TRUE(cursor.getPendingInputs().empty());
+  EXPECT_NE(std::string::npos, cursor.takeOutput().find("Finished collecting input"));
+
+  // Assert: each branch wrote to its own player only
+  const std::vector<GameState::VariableValue> EXPECTED_INPUTS = {5, -8, 9};
+  EXPECT_EQ(3, gameState.getValue("debug_target").value);
+  for (std::size_t i = 0; i < playerIDs.size(); ++i) {
+    const std::string player = "players." + std::to_string(playerIDs[i]);
+    EXPECT_EQ(EXPECTED_INPUTS[i], gameState.getValue(player + ".input").value);
+    EXPECT_EQ(3, gameState.getValue(player + ".wins").value);
+  }
+}
+
+TEST(GameRuleTests, parallelFor_abandonRestoresScopes) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_parallelFor_basic.json";
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(GAME_SPEC_PATH);
+  ASSERT_TRUE(gameData.isValid);
+  GameState::GameState gameState = GameState::GameState(gameData.variableLayout, {123, 456});
+  GameRules::RuleCursor cursor = GameRules::RuleCursor(gameData.topLevelRules, gameState);
+
+  // Act
+  ASSERT_EQ(GameRules::RuleExecutionResult::SUSPENDED, cursor.run());
+  const std::size_t scopeDepthWhileWaiting = gameState.getScopeDepth();
+  cursor.abandon();
+
+  // Assert
+  EXPECT_EQ(0u, scopeDepthWhileWaiting);
+  EXPECT_EQ(0u, gameState.getScopeDepth());
+  EXPECT_TRUE(cursor.getPendingInputs().empty());
+  EXPECT_EQ(GameRules::RuleExecutionResult::FAILURE, cursor.run());
+}
+
+TEST(GameRuleTests, numberRules_depthFirst) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_forEach_basic.json";
+
+  // Act
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(GAME_SPEC_PATH);
+
+  // Assert (the forEach is the third rule, its three children come before the rule after it)
+  ASSERT_TRUE(gameData.isValid);
+  const GameRules::Rules& rules = gameData.topLevelRules;
+  ASSERT_EQ(7u, rules.size());
+  EXPECT_EQ(0u, rules[0]->getTreeIndex());
+  EXPECT_EQ(2u, rules[2]->getTreeIndex());
+  ASSERT_EQ(3u, rules[2]->getChildren().size());
+  EXPECT_EQ(3u, rules[2]->getChildren()[0]->getTreeIndex());
+  EXPECT_EQ(5u, rules[2]->getChildren()[2]->getTreeIndex());
+  EXPECT_EQ(6u, rules[3]->getTreeIndex());
+  EXPECT_EQ(9u, rules[6]->getTreeIndex());
+}
+
+TEST(GameRuleTests, parallelFor_snapshotResumesBranches) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_parallelFor_basic.json";
+  const GameState::PlayerIDList playerIDs = {123, 456, 789};
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(GAME_SPEC_PATH);
+  ASSERT_TRUE(gameData.isValid);
+  GameState::GameState gameState = GameState::GameState(gameData.variableLayout, playerIDs);
+  GameRules::RuleCursor cursor = GameRules::RuleCursor(gameData.topLevelRules, gameState);
+  ASSERT_EQ(GameRules::RuleExecutionResult::SUSPENDED, cursor.run());
+  const std::size_t firstPlayerRequest = cursor.getPendingInputs().front()->requestNumber;
+  EXPECT_TRUE(cursor.provideInput(789, "9"));
+  ASSERT_EQ(GameRules::RuleExecutionResult::SUSPENDED, cursor.run());
+  EXPECT_TRUE(cursor.provideInput(456, "-8"));  // Provided but not yet run
+
+  // Act (Snapshot part way through, then carry on from a new cursor)
+  GameState::SnapshotWriter writer;
+  gameState.writeSnapshot(writer);
+  cursor.writeSnapshot(writer);
+  const std::string snapshot = writer.takeBytes();
+  cursor.abandon();
+
+  GameState::SnapshotReader reader(snapshot);
+  std::optional<GameState::GameState> restoredState = GameState::GameState::readSnapshot(reader, gameData.variableLayout);
+  ASSERT_TRUE(restoredState.has_value());
+  GameRules::RuleCursor restored = GameRules::RuleCursor(gameData.topLevelRules, *restoredState);
+  ASSERT_TRUE(restored.readSnapshot(reader));
+  EXPECT_TRUE(reader.isAtEnd());
+
+  // Assert
+  ASSERT_EQ(1u, restored.getPendingInputs().size());
+  EXPECT_EQ(123u, restored.getPendingInputs().front()->playerID);
+  EXPECT_EQ(std::chrono::seconds(10), restored.getPendingInputs().front()->timeout);
+  EXPECT_TRUE(restored.expireInput(firstPlayerRequest));
+  ASSERT_EQ(GameRules::RuleExecutionResult::SUCCESS, restored.run());
+  EXPECT_TRUE(restored.isFinished());
+  EXPECT_EQ(0u, restoredState->getScopeDepth());
+
+  const std::vector<GameState::VariableValue> EXPECTED_INPUTS = {5, -8, 9};
+  EXPECT_EQ(3, restoredState->getValue("debug_target").value);
+  for (std::size_t i = 0; i < playerIDs.size(); ++i) {
+    const std::string player = "players." + std::to_string(playerIDs[i]);
+    EXPECT_EQ(EXPECTED_INPUTS[i], restoredState->getValue(player + ".input").value);
+    EXPECT_EQ(3, restoredState->getValue(player + ".wins").value);
+  }
+}
+
+TEST(GameRuleTests, compiledProgram_inputText_suspendsAndResumes) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_inputOutput_basic.json";
+  const GameState::PlayerIDList playerIDs = {123, 456};
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(GAME_SPEC_PATH);
+  ASSERT_TRUE(gameData.program.has_value());
+  GameState::GameState gameState = GameState::GameState(gameData.variableLayout, playerIDs);
+  GameRules::RuleCursor cursor = GameRules::RuleCursor(*gameData.program, gameState);
+
+  // Act + Assert
+  ASSERT_EQ(GameRules::RuleExecutionResult::SUSPENDED, cursor.run());
+  EXPECT_EQ(123u, cursor.getPendingInputs().front()->playerID);
+  EXPECT_TRUE(cursor.provideInput(123, "11"));
+  ASSERT_EQ(GameRules::RuleExecutionResult::SUSPENDED, cursor.run());
+  EXPECT_EQ(456u, cursor.getPendingInputs().front()->playerID);
+  EXPECT_TRUE(cursor.expireInput(cursor.getPendingInputs().front()->requestNumber));
+  ASSERT_EQ(GameRules::RuleExecutionResult::SUCCESS, cursor.run());
+  EXPECT_TRUE(cursor.isFinished());
+
+  EXPECT_EQ(11, gameState.getValue("players.123.input").value);
+  EXPECT_EQ(0, gameState.getValue("players.456.input").value);
+}
+
+TEST(GameRuleTests, compiledProgram_loop) {
+  // Arrange
+  const GameState::VariableValue EXPECTED_DEBUG_TARGET_VALUE = 10;
+  const GameState::VariableLayout layout = GameState::VariableLayout({{"debug_target", -5}}, {});
+  const GameState::VariablePath debugTarget = {.slot = *layout.variables.find("debug_target"), .name = "debug_target"};
+  GameRules::RuleArena arena;
+  JsonParser::ExpressionParser expressionParser = JsonParser::ExpressionParser(
+    [&debugTarget](const std::string& name) { return std::optional(debugTarget); }, arena);
+  std::optional<GameRules::Expression> condition = expressionParser.parseExpression("debug_target != 10");
+  ASSERT_TRUE(condition.has_value());
+  GameRules::Rules loopedRules;
+  loopedRules.push_back(std::make_unique<GameRules::AddRule>(debugTarget, 1));
+  GameRules::Rules rules;
+  rules.push_back(std::make_unique<GameRules::LoopRule>(std::move(*condition), std::move(loopedRules)));
+
+  // Act
+  const std::optional<GameRules::RuleProgram> program = GameRules::compileRules(rules, layout);
+  ASSERT_TRUE(program.has_value());
+  GameState::GameState gameState = GameState::GameState(std::make_shared<const GameState::VariableLayout>(layout), {});
+  GameRules::RuleCursor cursor = GameRules::RuleCursor(*program, gameState);
+
+  // Assert
+  EXPECT_EQ(GameRules::RuleExecutionResult::SUCCESS, cursor.run());
+  EXPECT_EQ(EXPECTED_DEBUG_TARGET_VALUE, gameState.getVariableValue(debugTarget.slot).value);
+}
+
+TEST(GameRuleTests, loopRule_advanced) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_loop_advanced.json";
+  const GameState::PlayerIDList playerIDs = {123, 456};
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(GAME_SPEC_PATH);
+  ASSERT_TRUE(gameData.isValid);
+  GameState::GameState gameState = GameState::GameState(gameData.variableLayout, playerIDs);
+
+  // Act
+  GameRules::RuleCursor cursor = GameRules::RuleCursor(gameData.topLevelRules, gameState);
+
+  // Assert (Scores reach 2, 4, then stop at 5 in the last round)
+  EXPECT_EQ(GameRules::RuleExecutionResult::SUCCESS, cursor.run());
+  EXPECT_EQ(3, gameState.getValue("round").value);
+  EXPECT_EQ(5, gameState.getValue("players.123.score").value);
+  EXPECT_EQ(5, gameState.getValue("players.456.score").value);
+  EXPECT_EQ("Finished a round\nFinished a round\nFinished a round\n", cursor.takeOutput());
+}
+
+TEST(GameRuleTests, ruleArena_internsStrings) {
+  // Arrange
+  GameRules::RuleArena arena;
+
+  // Act
+  const std::string_view first = arena.intern("Hello");
+  const std::string_view second = arena.intern(std::string("Hel") + "lo");
+  const std::string_view other = arena.intern("World");
+
+  // Assert
+  EXPECT_EQ("Hello", first);
+  EXPECT_EQ(first.data(), second.data());
+  EXPECT_EQ("World", other);
+  EXPECT_NE(first.data(), other.data());
+}
+
+TEST(GameRuleTests, ruleArena_rulesExecute) {
+  // Arrange
+  const GameState::VariableLayout layout = GameState::VariableLayout({{"debug_target", 0}}, {});
+  const GameState::VariablePath debugTarget = {.slot = *layout.variables.find("debug_target"), .name = "debug_target"};
+  GameRules::RuleArena arena;
+  GameRules::Rules rules = arena.makeRules();
+  rules.push_back(arena.makeRule<GameRules::AddRule>(debugTarget, 3));
+  rules.push_back(arena.makeRule<GameRules::GlobalMessageRule>(arena.intern("Done")));
+  GameState::GameState gameState = GameState::GameState(std::make_shared<const GameState::VariableLayout>(layout), {});
+
+  // Act
+  GameRules::RuleCursor cursor = GameRules::RuleCursor(rules, gameState);
+
+  // Assert
+  EXPECT_EQ(GameRules::RuleExecutionResult::SUCCESS, cursor.run());
+  EXPECT_EQ(3, gameState.getVariableValue(debugTarget.slot).value);
+  EXPECT_EQ("Done\n", cursor.takeOutput());
+}
@@ -0,0 +1,119 @@
+#include "gtest/gtest.h"
+#include "GameServer.h"
+#include "Server.h"
+#include "SnapshotStore.h"
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+
+using namespace testing;
+
+/////////////////////////////////////////////////////////////////////////////
+// GameServer Tests
+/////////////////////////////////////////////////////////////////////////////
+TEST(GameServerTests, snapshotDirectory_keepsGamesOverRestart) {
+  // Arrange
+  const std::filesystem::path SNAPSHOT_DIRECTORY = std::filesystem::temp_directory_path() / "socialgaming_server_snapshot_test";
+  const std::filesystem::path CONFIG_PATH = std::filesystem::temp_directory_path() / "socialgaming_server_snapshot_test.json";
+  const Lobby::InviteCode INVITE_CODE = "0004-1";
+  const networking::Connection ALICE{1};
+  const networking::Connection BOB{2};
+  // Connections do not survive the restart, the players come back on new ones
+  const networking::Connection ALICE_AGAIN{3};
+  const networking::Connection BOB_AGAIN{4};
+  std::filesystem::remove_all(SNAPSHOT_DIRECTORY);
+  std::ofstream{CONFIG_PATH} << R"({
+    "port": 4000,
+    "serverhtml": "../web-socket-networking/webchat.html",
+    "snapshotdir": ")" << SNAPSHOT_DIRECTORY.string() << R"("
+  })";
+  // Only needed for its connections, the test never exchanges messages through it
+  networking::Server server = networking::Server(0, "", [](networking::Connection) {}, [](networking::Connection) {});
+  auto send = [&server](GameServer& gameServer, networking::Connection connection, std::string text) {
+    MessageResult result = gameServer.processMessages(server, {networking::Message{connection, std::move(text)}});
+    (void)gameServer.collectGameOutputs(result.results);
+    return result.results;
+  };
+
+  // Act (Alice answers, then the server goes down)
+  {
+    GameServer first;
+    ASSERT_TRUE(first.configure(CONFIG_PATH, "InputOutput"));
+    first.startGames();
+    first.onConnect(ALICE);
+    first.onConnect(BOB);
+    send(first, ALICE, "/nickname Alice");
+    send(first, BOB, "/nickname Bob");
+    send(first, ALICE, "/create InputOutput");
+    send(first, BOB, "/join " + INVITE_CODE);
+    send(first, ALICE, "/execute");
+    send(first, ALICE, "41");
+    first.stopGames();
+  }
+  const std::optional<Lobby::SnapshotStore::StoredSnapshot> stored = Lobby::SnapshotStore::load(SNAPSHOT_DIRECTORY, INVITE_CODE);
+
+  // Act (A new server resumes the game, and Bob takes his place back and answers)
+  GameServer second;
+  ASSERT_TRUE(second.configure(CONFIG_PATH, "InputOutput"));
+  second.startGames();
+  LobbyLogs restoreLogs;
+  (void)second.collectGameOutputs(restoreLogs);
+  second.onConnect(ALICE_AGAIN);
+  second.onConnect(BOB_AGAIN);
+  send(second, BOB_AGAIN, "/nickname Bob");
+  LobbyLogs rejoinLogs = send(second, BOB_AGAIN, "/join " + INVITE_CODE);
+  LobbyLogs answerLogs = send(second, BOB_AGAIN, "42");
+  second.stopGames();
+
+  // Assert
+  ASSERT_TRUE(stored.has_value());
+  EXPECT_EQ("InputOutput", stored->gameName);
+  ASSERT_EQ(2u, stored->playerNames.size());
+  EXPECT_EQ("Alice", stored->playerNames[0].nickname);
+  EXPECT_EQ("Bob", stored->playerNames[1].nickname);
+  EXPECT_NE(std::string::npos, rejoinLogs[INVITE_CODE].find("Bob has rejoined the game"));
+  EXPECT_FALSE(stored->log.empty());  // Alice's answer came after the game's first snapshot
+  EXPECT_NE(std::string::npos, answerLogs[INVITE_CODE].find("Game finished executing"));
+  EXPECT_FALSE(Lobby::SnapshotStore::load(SNAPSHOT_DIRECTORY, INVITE_CODE).has_value());  // Finished games are not kept
+
+  std::filesystem::remove_all(SNAPSHOT_DIRECTORY);
+  std::filesystem::remove(CONFIG_PATH);
+}
+
+TEST(GameServerTests, chat_awaitedInputIsNotEchoed) {
+  // Arrange
+  const std::filesystem::path CONFIG_PATH = std::filesystem::temp_directory_path() / "socialgaming_server_chat_test.json";
+  const Lobby::InviteCode INVITE_CODE = "0004-1";
+  const networking::Connection ALICE{1};
+  const networking::Connection BOB{2};
+  std::ofstream{CONFIG_PATH} << R"({
+    "port": 4000,
+    "serverhtml": "../web-socket-networking/webchat.html"
+  })";
+  networking::Server server = networking::Server(0, "", [](networking::Connection) {}, [](networking::Connection) {});
+  GameServer gameServer;
+  ASSERT_TRUE(gameServer.configure(CONFIG_PATH, "InputOutput"));
+  gameServer.startGames();
+  auto send = [&server, &gameServer](networking::Connection connection, std::string text) {
+    MessageResult result = gameServer.processMessages(server, {networking::Message{connection, std::move(text)}});
+    LobbyLogs lobbyLogs = result.results;
+    (void)gameServer.collectGameOutputs(result.results);
+    return lobbyLogs;
+  };
+  send(ALICE, "/create InputOutput");
+  send(BOB, "/join " + INVITE_CODE);
+  send(ALICE, "/execute");
+
+  // Act
+  LobbyLogs chatLogs = send(BOB, "hello");  // Only Alice is asked for input first
+  LobbyLogs answerLogs = send(ALICE, "secret 41");
+  gameServer.stopGames();
+
+  // Assert
+  EXPECT_EQ(std::string::npos, answerLogs[INVITE_CODE].find("secret 41"));
+  EXPECT_NE(std::string::npos, chatLogs[INVITE_CODE].find("hello"));
+
+  std::filesystem::remove(CONFIG_PATH);
+}
@@ -4,7 +4,13 @@
 #include "GameRules.h"
 #include "GameState.h"
 #include "JsonParser.h"
+#include "Snapshot.h"
+#include <memory>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 using namespace testing;
@@ -403,3 +409,248 @@ TEST(GameStateTests, valueSet_perPlayer_valid) {
     EXPECT_EQ(EXPECTED_VALUES.at(i), getResult.value);
   }
 }
+
+TEST(GameStateTests, slotGetSet_sharedLayout_valid) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_gameStateVariables_basic.json";
+  const GameState::PlayerIDList playerIDs = {123, 456, 789};
+  const GameState::VariableValue EXPECTED_ORIG_DEBUG_TARGET_VALUE = -40;
+  const GameState::VariableValue EXPECTED_NEW_PLAYER_VALUE = 55;
+
+  // Arrange (Assembling two GameStates over the same layout)
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(GAME_SPEC_PATH);
+  GameState::GameState gameState = GameState::GameState(gameData.variableLayout, playerIDs);
+  GameState::GameState otherGameState = GameState::GameState(gameData.variableLayout, playerIDs);
+
+  const std::optional<GameState::VariableSlot> debugTargetSlot = gameData.variableLayout->variables.find("debug_target");
+  const std::optional<GameState::VariableSlot> inputSlot = gameData.variableLayout->perPlayerVariables.find("input");
+  const std::optional<GameState::PlayerIndex> playerIndex = gameState.findPlayerIndex(456);
+  ASSERT_TRUE(debugTargetSlot && inputSlot && playerIndex);
+
+  // Act
+  const GameState::GetVariableResult getResult = gameState.getVariableValue(*debugTargetSlot);
+  const GameState::SetVariableResult setResult =
+    gameState.setPlayerVariableValue(*playerIndex, *inputSlot, EXPECTED_NEW_PLAYER_VALUE);
+
+  // Assert
+  EXPECT_EQ(EXPECTED_ORIG_DEBUG_TARGET_VALUE, getResult.value);
+  EXPECT_EQ(GameState::SetVariableResult::SUCCESS, setResult);
+  EXPECT_EQ(EXPECTED_NEW_PLAYER_VALUE, gameState.getValue("players.456.input").value);
+  EXPECT_EQ(gameData.perPlayerVariableMap.at("input"), otherGameState.getValue("players.456.input").value);
+  EXPECT_FALSE(gameState.findPlayerIndex(1).has_value());
+  EXPECT_EQ(playerIDs, gameState.getPlayerIDs());
+}
+
+TEST(GameStateTests, slotSet_copyOnWrite_valid) {
+  // Arrange
+  const GameState::PlayerIDList playerIDs = {123, 456, 789};
+  const auto layout = std::make_shared<const GameState::VariableLayout>(
+    GameState::VariableMap{{"debug_target", -40}, {"round", 1}},
+    GameState::VariableMap{{"input", 13}, {"score", 0}});
+  GameState::GameState gameState = GameState::GameState(layout, playerIDs);
+  GameState::GameState otherGameState = GameState::GameState(layout, playerIDs);
+
+  const GameState::VariableSlot debugTargetSlot = *layout->variables.find("debug_target");
+  const GameState::VariableSlot roundSlot = *layout->variables.find("round");
+  const GameState::VariableSlot inputSlot = *layout->perPlayerVariables.find("input");
+  const GameState::VariableSlot scoreSlot = *layout->perPlayerVariables.find("score");
+
+  // Act
+  const GameState::SetVariableResult setResult = gameState.setVariableValue(debugTargetSlot, 7);
+  const GameState::SetVariableResult setPlayerResult = gameState.setPlayerVariableValue(1, inputSlot, 55);
+  const GameState::SetVariableResult outOfRangeResult = otherGameState.setVariableValue(layout->variables.size(), 1);
+
+  // Assert (Unwritten values still read as their defaults, and the other GameState is untouched)
+  EXPECT_EQ(GameState::SetVariableResult::SUCCESS, setResult);
+  EXPECT_EQ(GameState::SetVariableResult::SUCCESS, setPlayerResult);
+  EXPECT_EQ(GameState::SetVariableResult::FAILURE, outOfRangeResult);
+  EXPECT_EQ(7, gameState.getVariableValue(debugTargetSlot).value);
+  EXPECT_EQ(1, gameState.getVariableValue(roundSlot).value);
+  EXPECT_EQ(13, gameState.getPlayerVariableValue(0, inputSlot).value);
+  EXPECT_EQ(55, gameState.getPlayerVariableValue(1, inputSlot).value);
+  EXPECT_EQ(0, gameState.getPlayerVariableValue(1, scoreSlot).value);
+  EXPECT_EQ(-40, otherGameState.getVariableValue(debugTargetSlot).value);
+  EXPECT_EQ(13, otherGameState.getPlayerVariableValue(1, inputSlot).value);
+  EXPECT_FALSE(otherGameState.getPlayerVariableValue(playerIDs.size(), inputSlot).wasSuccessful);
+}
+
+TEST(GameStateTests, value_kinds_valid) {
+  // Arrange
+  const std::string LONG_STRING = "a string too long to be stored inline";
+  const GameState::VariableValue integer = -40;
+  const GameState::VariableValue boolean = true;
+  const GameState::VariableValue smallString = "Scissors";
+  const GameState::VariableValue largeString = LONG_STRING;
+  const GameState::VariableValue list = GameState::VariableValue::makeList(
+    std::vector<GameState::VariableValue>{integer, smallString, largeString});
+  const GameState::VariableValue map = GameState::VariableValue::makeMap({{"name", "Rock"}, {"beats", smallString}});
+
+  // Act
+  const GameState::VariableValue listCopy = list;
+  GameState::VariableValue movedFrom = map;
+  const GameState::VariableValue moved = std::move(movedFrom);
+  std::ostringstream printed;
+  printed << list << " " << map << " " << boolean;
+
+  // Assert
+  EXPECT_EQ(-40, integer.getInteger());
+  EXPECT_NE(GameState::VariableValue(1), GameState::VariableValue(true));
+  EXPECT_EQ("Scissors", smallString.getString());
+  EXPECT_EQ(LONG_STRING, largeString.getString());
+  EXPECT_EQ(LONG_STRING.size(), largeString.size());
+  EXPECT_EQ(3, list.size());
+  EXPECT_EQ(list, listCopy);
+  EXPECT_EQ(list.getList().data(), listCopy.getList().data());  // Shared, not copied
+  EXPECT_EQ(map, moved);
+  EXPECT_EQ("Scissors", moved.find("beats")->getString());
+  EXPECT_EQ(nullptr, moved.find("loses"));
+  EXPECT_EQ(nullptr, list.find("beats"));
+  EXPECT_FALSE(integer.size().has_value());
+  EXPECT_FALSE(smallString.asCondition().has_value());
+  EXPECT_EQ("[-40, \"Scissors\", \"" + LONG_STRING + "\"] {\"beats\": \"Scissors\", \"name\": \"Rock\"} true",
+            printed.str());
+}
+
+TEST(GameStateTests, constantGetSet_valid) {
+  // Arrange
+  const GameState::VariableValue weapons = GameState::VariableValue::makeList(
+    std::vector<GameState::VariableValue>{"Rock", "Paper", "Scissors"});
+  const auto layout = std::make_shared<const GameState::VariableLayout>(
+    GameState::VariableMap{{"round", 1}},
+    GameState::VariableMap{},
+    GameState::VariableMap{{"weapons", weapons}});
+  GameState::GameState gameState = GameState::GameState(layout, {});
+  const GameState::VariablePath weaponsPath = {
+    .kind = GameState::VariablePath::Kind::CONSTANT,
+    .slot = *layout->constants.find("weapons"),
+    .name = "weapons",
+  };
+
+  // Act
+  const GameState::GetVariableResult getResult = gameState.getValue(weaponsPath);
+  const GameState::SetVariableResult setResult = gameState.setValue(weaponsPath, 3);
+
+  // Assert
+  EXPECT_TRUE(getResult.wasSuccessful);
+  EXPECT_EQ(weapons, getResult.value);
+  EXPECT_EQ(weapons, gameState.getValue("weapons").value);
+  EXPECT_EQ(GameState::SetVariableResult::FAILURE, setResult);
+}
+
+TEST(GameStateTests, snapshot_roundTrip_valid) {
+  // Arrange
+  const std::string LONG_STRING = "a string too long to be stored inline";
+  const GameState::PlayerIDList playerIDs = {123, 456, 789};
+  const auto layout = std::make_shared<const GameState::VariableLayout>(
+    GameState::VariableMap{{"debug_target", -40}, {"round", 1}},
+    GameState::VariableMap{{"input", 13}, {"name", "Rock"}});
+  const GameState::VariableValue history = GameState::VariableValue::makeList(
+    std::vector<GameState::VariableValue>{-3, true, LONG_STRING, GameState::VariableValue::makeMap({{"beats", "Paper"}})});
+  GameState::GameState gameState = GameState::GameState(layout, playerIDs);
+  ASSERT_EQ(GameState::SetVariableResult::SUCCESS, gameState.setValue("debug_target", history));
+  ASSERT_EQ(GameState::SetVariableResult::SUCCESS, gameState.setValue("players.456.input", -2000000000));
+  const std::size_t scopeDepth = gameState.pushScope("player");
+  gameState.bindScope(scopeDepth, 2);
+
+  // Act
+  GameState::SnapshotWriter writer;
+  gameState.writeSnapshot(writer);
+  const std::string snapshot = writer.takeBytes();
+  GameState::SnapshotReader reader(snapshot);
+  std::optional<GameState::GameState> restored = GameState::GameState::readSnapshot(reader, layout);
+  GameState::SnapshotReader truncatedReader(std::string_view(snapshot).substr(0, snapshot.size() - 1));
+  const std::optional<GameState::GameState> truncated = GameState::GameState::readSnapshot(truncatedReader, layout);
+
+  // Assert
+  ASSERT_TRUE(restored.has_value());
+  EXPECT_TRUE(reader.isAtEnd());
+  EXPECT_FALSE(truncated.has_value());
+  EXPECT_EQ(playerIDs, restored->getPlayerIDs());
+  EXPECT_EQ(history, restored->getValue("debug_target").value);
+  EXPECT_EQ(1, restored->getValue("round").value);
+  EXPECT_EQ(-2000000000, restored->getValue("players.456.input").value);
+  EXPECT_EQ(13, restored->getValue("players.789.input").value);
+  EXPECT_EQ("Rock", restored->getValue("players.123.name").value);
+  EXPECT_EQ(1u, restored->getScopeDepth());
+  EXPECT_EQ(789u, restored->getActiveScopeVariable("player").value);
+}
+
+TEST(GameStateTests, log_replay_valid) {
+  // Arrange
+  const GameState::PlayerIDList playerIDs = {123, 456, 789};
+  const auto layout = std::make_shared<const GameState::VariableLayout>(
+    GameState::VariableMap{{"debug_target", -40}, {"round", 1}},
+    GameState::VariableMap{{"input", 13}});
+  GameState::GameState gameState = GameState::GameState(layout, playerIDs);
+  const GameState::VariableSlot roundSlot = *layout->variables.find("round");
+  const GameState::VariableSlot inputSlot = *layout->perPlayerVariables.find("input");
+  ASSERT_EQ(GameState::SetVariableResult::SUCCESS, gameState.setValue("debug_target", 5));
+  GameState::SnapshotWriter snapshotWriter;
+  gameState.writeSnapshot(snapshotWriter);
+
+  // Act (Changes made after the snapshot are logged)
+  GameState::SnapshotWriter log;
+  gameState.setLog(&log);
+  ASSERT_EQ(GameState::SetVariableResult::SUCCESS, gameState.setVariableValue(roundSlot, "two"));
+  const std::size_t scopeDepth = gameState.pushScope("player");
+  gameState.bindScope(scopeDepth, 1);
+  ASSERT_EQ(GameState::SetVariableResult::SUCCESS, gameState.setValue("players.$player.input", 99));
+  GameState::GameState::Scopes branchScopes = {{"opponent", 2}};
+  gameState.swapScopes(scopeDepth + 1, branchScopes);
+  ASSERT_EQ(GameState::SetVariableResult::SUCCESS, gameState.setActiveScopeVariable("other", 123));
+  ASSERT_EQ(GameState::SetVariableResult::SUCCESS, gameState.unsetActiveScopeVariable("player"));
+  ASSERT_EQ(GameState::SetVariableResult::FAILURE, gameState.setVariableValue(layout->variables.size(), 1));
+  gameState.setLog(nullptr);
+
+  GameState::SnapshotReader snapshotReader(snapshotWriter.getBytes());
+  std::optional<GameState::GameState> restored = GameState::GameState::readSnapshot(snapshotReader, layout);
+  ASSERT_TRUE(restored.has_value());
+  GameState::SnapshotReader logReader(log.getBytes());
+  const bool isReplayed = restored->replayLog(logReader);
+  GameState::SnapshotReader corruptReader("\x07");
+  const bool isCorruptReplayed = restored->replayLog(corruptReader);
+
+  // Assert
+  EXPECT_TRUE(isReplayed);
+  EXPECT_FALSE(isCorruptReplayed);
+  EXPECT_EQ(5, restored->getValue("debug_target").value);
+  EXPECT_EQ("two", restored->getVariableValue(roundSlot).value);
+  EXPECT_EQ(99, restored->getPlayerVariableValue(1, inputSlot).value);
+  EXPECT_EQ(13, restored->getPlayerVariableValue(2, inputSlot).value);
+  EXPECT_EQ(gameState.getScopeDepth(), restored->getScopeDepth());
+  EXPECT_EQ(789u, restored->getActiveScopeVariable("opponent").value);
+  EXPECT_EQ(123u, restored->getActiveScopeVariable("other").value);
+  EXPECT_FALSE(restored->getActiveScopeVariable("player").wasSuccessful);
+}
+
+TEST(GameStateTests, takeChanges_listsEachWriteOnce) {
+  // Arrange
+  const GameState::PlayerIDList playerIDs = {123, 456, 789};
+  const auto layout = std::make_shared<const GameState::VariableLayout>(
+    GameState::VariableMap{{"debug_target", -40}, {"round", 1}},
+    GameState::VariableMap{{"input", 13}, {"score", 0}});
+  GameState::GameState gameState = GameState::GameState(layout, playerIDs);
+  const GameState::VariableSlot roundSlot = *layout->variables.find("round");
+  const GameState::VariableSlot scoreSlot = *layout->perPlayerVariables.find("score");
+
+  // Act
+  ASSERT_EQ(GameState::SetVariableResult::SUCCESS, gameState.setVariableValue(roundSlot, 2));
+  ASSERT_EQ(GameState::SetVariableResult::SUCCESS, gameState.setVariableValue(roundSlot, 3));
+  ASSERT_EQ(GameState::SetVariableResult::SUCCESS, gameState.setPlayerVariableValue(2, scoreSlot, 1));
+  ASSERT_EQ(GameState::SetVariableResult::SUCCESS, gameState.setValue("players.789.score", 2));
+  ASSERT_EQ(GameState::SetVariableResult::FAILURE, gameState.setPlayerVariableValue(3, scoreSlot, 1));
+  const GameState::GameState::Changes changes = gameState.takeChanges();
+  const GameState::GameState::Changes noChanges = gameState.takeChanges();
+  ASSERT_EQ(GameState::SetVariableResult::SUCCESS, gameState.setVariableValue(roundSlot, 4));
+  const GameState::GameState::Changes laterChanges = gameState.takeChanges();
+
+  // Assert
+  EXPECT_EQ(std::vector<GameState::VariableSlot>{roundSlot}, changes.variables);
+  ASSERT_EQ(1u, changes.playerVariables.size());
+  EXPECT_EQ(2u, changes.playerVariables.front().first);
+  EXPECT_EQ(scoreSlot, changes.playerVariables.front().second);
+  EXPECT_TRUE(noChanges.variables.empty());
+  EXPECT_TRUE(noChanges.playerVariables.empty());
+  EXPECT_EQ(std::vector<GameState::VariableSlot>{roundSlot}, laterChanges.variables);
+}
@@ -0,0 +1,74 @@
+#include "gtest/gtest.h"
+#include "LatencyHistogram.h"
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+/////////////////////////////////////////////////////////////////////////////
+// LatencyHistogram Tests
+/////////////////////////////////////////////////////////////////////////////
+TEST(LatencyHistogramTests, percentile_smallValuesAreExact) {
+  // Arrange
+  networking::LatencyHistogram histogram;
+  for (int micros = 1; micros <= 20; ++micros) {
+    histogram.record(std::chrono::microseconds{micros});
+  }
+
+  // Act & Assert
+  EXPECT_EQ(1us, histogram.percentile(0.0));
+  EXPECT_EQ(10us, histogram.percentile(0.5));
+  EXPECT_EQ(20us, histogram.percentile(1.0));
+  EXPECT_EQ(20u, histogram.getCount());
+}
+
+TEST(LatencyHistogramTests, percentile_firstRowsAboveExactValues) {
+  // Arrange
+  const std::vector<int64_t> SAMPLES = {32, 40, 63, 64, 65, 127};
+
+  for (const int64_t micros : SAMPLES) {
+    SCOPED_TRACE(micros);
+    networking::LatencyHistogram histogram;
+
+    // Act
+    histogram.record(std::chrono::microseconds{micros});
+    histogram.record(std::chrono::microseconds{micros});
+
+    // Assert: below 64 the buckets are one microsecond wide, then two
+    EXPECT_LE(micros, histogram.percentile(0.5).count());
+    EXPECT_GE(micros + (micros < 64 ? 0 : 1), histogram.percentile(0.5).count());
+  }
+}
+
+TEST(LatencyHistogramTests, percentile_knownSamples) {
+  // Arrange
+  networking::LatencyHistogram histogram;
+  networking::LatencyHistogram secondHalf;
+  for (int64_t micros = 1; micros <= 100000; ++micros) {
+    (micros <= 50000 ? histogram : secondHalf).record(std::chrono::microseconds{micros});
+  }
+  const std::vector<std::pair<double, int64_t>> EXPECTED = {
+    {0.5, 50000},
+    {0.9, 90000},
+    {0.99, 99000},
+    {0.999, 99900},
+  };
+
+  // Act
+  histogram.merge(secondHalf);
+
+  // Assert: each percentile is at most one bucket, 1/32 of its magnitude, above the sample
+  for (const auto& [quantile, micros] : EXPECTED) {
+    SCOPED_TRACE(quantile);
+    const int64_t percentile = histogram.percentile(quantile).count();
+    EXPECT_LE(micros, percentile);
+    EXPECT_GE(micros + micros / 32, percentile);
+  }
+  EXPECT_EQ(100000us, histogram.percentile(1.0));
+  EXPECT_EQ(100000us, histogram.getMax());
+  EXPECT_EQ(50000us, histogram.getMean());
+  EXPECT_EQ(100000u, histogram.getCount());
+}
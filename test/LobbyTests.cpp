@@ -0,0 +1,578 @@
+#include "gtest/gtest.h"
+#include <glog/logging.h>
+#include "Client.h"
+#include "GameData.h"
+#include "JsonParser.h"
+#include "Lobby.h"
+#include "Protocol.h"
+#include "ShardPool.h"
+#include "SnapshotStore.h"
+#include "Snapshot.h"
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <thread>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace testing;
+
+/////////////////////////////////////////////////////////////////////////////
+// Lobby Tests
+/////////////////////////////////////////////////////////////////////////////
+TEST(LobbyTests, createAndJoin_valid) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_forEach_basic.json";
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  auto gameData = std::make_shared<const GameData::GameData>(parser.parseJsonFile_gameSpec(GAME_SPEC_PATH));
+  Lobby::LobbyManager lobbies = Lobby::LobbyManager("0004", "Test", gameData);
+  const networking::Connection host = {1};
+  const networking::Connection guest = {2};
+
+  // Act
+  lobbies.joinLobby(host, "0004");
+  lobbies.joinLobby(guest, "0004");
+  Lobby::Lobby& lobby = lobbies.createLobby("Test", gameData);
+  Lobby::Lobby* joinedLobby = lobbies.joinLobby(host, lobby.getInviteCode());
+
+  // Assert
+  EXPECT_EQ("0004-1", lobby.getInviteCode());
+  EXPECT_EQ(&lobby, joinedLobby);
+  EXPECT_EQ(&lobby, lobbies.findLobbyOf(host));
+  EXPECT_EQ(&lobbies.getDefaultLobby(), lobbies.findLobbyOf(guest));
+  EXPECT_EQ(1u, lobby.getMembers().size());
+  EXPECT_EQ(1u, lobbies.getDefaultLobby().getMembers().size());
+  EXPECT_EQ(2u, lobbies.getLobbyCount());
+}
+
+TEST(LobbyTests, leaveLobby_stopsWaitingOnLeavingPlayer) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_inputOutput_basic.json";
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  auto gameData = std::make_shared<const GameData::GameData>(parser.parseJsonFile_gameSpec(GAME_SPEC_PATH));
+  Lobby::ShardPool shardPool = Lobby::ShardPool(0);
+  Lobby::LobbyManager lobbies = Lobby::LobbyManager("0004", "Test", gameData, {},
+    [&shardPool](const Lobby::InviteCode& inviteCode, GameState::PlayerID playerID) {
+      shardPool.post({.kind = Lobby::LobbyTask::Kind::LEAVE, .inviteCode = inviteCode, .playerID = playerID});
+    });
+  const networking::Connection first = {1};
+  const networking::Connection second = {2};
+  const networking::Connection third = {3};
+  Lobby::Lobby& lobby = lobbies.createLobby("Test", gameData);
+  for (const networking::Connection& member : {first, second, third}) {
+    lobbies.joinLobby(member, lobby.getInviteCode());
+  }
+  shardPool.post({
+    .kind = Lobby::LobbyTask::Kind::EXECUTE,
+    .inviteCode = lobby.getInviteCode(),
+    .gameData = gameData,
+    .playerIDs = lobby.getPlayerIDs(),
+  });
+  std::vector<Lobby::LobbyOutput> outputs = shardPool.takeOutputs();
+  ASSERT_EQ(1u, outputs.size());
+  ASSERT_EQ(GameState::PlayerIDList{1}, outputs.front().awaitingInputFrom);
+  lobby.setAwaitingInputFrom(outputs.front().awaitingInputFrom);
+
+  // Act
+  lobbies.leaveLobby(first);
+  outputs = shardPool.takeOutputs();
+  lobbies.leaveLobby(third);  // Not waited on, so the game is not disturbed
+
+  // Assert
+  ASSERT_EQ(1u, outputs.size());
+  EXPECT_NE(std::string::npos, outputs.front().text.find("Player 1 left"));
+  EXPECT_EQ(GameState::PlayerIDList{2}, outputs.front().awaitingInputFrom);
+  EXPECT_TRUE(shardPool.takeOutputs().empty());
+  EXPECT_FALSE(lobby.isAwaitingInputFrom(1));
+  EXPECT_EQ(std::vector<networking::Connection>{second}, lobby.getMembers());
+  EXPECT_EQ(&lobby, lobbies.findLobbyOf(second));
+}
+
+TEST(LobbyTests, join_invalidInviteCode) {
+  // Arrange
+  Lobby::LobbyManager lobbies = Lobby::LobbyManager("0004", "Test", nullptr);
+  const networking::Connection player = {1};
+  lobbies.joinLobby(player, "0004");
+
+  // Act
+  Lobby::Lobby* joinedLobby = lobbies.joinLobby(player, "0004-7");
+
+  // Assert
+  EXPECT_EQ(nullptr, joinedLobby);
+  EXPECT_EQ(&lobbies.getDefaultLobby(), lobbies.findLobbyOf(player));
+}
+
+TEST(LobbyTests, leave_closesEmptyLobbies) {
+  // Arrange
+  Lobby::LobbyManager lobbies = Lobby::LobbyManager("0004", "Test", nullptr);
+  const networking::Connection host = {1};
+  const networking::Connection guest = {2};
+  const Lobby::InviteCode inviteCode = lobbies.createLobby("Test", nullptr).getInviteCode();
+  lobbies.joinLobby(host, inviteCode);
+  lobbies.joinLobby(guest, "0004");
+
+  // Act
+  lobbies.leaveLobby(host);
+  lobbies.leaveLobby(guest);
+
+  // Assert
+  EXPECT_EQ(nullptr, lobbies.findLobby(inviteCode));
+  EXPECT_NE(nullptr, lobbies.findLobby("0004"));
+  EXPECT_EQ(nullptr, lobbies.findLobbyOf(host));
+  EXPECT_EQ(1u, lobbies.getLobbyCount());
+}
+
+TEST(LobbyTests, restoreLobby_absentPlayersExpire) {
+  // Arrange
+  std::vector<Lobby::InviteCode> closedLobbies;
+  GameState::PlayerIDList leftPlayers;
+  Lobby::LobbyManager lobbies = Lobby::LobbyManager("0004", "Test", nullptr,
+    [&closedLobbies](const Lobby::InviteCode& inviteCode) { closedLobbies.push_back(inviteCode); },
+    [&leftPlayers](const Lobby::InviteCode&, GameState::PlayerID playerID) { leftPlayers.push_back(playerID); });
+  const auto now = std::chrono::steady_clock::now();
+  const auto rejoinDeadline = now + std::chrono::minutes(2);
+  const networking::Connection aliceAgain = {3};
+  Lobby::Lobby& rejoined = lobbies.restoreLobby("0004-1", "Test", nullptr, {{1, "Alice"}, {2, "Bob"}}, rejoinDeadline);
+  lobbies.restoreLobby("0004-2", "Test", nullptr, {{5, "Carol"}}, rejoinDeadline);
+  lobbies.joinLobby(aliceAgain, "0004-1");
+  const bool isReclaimed = rejoined.reclaimPlayer(aliceAgain, "Alice");
+  rejoined.setAwaitingInputFrom({1, 2});
+
+  // Act
+  lobbies.expireAbsentPlayers(now);  // Nothing happens before the deadline
+  const std::size_t lobbyCountBeforeDeadline = lobbies.getLobbyCount();
+  lobbies.expireAbsentPlayers(rejoinDeadline);
+
+  // Assert
+  EXPECT_TRUE(isReclaimed);
+  EXPECT_EQ(GameState::PlayerIDList{1}, rejoined.getPlayerIDs());
+  EXPECT_EQ(3u, lobbyCountBeforeDeadline);
+  EXPECT_EQ(std::vector<Lobby::InviteCode>{"0004-2"}, closedLobbies);  // Nobody came back
+  EXPECT_EQ(nullptr, lobbies.findLobby("0004-2"));
+  EXPECT_EQ(GameState::PlayerIDList{2}, leftPlayers);
+  EXPECT_TRUE(rejoined.isAwaitingInputFrom(1));
+  EXPECT_FALSE(rejoined.isAwaitingInputFrom(2));
+  EXPECT_TRUE(rejoined.getAbsentPlayers().empty());
+}
+
+TEST(LobbyTests, shardPool_executesEveryLobby) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_forEach_basic.json";
+  const std::size_t WORKER_COUNT = 4;
+  const std::size_t LOBBY_COUNT = 32;
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  auto gameData = std::make_shared<const GameData::GameData>(parser.parseJsonFile_gameSpec(GAME_SPEC_PATH));
+  Lobby::ShardPool shardPool = Lobby::ShardPool(WORKER_COUNT);
+
+  // Act
+  for (std::size_t i = 0; i < LOBBY_COUNT; ++i) {
+    shardPool.post({
+      .kind = Lobby::LobbyTask::Kind::EXECUTE,
+      .inviteCode = "0004-" + std::to_string(i),
+      .gameData = gameData,
+      .playerIDs = {123, 456, 789},
+    });
+  }
+
+  std::vector<Lobby::LobbyOutput> outputs;
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (outputs.size() < LOBBY_COUNT && std::chrono::steady_clock::now() < deadline) {
+    for (auto& output : shardPool.takeOutputs()) {
+      outputs.push_back(std::move(output));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // Assert
+  EXPECT_EQ(WORKER_COUNT, shardPool.getShardCount());
+  ASSERT_EQ(LOBBY_COUNT, outputs.size());
+  for (const auto& output : outputs) {
+    EXPECT_NE(std::string::npos, output.text.find("debug_target variable AFTER executing rules: 5"));
+    EXPECT_LT(shardPool.getShardIndex(output.inviteCode), WORKER_COUNT);
+  }
+}
+
+TEST(LobbyTests, shardPool_inputTimeout_resumesWithDefault) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_inputText_timeout.json";
+  const Lobby::InviteCode INVITE_CODE = "0004-1";
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  auto gameData = std::make_shared<const GameData::GameData>(parser.parseJsonFile_gameSpec(GAME_SPEC_PATH));
+  Lobby::ShardPool shardPool = Lobby::ShardPool(0);
+  ASSERT_TRUE(gameData->isValid);
+
+  // Act + Assert: the first player answers in time
+  shardPool.post({
+    .kind = Lobby::LobbyTask::Kind::EXECUTE,
+    .inviteCode = INVITE_CODE,
+    .gameData = gameData,
+    .playerIDs = {123, 456},
+  });
+  std::vector<Lobby::LobbyOutput> outputs = shardPool.takeOutputs();
+  ASSERT_EQ(1u, outputs.size());
+  EXPECT_EQ(GameState::PlayerIDList{123}, outputs.front().awaitingInputFrom);
+  EXPECT_TRUE(shardPool.getNextDeadline().has_value());
+
+  shardPool.post({
+    .kind = Lobby::LobbyTask::Kind::INPUT,
+    .inviteCode = INVITE_CODE,
+    .playerID = 123,
+    .text = "3",
+  });
+  outputs = shardPool.takeOutputs();
+  ASSERT_EQ(1u, outputs.size());
+  EXPECT_EQ(GameState::PlayerIDList{456}, outputs.front().awaitingInputFrom);
+
+  // Act + Assert: the second player does not, and the game goes on without them
+  shardPool.advanceTimers(std::chrono::steady_clock::now() + std::chrono::seconds(5));
+  EXPECT_TRUE(shardPool.takeOutputs().empty());
+
+  shardPool.advanceTimers(std::chrono::steady_clock::now() + std::chrono::seconds(11));
+  outputs = shardPool.takeOutputs();
+  ASSERT_EQ(1u, outputs.size());
+  EXPECT_TRUE(outputs.front().awaitingInputFrom.empty());
+  EXPECT_NE(std::string::npos, outputs.front().text.find("Player 456 ran out of time"));
+  EXPECT_NE(std::string::npos, outputs.front().text.find("Game finished executing"));
+  EXPECT_FALSE(shardPool.getNextDeadline().has_value());
+}
+
+TEST(LobbyTests, shardPool_parallelFor_timesOutEachPlayer) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_parallelFor_basic.json";
+  const Lobby::InviteCode INVITE_CODE = "0004-1";
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  auto gameData = std::make_shared<const GameData::GameData>(parser.parseJsonFile_gameSpec(GAME_SPEC_PATH));
+  Lobby::ShardPool shardPool = Lobby::ShardPool(0);
+  ASSERT_TRUE(gameData->isValid);
+
+  // Act + Assert: both players are prompted at once
+  shardPool.post({
+    .kind = Lobby::LobbyTask::Kind::EXECUTE,
+    .inviteCode = INVITE_CODE,
+    .gameData = gameData,
+    .playerIDs = {123, 456},
+  });
+  std::vector<Lobby::LobbyOutput> outputs = shardPool.takeOutputs();
+  ASSERT_EQ(1u, outputs.size());
+  EXPECT_EQ((GameState::PlayerIDList{123, 456}), outputs.front().awaitingInputFrom);
+  EXPECT_NE(std::string::npos, outputs.front().text.find("Waiting for input from player 456"));
+
+  shardPool.post({
+    .kind = Lobby::LobbyTask::Kind::INPUT,
+    .inviteCode = INVITE_CODE,
+    .playerID = 456,
+    .text = "3",
+  });
+  outputs = shardPool.takeOutputs();
+  ASSERT_EQ(1u, outputs.size());
+  EXPECT_EQ(GameState::PlayerIDList{123}, outputs.front().awaitingInputFrom);
+  EXPECT_EQ(std::string::npos, outputs.front().text.find("Waiting for input"));  // Not prompted again
+
+  // Act + Assert: the other player runs out of time, and the game goes on without them
+  shardPool.advanceTimers(std::chrono::steady_clock::now() + std::chrono::seconds(11));
+  outputs = shardPool.takeOutputs();
+  ASSERT_EQ(1u, outputs.size());
+  EXPECT_TRUE(outputs.front().awaitingInputFrom.empty());
+  EXPECT_NE(std::string::npos, outputs.front().text.find("Player 123 ran out of time"));
+  EXPECT_NE(std::string::npos, outputs.front().text.find("Game finished executing"));
+  EXPECT_FALSE(shardPool.getNextDeadline().has_value());
+}
+
+TEST(LobbyTests, shardPool_snapshot_restoresGame) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_parallelFor_basic.json";
+  const std::string GAME_NAME = "ParallelFor";
+  const Lobby::InviteCode INVITE_CODE = "0004-1";
+  const std::filesystem::path SNAPSHOT_DIRECTORY = std::filesystem::temp_directory_path() / "socialgaming_snapshot_test";
+  std::filesystem::remove_all(SNAPSHOT_DIRECTORY);
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  auto gameData = std::make_shared<const GameData::GameData>(parser.parseJsonFile_gameSpec(GAME_SPEC_PATH));
+  ASSERT_TRUE(gameData->isValid);
+
+  // Act (One player answers before the server goes down)
+  std::vector<Lobby::SnapshotStore::StoredSnapshot> stored;
+  {
+    Lobby::SnapshotStore snapshots = Lobby::SnapshotStore(SNAPSHOT_DIRECTORY);
+    Lobby::ShardPool shardPool = Lobby::ShardPool(0, {}, &snapshots);
+    shardPool.post({
+      .kind = Lobby::LobbyTask::Kind::EXECUTE,
+      .inviteCode = INVITE_CODE,
+      .gameData = gameData,
+      .gameName = GAME_NAME,
+      .playerIDs = {123, 456},
+      .playerNames = {{123, "Alice"}, {456, "Bob"}},
+    });
+    shardPool.post({
+      .kind = Lobby::LobbyTask::Kind::INPUT,
+      .inviteCode = INVITE_CODE,
+      .playerID = 456,
+      .text = "3",
+    });
+    snapshots.flush();
+    stored = Lobby::SnapshotStore::loadAll(SNAPSHOT_DIRECTORY);
+  }
+
+  // Act (The game comes back in a new pool, and carries on)
+  Lobby::SnapshotStore snapshots = Lobby::SnapshotStore(SNAPSHOT_DIRECTORY);
+  Lobby::ShardPool shardPool = Lobby::ShardPool(0, {}, &snapshots);
+  ASSERT_EQ(1u, stored.size());
+  shardPool.post({
+    .kind = Lobby::LobbyTask::Kind::RESTORE,
+    .inviteCode = stored.front().inviteCode,
+    .gameData = gameData,
+    .gameName = stored.front().gameName,
+    .playerNames = stored.front().playerNames,
+    .text = stored.front().snapshot,
+    .log = stored.front().log,
+  });
+  std::vector<Lobby::LobbyOutput> restoreOutputs = shardPool.takeOutputs();
+  const bool hasRestoredDeadline = shardPool.getNextDeadline().has_value();
+
+  shardPool.post({
+    .kind = Lobby::LobbyTask::Kind::INPUT,
+    .inviteCode = INVITE_CODE,
+    .playerID = 123,
+    .text = "4",
+  });
+  std::vector<Lobby::LobbyOutput> inputOutputs = shardPool.takeOutputs();
+  snapshots.flush();
+
+  // Assert
+  EXPECT_EQ(INVITE_CODE, stored.front().inviteCode);
+  EXPECT_EQ(GAME_NAME, stored.front().gameName);
+  ASSERT_EQ(2u, stored.front().playerNames.size());
+  EXPECT_EQ("Bob", stored.front().playerNames[1].nickname);
+  EXPECT_FALSE(stored.front().log.empty());  // The answer came after the snapshot
+  ASSERT_EQ(1u, restoreOutputs.size());
+  EXPECT_EQ(GameState::PlayerIDList{123}, restoreOutputs.front().awaitingInputFrom);
+  EXPECT_TRUE(hasRestoredDeadline);
+  ASSERT_EQ(1u, inputOutputs.size());
+  EXPECT_NE(std::string::npos, inputOutputs.front().text.find("debug_target variable AFTER executing rules: 2"));
+  EXPECT_TRUE(Lobby::SnapshotStore::loadAll(SNAPSHOT_DIRECTORY).empty());  // Finished games are not kept
+
+  std::filesystem::remove_all(SNAPSHOT_DIRECTORY);
+}
+
+TEST(LobbyTests, snapshotStore_crashBeforeLogEmptied_dropsStaleEntries) {
+  // Arrange
+  const Lobby::InviteCode INVITE_CODE = "0004-1";
+  const std::filesystem::path SNAPSHOT_DIRECTORY = std::filesystem::temp_directory_path() / "socialgaming_crash_test";
+  const std::filesystem::path LOG_PATH = SNAPSHOT_DIRECTORY / (INVITE_CODE + ".log");
+  const std::filesystem::path STALE_LOG_PATH = SNAPSHOT_DIRECTORY / "stale";
+  std::filesystem::remove_all(SNAPSHOT_DIRECTORY);
+  Lobby::SnapshotStore snapshots = Lobby::SnapshotStore(SNAPSHOT_DIRECTORY);
+  snapshots.save(INVITE_CODE, "Game", {{7, "Alice"}}, "first snapshot");
+  snapshots.appendLog(INVITE_CODE, "stale entry");
+  snapshots.flush();
+  std::filesystem::copy_file(LOG_PATH, STALE_LOG_PATH);
+
+  // Act (The server stops once the new snapshot is renamed in, before its log is emptied,
+  //      and the log is appended to after it restarts)
+  snapshots.save(INVITE_CODE, "Game", {{7, "Alice"}}, "second snapshot");
+  snapshots.flush();
+  std::filesystem::copy_file(STALE_LOG_PATH, LOG_PATH, std::filesystem::copy_options::overwrite_existing);
+  const std::optional<Lobby::SnapshotStore::StoredSnapshot> crashed = Lobby::SnapshotStore::load(SNAPSHOT_DIRECTORY, INVITE_CODE);
+  snapshots.appendLog(INVITE_CODE, "fresh entry");
+  snapshots.flush();
+  const std::optional<Lobby::SnapshotStore::StoredSnapshot> appended = Lobby::SnapshotStore::load(SNAPSHOT_DIRECTORY, INVITE_CODE);
+
+  // Assert
+  ASSERT_TRUE(crashed.has_value());
+  EXPECT_EQ("second snapshot", crashed->snapshot);
+  EXPECT_EQ("", crashed->log);
+  ASSERT_EQ(1u, crashed->playerNames.size());
+  EXPECT_EQ(7u, crashed->playerNames.front().playerID);
+  EXPECT_EQ("Alice", crashed->playerNames.front().nickname);
+  ASSERT_TRUE(appended.has_value());
+  EXPECT_EQ("fresh entry", appended->log);
+
+  std::filesystem::remove_all(SNAPSHOT_DIRECTORY);
+}
+
+TEST(LobbyTests, gameSession_log_dropsTornEntry) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_parallelFor_basic.json";
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  auto gameData = std::make_shared<const GameData::GameData>(parser.parseJsonFile_gameSpec(GAME_SPEC_PATH));
+  ASSERT_TRUE(gameData->isValid);
+  Lobby::GameSession session = Lobby::GameSession(gameData);
+  std::ostringstream log;
+  session.executeGame({123, 456}, log);
+  const std::string snapshot = session.writeSnapshot();
+  session.provideInput(456, "3", log);
+  const std::string firstEntry = session.takeLogEntry();
+  session.provideInput(123, "4", log);
+  const std::string secondEntry = session.takeLogEntry();
+
+  // Act
+  Lobby::GameSession restored = Lobby::GameSession(gameData);
+  const bool isRestored = restored.restoreSnapshot(snapshot, firstEntry + secondEntry.substr(0, secondEntry.size() - 1));
+  Lobby::GameSession finished = Lobby::GameSession(gameData);
+  const bool isFinishedRestored = finished.restoreSnapshot(snapshot, firstEntry + secondEntry);
+  Lobby::GameSession corrupt = Lobby::GameSession(gameData);
+  const bool isCorruptRestored = corrupt.restoreSnapshot(snapshot, "\x01\x07");
+
+  // Assert (The torn second move is lost, the first is kept)
+  EXPECT_TRUE(isRestored);
+  EXPECT_EQ(GameState::PlayerIDList{123}, restored.getAwaitingInputFrom());
+  EXPECT_EQ(3, restored.getGameState()->getValue("players.456.input").value);
+  EXPECT_EQ(1, restored.getGameState()->getValue("debug_target").value);
+  EXPECT_TRUE(isFinishedRestored);
+  EXPECT_FALSE(finished.isRunning());
+  EXPECT_EQ(4, finished.getGameState()->getValue("players.123.input").value);
+  EXPECT_FALSE(isCorruptRestored);
+  EXPECT_FALSE(corrupt.isRunning());
+}
+
+TEST(LobbyTests, gameSession_stateDelta_onlyChanges) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_parallelFor_basic.json";
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  auto gameData = std::make_shared<const GameData::GameData>(parser.parseJsonFile_gameSpec(GAME_SPEC_PATH));
+  ASSERT_TRUE(gameData->isValid);
+  Lobby::GameSession session = Lobby::GameSession(gameData);
+  std::ostringstream log;
+  session.executeGame({123, 456}, log);
+  const Lobby::StateDelta startDelta = session.takeStateDelta();
+
+  // Act
+  session.provideInput(456, "3", log);
+  const Lobby::StateDelta inputDelta = session.takeStateDelta();
+  const std::string message = Lobby::encodeStateDelta(inputDelta);
+
+  // Assert (Only the answering player's branch has changed anything)
+  EXPECT_TRUE(startDelta.empty());
+  ASSERT_EQ(3u, inputDelta.size());
+  EXPECT_EQ("debug_target", inputDelta[0].name);
+  EXPECT_EQ(1, inputDelta[0].value);
+  EXPECT_EQ("players.456.input", inputDelta[1].name);
+  EXPECT_EQ(3, inputDelta[1].value);
+  EXPECT_EQ("players.456.wins", inputDelta[2].name);
+  EXPECT_EQ(2, inputDelta[2].value);
+  EXPECT_EQ("#state {\"players.456.wins\": 2, \"players.456.input\": 3, \"debug_target\": 1}\n", message);
+  EXPECT_TRUE(session.takeStateDelta().empty());
+}
+
+TEST(LobbyTests, encodeStateDelta_sendsLastValues) {
+  // Arrange
+  const Lobby::StateDelta delta = {
+    {"round", 1},
+    {"players.123.name", "Say \"hi\"\n"},
+    {"round", 2},
+  };
+
+  // Act
+  const std::string message = Lobby::encodeStateDelta(delta);
+
+  // Assert
+  EXPECT_EQ("#state {\"round\": 2, \"players.123.name\": \"Say \\\"hi\\\"\\u000a\"}\n", message);
+}
+
+TEST(LobbyTests, decodeCommand_textAndBinaryAgree) {
+  // Arrange
+  const networking::Connection connection{1};
+  const std::string binary = Lobby::encodeCommand({Lobby::MessageKind::JOIN, "0004-1"});
+  const networking::Message textMessage{connection, "/join 0004-1"};
+  const networking::Message binaryMessage{connection, binary, networking::MessageType::BINARY};
+  const networking::Message truncatedMessage{connection, binary.substr(0, binary.size() - 1), networking::MessageType::BINARY};
+
+  // Act
+  const auto fromText = Lobby::decodeCommand(textMessage);
+  const auto fromBinary = Lobby::decodeCommand(binaryMessage);
+
+  // Assert
+  ASSERT_TRUE(fromText.has_value());
+  ASSERT_TRUE(fromBinary.has_value());
+  EXPECT_EQ(Lobby::MessageKind::JOIN, fromText->kind);
+  EXPECT_EQ("0004-1", fromText->argument);
+  EXPECT_EQ(Lobby::MessageKind::JOIN, fromBinary->kind);
+  EXPECT_EQ("0004-1", fromBinary->argument);
+  EXPECT_FALSE(Lobby::decodeCommand(truncatedMessage).has_value());
+  EXPECT_FALSE(Lobby::decodeCommand({connection, "/unknown"}).has_value());
+  EXPECT_EQ(Lobby::MessageKind::CHAT, Lobby::decodeCommand({connection, "Rock"})->kind);
+}
+
+TEST(LobbyTests, encodeStateUpdate_sendsLastValues) {
+  // Arrange
+  const Lobby::StateDelta delta = {
+    {"round", 1},
+    {"players.123.name", "Rock"},
+    {"round", 2},
+  };
+
+  // Act
+  const std::string message = Lobby::encodeStateUpdate(delta);
+
+  // Assert
+  GameState::SnapshotReader reader(message);
+  EXPECT_EQ(static_cast<uint64_t>(Lobby::MessageKind::STATE_UPDATE), reader.readUnsigned());
+  EXPECT_EQ(2u, reader.readCount());
+  EXPECT_EQ("round", reader.readString());
+  EXPECT_EQ(GameState::VariableValue(2), reader.readValue());
+  EXPECT_EQ("players.123.name", reader.readString());
+  EXPECT_EQ(GameState::VariableValue("Rock"), reader.readValue());
+  EXPECT_TRUE(reader.isValid());
+  EXPECT_TRUE(reader.isAtEnd());
+}
+
+TEST(LobbyTests, decodeStateUpdate_coalescedUpdatesStaySeparate) {
+  // Arrange
+  networking::ServerOptions options;
+  options.coalesceWrites = true;
+  std::vector<networking::Connection> connections;
+  networking::Server server = networking::Server(40441, "",
+    [&connections](networking::Connection connection) { connections.push_back(connection); },
+    [](networking::Connection) {},
+    options);
+  networking::Client client = networking::Client("localhost", "40441");
+  for (int i = 0; i < 100 && connections.empty(); ++i) {
+    server.update();
+    client.update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(1u, connections.size());
+
+  const Lobby::StateDelta firstDelta = {{"round", 1}, {"players.123.name", "Rock"}};
+  const Lobby::StateDelta secondDelta = {{"round", 2}};
+
+  // Act
+  // The text message holds the write open, so both updates wait and go out as one batch
+  server.send({
+    {connections.front(), "Game started\n"},
+    {connections.front(), Lobby::encodeStateUpdate(firstDelta), networking::MessageType::BINARY},
+    {connections.front(), Lobby::encodeStateUpdate(secondDelta), networking::MessageType::BINARY},
+  });
+  std::deque<networking::Client::Frame> frames;
+  for (int i = 0; i < 100 && frames.size() < 3; ++i) {
+    server.update();
+    client.update();
+    for (networking::Client::Frame& frame : client.receiveFrames()) {
+      frames.push_back(std::move(frame));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  // Assert
+  ASSERT_EQ(3u, frames.size());
+  EXPECT_EQ(networking::MessageType::TEXT, frames[0].type);
+  EXPECT_EQ("Game started\n", frames[0].data);
+  const std::optional<Lobby::StateDelta> first = Lobby::decodeStateUpdate(frames[1].data);
+  const std::optional<Lobby::StateDelta> second = Lobby::decodeStateUpdate(frames[2].data);
+  ASSERT_TRUE(first.has_value());
+  ASSERT_TRUE(second.has_value());
+  ASSERT_EQ(2u, first->size());
+  EXPECT_EQ("players.123.name", (*first)[0].name);
+  EXPECT_EQ(GameState::VariableValue("Rock"), (*first)[0].value);
+  EXPECT_EQ("round", (*first)[1].name);
+  EXPECT_EQ(GameState::VariableValue(1), (*first)[1].value);
+  ASSERT_EQ(1u, second->size());
+  EXPECT_EQ(GameState::VariableValue(2), (*second)[0].value);
+  EXPECT_FALSE(Lobby::decodeStateUpdate(frames[1].data + frames[2].data).has_value());
+
+  const networking::ServerStatistics statistics = server.getStatistics();
+  EXPECT_EQ(3u, statistics.messagesSent);
+  EXPECT_EQ(2u, statistics.writeBatches);
+}
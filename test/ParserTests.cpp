@@ -1,8 +1,17 @@
 #include "gtest/gtest.h"
 #include "JsonParser.h"
+#include "ExpressionParser.h"
 #include "GameData.h"
 #include "GameRules.h"
 #include "GameState.h"
+#include "RuleArena.h"
+#include "ServerConfig.h"
+#include "VariableParser.h"
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
 using namespace testing;
 
@@ -84,6 +93,76 @@ TEST(ParserTests, parse_validServerConfig) {
   EXPECT_EQ(EXPECTED_OUTCOME, result);
 }
 
+TEST(ParserTests, parse_validServerConfig_optionalElements) {
+  // Arrange
+  const std::string VALID_SERVER_CONFIG =
+  R"({
+    "port": 4000,
+    "serverhtml": "../web-socket-networking/webchat.html",
+    "iothreads": 4
+  })";
+
+  const json EXPECTED_OUTCOME = {
+    {"port", 4000},
+    {"serverhtml", "../web-socket-networking/webchat.html"},
+    {"iothreads", 4}
+  };
+
+  // Act
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const json result = parser.parseJsonString_serverConfig(VALID_SERVER_CONFIG);
+
+  // Assert
+  EXPECT_EQ(EXPECTED_OUTCOME, result);
+}
+
+TEST(ParserTests, parse_validServerConfig_compression) {
+  // Arrange
+  const std::string VALID_SERVER_CONFIG =
+  R"({
+    "port": 4000,
+    "serverhtml": "../web-socket-networking/webchat.html",
+    "compression": true,
+    "compressionwindowbits": 12,
+    "compressionmemlevel": 8,
+    "compressionminsize": 512
+  })";
+
+  const json EXPECTED_OUTCOME = {
+    {"port", 4000},
+    {"serverhtml", "../web-socket-networking/webchat.html"},
+    {"compression", true},
+    {"compressionwindowbits", 12},
+    {"compressionmemlevel", 8},
+    {"compressionminsize", 512}
+  };
+
+  // Act
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const json result = parser.parseJsonString_serverConfig(VALID_SERVER_CONFIG);
+
+  // Assert
+  EXPECT_EQ(EXPECTED_OUTCOME, result);
+}
+
+TEST(ParserTests, parse_invalidServerConfig_optionalElementType) {
+  // Arrange
+  const std::string INVALID_SERVER_CONFIG =
+  R"({
+    "port": 4000,
+    "serverhtml": "../web-socket-networking/webchat.html",
+    "iothreads": "four"
+  })";
+  const json EXPECTED_OUTCOME = nullptr;
+
+  // Act
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const json result = parser.parseJsonString_serverConfig(INVALID_SERVER_CONFIG);
+
+  // Assert
+  EXPECT_EQ(EXPECTED_OUTCOME, result);
+}
+
 TEST(ParserTests, parse_validServerConfigFile) {
   // Arrange
   const std::string VALID_SERVER_CONFIG_FILEPATH =
@@ -117,6 +196,22 @@ TEST(ParserTests, parse_invalidServerConfigFile) {
   EXPECT_EQ(EXPECTED_OUTCOME, result);
 }
 
+TEST(ParserTests, parseGamefile_unknownGameLeavesConfigValid) {
+  // Arrange
+  ServerConfig config = ServerConfig("../social-gaming/test/json/testServerConfig.json");
+
+  // Act
+  const GameData::GameDataPtr unknown = config.parseGamefile("NoSuchGame");
+  const GameData::GameDataPtr first = config.parseGamefile("InputOutput");
+  const GameData::GameDataPtr second = config.parseGamefile("InputOutput");
+
+  // Assert
+  EXPECT_EQ(nullptr, unknown);
+  EXPECT_TRUE(config.isValid());
+  ASSERT_NE(nullptr, first);
+  EXPECT_EQ(first, second);
+}
+
 // TODO-#57: Fill in this unit test
 TEST(ParserTests, parse_gameSpec_inputText) {
   // Arrange
@@ -145,3 +240,150 @@ TEST(ParserTests, parse_gameSpec_inputText) {
   // EXPECT_EQ(EXPECTED_DEBUG_TARGET_VALIDITY, result.wasSuccessful);
   // EXPECT_EQ(EXPECTED_DEBUG_TARGET_VALUE, result.value);
 }
+
+TEST(ParserTests, parse_gameSpec_values) {
+  // Arrange
+  const std::string GAME_SPEC_PATH = "../social-gaming/test/json/gameSpec_values_basic.json";
+  const GameState::VariableValue EXPECTED_WEAPONS = GameState::VariableValue::makeList(std::vector<GameState::VariableValue>{
+    GameState::VariableValue::makeMap({{"name", "Rock"}, {"beats", "Scissors"}}),
+    GameState::VariableValue::makeMap({{"name", "Paper"}, {"beats", "Rock"}}),
+    GameState::VariableValue::makeMap({{"name", "Scissors"}, {"beats", "Paper"}}),
+  });
+
+  // Act (Game Load)
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  const GameData::GameData gameData = parser.parseJsonFile_gameSpec(GAME_SPEC_PATH);
+
+  // Assert (Game Load)
+  ASSERT_TRUE(gameData.isValid);
+  EXPECT_EQ(EXPECTED_WEAPONS, gameData.constantMap.at("weapons"));
+  EXPECT_EQ(false, gameData.variableMap.at("isFinished"));
+  EXPECT_EQ("nobody yet", gameData.variableMap.at("winner"));
+  EXPECT_EQ(0, gameData.variableMap.at("winners").size());
+
+  // Act (Game Execute)
+  GameState::GameState gameState = GameState::GameState(gameData.variableLayout, {});
+  for (const auto& rule : gameData.topLevelRules) {
+    ASSERT_EQ(GameRules::RuleExecutionResult::SUCCESS, rule->executeRule(gameState));
+  }
+
+  // Assert (Game Execute)
+  EXPECT_EQ(3, gameState.getValue("round").value);
+  EXPECT_EQ(EXPECTED_WEAPONS, gameState.getValue("weapons").value);
+}
+
+TEST(ParserTests, parse_variables_invalid) {
+  // Arrange
+  const std::vector<std::string> INVALID_VARIABLES = {
+    R"({"ratio": 0.5})",
+    R"({"big": 99999999999})",
+    R"({"nested": [[1, 2], {"ratio": 0.5}]})",
+    R"({"missing": null})",
+    R"([1, 2])",
+  };
+  const JsonParser::VariableParser variableParser = JsonParser::VariableParser();
+
+  // Act & Assert
+  for (const std::string& text : INVALID_VARIABLES) {
+    SCOPED_TRACE(text);
+    EXPECT_TRUE(variableParser.parseVariables(json::parse(text)).empty());
+  }
+}
+
+namespace {
+
+// Resolves the variables and constants of a layout, as RuleParser does outside of any forEach
+JsonParser::ExpressionParser::VariableResolver resolveGlobals(const GameState::VariableLayout& layout) {
+  return [&layout](const std::string& name) -> std::optional<GameState::VariablePath> {
+    if (const std::optional<GameState::VariableSlot> slot = layout.variables.find(name)) {
+      return GameState::VariablePath{.slot = *slot};
+    }
+    if (const std::optional<GameState::VariableSlot> slot = layout.constants.find(name)) {
+      return GameState::VariablePath{.kind = GameState::VariablePath::Kind::CONSTANT, .slot = *slot};
+    }
+    return std::nullopt;
+  };
+}
+
+const GameState::VariableMap EXPRESSION_CONSTANTS = {
+  {"weapons", GameState::VariableValue::makeList(std::vector<GameState::VariableValue>{"rock", "paper", "scissors"})},
+};
+
+}
+
+TEST(ParserTests, parse_expression_valid) {
+  // Arrange
+  const std::vector<std::pair<std::string, GameState::VariableValue>> EXPRESSIONS = {
+    {"1 + 2 * 3", 7},
+    {"(1 + 2) * 3", 9},
+    {"a - b - 1", 3},
+    {"a / b", 2},
+    {"a % b", 1},
+    {"-a + 10", 3},
+    {"a > b && b >= 3", true},
+    {"a < b || !(a == 7)", false},
+    {"true != false", true},
+    {"players.size * 2", 4},
+    {"b <= 2 && a / 0 == 1", false},  // Short-circuits before dividing by zero
+    {"weapons.size == players.size + 1", true},
+    {"winner.size - 1", 3},
+    {"winner == winner && winner < loser", true},
+  };
+  const auto layout = std::make_shared<const GameState::VariableLayout>(
+    GameState::VariableMap{{"a", 7}, {"b", 3}, {"winner", "rock"}, {"loser", "scissors"}},
+    GameState::VariableMap{},
+    EXPRESSION_CONSTANTS);
+  const GameState::GameState gameState = GameState::GameState(layout, {123, 456});
+  GameRules::RuleArena arena;
+  JsonParser::ExpressionParser parser = JsonParser::ExpressionParser(resolveGlobals(*layout), arena);
+
+  for (const auto& [text, expectedValue] : EXPRESSIONS) {
+    SCOPED_TRACE(text);
+
+    // Act
+    const std::optional<GameRules::Expression> expression = parser.parseExpression(text);
+    const std::optional<GameRules::Expression> negated = parser.parseExpression(text, true);
+
+    // Assert
+    ASSERT_TRUE(expression.has_value() && negated.has_value());
+    EXPECT_EQ(text, expression->getSource());
+    EXPECT_TRUE(expression->evaluate(gameState).wasSuccessful);
+    EXPECT_EQ(expectedValue, expression->evaluate(gameState).value);
+    EXPECT_EQ(!*expectedValue.asCondition(), negated->evaluate(gameState).value);
+  }
+}
+
+TEST(ParserTests, parse_expression_invalid) {
+  // Arrange
+  const std::vector<std::string> INVALID_EXPRESSIONS = {
+    "",
+    "a +",
+    "(a",
+    "a = b",
+    "a b",
+    "unknown > 1",
+    "99999999999",
+    "unknown.size",
+    "players.elements.collect(player, player.weapon == weapon.beats)",
+  };
+  const auto layout = std::make_shared<const GameState::VariableLayout>(GameState::VariableMap{{"a", 7}, {"b", 3}},
+                                                                        GameState::VariableMap{},
+                                                                        EXPRESSION_CONSTANTS);
+  const GameState::GameState gameState = GameState::GameState(layout, {});
+  GameRules::RuleArena arena;
+  JsonParser::ExpressionParser parser = JsonParser::ExpressionParser(resolveGlobals(*layout), arena);
+
+  // Act & Assert
+  for (const std::string& text : INVALID_EXPRESSIONS) {
+    SCOPED_TRACE(text);
+    EXPECT_FALSE(parser.parseExpression(text).has_value());
+  }
+
+  // Valid, but fails when evaluated
+  for (const std::string text : {"a / (b - 3)", "weapons + 1", "weapons < weapons", "a.size"}) {
+    SCOPED_TRACE(text);
+    const std::optional<GameRules::Expression> expression = parser.parseExpression(text);
+    ASSERT_TRUE(expression.has_value());
+    EXPECT_FALSE(expression->evaluate(gameState).wasSuccessful);
+  }
+}
@@ -0,0 +1,59 @@
+#include "gtest/gtest.h"
+#include "Client.h"
+#include "Server.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+
+/////////////////////////////////////////////////////////////////////////////
+// Server Tests
+/////////////////////////////////////////////////////////////////////////////
+TEST(ServerTests, coalesce_stalledClientBacklogStaysBounded) {
+  // Arrange
+  networking::ServerOptions options;
+  options.writeLowWatermark = 64 * 1024;
+  options.writeHighWatermark = 256 * 1024;
+  options.writeCoalesceLimit = 1024 * 1024;
+  options.overflowPolicy = networking::OverflowPolicy::COALESCE;
+  std::vector<networking::Connection> connections;
+  networking::Server server = networking::Server(40442, "",
+    [&connections](networking::Connection connection) { connections.push_back(connection); },
+    [](networking::Connection) {},
+    options);
+  networking::Client client = networking::Client("localhost", "40442");
+  for (int i = 0; i < 100 && connections.empty(); ++i) {
+    server.update();
+    client.update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_EQ(1u, connections.size());
+
+  // Act
+  // The client stops reading, so once the socket buffers fill up everything
+  // sent to it stays pending on the server
+  const std::string update(16 * 1024, 'x');
+  uint64_t mostPending = 0;
+  int sent = 0;
+  for (; sent < 16384; ++sent) {
+    server.send({{connections.front(), update}});
+    server.update();
+    const std::optional<networking::ChannelStatistics> statistics =
+      server.getChannelStatistics(connections.front());
+    if (!statistics) {
+      break;
+    }
+    mostPending = std::max(mostPending, statistics->messageBytesPending);
+  }
+
+  // Assert
+  EXPECT_LT(sent, 16384);
+  EXPECT_LE(options.writeHighWatermark, mostPending);
+  EXPECT_GE(options.writeCoalesceLimit, mostPending);
+  EXPECT_EQ(1u, server.getStatistics().slowClientDisconnects);
+}
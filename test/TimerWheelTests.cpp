@@ -0,0 +1,137 @@
+#include "gtest/gtest.h"
+#include "TimerWheel.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+using Clock = Lobby::TimerWheel<int>::Clock;
+
+/////////////////////////////////////////////////////////////////////////////
+// TimerWheel Tests
+/////////////////////////////////////////////////////////////////////////////
+TEST(TimerWheelTests, advance_firesDueTimersInOrder) {
+  // Arrange
+  const Clock::time_point start = Clock::now();
+  Lobby::TimerWheel<int> timers = Lobby::TimerWheel<int>(10ms, start);
+  timers.schedule(start + 300ms, 3);
+  timers.schedule(start + 100ms, 1);
+  timers.schedule(start + 200ms, 2);
+
+  // Act
+  const std::vector<int> beforeFirst = timers.advance(start + 90ms);
+  const std::vector<int> firstTwo = timers.advance(start + 200ms);
+  const std::vector<int> last = timers.advance(start + 1s);
+
+  // Assert
+  EXPECT_TRUE(beforeFirst.empty());
+  EXPECT_EQ(std::vector<int>({1, 2}), firstTwo);
+  EXPECT_EQ(std::vector<int>({3}), last);
+  EXPECT_TRUE(timers.empty());
+}
+
+TEST(TimerWheelTests, cancel_preventsFiring) {
+  // Arrange
+  const Clock::time_point start = Clock::now();
+  Lobby::TimerWheel<int> timers = Lobby::TimerWheel<int>(10ms, start);
+  const Lobby::TimerId cancelled = timers.schedule(start + 100ms, 1);
+  timers.schedule(start + 100ms, 2);
+
+  // Act
+  const bool wasCancelled = timers.cancel(cancelled);
+  const bool wasCancelledTwice = timers.cancel(cancelled);
+  const std::vector<int> expired = timers.advance(start + 1s);
+
+  // Assert
+  EXPECT_TRUE(wasCancelled);
+  EXPECT_FALSE(wasCancelledTwice);
+  EXPECT_EQ(std::vector<int>({2}), expired);
+}
+
+TEST(TimerWheelTests, cancel_staleIdLeavesReusedTimer) {
+  // Arrange
+  const Clock::time_point start = Clock::now();
+  Lobby::TimerWheel<int> timers = Lobby::TimerWheel<int>(10ms, start);
+  const Lobby::TimerId fired = timers.schedule(start + 10ms, 1);
+  const std::vector<int> firstExpired = timers.advance(start + 10ms);
+
+  // Act: the fired timer's storage is reused by the next one
+  timers.schedule(start + 100ms, 2);
+  const bool wasCancelled = timers.cancel(fired);
+  const std::vector<int> secondExpired = timers.advance(start + 1s);
+
+  // Assert
+  EXPECT_EQ(std::vector<int>({1}), firstExpired);
+  EXPECT_FALSE(wasCancelled);
+  EXPECT_EQ(std::vector<int>({2}), secondExpired);
+}
+
+TEST(TimerWheelTests, advance_cascadesDistantTimers) {
+  // Arrange: one deadline for each level of the wheel
+  const Clock::time_point start = Clock::now();
+  Lobby::TimerWheel<int> timers = Lobby::TimerWheel<int>(1ms, start);
+  const std::vector<Clock::duration> DELAYS = {200ms, 60s, 5h, 300h};
+  for (std::size_t i = 0; i < DELAYS.size(); ++i) {
+    timers.schedule(start + DELAYS[i], static_cast<int>(i));
+  }
+
+  // Act + Assert: each timer fires on the tick of its deadline, not before
+  for (std::size_t i = 0; i < DELAYS.size(); ++i) {
+    std::vector<int> expired;
+    Clock::time_point now = start;
+    while (expired.empty()) {
+      const std::optional<Clock::time_point> nextDeadline = timers.getNextDeadline();
+      ASSERT_TRUE(nextDeadline.has_value());
+      ASSERT_LE(*nextDeadline, start + DELAYS[i]);
+      now = *nextDeadline;
+      expired = timers.advance(now);
+    }
+    EXPECT_EQ(std::vector<int>({static_cast<int>(i)}), expired);
+    EXPECT_EQ(start + DELAYS[i], now);
+  }
+  EXPECT_FALSE(timers.getNextDeadline().has_value());
+}
+
+TEST(TimerWheelTests, advance_matchesEveryDeadline) {
+  // Arrange: many timers spread over every level, a third of them cancelled
+  const Clock::time_point start = Clock::now();
+  const int TIMER_COUNT = 20000;
+  Lobby::TimerWheel<int> timers = Lobby::TimerWheel<int>(1ms, start);
+  std::mt19937 random(7);
+  std::vector<std::chrono::milliseconds> delays;
+  std::vector<bool> isCancelled;
+  for (int i = 0; i < TIMER_COUNT; ++i) {
+    const std::chrono::milliseconds delay{random() % (1u << (8 + random() % 24))};
+    const Lobby::TimerId timer = timers.schedule(start + delay, i);
+    delays.push_back(delay);
+    isCancelled.push_back(random() % 3 == 0 && timers.cancel(timer));
+  }
+
+  // Act: advance by uneven steps, recording when each timer fired
+  std::vector<Clock::time_point> firedAt(TIMER_COUNT);
+  std::vector<Clock::time_point> previousAdvanceAt(TIMER_COUNT);
+  std::vector<int> fireCounts(TIMER_COUNT, 0);
+  Clock::time_point now = start;
+  while (!timers.empty()) {
+    const Clock::time_point previousNow = now;
+    now += std::chrono::milliseconds{1 + random() % 5000000};
+    for (int fired : timers.advance(now)) {
+      firedAt[fired] = now;
+      previousAdvanceAt[fired] = previousNow;
+      ++fireCounts[fired];
+    }
+  }
+
+  // Assert: each live timer fired once, on the first advance that reached its deadline
+  for (int i = 0; i < TIMER_COUNT; ++i) {
+    EXPECT_EQ(isCancelled[i] ? 0 : 1, fireCounts[i]);
+    if (!isCancelled[i]) {
+      EXPECT_GE(firedAt[i], start + delays[i]);
+      // Deadlines that are already due fire on the next tick
+      EXPECT_LT(previousAdvanceAt[i], start + std::max(delays[i], std::chrono::milliseconds{1}));
+    }
+  }
+}
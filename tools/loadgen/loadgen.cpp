@@ -0,0 +1,492 @@
+/////////////////////////////////////////////////////////////////////////////
+//                         Single Threaded Networking
+//
+// This file is distributed under the MIT License. See the LICENSE file
+// for details.
+/////////////////////////////////////////////////////////////////////////////
+
+// Opens many concurrent websocket connections to a chatserver or socialgaming
+// instance, sends scripted traffic from each at a fixed rate, and reports the
+// throughput along with the round trip latency of chat messages until the
+// server broadcasts them back.
+//
+// Every chat line sent carries a marker "#lg:<connection>:<sequence>:<sent>",
+// which both servers echo verbatim in their broadcast log. A connection that
+// sees its own marker come back records the round trip. Script lines starting
+// with '/' are commands, are sent without a marker, and are only counted.
+
+
+#include "LatencyHistogram.h"
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+
+#include <atomic>
+#include <charconv>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+using tcp = asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+using networking::LatencyHistogram;
+
+
+static constexpr std::string_view MARKER = "#lg:";
+
+
+struct Options {
+  std::string host;
+  std::string port;
+  std::size_t connections = 100;
+  double rate = 1.0;                  // Messages per second from each connection
+  std::chrono::seconds duration{10};
+  std::chrono::seconds drain{2};      // Time to wait for echoes after sending stops
+  std::size_t connectRate = 500;      // New connections opened per second
+  std::size_t threads = 1;
+  std::vector<std::string> script = {"Hello from loadgen"};
+};
+
+
+struct Totals {
+  std::atomic<uint64_t> connected{0};
+  std::atomic<uint64_t> connectFailures{0};
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<uint64_t> chatsSent{0};
+  std::atomic<uint64_t> commandsSent{0};
+  std::atomic<uint64_t> sendsSkipped{0};
+  std::atomic<uint64_t> framesReceived{0};
+  std::atomic<uint64_t> bytesReceived{0};
+  std::atomic<uint64_t> markersReceived{0};
+  std::atomic<uint64_t> echoesReceived{0};
+};
+
+
+/**
+ *  One simulated client. All of its handlers run on its own strand, so its
+ *  state, including its histogram, is only touched by one thread at a time.
+ */
+class LoadConnection : public std::enable_shared_from_this<LoadConnection> {
+public:
+  LoadConnection(asio::io_context& ioContext, const Options& options,
+                 Totals& totals, uint64_t id)
+    : options{options},
+      totals{totals},
+      id{id},
+      websocket{asio::make_strand(ioContext)},
+      sendTimer{websocket.get_executor()} {
+    websocket.text(true);
+  }
+
+  void
+  start(const tcp::resolver::results_type& endpoints) {
+    asio::dispatch(websocket.get_executor(),
+      [self = shared_from_this(), endpoints] () { self->connect(endpoints); });
+  }
+
+  void
+  stopSending() {
+    asio::dispatch(websocket.get_executor(), [self = shared_from_this()] () {
+      self->isSending = false;
+      self->sendTimer.cancel();
+    });
+  }
+
+  void
+  close() {
+    asio::dispatch(websocket.get_executor(), [self = shared_from_this()] () {
+      self->isClosing = true;
+      if (self->isOpen) {
+        self->websocket.async_close(websocket::close_code::normal,
+          [self] (auto /*errorCode*/) { self->isOpen = false; });
+      }
+    });
+  }
+
+  /** Only safe to call once the io_context has stopped. */
+  [[nodiscard]] const LatencyHistogram&
+  getHistogram() const noexcept {
+    return histogram;
+  }
+
+private:
+  void
+  connect(const tcp::resolver::results_type& endpoints) {
+    beast::get_lowest_layer(websocket).expires_after(std::chrono::seconds{30});
+    beast::get_lowest_layer(websocket).async_connect(endpoints,
+      [self = shared_from_this()] (auto errorCode, auto /*endpoint*/) {
+        if (errorCode) {
+          self->totals.connectFailures.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        self->handshake();
+      });
+  }
+
+  void
+  handshake() {
+    websocket.async_handshake(options.host + ":" + options.port, "/",
+      [self = shared_from_this()] (auto errorCode) {
+        if (errorCode) {
+          self->totals.connectFailures.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        // The stream manages its own timeouts once the session is open
+        beast::get_lowest_layer(self->websocket).expires_never();
+        self->websocket.set_option(
+          websocket::stream_base::timeout::suggested(beast::role_type::client));
+        self->isOpen = true;
+        self->totals.connected.fetch_add(1, std::memory_order_relaxed);
+
+        self->readMessage();
+        self->scheduleFirstSend();
+      });
+  }
+
+  void
+  scheduleFirstSend() {
+    if (!isSending || options.rate <= 0) {
+      return;
+    }
+    // Spread the connections across the send interval so they do not all
+    // fire on the same tick
+    std::mt19937_64 random{id};
+    auto interval = getSendInterval();
+    nextSend = Clock::now() + Clock::duration{random() % std::max<Clock::rep>(1, interval.count())};
+    scheduleSend();
+  }
+
+  void
+  scheduleSend() {
+    sendTimer.expires_at(nextSend);
+    sendTimer.async_wait([self = shared_from_this()] (auto errorCode) {
+      if (errorCode || !self->isSending || !self->isOpen) {
+        return;
+      }
+      self->nextSend += self->getSendInterval();
+      self->sendNext();
+      self->scheduleSend();
+    });
+  }
+
+  void
+  sendNext() {
+    // Keep at most one write in flight. When the server pushes back, the
+    // skipped sends show up in the report instead of piling up here.
+    if (isWriting) {
+      totals.sendsSkipped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    const std::string& line = options.script[scriptPosition];
+    scriptPosition = (scriptPosition + 1) % options.script.size();
+
+    outgoing = line;
+    if (line.starts_with('/')) {
+      totals.commandsSent.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      auto sentAt = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now().time_since_epoch()).count();
+      outgoing.append(" ").append(MARKER)
+              .append(std::to_string(id)).append(":")
+              .append(std::to_string(sequence++)).append(":")
+              .append(std::to_string(sentAt));
+      totals.chatsSent.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    isWriting = true;
+    websocket.async_write(asio::buffer(outgoing),
+      [self = shared_from_this()] (auto errorCode, std::size_t /*size*/) {
+        self->isWriting = false;
+        if (errorCode) {
+          self->reportDropped();
+        }
+      });
+  }
+
+  void
+  readMessage() {
+    websocket.async_read(readBuffer,
+      [self = shared_from_this()] (auto errorCode, std::size_t size) {
+        if (errorCode) {
+          self->reportDropped();
+          return;
+        }
+        self->totals.framesReceived.fetch_add(1, std::memory_order_relaxed);
+        self->totals.bytesReceived.fetch_add(size, std::memory_order_relaxed);
+
+        auto data = self->readBuffer.cdata();
+        self->scanMarkers({static_cast<const char*>(data.data()), data.size()});
+        self->readBuffer.consume(self->readBuffer.size());
+        self->readMessage();
+      });
+  }
+
+  void
+  scanMarkers(std::string_view frame) {
+    auto receivedAt = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      Clock::now().time_since_epoch()).count();
+
+    for (auto start = frame.find(MARKER); start != std::string_view::npos;
+         start = frame.find(MARKER, start + 1)) {
+      uint64_t connection = 0;
+      uint64_t markerSequence = 0;
+      int64_t sentAt = 0;
+      const char* position = frame.data() + start + MARKER.size();
+      const char* end = frame.data() + frame.size();
+
+      auto [afterConnection, e1] = std::from_chars(position, end, connection);
+      if (e1 != std::errc{} || afterConnection == end || *afterConnection != ':') {
+        continue;
+      }
+      auto [afterSequence, e2] = std::from_chars(afterConnection + 1, end, markerSequence);
+      if (e2 != std::errc{} || afterSequence == end || *afterSequence != ':') {
+        continue;
+      }
+      auto [afterSentAt, e3] = std::from_chars(afterSequence + 1, end, sentAt);
+      if (e3 != std::errc{}) {
+        continue;
+      }
+
+      totals.markersReceived.fetch_add(1, std::memory_order_relaxed);
+      if (connection == id) {
+        totals.echoesReceived.fetch_add(1, std::memory_order_relaxed);
+        histogram.record(std::chrono::nanoseconds{receivedAt - sentAt});
+      }
+    }
+  }
+
+  void
+  reportDropped() {
+    if (isOpen && !isClosing) {
+      totals.dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    isOpen = false;
+    sendTimer.cancel();
+  }
+
+  [[nodiscard]] Clock::duration
+  getSendInterval() const {
+    return std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>{1.0 / options.rate});
+  }
+
+  const Options& options;
+  Totals& totals;
+  const uint64_t id;
+
+  websocket::stream<beast::tcp_stream> websocket;
+  beast::flat_buffer readBuffer;
+  asio::steady_timer sendTimer;
+  Clock::time_point nextSend;
+
+  std::string outgoing;
+  std::size_t scriptPosition = 0;
+  uint64_t sequence = 0;
+  bool isOpen = false;
+  bool isWriting = false;
+  bool isSending = true;
+  bool isClosing = false;
+
+  LatencyHistogram histogram;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////
+// Command line handling and reporting
+/////////////////////////////////////////////////////////////////////////////
+
+static void
+printUsage(const char* program) {
+  std::cerr << "Usage:\n  " << program << " <ip address> <port> [options]\n"
+            << "  e.g. " << program << " localhost 4002 --connections=1000 --rate=2\n\n"
+            << "Options:\n"
+            << "  --connections=N   concurrent connections (default 100)\n"
+            << "  --rate=R          messages per second from each connection (default 1)\n"
+            << "  --duration=S      seconds to send for (default 10)\n"
+            << "  --drain=S         seconds to wait for echoes after sending stops (default 2)\n"
+            << "  --connect-rate=N  connections opened per second (default 500)\n"
+            << "  --threads=N       I/O threads (default 1)\n"
+            << "  --script=FILE     lines to send in turn, '/' lines are commands\n";
+}
+
+
+static bool
+parseOptions(int argc, char* argv[], Options& options) {
+  if (argc < 3) {
+    return false;
+  }
+  options.host = argv[1];
+  options.port = argv[2];
+
+  for (int i = 3; i < argc; ++i) {
+    std::string_view argument{argv[i]};
+    auto separator = argument.find('=');
+    if (!argument.starts_with("--") || separator == std::string_view::npos) {
+      std::cerr << "Unrecognized argument: " << argument << "\n";
+      return false;
+    }
+    auto key = argument.substr(2, separator - 2);
+    std::string value{argument.substr(separator + 1)};
+
+    try {
+      if (key == "connections") {
+        options.connections = std::stoul(value);
+      } else if (key == "rate") {
+        options.rate = std::stod(value);
+      } else if (key == "duration") {
+        options.duration = std::chrono::seconds{std::stoul(value)};
+      } else if (key == "drain") {
+        options.drain = std::chrono::seconds{std::stoul(value)};
+      } else if (key == "connect-rate") {
+        options.connectRate = std::max(1ul, std::stoul(value));
+      } else if (key == "threads") {
+        options.threads = std::max(1ul, std::stoul(value));
+      } else if (key == "script") {
+        std::ifstream scriptFile{value};
+        if (!scriptFile) {
+          std::cerr << "Unable to open script file: " << value << "\n";
+          return false;
+        }
+        options.script.clear();
+        for (std::string line; std::getline(scriptFile, line);) {
+          if (!line.empty()) {
+            options.script.push_back(line);
+          }
+        }
+        if (options.script.empty()) {
+          std::cerr << "Script file is empty: " << value << "\n";
+          return false;
+        }
+      } else {
+        std::cerr << "Unrecognized option: " << key << "\n";
+        return false;
+      }
+    } catch (const std::exception&) {
+      std::cerr << "Invalid value for " << key << ": " << value << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+
+static void
+printReport(const Options& options, const Totals& totals,
+            const LatencyHistogram& histogram) {
+  auto seconds = static_cast<double>(options.duration.count());
+  auto perSecond = [seconds] (uint64_t value) {
+    return seconds > 0 ? static_cast<double>(value) / seconds : 0.0;
+  };
+  auto chatsSent = totals.chatsSent.load();
+  auto echoes = totals.echoesReceived.load();
+
+  std::cout << std::fixed << std::setprecision(1)
+    << "\n---- loadgen report ----\n"
+    << "connections:  " << totals.connected << " opened, "
+                        << totals.connectFailures << " failed, "
+                        << totals.dropped << " dropped by the server\n"
+    << "sent:         " << chatsSent << " chats (" << perSecond(chatsSent) << "/s), "
+                        << totals.commandsSent << " commands, "
+                        << totals.sendsSkipped << " skipped while a write was pending\n"
+    << "received:     " << totals.framesReceived << " frames ("
+                        << perSecond(totals.framesReceived) << "/s), "
+                        << perSecond(totals.bytesReceived) / (1024 * 1024) << " MiB/s, "
+                        << totals.markersReceived << " chat lines\n"
+    << "echoed back:  " << echoes << " of " << chatsSent << " chats ("
+                        << (chatsSent > 0 ? 100.0 * echoes / chatsSent : 0.0) << "%)\n"
+    << "round trip:   p50 " << histogram.percentile(0.50).count() << "us"
+                        << "  p99 " << histogram.percentile(0.99).count() << "us"
+                        << "  p999 " << histogram.percentile(0.999).count() << "us"
+                        << "  max " << histogram.getMax().count() << "us"
+                        << "  mean " << histogram.getMean().count() << "us\n";
+}
+
+
+int
+main(int argc, char* argv[]) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  asio::io_context ioContext;
+  auto workGuard = asio::make_work_guard(ioContext);
+  tcp::resolver::results_type endpoints;
+  try {
+    endpoints = tcp::resolver{ioContext}.resolve(options.host, options.port);
+  } catch (const std::exception& e) {
+    std::cerr << "Unable to resolve " << options.host << ":" << options.port
+              << ": " << e.what() << "\n";
+    return 1;
+  }
+
+  Totals totals;
+  std::vector<std::thread> ioThreads;
+  for (std::size_t i = 0; i < options.threads; ++i) {
+    ioThreads.emplace_back([&ioContext] () { ioContext.run(); });
+  }
+
+  // Ramp connections up gradually so the server's accept backlog is not
+  // overrun before the run even starts
+  std::vector<std::shared_ptr<LoadConnection>> connections;
+  connections.reserve(options.connections);
+  auto connectBatch = std::max<std::size_t>(1, options.connectRate / 100);
+  for (std::size_t i = 0; i < options.connections; ++i) {
+    connections.push_back(std::make_shared<LoadConnection>(ioContext, options, totals, i));
+    connections.back()->start(endpoints);
+    if ((i + 1) % connectBatch == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+  }
+
+  uint64_t lastSent = 0;
+  uint64_t lastFrames = 0;
+  for (auto second = 1; second <= options.duration.count(); ++second) {
+    std::this_thread::sleep_for(std::chrono::seconds{1});
+    auto sent = totals.chatsSent.load() + totals.commandsSent.load();
+    auto frames = totals.framesReceived.load();
+    std::cout << "[" << second << "s] open " << (totals.connected - totals.dropped)
+              << "  sent/s " << (sent - lastSent)
+              << "  frames/s " << (frames - lastFrames)
+              << "  echoes " << totals.echoesReceived << "\n";
+    lastSent = sent;
+    lastFrames = frames;
+  }
+
+  for (auto& connection : connections) {
+    connection->stopSending();
+  }
+  std::this_thread::sleep_for(options.drain);
+
+  for (auto& connection : connections) {
+    connection->close();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds{500});
+  workGuard.reset();
+  ioContext.stop();
+  for (auto& thread : ioThreads) {
+    thread.join();
+  }
+
+  LatencyHistogram histogram;
+  for (const auto& connection : connections) {
+    histogram.merge(connection->getHistogram());
+  }
+  printReport(options, totals, histogram);
+
+  return 0;
+}
+
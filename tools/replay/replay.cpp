@@ -0,0 +1,73 @@
+// Rebuilds the game of one lobby from what a SnapshotStore kept of it, its last
+// snapshot plus the write-ahead log after it, and prints the game's variables and
+// whose input it is waiting on. Useful for seeing where a game had got to when the
+// server went down, or for checking a log replays cleanly.
+//
+//   replay <game spec> <snapshot directory> <invite code>
+
+
+#include "JsonParser.h"
+#include "Lobby.h"
+#include "SnapshotStore.h"
+
+#include <glog/logging.h>
+
+#include <iostream>
+#include <memory>
+#include <optional>
+
+
+static void printGameState(const GameState::GameState& gameState) {
+  const GameState::VariableLayout& layout = gameState.getLayout();
+  for (GameState::VariableSlot slot = 0; slot < layout.variables.size(); ++slot) {
+    std::cout << layout.variables.getName(slot) << " = " << gameState.getVariableValue(slot).value << "\n";
+  }
+
+  const GameState::PlayerIDList& playerIDs = gameState.getPlayerIDs();
+  for (GameState::PlayerIndex player = 0; player < playerIDs.size(); ++player) {
+    for (GameState::VariableSlot slot = 0; slot < layout.perPlayerVariables.size(); ++slot) {
+      std::cout << "players." << playerIDs[player] << "." << layout.perPlayerVariables.getName(slot)
+                << " = " << gameState.getPlayerVariableValue(player, slot).value << "\n";
+    }
+  }
+}
+
+
+int main(int argc, char* argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+
+  if (argc < 4) {
+    std::cerr << "Usage: " << argv[0] << " <game spec> <snapshot directory> <invite code>\n";
+    return 1;
+  }
+
+  const JsonParser::JsonParser parser = JsonParser::JsonParser();
+  auto gameData = std::make_shared<const GameData::GameData>(parser.parseJsonFile_gameSpec(argv[1]));
+  if (!gameData->isValid) {
+    std::cerr << "Could not load the game spec " << argv[1] << "\n";
+    return 1;
+  }
+
+  const std::optional<Lobby::SnapshotStore::StoredSnapshot> stored = Lobby::SnapshotStore::load(argv[2], argv[3]);
+  if (!stored.has_value()) {
+    std::cerr << "No snapshot of lobby " << argv[3] << " in " << argv[2] << "\n";
+    return 1;
+  }
+
+  Lobby::GameSession session = Lobby::GameSession(gameData);
+  if (!session.restoreSnapshot(stored->snapshot, stored->log)) {
+    std::cerr << "The snapshot or log of lobby " << argv[3] << " does not replay onto " << argv[1] << "\n";
+    return 1;
+  }
+
+  std::cout << "Lobby " << stored->inviteCode << " playing " << stored->gameName
+            << (session.isRunning() ? "" : ", finished") << "\n";
+  for (const GameRules::InputRequest* request : session.getPendingInputs()) {
+    std::cout << "Waiting for input from player " << request->playerID << ": " << request->prompt << "\n";
+  }
+  if (const GameState::GameState* gameState = session.getGameState(); gameState != nullptr) {
+    printGameState(*gameState);
+  }
+  return 0;
+}